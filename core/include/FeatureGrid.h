@@ -0,0 +1,82 @@
+/**
+ * This file is part of ORB-SLAM3
+ *
+ * Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez
+ * Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+ * Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós,
+ * University of Zaragoza.
+ *
+ * ORB-SLAM3 is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ORB-SLAM3. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef FEATUREGRID_H
+#define FEATUREGRID_H
+
+#include <cstdint>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+using namespace std;
+
+namespace ORB_SLAM3 {
+
+// Keypoints of one image bucketed in a regular grid, stored as a structure of
+// arrays sorted by cell (column major, so the cells of one grid column are
+// contiguous). A cell-offset table replaces one vector per cell: an area query
+// is a linear scan over contiguous x, y and octave arrays, and copying the grid
+// is a handful of vector copies.
+class FeatureGrid {
+public:
+  FeatureGrid();
+
+  // Assigns vKeys to the cells of a nCols x nRows grid whose origin is
+  // (minX, minY). Keypoints falling outside the grid are dropped.
+  void Build(const vector<cv::KeyPoint> &vKeys, const float minX,
+             const float minY, const float cellWidthInv,
+             const float cellHeightInv, const int nCols, const int nRows);
+
+  // Appends to vIndices the keypoints inside the square of half side r
+  // centered at (x, y), in cell order. Levels are only checked when
+  // minLevel > 0 or maxLevel >= 0.
+  void GetFeaturesInArea(const float &x, const float &y, const float &r,
+                         const int minLevel, const int maxLevel,
+                         vector<size_t> &vIndices) const;
+
+  // Keypoint indices of a cell are Index(k) for k in [CellBegin, CellEnd)
+  inline size_t CellBegin(const int ix, const int iy) const {
+    return mvCellStart[ix * mnRows + iy];
+  }
+  inline size_t CellEnd(const int ix, const int iy) const {
+    return mvCellStart[ix * mnRows + iy + 1];
+  }
+  inline size_t Index(const size_t k) const { return mvIndex[k]; }
+
+  inline bool empty() const { return mvIndex.empty(); }
+
+private:
+  int mnCols, mnRows;
+  float mfMinX, mfMinY;
+  float mfCellWidthInv, mfCellHeightInv;
+
+  // First entry of each cell, plus one past the last entry
+  vector<uint32_t> mvCellStart;
+
+  // Keypoint index and the fields read by area queries, sorted by cell
+  vector<uint32_t> mvIndex;
+  vector<float> mvX, mvY;
+  vector<int8_t> mvOctave;
+};
+
+} // namespace ORB_SLAM3
+
+#endif // FEATUREGRID_H
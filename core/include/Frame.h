@@ -29,9 +29,11 @@
 #include <sophus/geometry.hpp>
 
 #include "ImuTypes.h"
+#include "ORB/descriptors.h"
 #include "ORB/vocabulary.h"
 
 #include "Converter.h"
+#include "FeatureGrid.h"
 #include "Settings.h"
 
 #include <mutex>
@@ -87,6 +89,12 @@ public:
   // Extract ORB on the image. 0 for left image and 1 for right image.
   void ExtractORB(int flag, const cv::Mat &im, const int x0, const int x1);
 
+  // Extract ORB on both images of a stereo pair. The right image is handed to
+  // the extractors' thread pool while the left one is processed here.
+  void ExtractORBStereo(const cv::Mat &imLeft, const cv::Mat &imRight,
+                        const int x0Left, const int x1Left, const int x0Right,
+                        const int x1Right);
+
   // Compute Bag of Words representation.
   void ComputeBoW();
 
@@ -112,6 +120,9 @@ public:
   Eigen::Matrix3f GetRelativePoseTlr_rotation();
   Eigen::Vector3f GetRelativePoseTlr_translation();
 
+  // Set the extrinsics of the right camera of a rig
+  void SetRelativePoseTlr(const Sophus::SE3f &Tlr);
+
   void SetNewBias(const IMU::Bias &b);
 
   // Check if a MapPoint is in the frustum of the camera
@@ -130,6 +141,13 @@ public:
                                    const int maxLevel = -1,
                                    const bool bRight = false) const;
 
+  // Same as above, but fills a caller-owned buffer (cleared first) so its
+  // capacity can be reused across queries without heap allocations.
+  void GetFeaturesInArea(vector<size_t> &vIndices, const float &x,
+                         const float &y, const float &r,
+                         const int minLevel = -1, const int maxLevel = -1,
+                         const bool bRight = false) const;
+
   // Search a match for each keypoint in the left image to a keypoint in the
   // right image. If there is a match, depth is computed and the right
   // coordinate associated to the left keypoint is stored.
@@ -249,7 +267,7 @@ public:
   DBoW2::FeatureVector mFeatVec;
 
   // ORB descriptor, each row associated to a keypoint.
-  cv::Mat mDescriptors, mDescriptorsRight;
+  DescriptorBlock mDescriptors, mDescriptorsRight;
 
   // MapPoints associated to keypoints, NULL pointer if no association.
   // Flag to identify outlier associations.
@@ -260,7 +278,7 @@ public:
   // when projecting MapPoints.
   static float mfGridElementWidthInv;
   static float mfGridElementHeightInv;
-  vector<size_t> mGrid[FRAME_GRID_COLS][FRAME_GRID_ROWS];
+  FeatureGrid mGrid;
 
   IMU::Bias mPredBias;
 
@@ -353,7 +371,7 @@ public:
   vector<Eigen::Vector3f> mvStereo3Dpoints;
 
   // Grid for the right image
-  vector<size_t> mGridRight[FRAME_GRID_COLS][FRAME_GRID_ROWS];
+  FeatureGrid mGridRight;
 
   Frame(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timeStamp,
         ORBextractor *extractorLeft, ORBextractor *extractorRight,
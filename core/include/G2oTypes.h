@@ -378,6 +378,11 @@ public:
     return VPose->estimate().isDepthPositive(Xw, cam_idx);
   }
 
+  Eigen::Matrix<double, 2, 6> GetJacobian() {
+    linearizeOplus();
+    return _jacobianOplusXi;
+  }
+
   Eigen::Matrix<double, 6, 6> GetHessian() {
     linearizeOplus();
     return _jacobianOplusXi.transpose() * information() * _jacobianOplusXi;
@@ -447,6 +452,11 @@ public:
 
   virtual void linearizeOplus();
 
+  Eigen::Matrix<double, 3, 6> GetJacobian() {
+    linearizeOplus();
+    return _jacobianOplusXi;
+  }
+
   Eigen::Matrix<double, 6, 6> GetHessian() {
     linearizeOplus();
     return _jacobianOplusXi.transpose() * information() * _jacobianOplusXi;
@@ -469,6 +479,18 @@ public:
   void computeError();
   virtual void linearizeOplus();
 
+  Eigen::Matrix<double, 9, 24> GetJacobian() {
+    linearizeOplus();
+    Eigen::Matrix<double, 9, 24> J;
+    J.block<9, 6>(0, 0) = _jacobianOplus[0];
+    J.block<9, 3>(0, 6) = _jacobianOplus[1];
+    J.block<9, 3>(0, 9) = _jacobianOplus[2];
+    J.block<9, 3>(0, 12) = _jacobianOplus[3];
+    J.block<9, 6>(0, 15) = _jacobianOplus[4];
+    J.block<9, 3>(0, 21) = _jacobianOplus[5];
+    return J;
+  }
+
   Eigen::Matrix<double, 24, 24> GetHessian() {
     linearizeOplus();
     Eigen::Matrix<double, 9, 24> J;
@@ -614,6 +636,14 @@ public:
     _jacobianOplusXj.setIdentity();
   }
 
+  Eigen::Matrix<double, 3, 6> GetJacobian() {
+    linearizeOplus();
+    Eigen::Matrix<double, 3, 6> J;
+    J.block<3, 3>(0, 0) = _jacobianOplusXi;
+    J.block<3, 3>(0, 3) = _jacobianOplusXj;
+    return J;
+  }
+
   Eigen::Matrix<double, 6, 6> GetHessian() {
     linearizeOplus();
     Eigen::Matrix<double, 3, 6> J;
@@ -649,6 +679,14 @@ public:
     _jacobianOplusXj.setIdentity();
   }
 
+  Eigen::Matrix<double, 3, 6> GetJacobian() {
+    linearizeOplus();
+    Eigen::Matrix<double, 3, 6> J;
+    J.block<3, 3>(0, 0) = _jacobianOplusXi;
+    J.block<3, 3>(0, 3) = _jacobianOplusXj;
+    return J;
+  }
+
   Eigen::Matrix<double, 6, 6> GetHessian() {
     linearizeOplus();
     Eigen::Matrix<double, 3, 6> J;
@@ -699,6 +737,16 @@ public:
   void computeError();
   virtual void linearizeOplus();
 
+  Eigen::Matrix<double, 15, 15> GetJacobian() {
+    linearizeOplus();
+    Eigen::Matrix<double, 15, 15> J;
+    J.block<15, 6>(0, 0) = _jacobianOplus[0];
+    J.block<15, 3>(0, 6) = _jacobianOplus[1];
+    J.block<15, 3>(0, 9) = _jacobianOplus[2];
+    J.block<15, 3>(0, 12) = _jacobianOplus[3];
+    return J;
+  }
+
   Eigen::Matrix<double, 15, 15> GetHessian() {
     linearizeOplus();
     Eigen::Matrix<double, 15, 15> J;
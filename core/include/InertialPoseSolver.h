@@ -0,0 +1,121 @@
+/**
+ * This file is part of ORB-SLAM3
+ *
+ * Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez
+ * Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+ * Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós,
+ * University of Zaragoza.
+ *
+ * ORB-SLAM3 is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ORB-SLAM3. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef INERTIALPOSESOLVER_H
+#define INERTIALPOSESOLVER_H
+
+#include <vector>
+
+#include <Eigen/Core>
+#include <g2o/core/jacobian_workspace.h>
+
+#include "G2oTypes.h"
+
+using namespace std;
+
+namespace ORB_SLAM3 {
+
+// Gauss-Newton over the navigation state (pose, velocity, gyroscope and
+// accelerometer biases) of a frame, or of a frame and its predecessor, the
+// problems PoseInertialOptimizationLastKeyFrame/LastFrame used to hand to a
+// g2o::SparseOptimizer. Vertices and edges are the usual G2oTypes, so errors,
+// Jacobians and outlier handling are unchanged, but there is no graph to
+// build: the normal equations (at most 30x30) are accumulated in fixed
+// capacity storage and solved with a dense LDLT.
+class InertialPoseSolver {
+public:
+  // A frame and its predecessor, 15 states each
+  static const int MAX_DIM = 30;
+
+  InertialPoseSolver();
+
+  // Deletes every vertex and edge it was given, as the optimizer did
+  ~InertialPoseSolver();
+
+  // Adds the state of a frame. Free states are stacked in the order they are
+  // added (as g2o orders them by vertex id), fixed ones only condition the
+  // edges that reach them.
+  void AddState(VertexPose *VP, VertexVelocity *VV, VertexGyroBias *VG,
+                VertexAccBias *VA, const bool bFixed);
+
+  // Edges are active while at level 0
+  void AddEdge(EdgeMonoOnlyPose *e);
+  void AddEdge(EdgeStereoOnlyPose *e);
+  void AddEdge(EdgeInertial *e);
+  void AddEdge(EdgeGyroRW *e);
+  void AddEdge(EdgeAccRW *e);
+  void AddEdge(EdgePriorPoseImu *e);
+
+  // Number of edges, active or not
+  size_t NumEdges() const;
+
+  // Up to nIterations Gauss-Newton iterations. As in g2o the edge errors are
+  // those of the last linearization point, not of the returned estimate.
+  void Optimize(const int nIterations);
+
+private:
+  typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor,
+                        MAX_DIM, MAX_DIM>
+      MatrixH;
+  typedef Eigen::Matrix<double, Eigen::Dynamic, 1, Eigen::ColMajor, MAX_DIM, 1>
+      VectorB;
+
+  struct State {
+    VertexPose *VP;
+    VertexVelocity *VV;
+    VertexGyroBias *VG;
+    VertexAccBias *VA;
+    int nOffset; // -1 if fixed
+  };
+
+  // Offset of a vertex in the state vector, -1 if it is fixed
+  int Offset(const g2o::HyperGraph::Vertex *pV) const;
+
+  // Adds the robustified contribution of an edge, whose Jacobian stacks the
+  // blocks of its vertices in order
+  template <class Edge, class Jacobian>
+  void Accumulate(Edge *e, const Jacobian &J, MatrixH &H, VectorB &b) const;
+
+  // Computes the error of every active edge of a kind and accumulates it
+  template <class Edge>
+  void Accumulate(const vector<Edge *> &vpEdges, MatrixH &H, VectorB &b) const;
+
+  template <class Edge> void SizeWorkspace(const vector<Edge *> &vpEdges);
+  template <class Edge> void BindWorkspace(const vector<Edge *> &vpEdges);
+
+  vector<State> mvStates;
+  int mnDim;
+
+  vector<EdgeMonoOnlyPose *> mvpEdgesMono;
+  vector<EdgeStereoOnlyPose *> mvpEdgesStereo;
+  vector<EdgeInertial *> mvpEdgesInertial;
+  vector<EdgeGyroRW *> mvpEdgesGyroRW;
+  vector<EdgeAccRW *> mvpEdgesAccRW;
+  vector<EdgePriorPoseImu *> mvpEdgesPrior;
+
+  // Backs the Jacobian maps of the edges. Every edge is bound to it on the
+  // first Optimize, which also keeps their GetHessian usable afterwards.
+  g2o::JacobianWorkspace mJacobianWorkspace;
+  bool mbWorkspaceBound;
+};
+
+} // namespace ORB_SLAM3
+
+#endif // INERTIALPOSESOLVER_H
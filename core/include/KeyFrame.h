@@ -70,19 +70,6 @@ class KeyFrame {
     // ar & mnBALocalForKF;
     // ar & mnBAFixedForKF;
     // ar & mnNumberOfOpt;
-    // Variables used by KeyFrameDatabase
-    // ar & mnLoopQuery;
-    // ar & mnLoopWords;
-    // ar & mLoopScore;
-    // ar & mnRelocQuery;
-    // ar & mnRelocWords;
-    // ar & mRelocScore;
-    // ar & mnMergeQuery;
-    // ar & mnMergeWords;
-    // ar & mMergeScore;
-    // ar & mnPlaceRecognitionQuery;
-    // ar & mnPlaceRecognitionWords;
-    // ar & mPlaceRecognitionScore;
     // ar & mbCurrentPlaceRecognition;
     // Variables of loop closing
     // serializeMatrix(ar,mTcwGBA,version);
@@ -254,6 +241,8 @@ public:
   void ReplaceMapPointMatch(const int &idx, MapPoint *pMP);
   set<MapPoint *> GetMapPoints();
   vector<MapPoint *> GetMapPointMatches();
+  // Changes whenever a map point match is added, erased or replaced
+  unsigned long GetMapPointsVersion();
   int TrackedMapPoints(const int &minObs);
   MapPoint *GetMapPoint(const size_t &idx);
 
@@ -261,6 +250,10 @@ public:
   vector<size_t> GetFeaturesInArea(const float &x, const float &y,
                                    const float &r,
                                    const bool bRight = false) const;
+  // Same as above, filling a caller-owned buffer (cleared first)
+  void GetFeaturesInArea(vector<size_t> &vIndices, const float &x,
+                         const float &y, const float &r,
+                         const bool bRight = false) const;
   bool UnprojectStereo(int i, Eigen::Vector3f &x3D);
 
   // Image
@@ -334,20 +327,6 @@ public:
   // Number of optimizations by BA(amount of iterations in BA)
   long unsigned int mnNumberOfOpt;
 
-  // Variables used by the keyframe database
-  long unsigned int mnLoopQuery;
-  int mnLoopWords;
-  float mLoopScore;
-  long unsigned int mnRelocQuery;
-  int mnRelocWords;
-  float mRelocScore;
-  long unsigned int mnMergeQuery;
-  int mnMergeWords;
-  float mMergeScore;
-  long unsigned int mnPlaceRecognitionQuery;
-  int mnPlaceRecognitionWords;
-  float mPlaceRecognitionScore;
-
   bool mbCurrentPlaceRecognition;
 
   // Variables used by loop closing
@@ -384,7 +363,7 @@ public:
   const vector<cv::KeyPoint> mvKeysUn;
   const vector<float> mvuRight; // negative value for monocular points
   const vector<float> mvDepth;  // negative value for monocular points
-  const cv::Mat mDescriptors;
+  const DescriptorBlock mDescriptors;
 
   // BoW
   DBoW2::BowVector mBowVec;
@@ -452,6 +431,7 @@ protected:
   vector<MapPoint *> mvpMapPoints;
   // For save relation without pointer, this is necessary for save/load function
   vector<long long int> mvBackupMapPointsId;
+  unsigned long mnMapPointsVersion;
 
   // BoW
   KeyFrameDatabase *mpKeyFrameDB;
@@ -23,6 +23,7 @@
 
 using namespace std;
 
+#include <cstdint>
 #include <list>
 #include <set>
 #include <vector>
@@ -37,6 +38,7 @@ using namespace std;
 #include <boost/serialization/vector.hpp>
 
 #include <mutex>
+#include <shared_mutex>
 
 namespace ORB_SLAM3 {
 
@@ -53,9 +55,46 @@ class KeyFrameDatabase {
   }
 
 public:
+  // Working memory of a query, indexed by keyframe id. Queries only read the
+  // database, so any number of them can run at once as long as each thread
+  // uses its own context. Keeping one per caller saves reallocating it.
+  class QueryContext {
+    friend class KeyFrameDatabase;
+
+  public:
+    QueryContext() : mnQuery(0) {}
+
+  private:
+    // Start a new query over keyframe ids [0, n)
+    void Reset(size_t n);
+
+    // Start tracking a keyframe found in the postings
+    void Touch(size_t id, int group);
+
+    bool Touched(size_t id) const {
+      return id < vnQuery.size() && vnQuery[id] == mnQuery;
+    }
+
+    int MaxWords(const vector<KeyFrame *> &vpKFs) const;
+    int Words(const KeyFrame *pKF, int group) const;
+    float Similarity(const KeyFrame *pKF) const;
+
+    // Entries are only valid for the keyframes touched by the current query
+    unsigned long mnQuery;
+    vector<unsigned long> vnQuery;
+
+    // Candidate group (-1 for keyframes the query ignores), words shared with
+    // the query, running sum of the L1 score terms and the similarity, once
+    // computed
+    vector<signed char> vnGroup;
+    vector<int> vnWords;
+    vector<double> vL1;
+    vector<float> vScore;
+  };
+
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
-  KeyFrameDatabase() {}
+  KeyFrameDatabase() : mbL1Score(false) {}
   KeyFrameDatabase(const ORBVocabulary &voc);
 
   void add(KeyFrame *pKF);
@@ -65,38 +104,91 @@ public:
   void clear();
   void clearMap(Map *pMap);
 
+  // Queries take an optional context to reuse between calls, a temporary one
+  // is used otherwise
+
   // Loop Detection(DEPRECATED)
-  vector<KeyFrame *> DetectLoopCandidates(KeyFrame *pKF, float minScore);
+  vector<KeyFrame *> DetectLoopCandidates(KeyFrame *pKF, float minScore,
+                                          QueryContext *pContext = NULL);
 
   // Loop and Merge Detection
   void DetectCandidates(KeyFrame *pKF, float minScore,
                         vector<KeyFrame *> &vpLoopCand,
-                        vector<KeyFrame *> &vpMergeCand);
+                        vector<KeyFrame *> &vpMergeCand,
+                        QueryContext *pContext = NULL);
   void DetectBestCandidates(KeyFrame *pKF, vector<KeyFrame *> &vpLoopCand,
-                            vector<KeyFrame *> &vpMergeCand, int nMinWords);
+                            vector<KeyFrame *> &vpMergeCand, int nMinWords,
+                            QueryContext *pContext = NULL);
   void DetectNBestCandidates(KeyFrame *pKF, vector<KeyFrame *> &vpLoopCand,
                              vector<KeyFrame *> &vpMergeCand,
-                             int nNumCandidates);
+                             int nNumCandidates,
+                             QueryContext *pContext = NULL);
 
   // Relocalization
-  vector<KeyFrame *> DetectRelocalizationCandidates(Frame *F, Map *pMap);
+  vector<KeyFrame *>
+  DetectRelocalizationCandidates(Frame *F, Map *pMap,
+                                 QueryContext *pContext = NULL);
 
   void PreSave();
   void PostLoad(map<long unsigned int, KeyFrame *> mpKFid);
   void SetORBVocabulary(ORBVocabulary *pORBVoc);
 
 protected:
+  // Postings of one word: ids (KeyFrame::mnId) of the keyframes where it
+  // appears and its weight in each of them. Erased keyframes stay behind as
+  // tombstones until they make up half of the list.
+  struct PostingList {
+    PostingList() : nErased(0) {}
+
+    vector<uint32_t> vnIds;
+    vector<double> vWeights;
+    size_t nErased;
+  };
+
+  // Drop the tombstones of a posting list
+  void Compact(PostingList &postings);
+
+  // Count, for every live keyframe sharing words with "bow", the number of
+  // shared words. "classify" is called the first time a keyframe is found and
+  // returns its candidate group, the index of the list in vpKFsSharingWords it
+  // is appended to, or -1 to ignore it.
+  template <class Classify>
+  void CollectSharingWords(const DBoW2::BowVector &bow, QueryContext &context,
+                           vector<KeyFrame *> *vpKFsSharingWords,
+                           Classify classify);
+
+  // Similarity between "bow" and a collected keyframe
+  float Score(const DBoW2::BowVector &bow, const QueryContext &context,
+              KeyFrame *pKF) const;
+
+  // Score the keyframes of a candidate group sharing more than minCommonWords
+  // words, keep those scoring at least minScore and add to each the scores of
+  // its covisible keyframes of the same group sharing more than minNeighWords
+  // words. Pairs hold the accumulated score and the best scoring keyframe.
+  void AccumulateCovisibilityScores(
+      const DBoW2::BowVector &bow, QueryContext &context,
+      const vector<KeyFrame *> &vpKFsSharingWords, int group,
+      int minCommonWords, float minScore, int minNeighWords,
+      vector<pair<float, KeyFrame *>> &vAccScoreAndMatch);
+
   // Associated vocabulary
   const ORBVocabulary *mpVoc;
 
+  // L1 scores are accumulated while walking the postings, any other scoring
+  // is left to the vocabulary
+  bool mbL1Score;
+
   // Inverted file
-  vector<list<KeyFrame *>> mvInvertedFile;
+  vector<PostingList> mvInvertedFile;
+
+  // Keyframe of every id in the inverted file, NULL once erased
+  vector<KeyFrame *> mvpKeyFrames;
 
   // For save relation without pointer, this is necessary for save/load function
   vector<list<long unsigned int>> mvBackupInvertedFileId;
 
-  // Mutex
-  mutex mMutex;
+  // Mutex, queries share it and updates own it
+  shared_mutex mMutex;
 };
 
 } // namespace ORB_SLAM3
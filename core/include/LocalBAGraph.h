@@ -0,0 +1,122 @@
+/**
+ * This file is part of ORB-SLAM3
+ *
+ * Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez
+ * Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+ * Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós,
+ * University of Zaragoza.
+ *
+ * ORB-SLAM3 is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ORB-SLAM3. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LOCALBAGRAPH_H
+#define LOCALBAGRAPH_H
+
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+#include <g2o/core/optimization_algorithm_levenberg.h>
+#include <g2o/core/sparse_optimizer.h>
+#include <g2o/types/sba/types_six_dof_expmap.h>
+
+using namespace std;
+
+namespace ORB_SLAM3 {
+
+class KeyFrame;
+class Map;
+class MapPoint;
+class ThreadPool;
+
+// g2o graph of the local bundle adjustment, kept from one keyframe to the
+// next. Consecutive local windows share most of their keyframes and points,
+// so Update only removes the vertices that left the window, creates those
+// that entered it and rebuilds the edges of the points whose observations
+// changed (see MapPoint::GetObservationsVersion). Estimates are read again
+// from the map on every update: the last solution, as written back, plus any
+// correction made by other threads since. Keyframes and map points are
+// referenced by address, so the graph must be cleared whenever they may be
+// deleted.
+class LocalBAGraph {
+public:
+  // Kinds of observation, as the edges used for them
+  enum Kind {
+    MONO = 0,   // EdgeSE3ProjectXYZ
+    STEREO = 1, // g2o::EdgeStereoSE3ProjectXYZ
+    BODY = 2    // right camera of a rig, EdgeSE3ProjectXYZToBody
+  };
+
+  struct Observation {
+    g2o::OptimizableGraph::Edge *pEdge;
+    KeyFrame *pKF;
+    MapPoint *pMP;
+    Kind kind;
+  };
+
+  // Edges are linearized on pThreadPool if given
+  LocalBAGraph(ThreadPool *pThreadPool = NULL);
+
+  void Clear();
+
+  // Make the graph that of a local window of pMap: the local keyframes, free
+  // but for the first keyframe of the map, the fixed keyframes and the local
+  // points with their observations in good keyframes of pMap. Returns the
+  // number of edges.
+  int Update(Map *pMap, const list<KeyFrame *> &lLocalKeyFrames,
+             const list<KeyFrame *> &lFixedKeyFrames,
+             const list<MapPoint *> &lLocalMapPoints);
+
+  g2o::SparseOptimizer &GetOptimizer() { return mOptimizer; }
+  g2o::OptimizationAlgorithmLevenberg *GetAlgorithm() { return mpAlgorithm; }
+
+  // Edges of the local points, in the order of the last Update
+  const vector<Observation> &GetObservations() const { return mvObservations; }
+
+  g2o::VertexSE3Expmap *GetVertex(KeyFrame *pKF) const;
+  g2o::VertexPointXYZ *GetVertex(MapPoint *pMP) const;
+
+private:
+  // Vertex of a keyframe and the update it was last part of
+  struct KeyFrameEntry {
+    g2o::VertexSE3Expmap *pVertex;
+    unsigned long nStamp;
+  };
+
+  // Vertex of a point, its edges and the version of its observations they
+  // were built from
+  struct PointEntry {
+    g2o::VertexPointXYZ *pVertex;
+    unsigned long nStamp;
+    unsigned long nVersion;
+    vector<Observation> vObservations;
+  };
+
+  g2o::VertexSE3Expmap *AddKeyFrame(KeyFrame *pKF, const bool bFixed);
+  bool AreEdgesValid(const PointEntry &entry) const;
+  void BuildEdges(MapPoint *pMP, PointEntry &entry);
+
+  g2o::SparseOptimizer mOptimizer;
+  g2o::OptimizationAlgorithmLevenberg *mpAlgorithm;
+
+  Map *mpMap;
+  unsigned long mnMapId;
+  unsigned long mnStamp;
+
+  unordered_map<KeyFrame *, KeyFrameEntry> mKeyFrames;
+  unordered_map<MapPoint *, PointEntry> mMapPoints;
+  vector<Observation> mvObservations;
+};
+
+} // namespace ORB_SLAM3
+
+#endif // LOCALBAGRAPH_H
@@ -0,0 +1,96 @@
+/**
+ * This file is part of ORB-SLAM3
+ *
+ * Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez
+ * Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+ * Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós,
+ * University of Zaragoza.
+ *
+ * ORB-SLAM3 is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ORB-SLAM3. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LOCALMAPCACHE_H
+#define LOCALMAPCACHE_H
+
+#include <vector>
+
+using namespace std;
+
+namespace ORB_SLAM3 {
+
+class KeyFrame;
+class MapPoint;
+
+// Keyframe votes and map points of the tracking local map, carried over from
+// frame to frame. Only the map points whose observations changed, and the
+// keyframes whose matches changed, are read again (see
+// MapPoint::GetObservingKeyFrames and KeyFrame::GetMapPointsVersion).
+// Keyframes and map points are referenced by address, so the cache must be
+// cleared whenever they may be deleted.
+class LocalMapCache {
+public:
+  void Clear();
+
+  // Make the votes those of vpMapPoints: every point votes once for each
+  // keyframe observing it, a point repeated in the list as many times. Null
+  // entries are skipped, the caller discards bad points.
+  void UpdateVotes(const vector<MapPoint *> &vpMapPoints);
+
+  // Keyframes with at least one vote, by increasing address (the iteration
+  // order of a map<KeyFrame*, int>)
+  const vector<KeyFrame *> &GetVotedKeyFrames() const { return mvpVoted; }
+  int GetVotes(KeyFrame *pKF) const;
+
+  // Map points of vpKeyFrames, visiting the keyframes backwards, without bad
+  // points or repetitions. Collected points are stamped with nFrameId in
+  // MapPoint::mnTrackReferenceForFrame.
+  void CollectMapPoints(const vector<KeyFrame *> &vpKeyFrames,
+                        const unsigned long nFrameId,
+                        vector<MapPoint *> &vpMapPoints);
+
+private:
+  void AddVotes(KeyFrame *const *vpKFs, const size_t n, const int nVotes);
+
+  // A voting point, how many times it voted, and the keyframes observing it
+  // (range of mvpVoterKFs) at version nVersion of its observations
+  struct Voter {
+    MapPoint *pMP;
+    unsigned long nVersion;
+    int nTimes;
+    size_t begin, end;
+  };
+  vector<Voter> mvVoters, mvNewVoters;
+  vector<KeyFrame *> mvpVoterKFs, mvpNewVoterKFs;
+  vector<MapPoint *> mvpSortedPoints;
+
+  // Votes by KeyFrame::mnId
+  vector<int> mvnVotes;
+  vector<KeyFrame *> mvpVoted;
+
+  // Non null matches of a local keyframe (range of mvpKFPoints) at version
+  // nVersion, sorted by keyframe address
+  struct KeyFramePoints {
+    KeyFrame *pKF;
+    unsigned long nVersion;
+    size_t begin, end;
+
+    bool operator<(const KeyFramePoints &other) const {
+      return pKF < other.pKF;
+    }
+  };
+  vector<KeyFramePoints> mvKFPoints, mvNewKFPoints;
+  vector<MapPoint *> mvpKFPoints, mvpNewKFPoints;
+};
+
+} // namespace ORB_SLAM3
+
+#endif // LOCALMAPCACHE_H
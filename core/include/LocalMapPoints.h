@@ -0,0 +1,80 @@
+/**
+ * This file is part of ORB-SLAM3
+ *
+ * Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez
+ * Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+ * Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós,
+ * University of Zaragoza.
+ *
+ * ORB-SLAM3 is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ORB-SLAM3. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LOCALMAPPOINTS_H
+#define LOCALMAPPOINTS_H
+
+#include <cstdint>
+#include <vector>
+
+#include <Eigen/Core>
+
+using namespace std;
+
+namespace ORB_SLAM3 {
+
+class Frame;
+class GeometricCamera;
+class MapPoint;
+
+// Geometry of the local map points snapshotted as a structure of arrays, one
+// MapPoint lock per point, so that the frustum test of the whole local map is
+// a handful of vectorizable loops instead of one locked, scalar test per
+// point.
+class LocalMapPoints {
+public:
+  // Frustum test of every point against one camera
+  struct View {
+    // Projection, depth (camera coordinates) of the point, distance to the
+    // camera center and cosine of the viewing angle
+    vector<float> vU, vV, vZ;
+    vector<float> vDepth, vDist, vViewCos;
+    // In front of the camera and projected inside the image
+    vector<uint8_t> vbInImage;
+    // Also within the scale invariance region and the viewing angle limit
+    vector<uint8_t> vbVisible;
+  };
+
+  // Snapshot the geometry of vpMapPoints
+  void Build(const vector<MapPoint *> &vpMapPoints);
+
+  inline size_t size() const { return mvX.size(); }
+
+  // Test every point against a camera with pose (Rcw, tcw) and center Ow
+  // whose image spans [minX, maxX] x [minY, maxY]. Pinhole projections are
+  // batched, other models are projected point by point.
+  void Project(const Eigen::Matrix3f &Rcw, const Eigen::Vector3f &tcw,
+               const Eigen::Vector3f &Ow, GeometricCamera *pCamera,
+               const float minX, const float maxX, const float minY,
+               const float maxY, const float viewingCosLimit,
+               View &view) const;
+
+  // Scale level of point i at distance dist, as MapPoint::PredictScale
+  int PredictScale(const size_t i, const float dist, const Frame &F) const;
+
+private:
+  vector<float> mvX, mvY, mvZ;
+  vector<float> mvNx, mvNy, mvNz;
+  vector<float> mvMinDistance, mvMaxDistance;
+};
+
+} // namespace ORB_SLAM3
+
+#endif // LOCALMAPPOINTS_H
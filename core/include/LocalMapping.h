@@ -26,10 +26,14 @@ using namespace std;
 #include "Atlas.h"
 #include "KeyFrame.h"
 #include "KeyFrameDatabase.h"
+#include "LocalBAGraph.h"
 #include "LoopClosing.h"
+#include "SPSCQueue.h"
 #include "Settings.h"
+#include "ThreadPool.h"
 #include "Tracking.h"
 
+#include <condition_variable>
 #include <mutex>
 
 namespace ORB_SLAM3 {
@@ -42,8 +46,13 @@ class Atlas;
 class LocalMapping {
 public:
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  // nThreads worker threads help the mapping thread with the per-neighbour
+  // work of a keyframe and the linearization of local BA (none runs it all
+  // on the mapping thread)
   LocalMapping(System *pSys, Atlas *pAtlas, const float bMonocular,
-               bool bInertial, const string &_strSeqName = string());
+               bool bInertial, const string &_strSeqName = string(),
+               const int nThreads = 0);
+  ~LocalMapping();
 
   void SetLoopCloser(LoopClosing *pLoopCloser);
 
@@ -62,6 +71,8 @@ public:
   bool Stop();
   void Release();
   bool isStopped();
+  // Block until Local Mapping has stopped (or finished)
+  void WaitUntilStopped();
   bool stopRequested();
   bool AcceptKeyFrames();
   void SetAcceptKeyFrames(bool flag);
@@ -72,9 +83,12 @@ public:
   void RequestFinish();
   bool isFinished();
 
-  int KeyframesInQueue() {
-    unique_lock<mutex> lock(mMutexNewKFs);
-    return mlNewKeyFrames.size();
+  int KeyframesInQueue() { return mNewKeyFrames.Size(); }
+  // Deepest the keyframe queue has been
+  int MaxKeyframesInQueue() { return mNewKeyFrames.MaxSize(); }
+  // True when Tracking should hold back new keyframes
+  bool KeyframeQueueFull() {
+    return mNewKeyFrames.Size() >= mNewKeyFrames.Capacity();
   }
 
   bool IsInitializing();
@@ -134,12 +148,33 @@ protected:
   void ProcessNewKeyFrame();
   void CreateNewMapPoints();
 
+  // A point triangulated from the current keyframe feature idx1 and the
+  // neighbour feature idx2, not yet added to the map
+  struct NewMapPoint {
+    Eigen::Vector3f x3D;
+    int idx1;
+    int idx2;
+  };
+  // Matches the current keyframe against one neighbour and triangulates.
+  // Only reads shared state, so it runs concurrently for several neighbours.
+  void TriangulateWithNeighbor(KeyFrame *pKF2, const bool bCoarse,
+                               vector<NewMapPoint> &vNewMapPoints);
+  // Adds the points to the map, except those whose feature of the current
+  // keyframe already has one
+  void AddNewMapPoints(KeyFrame *pKF2,
+                       const vector<NewMapPoint> &vNewMapPoints);
+
   void MapPointCulling();
   void SearchInNeighbors();
   void KeyFrameCulling();
 
   System *mpSystem;
 
+  ThreadPool *mpThreadPool;
+
+  // Local bundle adjustment graph carried over between keyframes
+  LocalBAGraph *mpLocalBAGraph;
+
   bool mbMonocular;
   bool mbInertial;
 
@@ -148,6 +183,7 @@ protected:
   bool mbResetRequestedActiveMap;
   Map *mpMapToReset;
   mutex mMutexReset;
+  condition_variable mcvReset;
 
   bool CheckFinish();
   void SetFinish();
@@ -160,20 +196,29 @@ protected:
   LoopClosing *mpLoopCloser;
   Tracking *mpTracker;
 
-  list<KeyFrame *> mlNewKeyFrames;
+  // Keyframes handed over by Tracking (producer) to the Run loop (consumer).
+  // Other threads only pop while Local Mapping is stopped.
+  SPSCQueue<KeyFrame *> mNewKeyFrames;
 
   KeyFrame *mpCurrentKeyFrame;
 
   list<MapPoint *> mlpRecentAddedMapPoints;
 
-  mutex mMutexNewKFs;
-
   bool mbAbortBA;
 
   bool mbStopped;
   bool mbStopRequested;
   bool mbNotStop;
   mutex mMutexStop;
+  condition_variable mcvStop;
+
+  // Raised by everything that hands the Run loop a keyframe or a request, so
+  // that it sleeps while idle instead of polling
+  void WakeUp();
+  void WaitForWakeUp();
+  bool mbWakeUp;
+  mutex mMutexWakeUp;
+  condition_variable mcvWakeUp;
 
   bool mbAcceptKeyFrames;
   mutex mMutexAccept;
@@ -25,11 +25,13 @@
 #include "KeyFrame.h"
 #include "LocalMapping.h"
 #include "ORB/vocabulary.h"
+#include "SPSCQueue.h"
 #include "Tracking.h"
 
 #include "KeyFrameDatabase.h"
 
 #include <boost/algorithm/string.hpp>
+#include <condition_variable>
 #include <mutex>
 #include <thread>
 
@@ -64,6 +66,11 @@ public:
 
   void InsertKeyFrame(KeyFrame *pKF);
 
+  // Keyframe queue depth counters
+  int KeyframesInQueue() { return mLoopKeyFrameQueue.Size(); }
+  int MaxKeyframesInQueue() { return mLoopKeyFrameQueue.MaxSize(); }
+  int OverflowedKeyframes() { return mLoopKeyFrameQueue.Rejected(); }
+
   void RequestReset();
   void RequestResetActiveMap(Map *pMap);
 
@@ -161,6 +168,7 @@ protected:
   bool mbResetActiveMapRequested;
   Map *mpMapToReset;
   mutex mMutexReset;
+  condition_variable mcvReset;
 
   bool CheckFinish();
   void SetFinish();
@@ -172,13 +180,28 @@ protected:
   Tracking *mpTracker;
 
   KeyFrameDatabase *mpKeyFrameDB;
+  KeyFrameDatabase::QueryContext mPlaceRecognitionQuery;
   ORBVocabulary *mpORBVocabulary;
 
   LocalMapping *mpLocalMapper;
 
-  list<KeyFrame *> mlpLoopKeyFrameQueue;
-
-  mutex mMutexLoopQueue;
+  // Keyframes handed over by Local Mapping (producer) to the Run loop
+  // (consumer). If the ring is full they go to the overflow list, so every
+  // keyframe reaches the Run loop, and with it the keyframe database.
+  SPSCQueue<KeyFrame *> mLoopKeyFrameQueue;
+  list<KeyFrame *> mlpLoopKeyFrameOverflow;
+  mutex mMutexLoopOverflow;
+  // Keyframes that an active map reset took off the ring and kept. Only
+  // touched by the Run loop, and processed before the ring.
+  list<KeyFrame *> mlpLoopKeyFrameBacklog;
+
+  // Raised by everything that hands the Run loop a keyframe or a request, so
+  // that it sleeps while idle instead of polling
+  void WakeUp();
+  void WaitForWakeUp();
+  bool mbWakeUp;
+  mutex mMutexWakeUp;
+  condition_variable mcvWakeUp;
 
   // Loop detector parameters
   float mnCovisibilityConsistencyTh;
@@ -123,6 +123,12 @@ public:
   map<KeyFrame *, tuple<int, int>> GetObservations();
   int Observations();
 
+  // Append the keyframes observing the point to vpKFs and return the version
+  // of the observations they were read at. The version changes whenever an
+  // observation is added or erased, so callers can cache what they read.
+  unsigned long GetObservingKeyFrames(vector<KeyFrame *> &vpKFs);
+  unsigned long GetObservationsVersion();
+
   void AddObservation(KeyFrame *pKF, int idx);
   void EraseObservation(KeyFrame *pKF);
 
@@ -140,14 +146,23 @@ public:
   float GetFoundRatio();
   inline int GetFound() { return mnFound; }
 
+  // Picks the observed descriptor with least median distance to the others.
+  // Distances from the previous call are reused, so only new observations
+  // cost Hamming distances. At most MAX_DESCRIPTOR_OBSERVATIONS descriptors
+  // (those of the most recent keyframes) are considered.
   void ComputeDistinctiveDescriptors();
+  static const size_t MAX_DESCRIPTOR_OBSERVATIONS = 32;
 
-  cv::Mat GetDescriptor();
+  DescriptorBlock GetDescriptor();
 
   void UpdateNormalAndDepth();
 
   float GetMinDistanceInvariance();
   float GetMaxDistanceInvariance();
+  // Position, normal and scale invariance distances (without the 0.8 and 1.2
+  // margins) read under a single lock
+  void GetViewingGeometry(Eigen::Vector3f &pos, Eigen::Vector3f &normal,
+                          float &minDistance, float &maxDistance);
   int PredictScale(const float &currentDist, KeyFrame *pKF);
   int PredictScale(const float &currentDist, Frame *pF);
 
@@ -212,6 +227,7 @@ protected:
 
   // Keyframes observing the point and associated index in keyframe
   map<KeyFrame *, tuple<int, int>> mObservations;
+  unsigned long mnObservationsVersion;
   // For save relation without pointer, this is necessary for save/load function
   map<long unsigned int, int> mBackupObservationsId1;
   map<long unsigned int, int> mBackupObservationsId2;
@@ -220,7 +236,17 @@ protected:
   Eigen::Vector3f mNormalVector;
 
   // Best descriptor to fast matching
-  cv::Mat mDescriptor;
+  DescriptorBlock mDescriptor;
+
+  // Observations mDescriptor was chosen from, ordered by keyframe and
+  // keypoint index, and their N x N descriptor distances
+  struct DescriptorObservation {
+    KeyFrame *pKF;
+    int idx;
+  };
+  vector<DescriptorObservation> mvDescriptorObservations;
+  vector<uint16_t> mvDescriptorDistances;
+  mutex mMutexDescriptor;
 
   // Reference KeyFrame
   KeyFrame *mpRefKF;
@@ -29,6 +29,8 @@
 #include "Frame.h"
 #include "KeyFrame.h"
 #include "MapPoint.h"
+#include "ORB/descriptors.h"
+#include "ORB/hamming.h"
 
 using namespace std;
 
@@ -39,7 +41,19 @@ public:
   ORBmatcher(float nnratio = 0.6, bool checkOri = true);
 
   // Computes the Hamming distance between two ORB descriptors
-  static int DescriptorDistance(const cv::Mat &a, const cv::Mat &b);
+  static inline int DescriptorDistance(const cv::Mat &a, const cv::Mat &b) {
+    return Hamming::Distance(a.ptr<uint8_t>(), b.ptr<uint8_t>());
+  }
+
+  static inline int DescriptorDistance(const uint8_t *a, const uint8_t *b) {
+    return Hamming::Distance(a, b);
+  }
+
+  // Computes the Hamming distance between one ORB descriptor and the rows
+  // vIndices of a descriptor block, using the widest SIMD kernel available
+  static void DescriptorDistances(const uint8_t *a, const DescriptorBlock &B,
+                                  const vector<size_t> &vIndices,
+                                  vector<int> &vDistances);
 
   // Search matches between Frame keypoints and projected MapPoints. Returns
   // number of matches Used to track the local map (Tracking)
@@ -106,6 +120,23 @@ public:
   int Fuse(KeyFrame *pKF, const vector<MapPoint *> &vpMapPoints,
            const float th = 3.0, const bool bRight = false);
 
+  // Fuse split in two steps. SearchForFuse finds the keypoint of pKF each
+  // point would be fused with (nPoint indexes vpMapPoints, nIdx the keypoint)
+  // and does not change the map, so several keyframes can be searched
+  // concurrently. ApplyFuse then adds or replaces the matched points, skipping
+  // points that became bad or were added to pKF since the search. Points whose
+  // observations changed are appended to pvpTouched.
+  struct FuseMatch {
+    int nPoint;
+    int nIdx;
+  };
+  void SearchForFuse(KeyFrame *pKF, const vector<MapPoint *> &vpMapPoints,
+                     vector<FuseMatch> &vMatches, const float th = 3.0,
+                     const bool bRight = false);
+  int ApplyFuse(KeyFrame *pKF, const vector<MapPoint *> &vpMapPoints,
+                const vector<FuseMatch> &vMatches,
+                vector<MapPoint *> *pvpTouched = NULL);
+
   // Project MapPoints into KeyFrame using a given Sim3 and search for
   // duplicated MapPoints.
   int Fuse(KeyFrame *pKF, Sophus::Sim3f &Scw,
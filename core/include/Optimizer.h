@@ -43,7 +43,9 @@ using namespace std;
 
 namespace ORB_SLAM3 {
 
+class LocalBAGraph;
 class LoopClosing;
+class ThreadPool;
 
 namespace Optimizer {
 
@@ -60,9 +62,11 @@ void FullInertialBA(Map *pMap, int its, const bool bFixLocal = false,
                     bool bInit = false, float priorG = 1e2, float priorA = 1e6,
                     Eigen::VectorXd *vSingVal = NULL, bool *bHess = NULL);
 
+// pGraph, if given, is updated to the current window instead of building the
+// graph from scratch (see LocalBAGraph)
 void LocalBundleAdjustment(KeyFrame *pKF, bool *pbStopFlag, Map *pMap,
                            int &num_fixedKF, int &num_OptKF, int &num_MPs,
-                           int &num_edges);
+                           int &num_edges, LocalBAGraph *pGraph = NULL);
 
 int PoseOptimization(Frame *pFrame);
 int PoseInertialOptimizationLastKeyFrame(Frame *pFrame, bool bRecInit = false);
@@ -100,7 +104,7 @@ int OptimizeSim3(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint *> &vpMatches1,
 void LocalInertialBA(KeyFrame *pKF, bool *pbStopFlag, Map *pMap,
                      int &num_fixedKF, int &num_OptKF, int &num_MPs,
                      int &num_edges, bool bLarge = false,
-                     bool bRecInit = false);
+                     bool bRecInit = false, ThreadPool *pThreadPool = NULL);
 void MergeInertialBA(KeyFrame *pCurrKF, KeyFrame *pMergeKF, bool *pbStopFlag,
                      Map *pMap, LoopClosing::KeyFrameAndPose &corrPoses);
 
@@ -0,0 +1,301 @@
+/**
+ * This file is part of ORB-SLAM3
+ *
+ * Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez
+ * Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+ * Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós,
+ * University of Zaragoza.
+ *
+ * ORB-SLAM3 is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ORB-SLAM3. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PARALLELBLOCKSOLVER_H
+#define PARALLELBLOCKSOLVER_H
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include <Eigen/Core>
+#include <g2o/core/block_solver.h>
+#include <g2o/core/jacobian_workspace.h>
+#include <g2o/core/robust_kernel.h>
+#include <g2o/core/sparse_optimizer.h>
+
+#include "ThreadPool.h"
+
+using namespace std;
+
+namespace ORB_SLAM3 {
+
+// g2o::BlockSolver whose buildSystem linearizes the edges on a ThreadPool.
+// Each edge first writes its Hessian and gradient terms to a slot of its own,
+// then every free vertex sums, in active edge order, the slots of its edges
+// into what it owns: its diagonal block, its own gradient (copied to the
+// system's as g2o does, so both stay valid) and the off-diagonal blocks of its
+// row of the upper triangle. No block has two writers and the summation order
+// is fixed, so the system is the same for any number of threads. Without a
+// pool (or with an empty one) it is exactly g2o's serial buildSystem.
+template <typename Traits>
+class ParallelBlockSolver : public g2o::BlockSolver<Traits> {
+public:
+  typedef typename Traits::LinearSolverType LinearSolverType;
+
+  ParallelBlockSolver(std::unique_ptr<LinearSolverType> linearSolver,
+                      ThreadPool *pThreadPool)
+      : g2o::BlockSolver<Traits>(std::move(linearSolver)),
+        mpThreadPool(pThreadPool) {}
+
+  virtual bool buildSystem();
+
+private:
+  typedef Eigen::Map<Eigen::MatrixXd> MatrixMap;
+  typedef Eigen::Map<const Eigen::MatrixXd> ConstMatrixMap;
+
+  // Edges and vertices handed to each job
+  static const int EDGE_BATCH = 64;
+  static const int VERTEX_BATCH = 16;
+
+  // Fills the slot of an edge with H = J^T W J and b = -J^T W e, J stacking
+  // the Jacobians of all its vertices. Rows and columns of fixed vertices are
+  // left unset.
+  void Linearize(g2o::OptimizableGraph::Edge *e,
+                 g2o::JacobianWorkspace &workspace, double *pScratch,
+                 double *pSlot) const;
+
+  // Adds the slots of the edges of vertex iv to the blocks it owns and to its
+  // gradient, which is then copied to b
+  void Reduce(const int iv);
+
+  // Hessian block of the upper triangle for hessian indices i1 <= i2
+  double *Block(const int i1, const int i2) const;
+
+  ThreadPool *mpThreadPool;
+
+  // Slot of active edge k at mvSlots[mvnSlotOffsets[k]], n*n Hessian terms
+  // followed by n gradient terms (n the summed dimension of its vertices)
+  vector<double> mvSlots;
+  vector<size_t> mvnSlotOffsets;
+  vector<int> mvnSlotDims;
+
+  // Active edges of each free vertex (by hessian index), in CSR form
+  vector<int> mvnVertexEdgeBegin;
+  vector<int> mvnVertexEdges;
+};
+
+template <typename Traits>
+bool ParallelBlockSolver<Traits>::buildSystem() {
+  if (!mpThreadPool || mpThreadPool->Size() == 0)
+    return g2o::BlockSolver<Traits>::buildSystem();
+
+  g2o::SparseOptimizer *optimizer = this->_optimizer;
+  const g2o::OptimizableGraph::EdgeContainer &vpEdges =
+      optimizer->activeEdges();
+  const int nEdges = vpEdges.size();
+  const int nVertices = optimizer->indexMapping().size();
+
+  // Slot layout and the edges of every free vertex
+  mvnSlotOffsets.resize(nEdges + 1);
+  mvnSlotDims.resize(nEdges);
+  mvnVertexEdgeBegin.assign(nVertices + 1, 0);
+  size_t nSlots = 0;
+  int nMaxScratch = 0;
+  for (int k = 0; k < nEdges; k++) {
+    g2o::OptimizableGraph::Edge *e = vpEdges[k];
+    int n = 0;
+    for (size_t i = 0; i < e->vertices().size(); i++) {
+      const g2o::OptimizableGraph::Vertex *v =
+          static_cast<const g2o::OptimizableGraph::Vertex *>(e->vertex(i));
+      n += v->dimension();
+      if (v->hessianIndex() >= 0)
+        mvnVertexEdgeBegin[v->hessianIndex() + 1]++;
+    }
+    mvnSlotOffsets[k] = nSlots;
+    mvnSlotDims[k] = n;
+    nSlots += n * n + n;
+    nMaxScratch = max(nMaxScratch, e->dimension() * n);
+  }
+  mvnSlotOffsets[nEdges] = nSlots;
+  mvSlots.resize(nSlots);
+
+  for (int i = 0; i < nVertices; i++)
+    mvnVertexEdgeBegin[i + 1] += mvnVertexEdgeBegin[i];
+  mvnVertexEdges.resize(mvnVertexEdgeBegin[nVertices]);
+  vector<int> vnFill(mvnVertexEdgeBegin.begin(), mvnVertexEdgeBegin.end() - 1);
+  for (int k = 0; k < nEdges; k++) {
+    g2o::OptimizableGraph::Edge *e = vpEdges[k];
+    for (size_t i = 0; i < e->vertices().size(); i++) {
+      const int iv = static_cast<const g2o::OptimizableGraph::Vertex *>(
+                         e->vertex(i))
+                         ->hessianIndex();
+      if (iv >= 0)
+        mvnVertexEdges[vnFill[iv]++] = k;
+    }
+  }
+
+  // Per edge terms. Jacobians live in a workspace private to each job.
+  const g2o::JacobianWorkspace &workspace = optimizer->jacobianWorkspace();
+  mpThreadPool->ParallelFor(
+      0, (nEdges + EDGE_BATCH - 1) / EDGE_BATCH, [&](int batch) {
+        g2o::JacobianWorkspace jobWorkspace = workspace;
+        vector<double> vScratch(nMaxScratch);
+        const int kend = min(nEdges, (batch + 1) * EDGE_BATCH);
+        for (int k = batch * EDGE_BATCH; k < kend; k++)
+          Linearize(vpEdges[k], jobWorkspace, vScratch.data(),
+                    &mvSlots[mvnSlotOffsets[k]]);
+      });
+
+  // Reduction into the system, one owner per block. Every free vertex copies
+  // its gradient over its segment of b, so b needs no clearing.
+  this->_Hpp->clear();
+  if (this->_doSchur) {
+    this->_Hll->clear();
+    this->_Hpl->clear();
+  }
+
+  mpThreadPool->ParallelFor(
+      0, (nVertices + VERTEX_BATCH - 1) / VERTEX_BATCH, [&](int batch) {
+        const int ivend = min(nVertices, (batch + 1) * VERTEX_BATCH);
+        for (int iv = batch * VERTEX_BATCH; iv < ivend; iv++)
+          Reduce(iv);
+      });
+
+  return true;
+}
+
+template <typename Traits>
+void ParallelBlockSolver<Traits>::Linearize(g2o::OptimizableGraph::Edge *e,
+                                            g2o::JacobianWorkspace &workspace,
+                                            double *pScratch,
+                                            double *pSlot) const {
+  e->linearizeOplus(workspace);
+
+  const int D = e->dimension();
+  const size_t nv = e->vertices().size();
+  int n = 0;
+  for (size_t i = 0; i < nv; i++)
+    n += static_cast<const g2o::OptimizableGraph::Vertex *>(e->vertex(i))
+             ->dimension();
+
+  // Huber (or any) kernel scales the information by its first derivative
+  double w = 1.0;
+  if (e->robustKernel()) {
+    g2o::Vector3 rho;
+    e->robustKernel()->robustify(e->chi2(), rho);
+    w = rho[1];
+  }
+
+  const ConstMatrixMap Omega(e->informationData(), D, D);
+  const Eigen::Map<const Eigen::VectorXd> error(e->errorData(), D);
+  MatrixMap WJ(pScratch, D, n);
+  MatrixMap H(pSlot, n, n);
+  Eigen::Map<Eigen::VectorXd> b(pSlot + n * n, n);
+
+  int c = 0;
+  for (size_t i = 0; i < nv; i++) {
+    const g2o::OptimizableGraph::Vertex *v =
+        static_cast<const g2o::OptimizableGraph::Vertex *>(e->vertex(i));
+    const int d = v->dimension();
+    if (v->hessianIndex() >= 0)
+      WJ.middleCols(c, d).noalias() =
+          w * Omega * ConstMatrixMap(workspace.workspaceForVertex(i), D, d);
+    c += d;
+  }
+
+  int r = 0;
+  for (size_t i = 0; i < nv; i++) {
+    const g2o::OptimizableGraph::Vertex *vi =
+        static_cast<const g2o::OptimizableGraph::Vertex *>(e->vertex(i));
+    const int di = vi->dimension();
+    if (vi->hessianIndex() >= 0) {
+      const ConstMatrixMap Ji(workspace.workspaceForVertex(i), D, di);
+      b.segment(r, di).noalias() = -WJ.middleCols(r, di).transpose() * error;
+
+      c = 0;
+      for (size_t j = 0; j < nv; j++) {
+        const g2o::OptimizableGraph::Vertex *vj =
+            static_cast<const g2o::OptimizableGraph::Vertex *>(e->vertex(j));
+        const int dj = vj->dimension();
+        if (vj->hessianIndex() >= 0)
+          H.block(r, c, di, dj).noalias() =
+              Ji.transpose() * WJ.middleCols(c, dj);
+        c += dj;
+      }
+    }
+    r += di;
+  }
+}
+
+template <typename Traits>
+void ParallelBlockSolver<Traits>::Reduce(const int iv) {
+  const g2o::OptimizableGraph::EdgeContainer &vpEdges =
+      this->_optimizer->activeEdges();
+  g2o::OptimizableGraph::Vertex *v = this->_optimizer->indexMapping()[iv];
+  const int dv = v->dimension();
+
+  MatrixMap Hvv(Block(iv, iv), dv, dv);
+  v->clearQuadraticForm();
+  Eigen::Map<Eigen::VectorXd> bv(v->bData(), dv);
+
+  for (int p = mvnVertexEdgeBegin[iv]; p < mvnVertexEdgeBegin[iv + 1]; p++) {
+    const int k = mvnVertexEdges[p];
+    g2o::OptimizableGraph::Edge *e = vpEdges[k];
+    const size_t nv = e->vertices().size();
+    const double *pSlot = &mvSlots[mvnSlotOffsets[k]];
+    const int n = mvnSlotDims[k];
+    const ConstMatrixMap H(pSlot, n, n);
+
+    // Columns of this vertex within the slot
+    int r = 0;
+    for (size_t i = 0; i < nv && e->vertex(i) != v; i++)
+      r += static_cast<const g2o::OptimizableGraph::Vertex *>(e->vertex(i))
+               ->dimension();
+
+    Hvv += H.block(r, r, dv, dv);
+    bv += Eigen::Map<const Eigen::VectorXd>(pSlot + n * n + r, dv);
+
+    int c = 0;
+    for (size_t j = 0; j < nv; j++) {
+      const g2o::OptimizableGraph::Vertex *u =
+          static_cast<const g2o::OptimizableGraph::Vertex *>(e->vertex(j));
+      const int du = u->dimension();
+      if (u->hessianIndex() > iv)
+        MatrixMap(Block(iv, u->hessianIndex()), dv, du) +=
+            H.block(r, c, dv, du);
+      c += du;
+    }
+  }
+
+  v->copyB(this->_b + v->colInHessian() +
+           (v->marginalized() ? this->_sizePoses : 0));
+}
+
+template <typename Traits>
+double *ParallelBlockSolver<Traits>::Block(const int i1, const int i2) const {
+  const int nPoses = this->_numPoses;
+  if (i2 < nPoses)
+    return this->_Hpp->block(i1, i2)->data();
+  if (i1 < nPoses)
+    return this->_Hpl->block(i1, i2 - nPoses)->data();
+  return this->_Hll->block(i1 - nPoses, i2 - nPoses)->data();
+}
+
+// Counterparts of g2o::BlockSolver_6_3 and g2o::BlockSolverX
+typedef ParallelBlockSolver<g2o::BlockSolverTraits<6, 3>>
+    ParallelBlockSolver_6_3;
+typedef ParallelBlockSolver<
+    g2o::BlockSolverTraits<Eigen::Dynamic, Eigen::Dynamic>>
+    ParallelBlockSolverX;
+
+} // namespace ORB_SLAM3
+
+#endif // PARALLELBLOCKSOLVER_H
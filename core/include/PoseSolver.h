@@ -0,0 +1,122 @@
+/**
+ * This file is part of ORB-SLAM3
+ *
+ * Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez
+ * Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+ * Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós,
+ * University of Zaragoza.
+ *
+ * ORB-SLAM3 is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ORB-SLAM3. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef POSESOLVER_H
+#define POSESOLVER_H
+
+#include <cstdint>
+#include <vector>
+
+#include <Eigen/Core>
+#include <sophus/se3.hpp>
+
+using namespace std;
+
+namespace ORB_SLAM3 {
+
+class Frame;
+class GeometricCamera;
+
+// Motion-only bundle adjustment of a frame pose against fixed 3D points, the
+// problem PoseOptimization used to hand to g2o. Observations are kept as a
+// structure of arrays per kind and the 6x6 normal equations live on the
+// stack, so no graph is built. Each iteration reproduces a step of g2o's
+// Levenberg-Marquardt on a VertexSE3Expmap (left-multiplied exponential
+// update, rotation first) with Huber weighted residuals.
+class PoseSolver {
+public:
+  // Kinds of observation, as the g2o edges they replace
+  enum Kind {
+    MONO = 0,   // left (or only) camera, EdgeSE3ProjectXYZOnlyPose
+    STEREO = 1, // rectified stereo, EdgeStereoSE3ProjectXYZOnlyPose
+    RIGHT = 2   // right camera of a rig, EdgeSE3ProjectXYZOnlyPoseToBody
+  };
+
+  // Takes the cameras, calibration and rig extrinsics of pFrame
+  PoseSolver(Frame *pFrame, const double deltaMono, const double deltaStereo);
+
+  // Observation of Xw at (u, v) (and ur for stereo), nIndex being the
+  // keypoint index reported back by Classify
+  void AddMono(const Eigen::Vector3d &Xw, const double u, const double v,
+               const double invSigma2, const int nIndex);
+  void AddStereo(const Eigen::Vector3d &Xw, const double u, const double v,
+                 const double ur, const double invSigma2, const int nIndex);
+  void AddRight(const Eigen::Vector3d &Xw, const double u, const double v,
+                const double invSigma2, const int nIndex);
+
+  size_t size() const;
+
+  // Huber weighting on (default) or off
+  void SetRobust(const bool bRobust) { mbRobust = bRobust; }
+
+  // Up to nIterations Levenberg-Marquardt iterations over the inliers,
+  // starting from Tcw
+  void Optimize(Sophus::SE3d &Tcw, const int nIterations) const;
+
+  // Computes the chi2 of every observation at Tcw, marks as outliers (for
+  // the next Optimize and in vbOutlier) those above the threshold of their
+  // kind and returns how many they are
+  int Classify(const Sophus::SE3d &Tcw, const double chi2Mono,
+               const double chi2Stereo, vector<bool> &vbOutlier);
+
+private:
+  struct Observations {
+    vector<double> vX, vY, vZ;
+    vector<double> vU, vV, vUr;
+    vector<double> vInvSigma2;
+    vector<uint8_t> vbInlier;
+    vector<int> vnIndex;
+
+    void Add(const Eigen::Vector3d &Xw, const double u, const double v,
+             const double ur, const double invSigma2, const int nIndex);
+    size_t size() const { return vX.size(); }
+  };
+
+  // Robust chi2 of the inliers at Tcw. If H and b are given, also the normal
+  // equations H dx = b of the linearization at Tcw.
+  double Evaluate(const Sophus::SE3d &Tcw, Eigen::Matrix<double, 6, 6> *H,
+                  Eigen::Matrix<double, 6, 1> *b) const;
+
+  // Residual of observation i of the given kind with the camera at (Rcw, tcw)
+  // and, if J is given, its Jacobian with respect to the pose update. The
+  // last row is zero unless the observation is stereo.
+  void Residual(const int kind, const size_t i, const Eigen::Matrix3d &Rcw,
+                const Eigen::Vector3d &tcw, Eigen::Vector3d &e,
+                Eigen::Matrix<double, 3, 6> *J) const;
+
+  Observations mObs[3];
+
+  // Left and right cameras and, for pinhole ones, their fx, fy, cx, cy so the
+  // projection is inlined instead of going through a virtual call
+  GeometricCamera *mpCameras[2];
+  bool mbPinhole[2];
+  double mK[2][4];
+  Sophus::SE3d mTrl;
+
+  // Rectified stereo calibration
+  double mfx, mfy, mcx, mcy, mbf;
+
+  double mDeltaMono, mDeltaStereo;
+  bool mbRobust;
+};
+
+} // namespace ORB_SLAM3
+
+#endif // POSESOLVER_H
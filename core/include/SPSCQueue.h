@@ -0,0 +1,135 @@
+/**
+ * This file is part of ORB-SLAM3
+ *
+ * Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez
+ * Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+ * Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós,
+ * University of Zaragoza.
+ *
+ * ORB-SLAM3 is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ORB-SLAM3. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+using namespace std;
+
+namespace ORB_SLAM3 {
+
+// Bounded lock-free ring for handing items from exactly one producer thread to
+// exactly one consumer thread. Push and pop never block: a full ring rejects
+// the push and leaves the backpressure policy to the caller.
+//
+// The consumer side (TryPop, Clear) may be used from another thread as long
+// as that thread is ordered with the consumer by some other synchronization,
+// e.g. while the consumer thread is known to be stopped. The same holds for
+// the producer side.
+template <class T> class SPSCQueue {
+public:
+  // The capacity is rounded up to a power of two
+  explicit SPSCQueue(const size_t capacity)
+      : mHead(0), mTail(0), mHeadCache(0), mTailCache(0), mMaxSize(0),
+        mnRejected(0) {
+    size_t n = 1;
+    while (n < capacity)
+      n <<= 1;
+    mvBuffer.resize(n);
+    mMask = n - 1;
+  }
+
+  SPSCQueue(const SPSCQueue &) = delete;
+  SPSCQueue &operator=(const SPSCQueue &) = delete;
+
+  size_t Capacity() const { return mvBuffer.size(); }
+
+  // Producer side. Returns false (and counts the rejection) if the ring is
+  // full.
+  bool TryPush(const T &item) {
+    const size_t tail = mTail.load(memory_order_relaxed);
+    if (tail - mHeadCache == mvBuffer.size()) {
+      mHeadCache = mHead.load(memory_order_acquire);
+      if (tail - mHeadCache == mvBuffer.size()) {
+        mnRejected.fetch_add(1, memory_order_relaxed);
+        return false;
+      }
+    }
+    mvBuffer[tail & mMask] = item;
+    mTail.store(tail + 1, memory_order_release);
+
+    const size_t size = tail + 1 - mHead.load(memory_order_relaxed);
+    if (size > mMaxSize.load(memory_order_relaxed))
+      mMaxSize.store(size, memory_order_relaxed);
+    return true;
+  }
+
+  // Consumer side. Returns false if the ring is empty.
+  bool TryPop(T &item) {
+    const size_t head = mHead.load(memory_order_relaxed);
+    if (head == mTailCache) {
+      mTailCache = mTail.load(memory_order_acquire);
+      if (head == mTailCache)
+        return false;
+    }
+    item = mvBuffer[head & mMask];
+    mHead.store(head + 1, memory_order_release);
+    return true;
+  }
+
+  // Consumer side. Drops every queued item.
+  void Clear() {
+    T item;
+    while (TryPop(item))
+      ;
+  }
+
+  // Safe from any thread. The result is a snapshot and may be stale by the
+  // time it is used.
+  bool Empty() const {
+    return mHead.load(memory_order_acquire) == mTail.load(memory_order_acquire);
+  }
+
+  size_t Size() const {
+    // Head first: it never overtakes the tail read after it
+    const size_t head = mHead.load(memory_order_acquire);
+    const size_t tail = mTail.load(memory_order_acquire);
+    const size_t size = tail - head;
+    return size < mvBuffer.size() ? size : mvBuffer.size();
+  }
+
+  // Queue depth counters: deepest the ring has been and number of rejected
+  // pushes since construction
+  size_t MaxSize() const { return mMaxSize.load(memory_order_relaxed); }
+  size_t Rejected() const { return mnRejected.load(memory_order_relaxed); }
+
+private:
+  vector<T> mvBuffer;
+  size_t mMask;
+
+  // Head is written by the consumer and tail by the producer. Each side keeps
+  // a cached copy of the other index, so the shared cache line is only read
+  // when the ring looks full (producer) or empty (consumer).
+  alignas(64) atomic<size_t> mHead;
+  alignas(64) atomic<size_t> mTail;
+  alignas(64) size_t mHeadCache;
+  alignas(64) size_t mTailCache;
+
+  atomic<size_t> mMaxSize;
+  atomic<size_t> mnRejected;
+};
+
+} // namespace ORB_SLAM3
+
+#endif // SPSCQUEUE_H
@@ -34,6 +34,8 @@ using namespace std;
 
 #include <vector>
 
+#include "ORB/descriptors.h"
+
 namespace ORB_SLAM3 {
 
 template <class Archive>
@@ -117,6 +119,20 @@ void serializeMatrix(Archive &ar, const cv::Mat &mat,
   }
 }
 
+template <class Archive>
+void serializeMatrix(Archive &ar, const DescriptorBlock &desc,
+                     const unsigned int version) {
+  cv::Mat matAux = desc.mat();
+
+  serializeMatrix(ar, matAux, version);
+
+  if (Archive::is_loading::value) {
+    DescriptorBlock *ptr;
+    ptr = (DescriptorBlock *)(&desc);
+    *ptr = matAux;
+  }
+}
+
 template <class Archive>
 void serializeVectorKeyPoints(Archive &ar, const vector<cv::KeyPoint> &vKP,
                               const unsigned int version) {
@@ -105,6 +105,8 @@ public:
   float initThFAST() { return initThFAST_; }
   float minThFAST() { return minThFAST_; }
   float scaleFactor() { return scaleFactor_; }
+  int extractorThreads() { return extractorThreads_; }
+  vector<int> extractorAffinity() { return vExtractorAffinity_; }
 
   float keyFrameSize() { return keyFrameSize_; }
   float keyFrameLineWidth() { return keyFrameLineWidth_; }
@@ -122,6 +124,8 @@ public:
   string atlasSaveFile() { return sSaveto_; }
 
   float thFarPoints() { return thFarPoints_; }
+  float relocTimeBudget() { return relocTimeBudget_; }
+  int mappingThreads() { return mappingThreads_; }
 
   cv::Mat M1l() { return M1l_; }
   cv::Mat M2l() { return M2l_; }
@@ -211,6 +215,8 @@ private:
   float scaleFactor_;
   int nLevels_;
   int initThFAST_, minThFAST_;
+  int extractorThreads_;
+  vector<int> vExtractorAffinity_;
 
   /*
    * Viewer stuff
@@ -233,6 +239,8 @@ private:
    * Other stuff
    */
   float thFarPoints_;
+  float relocTimeBudget_;
+  int mappingThreads_;
 };
 }; // namespace ORB_SLAM3
 
@@ -0,0 +1,80 @@
+/**
+ * This file is part of ORB-SLAM3
+ *
+ * Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez
+ * Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+ * Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós,
+ * University of Zaragoza.
+ *
+ * ORB-SLAM3 is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ORB-SLAM3. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace ORB_SLAM3 {
+
+// Fixed set of worker threads fed from a FIFO job queue. Workers are created
+// once and live as long as the pool, so per-frame work does not pay for
+// thread creation.
+class ThreadPool {
+public:
+  // nThreads worker threads are spawned (none if nThreads <= 0, in which case
+  // every job runs on the calling thread). If vCpus is not empty, worker i is
+  // pinned to CPU vCpus[i % vCpus.size()].
+  ThreadPool(const int nThreads, const vector<int> &vCpus = vector<int>());
+
+  // Finishes the queued jobs and joins the workers
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  int Size() const { return (int)mvWorkers.size(); }
+
+  // Queues a job. The future becomes ready once the job has run.
+  future<void> Submit(function<void()> job);
+
+  // Calls f(i) for every i in [begin, end). The caller processes items too and
+  // returns as soon as all of them are done, so ParallelFor can be used from
+  // inside a job of the same pool without deadlocking. The order in which
+  // items run is unspecified: results must be written to slots owned by i.
+  void ParallelFor(const int begin, const int end,
+                   const function<void(int)> &f);
+
+private:
+  void Run();
+
+  // Restricts worker i to one CPU. Returns false if it could not be done.
+  bool PinWorker(const int i, const int cpu);
+
+  vector<thread> mvWorkers;
+
+  deque<function<void()>> mqJobs;
+  mutex mMutexJobs;
+  condition_variable mcvJobs;
+  bool mbStop;
+};
+
+} // namespace ORB_SLAM3
+
+#endif // THREADPOOL_H
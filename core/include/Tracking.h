@@ -31,6 +31,8 @@ using namespace std;
 #include "FrameDrawer.h"
 #include "ImuTypes.h"
 #include "KeyFrameDatabase.h"
+#include "LocalMapCache.h"
+#include "LocalMapPoints.h"
 #include "LocalMapping.h"
 #include "LoopClosing.h"
 #include "MapDrawer.h"
@@ -39,10 +41,12 @@ using namespace std;
 #include "ORB_SLAM3.h"
 #include "Settings.h"
 #include "System.h"
+#include "ThreadPool.h"
 #include "Viewer.h"
 
 #include "CameraModels/GeometricCamera.h"
 
+#include <functional>
 #include <mutex>
 #include <sstream>
 
@@ -229,6 +233,11 @@ protected:
   bool PredictStateIMU();
 
   bool Relocalization();
+  // Match the current frame against one relocalization candidate and look for
+  // a pose supported by enough inliers, working on "frame". Gives up as soon
+  // as bCancelled returns true.
+  bool RelocalizeWithCandidate(KeyFrame *pKF, Frame &frame,
+                               const function<bool()> &bCancelled);
 
   void UpdateLocalMap();
   void UpdateLocalPoints();
@@ -280,9 +289,13 @@ protected:
   ORBextractor *mpORBextractorLeft, *mpORBextractorRight;
   ORBextractor *mpIniORBextractor;
 
+  // Worker threads shared by the extractors
+  ThreadPool *mpExtractorPool;
+
   // BoW
   ORBVocabulary *mpORBVocabulary;
   KeyFrameDatabase *mpKeyFrameDB;
+  KeyFrameDatabase::QueryContext mRelocQuery;
 
   // Initalization (only for monocular)
   bool mbReadyToInitialize;
@@ -292,6 +305,14 @@ protected:
   KeyFrame *mpReferenceKF;
   vector<KeyFrame *> mvpLocalKeyFrames;
   vector<MapPoint *> mvpLocalMapPoints;
+  // Votes and points carried over between frames, for the map it was filled
+  // from
+  LocalMapCache mLocalMapCache;
+  Map *mpLocalMapCacheMap;
+  // Frustum test of the local map against the current frame (left and right
+  // cameras), kept as members to reuse their buffers
+  LocalMapPoints mLocalMapPoints;
+  LocalMapPoints::View mLocalMapView, mLocalMapViewR;
 
   // System
   System *mpSystem;
@@ -340,6 +361,8 @@ protected:
   KeyFrame *mpLastKeyFrame;
   unsigned int mnLastKeyFrameId;
   unsigned int mnLastRelocFrameId;
+  // Time allowed to a relocalization attempt in ms, 0 for no limit
+  float mRelocTimeBudget;
   double mTimeStampLost;
   double time_recently_lost;
 
@@ -29,6 +29,7 @@ using namespace std;
 #include "System.h"
 #include "Tracking.h"
 
+#include <condition_variable>
 #include <mutex>
 
 namespace ORB_SLAM3 {
@@ -60,6 +61,9 @@ public:
 
   bool isStopped();
 
+  // Block until the viewer has stopped
+  void WaitUntilStopped();
+
   bool isStepByStep();
 
   void Release();
@@ -94,6 +98,7 @@ private:
   bool mbStopped;
   bool mbStopRequested;
   mutex mMutexStop;
+  condition_variable mcvStop;
 
   bool mbStopTrack;
 };
@@ -0,0 +1,58 @@
+/**
+ * This file is part of ORB-SLAM3
+ *
+ * Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez
+ * Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+ * Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós,
+ * University of Zaragoza.
+ *
+ * ORB-SLAM3 is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ORB-SLAM3. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ORB/descriptors.h"
+
+namespace ORB_SLAM3 {
+
+// Alignment required by the widest (AVX2) single descriptor load
+static const size_t DESCRIPTOR_ALIGN = 32;
+
+void DescriptorBlock::Assign(const cv::Mat &descriptors) {
+  if (descriptors.empty()) {
+    mMat = cv::Mat();
+    mpData = NULL;
+    mN = 0;
+    return;
+  }
+
+  CV_Assert(descriptors.type() == CV_8UC1 &&
+            descriptors.cols == (int)Hamming::DESCRIPTOR_BYTES);
+
+  if (descriptors.isContinuous() &&
+      reinterpret_cast<uintptr_t>(descriptors.data) % DESCRIPTOR_ALIGN == 0) {
+    mMat = descriptors;
+  } else {
+    // cv::Mat buffers are allocated with CV_MALLOC_ALIGN (>= 32) alignment
+    cv::Mat aligned(descriptors.rows, descriptors.cols, CV_8UC1);
+    descriptors.copyTo(aligned);
+    mMat = aligned;
+  }
+
+  mpData = mMat.data;
+  mN = mMat.rows;
+}
+
+DescriptorBlock DescriptorBlock::clone() const {
+  return DescriptorBlock(mMat.clone());
+}
+
+} // namespace ORB_SLAM3
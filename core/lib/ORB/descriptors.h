@@ -0,0 +1,79 @@
+/**
+ * This file is part of ORB-SLAM3
+ *
+ * Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez
+ * Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+ * Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós,
+ * University of Zaragoza.
+ *
+ * ORB-SLAM3 is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ORB-SLAM3. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ORBDESCRIPTORS_H
+#define ORBDESCRIPTORS_H
+
+#include <cstdint>
+
+#include <opencv2/core/core.hpp>
+
+#include "ORB/hamming.h"
+
+namespace ORB_SLAM3 {
+
+// Packed block of ORB descriptors, one 256 bit descriptor per row, stored
+// contiguously and 32 byte aligned so the Hamming kernels can load rows
+// directly. The storage is a continuous CV_8U Nx32 cv::Mat, so it is shared
+// (not copied) with code that still works on cv::Mat, and like cv::Mat a copy
+// of the block shares its data: use clone() for a deep copy.
+class DescriptorBlock {
+public:
+  DescriptorBlock() : mpData(NULL), mN(0) {}
+
+  // Wraps the matrix when it is already continuous and aligned, otherwise
+  // copies it into an aligned one.
+  DescriptorBlock(const cv::Mat &descriptors) { Assign(descriptors); }
+
+  DescriptorBlock &operator=(const cv::Mat &descriptors) {
+    Assign(descriptors);
+    return *this;
+  }
+
+  // Pointer to the i-th descriptor, no cv::Mat header involved
+  inline const uint8_t *At(size_t i) const {
+    return mpData + i * Hamming::DESCRIPTOR_BYTES;
+  }
+
+  inline const uint8_t *data() const { return mpData; }
+  inline size_t size() const { return mN; }
+  inline bool empty() const { return mN == 0; }
+
+  // Zero-copy cv::Mat views
+  inline const cv::Mat &mat() const { return mMat; }
+  inline operator const cv::Mat &() const { return mMat; }
+  inline cv::Mat row(int i) const { return mMat.row(i); }
+  inline cv::Mat rowRange(int startrow, int endrow) const {
+    return mMat.rowRange(startrow, endrow);
+  }
+
+  DescriptorBlock clone() const;
+
+private:
+  void Assign(const cv::Mat &descriptors);
+
+  cv::Mat mMat;
+  const uint8_t *mpData;
+  size_t mN;
+};
+
+} // namespace ORB_SLAM3
+
+#endif // ORBDESCRIPTORS_H
@@ -54,6 +54,7 @@
  *
  */
 
+#include <cstring>
 #include <iostream>
 #include <opencv2/core/core.hpp>
 #include <opencv2/features2d/features2d.hpp>
@@ -62,6 +63,8 @@
 #include <vector>
 
 #include "ORB/extractor.h"
+#include "ORB/kernels.h"
+#include "ThreadPool.h"
 
 using namespace cv;
 using namespace std;
@@ -73,75 +76,36 @@ const int HALF_PATCH_SIZE = 15;
 const int EDGE_THRESHOLD = 19;
 
 static float IC_Angle(const Mat &image, Point2f pt, const vector<int> &u_max) {
-  int m_01 = 0, m_10 = 0;
+  int m_01, m_10;
 
   const uchar *center = &image.at<uchar>(cvRound(pt.y), cvRound(pt.x));
-
-  // Treat the center line differently, v=0
-  for (int u = -HALF_PATCH_SIZE; u <= HALF_PATCH_SIZE; ++u)
-    m_10 += u * center[u];
-
-  // Go line by line in the circuI853lar patch
-  int step = (int)image.step1();
-  for (int v = 1; v <= HALF_PATCH_SIZE; ++v) {
-    // Proceed over the two lines
-    int v_sum = 0;
-    int d = u_max[v];
-    for (int u = -d; u <= d; ++u) {
-      int val_plus = center[u + v * step], val_minus = center[u - v * step];
-      v_sum += (val_plus - val_minus);
-      m_10 += u * (val_plus + val_minus);
-    }
-    m_01 += v * v_sum;
-  }
+  ORBKernels::PatchMoments(center, (int)image.step1(), &u_max[0], m_01, m_10);
 
   return fastAtan2((float)m_01, (float)m_10);
 }
 
 const float factorPI = (float)(CV_PI / 180.f);
 static void computeOrbDescriptor(const KeyPoint &kpt, const Mat &img,
-                                 const Point *pattern, uchar *desc) {
+                                 const float *patternX, const float *patternY,
+                                 uchar *desc) {
   float angle = (float)kpt.angle * factorPI;
   float a = (float)cos(angle), b = (float)sin(angle);
 
   const uchar *center = &img.at<uchar>(cvRound(kpt.pt.y), cvRound(kpt.pt.x));
   const int step = (int)img.step;
 
-#define GET_VALUE(idx)                                                         \
-  center[cvRound(pattern[idx].x * b + pattern[idx].y * a) * step +             \
-         cvRound(pattern[idx].x * a - pattern[idx].y * b)]
-
-  for (int i = 0; i < 32; ++i, pattern += 16) {
-    int t0, t1, val;
-    t0 = GET_VALUE(0);
-    t1 = GET_VALUE(1);
-    val = t0 < t1;
-    t0 = GET_VALUE(2);
-    t1 = GET_VALUE(3);
-    val |= (t0 < t1) << 1;
-    t0 = GET_VALUE(4);
-    t1 = GET_VALUE(5);
-    val |= (t0 < t1) << 2;
-    t0 = GET_VALUE(6);
-    t1 = GET_VALUE(7);
-    val |= (t0 < t1) << 3;
-    t0 = GET_VALUE(8);
-    t1 = GET_VALUE(9);
-    val |= (t0 < t1) << 4;
-    t0 = GET_VALUE(10);
-    t1 = GET_VALUE(11);
-    val |= (t0 < t1) << 5;
-    t0 = GET_VALUE(12);
-    t1 = GET_VALUE(13);
-    val |= (t0 < t1) << 6;
-    t0 = GET_VALUE(14);
-    t1 = GET_VALUE(15);
-    val |= (t0 < t1) << 7;
+  // Offsets of the 256 rotated point pairs, computed in one batch
+  int offsets[512];
+  ORBKernels::RotatedOffsets(patternX, patternY, 512, a, b, step, offsets);
+
+  const int *pair = offsets;
+  for (int i = 0; i < 32; ++i) {
+    int val = 0;
+    for (int j = 0; j < 8; ++j, pair += 2)
+      val |= (center[pair[0]] < center[pair[1]]) << j;
 
     desc[i] = (uchar)val;
   }
-
-#undef GET_VALUE
 }
 
 static int bit_pattern_31_[256 * 4] = {
@@ -406,7 +370,7 @@ static int bit_pattern_31_[256 * 4] = {
 ORBextractor::ORBextractor(int _nfeatures, float _scaleFactor, int _nlevels,
                            int _iniThFAST, int _minThFAST)
     : nfeatures(_nfeatures), scaleFactor(_scaleFactor), nlevels(_nlevels),
-      iniThFAST(_iniThFAST), minThFAST(_minThFAST) {
+      iniThFAST(_iniThFAST), minThFAST(_minThFAST), mpThreadPool(nullptr) {
   mvScaleFactor.resize(nlevels);
   mvLevelSigma2.resize(nlevels);
   mvScaleFactor[0] = 1.0f;
@@ -424,6 +388,9 @@ ORBextractor::ORBextractor(int _nfeatures, float _scaleFactor, int _nlevels,
   }
 
   mvImagePyramid.resize(nlevels);
+  mvPyramidBuffer.resize(nlevels);
+  mvBlurredPyramid.resize(nlevels);
+  mvOctTrees.resize(nlevels);
 
   mnFeaturesPerLevel.resize(nlevels);
   float factor = 1.0f / scaleFactor;
@@ -443,6 +410,14 @@ ORBextractor::ORBextractor(int _nfeatures, float _scaleFactor, int _nlevels,
   const Point *pattern0 = (const Point *)bit_pattern_31_;
   copy(pattern0, pattern0 + npoints, back_inserter(pattern));
 
+  // Same points as floats, in the layout read by the descriptor kernel
+  mvPatternX.resize(npoints);
+  mvPatternY.resize(npoints);
+  for (int i = 0; i < npoints; i++) {
+    mvPatternX[i] = (float)pattern[i].x;
+    mvPatternY[i] = (float)pattern[i].y;
+  }
+
   // This is for orientation
   //  pre-compute the end of a row in a circular patch
   umax.resize(HALF_PATCH_SIZE + 1);
@@ -471,387 +446,343 @@ static void computeOrientation(const Mat &image, vector<KeyPoint> &keypoints,
   }
 }
 
-void ExtractorNode::DivideNode(ExtractorNode &n1, ExtractorNode &n2,
-                               ExtractorNode &n3, ExtractorNode &n4) {
-  const int halfX = ceil(static_cast<float>(UR.x - UL.x) / 2);
-  const int halfY = ceil(static_cast<float>(BR.y - UL.y) / 2);
-
-  // Define boundaries of childs
-  n1.UL = UL;
-  n1.UR = cv::Point2i(UL.x + halfX, UL.y);
-  n1.BL = cv::Point2i(UL.x, UL.y + halfY);
-  n1.BR = cv::Point2i(UL.x + halfX, UL.y + halfY);
-  n1.vKeys.reserve(vKeys.size());
-
-  n2.UL = n1.UR;
-  n2.UR = UR;
-  n2.BL = n1.BR;
-  n2.BR = cv::Point2i(UR.x, UL.y + halfY);
-  n2.vKeys.reserve(vKeys.size());
-
-  n3.UL = n1.BL;
-  n3.UR = n1.BR;
-  n3.BL = BL;
-  n3.BR = cv::Point2i(n1.BR.x, BL.y);
-  n3.vKeys.reserve(vKeys.size());
-
-  n4.UL = n3.UR;
-  n4.UR = n2.BR;
-  n4.BL = n3.BR;
-  n4.BR = BR;
-  n4.vKeys.reserve(vKeys.size());
-
-  // Associate points to childs
-  for (size_t i = 0; i < vKeys.size(); i++) {
-    const cv::KeyPoint &kp = vKeys[i];
-    if (kp.pt.x < n1.UR.x) {
-      if (kp.pt.y < n1.BR.y)
-        n1.vKeys.push_back(kp);
-      else
-        n3.vKeys.push_back(kp);
-    } else if (kp.pt.y < n1.BR.y)
-      n2.vKeys.push_back(kp);
-    else
-      n4.vKeys.push_back(kp);
-  }
+void OctTree::PushFront(const int node) {
+  Node &n = mvNodes[node];
+  n.prev = -1;
+  n.next = mHead;
+  if (mHead >= 0)
+    mvNodes[mHead].prev = node;
+  mHead = node;
+  mnNodes++;
+}
 
-  if (n1.vKeys.size() == 1)
-    n1.bNoMore = true;
-  if (n2.vKeys.size() == 1)
-    n2.bNoMore = true;
-  if (n3.vKeys.size() == 1)
-    n3.bNoMore = true;
-  if (n4.vKeys.size() == 1)
-    n4.bNoMore = true;
+int OctTree::Erase(const int node) {
+  const Node &n = mvNodes[node];
+  if (n.prev >= 0)
+    mvNodes[n.prev].next = n.next;
+  else
+    mHead = n.next;
+  if (n.next >= 0)
+    mvNodes[n.next].prev = n.prev;
+  mnNodes--;
+  return n.next;
 }
 
-static bool compareNodes(pair<int, ExtractorNode *> &e1,
-                         pair<int, ExtractorNode *> &e2) {
-  if (e1.first < e2.first) {
-    return true;
-  } else if (e1.first > e2.first) {
-    return false;
-  } else {
-    if (e1.second->UL.x < e2.second->UL.x) {
-      return true;
-    } else {
-      return false;
-    }
+void OctTree::Divide(const int node, vector<pair<int, int>> &vToExpand) {
+  const Node parent = mvNodes[node];
+  const vector<cv::KeyPoint> &vKeys = *mpKeys;
+
+  const int halfX = ceil(static_cast<float>(parent.maxX - parent.minX) / 2);
+  const int halfY = ceil(static_cast<float>(parent.maxY - parent.minY) / 2);
+  const int midX = parent.minX + halfX;
+  const int midY = parent.minY + halfY;
+
+  // Stable partition of the parent range into the four children: upper left,
+  // upper right, bottom left and bottom right
+  auto quadrant = [&](const int idx) {
+    const cv::KeyPoint &kp = vKeys[idx];
+    return (kp.pt.x < midX ? 0 : 1) + (kp.pt.y < midY ? 0 : 2);
+  };
+
+  int count[4] = {0, 0, 0, 0};
+  for (int k = parent.begin; k < parent.end; k++) {
+    mvScratch[k] = mvKeyIndices[k];
+    count[quadrant(mvScratch[k])]++;
   }
-}
 
-vector<cv::KeyPoint>
-ORBextractor::DistributeOctTree(const vector<cv::KeyPoint> &vToDistributeKeys,
-                                const int &minX, const int &maxX,
-                                const int &minY, const int &maxY, const int &N,
-                                const int &level) {
-  // Compute how many initial nodes
-  const int nIni = round(static_cast<float>(maxX - minX) / (maxY - minY));
+  int start[5];
+  start[0] = parent.begin;
+  for (int c = 0; c < 4; c++)
+    start[c + 1] = start[c] + count[c];
 
-  const float hX = static_cast<float>(maxX - minX) / nIni;
+  int fill[4] = {start[0], start[1], start[2], start[3]};
+  for (int k = parent.begin; k < parent.end; k++)
+    mvKeyIndices[fill[quadrant(mvScratch[k])]++] = mvScratch[k];
 
-  list<ExtractorNode> lNodes;
+  const int minX[4] = {parent.minX, midX, parent.minX, midX};
+  const int maxX[4] = {midX, parent.maxX, midX, parent.maxX};
+  const int minY[4] = {parent.minY, parent.minY, midY, midY};
+  const int maxY[4] = {midY, midY, parent.maxY, parent.maxY};
 
-  vector<ExtractorNode *> vpIniNodes;
-  vpIniNodes.resize(nIni);
+  // Add childs if they contain points
+  for (int c = 0; c < 4; c++) {
+    if (count[c] == 0)
+      continue;
 
-  for (int i = 0; i < nIni; i++) {
-    ExtractorNode ni;
-    ni.UL = cv::Point2i(hX * static_cast<float>(i), 0);
-    ni.UR = cv::Point2i(hX * static_cast<float>(i + 1), 0);
-    ni.BL = cv::Point2i(ni.UL.x, maxY - minY);
-    ni.BR = cv::Point2i(ni.UR.x, maxY - minY);
-    ni.vKeys.reserve(vToDistributeKeys.size());
-
-    lNodes.push_back(ni);
-    vpIniNodes[i] = &lNodes.back();
+    Node child;
+    child.minX = minX[c];
+    child.maxX = maxX[c];
+    child.minY = minY[c];
+    child.maxY = maxY[c];
+    child.begin = start[c];
+    child.end = start[c + 1];
+    child.bNoMore = count[c] == 1;
+    mvNodes.push_back(child);
+
+    const int idx = mvNodes.size() - 1;
+    PushFront(idx);
+    if (count[c] > 1)
+      vToExpand.push_back(make_pair(count[c], idx));
   }
+}
 
-  // Associate points to childs
-  for (size_t i = 0; i < vToDistributeKeys.size(); i++) {
-    const cv::KeyPoint &kp = vToDistributeKeys[i];
-    vpIniNodes[kp.pt.x / hX]->vKeys.push_back(kp);
-  }
+void OctTree::Distribute(const vector<cv::KeyPoint> &vKeys, const int width,
+                         const int height, const int N,
+                         vector<cv::KeyPoint> &vResultKeys) {
+  mpKeys = &vKeys;
+  mvNodes.clear();
+  mHead = -1;
+  mnNodes = 0;
 
-  list<ExtractorNode>::iterator lit = lNodes.begin();
+  // Compute how many initial nodes
+  const int nIni = round(static_cast<float>(width) / height);
 
-  while (lit != lNodes.end()) {
-    if (lit->vKeys.size() == 1) {
-      lit->bNoMore = true;
-      lit++;
-    } else if (lit->vKeys.empty())
-      lit = lNodes.erase(lit);
-    else
-      lit++;
-  }
+  const float hX = static_cast<float>(width) / nIni;
 
-  bool bFinish = false;
+  // Associate points to the initial nodes, keeping their order
+  const int nKeys = vKeys.size();
+  mvKeyIndices.resize(nKeys);
+  mvScratch.resize(nKeys);
 
-  int iteration = 0;
+  vector<int> &vIniNode = mvScratch;
+  mvIniStart.assign(nIni + 1, 0);
+  for (int i = 0; i < nKeys; i++) {
+    vIniNode[i] = vKeys[i].pt.x / hX;
+    mvIniStart[vIniNode[i] + 1]++;
+  }
+  for (int i = 0; i < nIni; i++)
+    mvIniStart[i + 1] += mvIniStart[i];
 
-  vector<pair<int, ExtractorNode *>> vSizeAndPointerToNode;
-  vSizeAndPointerToNode.reserve(lNodes.size() * 4);
+  mvNodes.resize(nIni);
+  for (int i = 0; i < nIni; i++) {
+    Node &ni = mvNodes[i];
+    ni.minX = hX * static_cast<float>(i);
+    ni.maxX = hX * static_cast<float>(i + 1);
+    ni.minY = 0;
+    ni.maxY = height;
+    ni.begin = mvIniStart[i];
+    ni.end = mvIniStart[i];
+  }
+  for (int i = 0; i < nKeys; i++)
+    mvKeyIndices[mvNodes[vIniNode[i]].end++] = i;
 
-  while (!bFinish) {
-    iteration++;
+  // Chain the non-empty ones in order
+  for (int i = nIni - 1; i >= 0; i--) {
+    Node &ni = mvNodes[i];
+    if (ni.Size() == 0)
+      continue;
+    ni.bNoMore = ni.Size() == 1;
+    PushFront(i);
+  }
 
-    int prevSize = lNodes.size();
+  bool bFinish = false;
 
-    lit = lNodes.begin();
+  while (!bFinish) {
+    int prevSize = mnNodes;
 
     int nToExpand = 0;
+    mvToExpand.clear();
 
-    vSizeAndPointerToNode.clear();
-
-    while (lit != lNodes.end()) {
-      if (lit->bNoMore) {
-        // If node only contains one point do not subdivide and continue
-        lit++;
-        continue;
-      } else {
-        // If more than one point, subdivide
-        ExtractorNode n1, n2, n3, n4;
-        lit->DivideNode(n1, n2, n3, n4);
-
-        // Add childs if they contain points
-        if (n1.vKeys.size() > 0) {
-          lNodes.push_front(n1);
-          if (n1.vKeys.size() > 1) {
-            nToExpand++;
-            vSizeAndPointerToNode.push_back(
-                make_pair(n1.vKeys.size(), &lNodes.front()));
-            lNodes.front().lit = lNodes.begin();
-          }
-        }
-        if (n2.vKeys.size() > 0) {
-          lNodes.push_front(n2);
-          if (n2.vKeys.size() > 1) {
-            nToExpand++;
-            vSizeAndPointerToNode.push_back(
-                make_pair(n2.vKeys.size(), &lNodes.front()));
-            lNodes.front().lit = lNodes.begin();
-          }
-        }
-        if (n3.vKeys.size() > 0) {
-          lNodes.push_front(n3);
-          if (n3.vKeys.size() > 1) {
-            nToExpand++;
-            vSizeAndPointerToNode.push_back(
-                make_pair(n3.vKeys.size(), &lNodes.front()));
-            lNodes.front().lit = lNodes.begin();
-          }
-        }
-        if (n4.vKeys.size() > 0) {
-          lNodes.push_front(n4);
-          if (n4.vKeys.size() > 1) {
-            nToExpand++;
-            vSizeAndPointerToNode.push_back(
-                make_pair(n4.vKeys.size(), &lNodes.front()));
-            lNodes.front().lit = lNodes.begin();
-          }
-        }
-
-        lit = lNodes.erase(lit);
+    // If more than one point, subdivide
+    int node = mHead;
+    while (node >= 0) {
+      if (mvNodes[node].bNoMore) {
+        node = mvNodes[node].next;
         continue;
       }
+
+      const size_t prevToExpand = mvToExpand.size();
+      Divide(node, mvToExpand);
+      nToExpand += mvToExpand.size() - prevToExpand;
+      node = Erase(node);
     }
 
     // Finish if there are more nodes than required features
     // or all nodes contain just one point
-    if ((int)lNodes.size() >= N || (int)lNodes.size() == prevSize) {
+    if (mnNodes >= N || mnNodes == prevSize) {
       bFinish = true;
-    } else if (((int)lNodes.size() + nToExpand * 3) > N) {
-
+    } else if ((mnNodes + nToExpand * 3) > N) {
+      // Close to N: split the largest nodes first
       while (!bFinish) {
+        prevSize = mnNodes;
 
-        prevSize = lNodes.size();
-
-        vector<pair<int, ExtractorNode *>> vPrevSizeAndPointerToNode =
-            vSizeAndPointerToNode;
-        vSizeAndPointerToNode.clear();
-
-        sort(vPrevSizeAndPointerToNode.begin(), vPrevSizeAndPointerToNode.end(),
-             compareNodes);
-        for (int j = vPrevSizeAndPointerToNode.size() - 1; j >= 0; j--) {
-          ExtractorNode n1, n2, n3, n4;
-          vPrevSizeAndPointerToNode[j].second->DivideNode(n1, n2, n3, n4);
-
-          // Add childs if they contain points
-          if (n1.vKeys.size() > 0) {
-            lNodes.push_front(n1);
-            if (n1.vKeys.size() > 1) {
-              vSizeAndPointerToNode.push_back(
-                  make_pair(n1.vKeys.size(), &lNodes.front()));
-              lNodes.front().lit = lNodes.begin();
-            }
-          }
-          if (n2.vKeys.size() > 0) {
-            lNodes.push_front(n2);
-            if (n2.vKeys.size() > 1) {
-              vSizeAndPointerToNode.push_back(
-                  make_pair(n2.vKeys.size(), &lNodes.front()));
-              lNodes.front().lit = lNodes.begin();
-            }
-          }
-          if (n3.vKeys.size() > 0) {
-            lNodes.push_front(n3);
-            if (n3.vKeys.size() > 1) {
-              vSizeAndPointerToNode.push_back(
-                  make_pair(n3.vKeys.size(), &lNodes.front()));
-              lNodes.front().lit = lNodes.begin();
-            }
-          }
-          if (n4.vKeys.size() > 0) {
-            lNodes.push_front(n4);
-            if (n4.vKeys.size() > 1) {
-              vSizeAndPointerToNode.push_back(
-                  make_pair(n4.vKeys.size(), &lNodes.front()));
-              lNodes.front().lit = lNodes.begin();
-            }
-          }
+        mvPrevToExpand.swap(mvToExpand);
+        mvToExpand.clear();
 
-          lNodes.erase(vPrevSizeAndPointerToNode[j].second->lit);
+        sort(mvPrevToExpand.begin(), mvPrevToExpand.end(),
+             [this](const pair<int, int> &e1, const pair<int, int> &e2) {
+               if (e1.first != e2.first)
+                 return e1.first < e2.first;
+               return mvNodes[e1.second].minX < mvNodes[e2.second].minX;
+             });
 
-          if ((int)lNodes.size() >= N)
+        for (int j = mvPrevToExpand.size() - 1; j >= 0; j--) {
+          const int node = mvPrevToExpand[j].second;
+          Divide(node, mvToExpand);
+          Erase(node);
+
+          if (mnNodes >= N)
             break;
         }
 
-        if ((int)lNodes.size() >= N || (int)lNodes.size() == prevSize)
+        if (mnNodes >= N || mnNodes == prevSize)
           bFinish = true;
       }
     }
   }
 
   // Retain the best point in each node
-  vector<cv::KeyPoint> vResultKeys;
-  vResultKeys.reserve(nfeatures);
-  for (list<ExtractorNode>::iterator lit = lNodes.begin(); lit != lNodes.end();
-       lit++) {
-    vector<cv::KeyPoint> &vNodeKeys = lit->vKeys;
-    cv::KeyPoint *pKP = &vNodeKeys[0];
+  vResultKeys.clear();
+  vResultKeys.reserve(mnNodes);
+  for (int node = mHead; node >= 0; node = mvNodes[node].next) {
+    const Node &n = mvNodes[node];
+    const cv::KeyPoint *pKP = &vKeys[mvKeyIndices[n.begin]];
     float maxResponse = pKP->response;
 
-    for (size_t k = 1; k < vNodeKeys.size(); k++) {
-      if (vNodeKeys[k].response > maxResponse) {
-        pKP = &vNodeKeys[k];
-        maxResponse = vNodeKeys[k].response;
+    for (int k = n.begin + 1; k < n.end; k++) {
+      const cv::KeyPoint &kp = vKeys[mvKeyIndices[k]];
+      if (kp.response > maxResponse) {
+        pKP = &kp;
+        maxResponse = kp.response;
       }
     }
 
     vResultKeys.push_back(*pKP);
   }
+}
 
+vector<cv::KeyPoint>
+ORBextractor::DistributeOctTree(const vector<cv::KeyPoint> &vToDistributeKeys,
+                                const int &minX, const int &maxX,
+                                const int &minY, const int &maxY, const int &N,
+                                const int &level) {
+  vector<cv::KeyPoint> vResultKeys;
+  mvOctTrees[level].Distribute(vToDistributeKeys, maxX - minX, maxY - minY, N,
+                               vResultKeys);
   return vResultKeys;
 }
 
-void ORBextractor::ComputeKeyPointsOctTree(
-    vector<vector<KeyPoint>> &allKeypoints) {
-  allKeypoints.resize(nlevels);
+// Cell layout of one pyramid level for the octree detector
+struct LevelCells {
+  int minBorderX, minBorderY, maxBorderX, maxBorderY;
+  int nCols, nRows;
+  int wCell, hCell;
+};
 
+static LevelCells ComputeLevelCells(const Mat &image) {
   const float W = 35;
 
-  for (int level = 0; level < nlevels; ++level) {
-    const int minBorderX = EDGE_THRESHOLD - 3;
-    const int minBorderY = minBorderX;
-    const int maxBorderX = mvImagePyramid[level].cols - EDGE_THRESHOLD + 3;
-    const int maxBorderY = mvImagePyramid[level].rows - EDGE_THRESHOLD + 3;
+  LevelCells c;
+  c.minBorderX = EDGE_THRESHOLD - 3;
+  c.minBorderY = c.minBorderX;
+  c.maxBorderX = image.cols - EDGE_THRESHOLD + 3;
+  c.maxBorderY = image.rows - EDGE_THRESHOLD + 3;
 
-    vector<cv::KeyPoint> vToDistributeKeys;
-    vToDistributeKeys.reserve(nfeatures * 10);
+  const float width = (c.maxBorderX - c.minBorderX);
+  const float height = (c.maxBorderY - c.minBorderY);
 
-    const float width = (maxBorderX - minBorderX);
-    const float height = (maxBorderY - minBorderY);
-
-    const int nCols = width / W;
-    const int nRows = height / W;
-    const int wCell = ceil(width / nCols);
-    const int hCell = ceil(height / nRows);
+  c.nCols = width / W;
+  c.nRows = height / W;
+  c.wCell = ceil(width / c.nCols);
+  c.hCell = ceil(height / c.nRows);
+  return c;
+}
 
-    for (int i = 0; i < nRows; i++) {
-      const float iniY = minBorderY + i * hCell;
-      float maxY = iniY + hCell + 6;
+// FAST corners of the cells in row i, appended in cell order. Coordinates are
+// relative to (minBorderX, minBorderY).
+static void DetectCellRow(const Mat &image, const LevelCells &c, const int i,
+                          const int iniThFAST, const int minThFAST,
+                          vector<KeyPoint> &vKeys) {
+  const float iniY = c.minBorderY + i * c.hCell;
+  float maxY = iniY + c.hCell + 6;
+
+  if (iniY >= c.maxBorderY - 3)
+    return;
+  if (maxY > c.maxBorderY)
+    maxY = c.maxBorderY;
+
+  vector<cv::KeyPoint> vKeysCell;
+  for (int j = 0; j < c.nCols; j++) {
+    const float iniX = c.minBorderX + j * c.wCell;
+    float maxX = iniX + c.wCell + 6;
+    if (iniX >= c.maxBorderX - 6)
+      continue;
+    if (maxX > c.maxBorderX)
+      maxX = c.maxBorderX;
+
+    vKeysCell.clear();
+    FAST(image.rowRange(iniY, maxY).colRange(iniX, maxX), vKeysCell,
+         iniThFAST, true);
+
+    if (vKeysCell.empty())
+      FAST(image.rowRange(iniY, maxY).colRange(iniX, maxX), vKeysCell,
+           minThFAST, true);
+
+    for (vector<cv::KeyPoint>::iterator vit = vKeysCell.begin();
+         vit != vKeysCell.end(); vit++) {
+      (*vit).pt.x += j * c.wCell;
+      (*vit).pt.y += i * c.hCell;
+      vKeys.push_back(*vit);
+    }
+  }
+}
 
-      if (iniY >= maxBorderY - 3)
-        continue;
-      if (maxY > maxBorderY)
-        maxY = maxBorderY;
+void ORBextractor::ComputeKeyPointsOctTree(
+    vector<vector<KeyPoint>> &allKeypoints) {
+  allKeypoints.resize(nlevels);
 
-      for (int j = 0; j < nCols; j++) {
-        const float iniX = minBorderX + j * wCell;
-        float maxX = iniX + wCell + 6;
-        if (iniX >= maxBorderX - 6)
-          continue;
-        if (maxX > maxBorderX)
-          maxX = maxBorderX;
+  // FAST is run over (level, cell row) tiles, which may be detected in any
+  // order. Each tile writes its own vector and tiles are concatenated in row
+  // order, so the result does not depend on the number of threads.
+  vector<LevelCells> vCells(nlevels);
+  vector<int> vFirstTile(nlevels + 1, 0);
+  for (int level = 0; level < nlevels; ++level) {
+    vCells[level] = ComputeLevelCells(mvImagePyramid[level]);
+    vFirstTile[level + 1] = vFirstTile[level] + vCells[level].nRows;
+  }
 
-        vector<cv::KeyPoint> vKeysCell;
+  vector<int> vTileLevel(vFirstTile[nlevels]);
+  for (int level = 0; level < nlevels; ++level)
+    fill(vTileLevel.begin() + vFirstTile[level],
+         vTileLevel.begin() + vFirstTile[level + 1], level);
 
-        FAST(mvImagePyramid[level].rowRange(iniY, maxY).colRange(iniX, maxX),
-             vKeysCell, iniThFAST, true);
+  vector<vector<KeyPoint>> vTileKeys(vFirstTile[nlevels]);
+  ParallelFor(0, vFirstTile[nlevels], [&](int t) {
+    const int level = vTileLevel[t];
+    DetectCellRow(mvImagePyramid[level], vCells[level], t - vFirstTile[level],
+                  iniThFAST, minThFAST, vTileKeys[t]);
+  });
 
-        /*if(bRight && j <= 13){
-            FAST(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
-                 vKeysCell,10,true);
-        }
-        else if(!bRight && j >= 16){
-            FAST(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
-                 vKeysCell,10,true);
-        }
-        else{
-            FAST(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
-                 vKeysCell,iniThFAST,true);
-        }*/
-
-        if (vKeysCell.empty()) {
-          FAST(mvImagePyramid[level].rowRange(iniY, maxY).colRange(iniX, maxX),
-               vKeysCell, minThFAST, true);
-          /*if(bRight && j <= 13){
-              FAST(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
-                   vKeysCell,5,true);
-          }
-          else if(!bRight && j >= 16){
-              FAST(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
-                   vKeysCell,5,true);
-          }
-          else{
-              FAST(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
-                   vKeysCell,minThFAST,true);
-          }*/
-        }
+  ParallelFor(0, nlevels, [&](int level) {
+    const LevelCells &c = vCells[level];
 
-        if (!vKeysCell.empty()) {
-          for (vector<cv::KeyPoint>::iterator vit = vKeysCell.begin();
-               vit != vKeysCell.end(); vit++) {
-            (*vit).pt.x += j * wCell;
-            (*vit).pt.y += i * hCell;
-            vToDistributeKeys.push_back(*vit);
-          }
-        }
-      }
-    }
+    vector<cv::KeyPoint> vToDistributeKeys;
+    vToDistributeKeys.reserve(nfeatures * 10);
+    for (int t = vFirstTile[level]; t < vFirstTile[level + 1]; t++)
+      vToDistributeKeys.insert(vToDistributeKeys.end(), vTileKeys[t].begin(),
+                               vTileKeys[t].end());
 
     vector<KeyPoint> &keypoints = allKeypoints[level];
     keypoints.reserve(nfeatures);
 
-    keypoints =
-        DistributeOctTree(vToDistributeKeys, minBorderX, maxBorderX, minBorderY,
-                          maxBorderY, mnFeaturesPerLevel[level], level);
+    keypoints = DistributeOctTree(vToDistributeKeys, c.minBorderX,
+                                  c.maxBorderX, c.minBorderY, c.maxBorderY,
+                                  mnFeaturesPerLevel[level], level);
 
     const int scaledPatchSize = PATCH_SIZE * mvScaleFactor[level];
 
     // Add border to coordinates and scale information
     const int nkps = keypoints.size();
     for (int i = 0; i < nkps; i++) {
-      keypoints[i].pt.x += minBorderX;
-      keypoints[i].pt.y += minBorderY;
+      keypoints[i].pt.x += c.minBorderX;
+      keypoints[i].pt.y += c.minBorderY;
       keypoints[i].octave = level;
       keypoints[i].size = scaledPatchSize;
     }
-  }
 
-  // compute orientations
-  for (int level = 0; level < nlevels; ++level)
-    computeOrientation(mvImagePyramid[level], allKeypoints[level], umax);
+    // compute orientations
+    computeOrientation(mvImagePyramid[level], keypoints, umax);
+  });
 }
 
 void ORBextractor::ComputeKeyPointsOld(vector<vector<KeyPoint>> &allKeypoints) {
@@ -1006,15 +937,29 @@ void ORBextractor::ComputeKeyPointsOld(vector<vector<KeyPoint>> &allKeypoints) {
     computeOrientation(mvImagePyramid[level], allKeypoints[level], umax);
 }
 
-static void computeDescriptors(const Mat &image, vector<KeyPoint> &keypoints,
-                               Mat &descriptors, const vector<Point> &pattern) {
+static void computeDescriptors(const Mat &image,
+                               const vector<KeyPoint> &keypoints,
+                               Mat &descriptors,
+                               const vector<float> &patternX,
+                               const vector<float> &patternY) {
   descriptors = Mat::zeros((int)keypoints.size(), 32, CV_8UC1);
 
   for (size_t i = 0; i < keypoints.size(); i++)
-    computeOrbDescriptor(keypoints[i], image, &pattern[0],
+    computeOrbDescriptor(keypoints[i], image, &patternX[0], &patternY[0],
                          descriptors.ptr((int)i));
 }
 
+void ORBextractor::ComputeOrientations(const Mat &image,
+                                       vector<KeyPoint> &keypoints) const {
+  computeOrientation(image, keypoints, umax);
+}
+
+void ORBextractor::ComputeDescriptors(const Mat &image,
+                                      const vector<KeyPoint> &keypoints,
+                                      Mat &descriptors) const {
+  computeDescriptors(image, keypoints, descriptors, mvPatternX, mvPatternY);
+}
+
 int ORBextractor::operator()(InputArray _image, InputArray _mask,
                              vector<KeyPoint> &_keypoints,
                              OutputArray _descriptors,
@@ -1049,39 +994,42 @@ int ORBextractor::operator()(InputArray _image, InputArray _mask,
   //_keypoints.reserve(nkeypoints);
   _keypoints = vector<cv::KeyPoint>(nkeypoints);
 
-  int offset = 0;
-  // Modified for speeding up stereo fisheye matching
-  int monoIndex = 0, stereoIndex = nkeypoints - 1;
-  for (int level = 0; level < nlevels; ++level) {
+  // Blur and describe every level independently, then scatter the results
+  // serially so the mono/stereo ordering stays the same
+  vector<Mat> vLevelDescriptors(nlevels);
+  ParallelFor(0, nlevels, [&](int level) {
     vector<KeyPoint> &keypoints = allKeypoints[level];
-    int nkeypointsLevel = (int)keypoints.size();
+    if (keypoints.empty())
+      return;
 
-    if (nkeypointsLevel == 0)
-      continue;
-
-    // preprocess the resized image
-    Mat workingMat = mvImagePyramid[level].clone();
-    GaussianBlur(workingMat, workingMat, Size(7, 7), 2, 2, BORDER_REFLECT_101);
+    // preprocess the resized image. The level is blurred in isolation, as if
+    // it were a standalone copy, into a buffer kept across calls.
+    Mat &workingMat = mvBlurredPyramid[level];
+    GaussianBlur(mvImagePyramid[level], workingMat, Size(7, 7), 2, 2,
+                 BORDER_REFLECT_101 | BORDER_ISOLATED);
 
     // Compute the descriptors
-    // Mat desc = descriptors.rowRange(offset, offset + nkeypointsLevel);
-    Mat desc = cv::Mat(nkeypointsLevel, 32, CV_8U);
-    computeDescriptors(workingMat, keypoints, desc, pattern);
+    computeDescriptors(workingMat, keypoints, vLevelDescriptors[level],
+                       mvPatternX, mvPatternY);
 
-    offset += nkeypointsLevel;
+    // Scale keypoint coordinates
+    if (level != 0) {
+      const float scale = mvScaleFactor[level];
+      for (KeyPoint &keypoint : keypoints)
+        keypoint.pt *= scale;
+    }
+  });
+
+  // Modified for speeding up stereo fisheye matching
+  int monoIndex = 0, stereoIndex = nkeypoints - 1;
+  for (int level = 0; level < nlevels; ++level) {
+    vector<KeyPoint> &keypoints = allKeypoints[level];
+    const Mat &desc = vLevelDescriptors[level];
 
-    float scale =
-        mvScaleFactor[level]; // getScale(level, firstLevel, scaleFactor);
     int i = 0;
     for (vector<KeyPoint>::iterator keypoint = keypoints.begin(),
                                     keypointEnd = keypoints.end();
          keypoint != keypointEnd; ++keypoint) {
-
-      // Scale keypoint coordinates
-      if (level != 0) {
-        keypoint->pt *= scale;
-      }
-
       if (keypoint->pt.x >= vLappingArea[0] &&
           keypoint->pt.x <= vLappingArea[1]) {
         _keypoints.at(stereoIndex) = (*keypoint);
@@ -1100,14 +1048,62 @@ int ORBextractor::operator()(InputArray _image, InputArray _mask,
   return monoIndex;
 }
 
+void ORBextractor::ParallelFor(const int begin, const int end,
+                               const function<void(int)> &f) {
+  if (mpThreadPool) {
+    mpThreadPool->ParallelFor(begin, end, f);
+  } else {
+    for (int i = begin; i < end; i++)
+      f(i);
+  }
+}
+
+// Fills the "border" pixels around the interior of a bordered image with
+// BORDER_REFLECT_101, reading only the interior (as BORDER_ISOLATED does).
+// Unlike copyMakeBorder the interior is not copied, so a level can be resized
+// straight into its final place.
+static void FillBorderReflect101(Mat &whole, const int border) {
+  const int w = whole.cols - 2 * border;
+  const int h = whole.rows - 2 * border;
+
+  if (w <= border || h <= border) {
+    // Reflection needs more than "border" pixels, let OpenCV handle tiny levels
+    Mat interior = whole(Rect(border, border, w, h)).clone();
+    copyMakeBorder(interior, whole, border, border, border, border,
+                   BORDER_REFLECT_101);
+    return;
+  }
+
+  for (int y = border; y < border + h; y++) {
+    uchar *row = whole.ptr<uchar>(y);
+    uchar *first = row + border;
+    uchar *last = row + border + w - 1;
+    for (int k = 1; k <= border; k++) {
+      first[-k] = first[k];
+      last[k] = last[-k];
+    }
+  }
+
+  const size_t rowBytes = whole.cols;
+  for (int k = 1; k <= border; k++) {
+    memcpy(whole.ptr<uchar>(border - k), whole.ptr<uchar>(border + k),
+           rowBytes);
+    memcpy(whole.ptr<uchar>(border + h - 1 + k),
+           whole.ptr<uchar>(border + h - 1 - k), rowBytes);
+  }
+}
+
 void ORBextractor::ComputePyramid(cv::Mat image) {
+  // Bordered level buffers are only (re)allocated when the input size
+  // changes, every other call writes into the same memory
   for (int level = 0; level < nlevels; ++level) {
     float scale = mvInvScaleFactor[level];
     Size sz(cvRound((float)image.cols * scale),
             cvRound((float)image.rows * scale));
     Size wholeSize(sz.width + EDGE_THRESHOLD * 2,
                    sz.height + EDGE_THRESHOLD * 2);
-    Mat temp(wholeSize, image.type()), masktemp;
+    Mat &temp = mvPyramidBuffer[level];
+    temp.create(wholeSize, image.type());
     mvImagePyramid[level] =
         temp(Rect(EDGE_THRESHOLD, EDGE_THRESHOLD, sz.width, sz.height));
 
@@ -1116,9 +1112,7 @@ void ORBextractor::ComputePyramid(cv::Mat image) {
       resize(mvImagePyramid[level - 1], mvImagePyramid[level], sz, 0, 0,
              INTER_LINEAR);
 
-      copyMakeBorder(mvImagePyramid[level], temp, EDGE_THRESHOLD,
-                     EDGE_THRESHOLD, EDGE_THRESHOLD, EDGE_THRESHOLD,
-                     BORDER_REFLECT_101 + BORDER_ISOLATED);
+      FillBorderReflect101(temp, EDGE_THRESHOLD);
     } else {
       copyMakeBorder(image, temp, EDGE_THRESHOLD, EDGE_THRESHOLD,
                      EDGE_THRESHOLD, EDGE_THRESHOLD, BORDER_REFLECT_101);
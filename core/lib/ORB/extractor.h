@@ -23,23 +23,56 @@
 
 using namespace std;
 
-#include <list>
+#include <functional>
 #include <opencv2/opencv.hpp>
 #include <vector>
 
 namespace ORB_SLAM3 {
 
-class ExtractorNode {
-public:
-  ExtractorNode() : bNoMore(false) {}
-
-  void DivideNode(ExtractorNode &n1, ExtractorNode &n2, ExtractorNode &n3,
-                  ExtractorNode &n4);
+class ThreadPool;
 
-  vector<cv::KeyPoint> vKeys;
-  cv::Point2i UL, UR, BL, BR;
-  list<ExtractorNode>::iterator lit;
-  bool bNoMore;
+// Quadtree used to spread the keypoints of one pyramid level. Nodes live in
+// a single array and are chained in a linked list of indices, keypoints are
+// referred to by index and partitioned in place, so a node owns no memory and
+// the buffers are reused from one call to the next.
+class OctTree {
+public:
+  // Splits the area [0, width) x [0, height) until there are at least N
+  // nodes (or no node can be split) and returns the keypoint with the highest
+  // response of every node.
+  void Distribute(const vector<cv::KeyPoint> &vKeys, const int width,
+                  const int height, const int N,
+                  vector<cv::KeyPoint> &vResultKeys);
+
+private:
+  struct Node {
+    int minX, minY, maxX, maxY;
+    // Keypoints of the node are mvKeyIndices[begin, end)
+    int begin, end;
+    // Neighbours in the node list, -1 at the ends
+    int prev, next;
+    bool bNoMore;
+
+    int Size() const { return end - begin; }
+  };
+
+  void PushFront(const int node);
+  int Erase(const int node);
+
+  // Splits a node in four and pushes the non-empty children to the front of
+  // the list. Children with more than one keypoint are appended to
+  // vToExpand as (size, node).
+  void Divide(const int node, vector<pair<int, int>> &vToExpand);
+
+  const vector<cv::KeyPoint> *mpKeys;
+
+  vector<Node> mvNodes;
+  int mHead, mnNodes;
+
+  vector<int> mvKeyIndices;
+  vector<int> mvScratch;
+  vector<int> mvIniStart;
+  vector<pair<int, int>> mvToExpand, mvPrevToExpand;
 };
 
 class ORBextractor {
@@ -72,6 +105,23 @@ public:
     return mvInvLevelSigma2;
   }
 
+  // Orientations of the keypoints and their descriptors (at the keypoint
+  // orientation) on one pyramid level image, with the same code as
+  // operator(). Used by the tests of the ORB kernels.
+  void ComputeOrientations(const cv::Mat &image,
+                           vector<cv::KeyPoint> &keypoints) const;
+  void ComputeDescriptors(const cv::Mat &image,
+                          const vector<cv::KeyPoint> &keypoints,
+                          cv::Mat &descriptors) const;
+
+  // The 256 point pairs compared by the descriptor
+  const vector<cv::Point> &GetPattern() const { return pattern; }
+
+  // Pyramid levels and cell rows are processed on pPool (not owned). The
+  // output does not depend on the pool, nullptr runs everything serially.
+  void SetThreadPool(ThreadPool *pPool) { mpThreadPool = pPool; }
+  ThreadPool *GetThreadPool() const { return mpThreadPool; }
+
   vector<cv::Mat> mvImagePyramid;
 
 protected:
@@ -83,7 +133,13 @@ protected:
                     const int &maxY, const int &nFeatures, const int &level);
 
   void ComputeKeyPointsOld(vector<vector<cv::KeyPoint>> &allKeypoints);
+
+  // Runs f(i) for i in [begin, end) on the thread pool, if any
+  void ParallelFor(const int begin, const int end,
+                   const function<void(int)> &f);
+
   vector<cv::Point> pattern;
+  vector<float> mvPatternX, mvPatternY;
 
   int nfeatures;
   double scaleFactor;
@@ -99,6 +155,17 @@ protected:
   vector<float> mvInvScaleFactor;
   vector<float> mvLevelSigma2;
   vector<float> mvInvLevelSigma2;
+
+  // Bordered storage of mvImagePyramid and the blurred levels, reused across
+  // calls
+  vector<cv::Mat> mvPyramidBuffer;
+  vector<cv::Mat> mvBlurredPyramid;
+
+  // Workspace of DistributeOctTree, one per level so levels can be processed
+  // concurrently
+  vector<OctTree> mvOctTrees;
+
+  ThreadPool *mpThreadPool;
 };
 
 } // namespace ORB_SLAM3
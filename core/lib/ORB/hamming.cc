@@ -0,0 +1,211 @@
+/**
+ * This file is part of ORB-SLAM3
+ *
+ * Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez
+ * Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+ * Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós,
+ * University of Zaragoza.
+ *
+ * ORB-SLAM3 is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ORB-SLAM3. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ORB/hamming.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ORB_HAMMING_X86
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define ORB_HAMMING_NEON
+#include <arm_neon.h>
+#endif
+
+namespace ORB_SLAM3 {
+
+namespace Hamming {
+
+namespace {
+
+// Row accessors, so every kernel serves both the strided and the indexed API
+struct StridedRows {
+  const uint8_t *base;
+  size_t stride;
+  inline const uint8_t *operator()(size_t i) const { return base + i * stride; }
+};
+
+struct IndexedRows {
+  const uint8_t *base;
+  size_t stride;
+  const size_t *indices;
+  inline const uint8_t *operator()(size_t i) const {
+    return base + indices[i] * stride;
+  }
+};
+
+template <class Rows>
+void DistancesScalar(const uint8_t *q, const Rows &rows, size_t n, int *dist) {
+  for (size_t i = 0; i < n; i++)
+    dist[i] = Distance(q, rows(i));
+}
+
+#ifdef ORB_HAMMING_X86
+// Nibble lookup popcount (Mula et al.), one descriptor per iteration
+template <class Rows>
+__attribute__((target("avx2"))) void
+DistancesAVX2(const uint8_t *q, const Rows &rows, size_t n, int *dist) {
+  const __m256i lut =
+      _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1, 1,
+                       2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low = _mm256_set1_epi8(0x0f);
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i vq = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(q));
+
+  for (size_t i = 0; i < n; i++) {
+    const __m256i x = _mm256_xor_si256(
+        vq, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(rows(i))));
+    const __m256i cnt = _mm256_add_epi8(
+        _mm256_shuffle_epi8(lut, _mm256_and_si256(x, low)),
+        _mm256_shuffle_epi8(lut,
+                            _mm256_and_si256(_mm256_srli_epi16(x, 4), low)));
+    const __m256i sad = _mm256_sad_epu8(cnt, zero);
+    const __m128i s = _mm_add_epi64(_mm256_castsi256_si128(sad),
+                                    _mm256_extracti128_si256(sad, 1));
+    dist[i] = _mm_cvtsi128_si32(s) + _mm_extract_epi32(s, 2);
+  }
+}
+
+// Native 64 bit popcount, two descriptors per 512 bit register
+template <class Rows>
+__attribute__((target("avx512f,avx512vpopcntdq"))) void
+DistancesAVX512(const uint8_t *q, const Rows &rows, size_t n, int *dist) {
+  const __m512i vq = _mm512_broadcast_i64x4(
+      _mm256_loadu_si256(reinterpret_cast<const __m256i *>(q)));
+
+  size_t i = 0;
+  for (; i + 1 < n; i += 2) {
+    const __m256i c0 =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(rows(i)));
+    const __m256i c1 =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(rows(i + 1)));
+    const __m512i c = _mm512_inserti64x4(_mm512_castsi256_si512(c0), c1, 1);
+    const __m512i cnt = _mm512_popcnt_epi64(_mm512_xor_si512(vq, c));
+    dist[i] = (int)_mm512_mask_reduce_add_epi64(0x0F, cnt);
+    dist[i + 1] = (int)_mm512_mask_reduce_add_epi64(0xF0, cnt);
+  }
+  if (i < n)
+    dist[i] = Distance(q, rows(i));
+}
+#endif
+
+#ifdef ORB_HAMMING_NEON
+template <class Rows>
+void DistancesNEON(const uint8_t *q, const Rows &rows, size_t n, int *dist) {
+  const uint8x16_t q0 = vld1q_u8(q);
+  const uint8x16_t q1 = vld1q_u8(q + 16);
+  for (size_t i = 0; i < n; i++) {
+    const uint8_t *c = rows(i);
+    const uint8x16_t cnt =
+        vaddq_u8(vcntq_u8(veorq_u8(q0, vld1q_u8(c))),
+                 vcntq_u8(veorq_u8(q1, vld1q_u8(c + 16))));
+    dist[i] = vaddlvq_u8(cnt);
+  }
+}
+#endif
+
+struct Kernels {
+  void (*strided)(const uint8_t *, const StridedRows &, size_t, int *);
+  void (*indexed)(const uint8_t *, const IndexedRows &, size_t, int *);
+  const char *name;
+};
+
+Kernels SelectKernels() {
+#ifdef ORB_HAMMING_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f") &&
+      __builtin_cpu_supports("avx512vpopcntdq"))
+    return {DistancesAVX512<StridedRows>, DistancesAVX512<IndexedRows>,
+            "avx512"};
+  if (__builtin_cpu_supports("avx2"))
+    return {DistancesAVX2<StridedRows>, DistancesAVX2<IndexedRows>, "avx2"};
+#endif
+#ifdef ORB_HAMMING_NEON
+  return {DistancesNEON<StridedRows>, DistancesNEON<IndexedRows>, "neon"};
+#endif
+  return {DistancesScalar<StridedRows>, DistancesScalar<IndexedRows>,
+          "scalar"};
+}
+
+const Kernels &GetKernels() {
+  static const Kernels kernels = SelectKernels();
+  return kernels;
+}
+
+inline void UpdateBestTwo(BestTwo &res, const int *dist, size_t n,
+                          size_t offset) {
+  for (size_t i = 0; i < n; i++) {
+    const int d = dist[i];
+    if (d < res.bestDist) {
+      res.secondDist = res.bestDist;
+      res.secondIdx = res.bestIdx;
+      res.bestDist = d;
+      res.bestIdx = (int)(offset + i);
+    } else if (d < res.secondDist) {
+      res.secondDist = d;
+      res.secondIdx = (int)(offset + i);
+    }
+  }
+}
+
+// Candidates are processed in chunks so distances stay on the stack
+const size_t CHUNK = 64;
+
+} // namespace
+
+void Distances(const uint8_t *query, const uint8_t *candidates, size_t stride,
+               size_t n, int *dist) {
+  GetKernels().strided(query, StridedRows{candidates, stride}, n, dist);
+}
+
+void Distances(const uint8_t *query, const uint8_t *base, size_t stride,
+               const size_t *indices, size_t n, int *dist) {
+  GetKernels().indexed(query, IndexedRows{base, stride, indices}, n, dist);
+}
+
+BestTwo SearchBestTwo(const uint8_t *query, const uint8_t *candidates,
+                      size_t stride, size_t n) {
+  BestTwo res = {256, -1, 256, -1};
+  int dist[CHUNK];
+  for (size_t i = 0; i < n; i += CHUNK) {
+    const size_t m = (n - i < CHUNK) ? n - i : CHUNK;
+    Distances(query, candidates + i * stride, stride, m, dist);
+    UpdateBestTwo(res, dist, m, i);
+  }
+  return res;
+}
+
+BestTwo SearchBestTwo(const uint8_t *query, const uint8_t *base, size_t stride,
+                      const size_t *indices, size_t n) {
+  BestTwo res = {256, -1, 256, -1};
+  int dist[CHUNK];
+  for (size_t i = 0; i < n; i += CHUNK) {
+    const size_t m = (n - i < CHUNK) ? n - i : CHUNK;
+    Distances(query, base, stride, indices + i, m, dist);
+    UpdateBestTwo(res, dist, m, i);
+  }
+  return res;
+}
+
+const char *KernelName() { return GetKernels().name; }
+
+} // namespace Hamming
+
+} // namespace ORB_SLAM3
@@ -0,0 +1,85 @@
+/**
+ * This file is part of ORB-SLAM3
+ *
+ * Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez
+ * Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+ * Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós,
+ * University of Zaragoza.
+ *
+ * ORB-SLAM3 is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ORB-SLAM3. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ORBHAMMING_H
+#define ORBHAMMING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace ORB_SLAM3 {
+
+namespace Hamming {
+
+// Size of an ORB descriptor in bytes (256 bits)
+const size_t DESCRIPTOR_BYTES = 32;
+
+// Result of a one-vs-many search. Indices are positions in the candidate
+// list, -1 when there is no such candidate. Distances start at 256, so a
+// candidate is only reported if it is strictly better than that.
+struct BestTwo {
+  int bestDist;
+  int bestIdx;
+  int secondDist;
+  int secondIdx;
+};
+
+// Hamming distance between two 256 bit descriptors. Four 64 bit popcounts
+// are as fast as any vector kernel for a single pair, so this one is inline.
+inline int Distance(const uint8_t *a, const uint8_t *b) {
+  uint64_t va[4], vb[4];
+  memcpy(va, a, DESCRIPTOR_BYTES);
+  memcpy(vb, b, DESCRIPTOR_BYTES);
+  return __builtin_popcountll(va[0] ^ vb[0]) +
+         __builtin_popcountll(va[1] ^ vb[1]) +
+         __builtin_popcountll(va[2] ^ vb[2]) +
+         __builtin_popcountll(va[3] ^ vb[3]);
+}
+
+// Distances from one query to n candidates laid out every "stride" bytes
+// starting at "candidates".
+void Distances(const uint8_t *query, const uint8_t *candidates, size_t stride,
+               size_t n, int *dist);
+
+// Distances from one query to the rows "indices[0..n)" of a descriptor block
+// (row i starts at base + indices[i] * stride).
+void Distances(const uint8_t *query, const uint8_t *base, size_t stride,
+               const size_t *indices, size_t n, int *dist);
+
+// Best and second best candidate of a contiguous (or strided) block. Ties keep
+// the first candidate found, as the scalar matching loops do.
+BestTwo SearchBestTwo(const uint8_t *query, const uint8_t *candidates,
+                      size_t stride, size_t n);
+
+// Best and second best among the rows "indices[0..n)" of a descriptor block.
+// Reported indices are positions in "indices", not row numbers.
+BestTwo SearchBestTwo(const uint8_t *query, const uint8_t *base, size_t stride,
+                      const size_t *indices, size_t n);
+
+// Name of the kernel selected for this CPU ("avx512", "avx2", "neon" or
+// "scalar")
+const char *KernelName();
+
+} // namespace Hamming
+
+} // namespace ORB_SLAM3
+
+#endif // ORBHAMMING_H
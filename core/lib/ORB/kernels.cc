@@ -0,0 +1,224 @@
+/**
+ * This file is part of ORB-SLAM3
+ *
+ * Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez
+ * Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+ * Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós,
+ * University of Zaragoza.
+ *
+ * ORB-SLAM3 is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ORB-SLAM3. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ORB/kernels.h"
+
+#include <opencv2/core/core.hpp>
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ORB_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+namespace ORB_SLAM3 {
+
+namespace ORBKernels {
+
+namespace {
+
+void PatchMomentsScalar(const uint8_t *center, const int step,
+                        const int *umax, int &m_01, int &m_10) {
+  m_01 = 0;
+  m_10 = 0;
+
+  // Treat the center line differently, v=0
+  for (int u = -HALF_PATCH_SIZE; u <= HALF_PATCH_SIZE; ++u)
+    m_10 += u * center[u];
+
+  // Go line by line in the circular patch
+  for (int v = 1; v <= HALF_PATCH_SIZE; ++v) {
+    // Proceed over the two lines
+    int v_sum = 0;
+    const int d = umax[v];
+    for (int u = -d; u <= d; ++u) {
+      const int val_plus = center[u + v * step];
+      const int val_minus = center[u - v * step];
+      v_sum += (val_plus - val_minus);
+      m_10 += u * (val_plus + val_minus);
+    }
+    m_01 += v * v_sum;
+  }
+}
+
+void RotatedOffsetsScalar(const float *x, const float *y, const int n,
+                          const float a, const float b, const int step,
+                          int *offsets) {
+  for (int i = 0; i < n; i++)
+    offsets[i] = cvRound(x[i] * b + y[i] * a) * step +
+                 cvRound(x[i] * a - y[i] * b);
+}
+
+#ifdef ORB_KERNELS_X86
+inline __attribute__((target("avx2"))) int HorizontalSum(const __m256i v) {
+  __m128i s = _mm_add_epi32(_mm256_castsi256_si128(v),
+                            _mm256_extracti128_si256(v, 1));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(s);
+}
+
+// Each patch row is read as 32 pixels starting at u = -15 and widened to two
+// registers of 16 bit lanes. Pixels outside [-d, d] are masked out, and the
+// weighted sums are done with madd into 32 bit lanes, so the result is exact.
+__attribute__((target("avx2"))) void
+PatchMomentsAVX2(const uint8_t *center, const int step, const int *umax,
+                 int &m_01, int &m_10) {
+  const __m256i uLo = _mm256_setr_epi16(-15, -14, -13, -12, -11, -10, -9, -8,
+                                        -7, -6, -5, -4, -3, -2, -1, 0);
+  const __m256i uHi = _mm256_setr_epi16(1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12,
+                                        13, 14, 15, 16);
+  const __m256i absLo = _mm256_abs_epi16(uLo);
+  const __m256i absHi = uHi;
+
+  // Center line, u = 16 is masked out
+  const __m256i c = _mm256_loadu_si256(
+      reinterpret_cast<const __m256i *>(center - HALF_PATCH_SIZE));
+  const __m256i cMask =
+      _mm256_cmpgt_epi16(_mm256_set1_epi16(HALF_PATCH_SIZE + 1), absHi);
+  __m256i acc10 = _mm256_add_epi32(
+      _mm256_madd_epi16(_mm256_cvtepu8_epi16(_mm256_castsi256_si128(c)), uLo),
+      _mm256_madd_epi16(
+          _mm256_and_si256(
+              _mm256_cvtepu8_epi16(_mm256_extracti128_si256(c, 1)), cMask),
+          uHi));
+  __m256i acc01 = _mm256_setzero_si256();
+
+  for (int v = 1; v <= HALF_PATCH_SIZE; ++v) {
+    const __m256i dPlusOne = _mm256_set1_epi16(umax[v] + 1);
+    const __m256i maskLo = _mm256_cmpgt_epi16(dPlusOne, absLo);
+    const __m256i maskHi = _mm256_cmpgt_epi16(dPlusOne, absHi);
+
+    const __m256i plus = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(
+        center + v * step - HALF_PATCH_SIZE));
+    const __m256i minus = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(
+        center - v * step - HALF_PATCH_SIZE));
+
+    const __m256i pLo = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(plus));
+    const __m256i pHi = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(plus, 1));
+    const __m256i mLo = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(minus));
+    const __m256i mHi =
+        _mm256_cvtepu8_epi16(_mm256_extracti128_si256(minus, 1));
+
+    const __m256i sumLo = _mm256_and_si256(_mm256_add_epi16(pLo, mLo), maskLo);
+    const __m256i sumHi = _mm256_and_si256(_mm256_add_epi16(pHi, mHi), maskHi);
+    const __m256i difLo = _mm256_and_si256(_mm256_sub_epi16(pLo, mLo), maskLo);
+    const __m256i difHi = _mm256_and_si256(_mm256_sub_epi16(pHi, mHi), maskHi);
+
+    acc10 = _mm256_add_epi32(acc10, _mm256_madd_epi16(sumLo, uLo));
+    acc10 = _mm256_add_epi32(acc10, _mm256_madd_epi16(sumHi, uHi));
+
+    const __m256i vv = _mm256_set1_epi16(v);
+    acc01 = _mm256_add_epi32(acc01, _mm256_madd_epi16(difLo, vv));
+    acc01 = _mm256_add_epi32(acc01, _mm256_madd_epi16(difHi, vv));
+  }
+
+  m_01 = HorizontalSum(acc01);
+  m_10 = HorizontalSum(acc10);
+}
+
+// Same arithmetic as the scalar path: products and sums in single precision
+// and round to nearest (cvRound), eight pattern points per iteration
+__attribute__((target("avx2"))) void
+RotatedOffsetsAVX2(const float *x, const float *y, const int n, const float a,
+                   const float b, const int step, int *offsets) {
+  const __m256 va = _mm256_set1_ps(a);
+  const __m256 vb = _mm256_set1_ps(b);
+  const __m256i vstep = _mm256_set1_epi32(step);
+
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256 vx = _mm256_loadu_ps(x + i);
+    const __m256 vy = _mm256_loadu_ps(y + i);
+    const __m256i row = _mm256_cvtps_epi32(
+        _mm256_add_ps(_mm256_mul_ps(vx, vb), _mm256_mul_ps(vy, va)));
+    const __m256i col = _mm256_cvtps_epi32(
+        _mm256_sub_ps(_mm256_mul_ps(vx, va), _mm256_mul_ps(vy, vb)));
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i *>(offsets + i),
+        _mm256_add_epi32(_mm256_mullo_epi32(row, vstep), col));
+  }
+  RotatedOffsetsScalar(x + i, y + i, n - i, a, b, step, offsets + i);
+}
+#endif
+
+struct Kernels {
+  void (*patchMoments)(const uint8_t *, const int, const int *, int &, int &);
+  void (*rotatedOffsets)(const float *, const float *, const int, const float,
+                         const float, const int, int *);
+  const char *name;
+};
+
+// The kernel set of that name, if compiled in and supported by this CPU
+bool FindKernels(const char *name, Kernels &kernels) {
+  if (strcmp(name, "scalar") == 0) {
+    kernels = {PatchMomentsScalar, RotatedOffsetsScalar, "scalar"};
+    return true;
+  }
+#ifdef ORB_KERNELS_X86
+  __builtin_cpu_init();
+  if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+    kernels = {PatchMomentsAVX2, RotatedOffsetsAVX2, "avx2"};
+    return true;
+  }
+#endif
+  return false;
+}
+
+Kernels SelectKernels() {
+  Kernels kernels;
+  if (!FindKernels("avx2", kernels))
+    FindKernels("scalar", kernels);
+  return kernels;
+}
+
+Kernels &GetKernels() {
+  static Kernels kernels = SelectKernels();
+  return kernels;
+}
+
+} // namespace
+
+void PatchMoments(const uint8_t *center, const int step, const int *umax,
+                  int &m_01, int &m_10) {
+  GetKernels().patchMoments(center, step, umax, m_01, m_10);
+}
+
+void RotatedOffsets(const float *x, const float *y, const int n,
+                    const float a, const float b, const int step,
+                    int *offsets) {
+  GetKernels().rotatedOffsets(x, y, n, a, b, step, offsets);
+}
+
+const char *KernelName() { return GetKernels().name; }
+
+bool UseKernels(const char *name) {
+  Kernels kernels;
+  if (!FindKernels(name, kernels))
+    return false;
+  GetKernels() = kernels;
+  return true;
+}
+
+} // namespace ORBKernels
+
+} // namespace ORB_SLAM3
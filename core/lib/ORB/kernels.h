@@ -0,0 +1,63 @@
+/**
+ * This file is part of ORB-SLAM3
+ *
+ * Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez
+ * Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+ * Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós,
+ * University of Zaragoza.
+ *
+ * ORB-SLAM3 is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ORB-SLAM3. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ORBKERNELS_H
+#define ORBKERNELS_H
+
+#include <cstdint>
+
+namespace ORB_SLAM3 {
+
+// Per-keypoint kernels of the ORB extractor. A vector implementation is
+// selected at run time when the CPU supports it; every implementation returns
+// exactly what the scalar one does.
+namespace ORBKernels {
+
+// Radius of the circular patch used for the orientation
+const int HALF_PATCH_SIZE = 15;
+
+// Intensity centroid moments m_01 and m_10 of the circular patch around
+// "center". umax[v] is the half width of the patch at row offset v
+// (HALF_PATCH_SIZE + 1 entries). Reads HALF_PATCH_SIZE + 1 pixels to the
+// right of the patch rows.
+void PatchMoments(const uint8_t *center, const int step, const int *umax,
+                  int &m_01, int &m_10);
+
+// Byte offsets, relative to the keypoint, of the n pattern points (x, y)
+// rotated by the angle whose cosine is a and sine is b:
+// offsets[i] = cvRound(x * b + y * a) * step + cvRound(x * a - y * b)
+void RotatedOffsets(const float *x, const float *y, const int n,
+                    const float a, const float b, const int step,
+                    int *offsets);
+
+// Name of the kernel set in use ("avx2" or "scalar")
+const char *KernelName();
+
+// Uses the named kernel set from now on instead of the one selected for this
+// CPU, so tests can compare every variant. Returns false, changing nothing,
+// if the set is not compiled in or the CPU cannot run it. Not to be called
+// while features are being extracted.
+bool UseKernels(const char *name);
+
+} // namespace ORBKernels
+
+} // namespace ORB_SLAM3
+
+#endif // ORBKERNELS_H
@@ -46,6 +46,12 @@ int ORBmatcher::SearchByProjection(Frame &F,
 
   const bool bFactor = th != 1.0;
 
+  // Candidates of the current point and their distances, reused across points
+  vector<size_t> vIndices;
+  vector<int> vDistances;
+  vIndices.reserve(64);
+  vDistances.reserve(64);
+
   for (size_t iMP = 0; iMP < vpMapPoints.size(); iMP++) {
     MapPoint *pMP = vpMapPoints[iMP];
     if (!pMP->mbTrackInView && !pMP->mbTrackInViewR)
@@ -66,13 +72,12 @@ int ORBmatcher::SearchByProjection(Frame &F,
       if (bFactor)
         r *= th;
 
-      const vector<size_t> vIndices =
-          F.GetFeaturesInArea(pMP->mTrackProjX, pMP->mTrackProjY,
-                              r * F.mvScaleFactors[nPredictedLevel],
-                              nPredictedLevel - 1, nPredictedLevel);
+      F.GetFeaturesInArea(vIndices, pMP->mTrackProjX, pMP->mTrackProjY,
+                          r * F.mvScaleFactors[nPredictedLevel],
+                          nPredictedLevel - 1, nPredictedLevel);
 
       if (!vIndices.empty()) {
-        const cv::Mat MPdescriptor = pMP->GetDescriptor();
+        const DescriptorBlock MPdescriptor = pMP->GetDescriptor();
 
         int bestDist = 256;
         int bestLevel = -1;
@@ -80,11 +85,12 @@ int ORBmatcher::SearchByProjection(Frame &F,
         int bestLevel2 = -1;
         int bestIdx = -1;
 
+        DescriptorDistances(MPdescriptor.data(), F.mDescriptors, vIndices,
+                            vDistances);
+
         // Get best and second matches with near keypoints
-        for (vector<size_t>::const_iterator vit = vIndices.begin(),
-                                            vend = vIndices.end();
-             vit != vend; vit++) {
-          const size_t idx = *vit;
+        for (size_t i = 0; i < vIndices.size(); i++) {
+          const size_t idx = vIndices[i];
 
           if (F.mvpMapPoints[idx])
             if (F.mvpMapPoints[idx]->Observations() > 0)
@@ -96,9 +102,7 @@ int ORBmatcher::SearchByProjection(Frame &F,
               continue;
           }
 
-          const cv::Mat &d = F.mDescriptors.row(idx);
-
-          const int dist = DescriptorDistance(MPdescriptor, d);
+          const int dist = vDistances[i];
 
           if (dist < bestDist) {
             bestDist2 = bestDist;
@@ -146,15 +150,14 @@ int ORBmatcher::SearchByProjection(Frame &F,
       if (nPredictedLevel != -1) {
         float r = RadiusByViewingCos(pMP->mTrackViewCosR);
 
-        const vector<size_t> vIndices =
-            F.GetFeaturesInArea(pMP->mTrackProjXR, pMP->mTrackProjYR,
-                                r * F.mvScaleFactors[nPredictedLevel],
-                                nPredictedLevel - 1, nPredictedLevel, true);
+        F.GetFeaturesInArea(vIndices, pMP->mTrackProjXR, pMP->mTrackProjYR,
+                            r * F.mvScaleFactors[nPredictedLevel],
+                            nPredictedLevel - 1, nPredictedLevel, true);
 
         if (vIndices.empty())
           continue;
 
-        const cv::Mat MPdescriptor = pMP->GetDescriptor();
+        const DescriptorBlock MPdescriptor = pMP->GetDescriptor();
 
         int bestDist = 256;
         int bestLevel = -1;
@@ -162,19 +165,18 @@ int ORBmatcher::SearchByProjection(Frame &F,
         int bestLevel2 = -1;
         int bestIdx = -1;
 
+        DescriptorDistances(MPdescriptor.data(), F.mDescriptorsRight, vIndices,
+                            vDistances);
+
         // Get best and second matches with near keypoints
-        for (vector<size_t>::const_iterator vit = vIndices.begin(),
-                                            vend = vIndices.end();
-             vit != vend; vit++) {
-          const size_t idx = *vit;
+        for (size_t i = 0; i < vIndices.size(); i++) {
+          const size_t idx = vIndices[i];
 
           if (F.mvpMapPoints[idx + F.Nleft])
             if (F.mvpMapPoints[idx + F.Nleft]->Observations() > 0)
               continue;
 
-          const cv::Mat &d = F.mDescriptors.row(idx + F.Nleft);
-
-          const int dist = DescriptorDistance(MPdescriptor, d);
+          const int dist = vDistances[i];
 
           if (dist < bestDist) {
             bestDist2 = bestDist;
@@ -257,7 +259,7 @@ int ORBmatcher::SearchByBoW(KeyFrame *pKF, Frame &F,
         if (pMP->isBad())
           continue;
 
-        const cv::Mat &dKF = pKF->mDescriptors.row(realIdxKF);
+        const uint8_t *dKF = pKF->mDescriptors.At(realIdxKF);
 
         int bestDist1 = 256;
         int bestIdxF = -1;
@@ -274,7 +276,7 @@ int ORBmatcher::SearchByBoW(KeyFrame *pKF, Frame &F,
             if (vpMapPointMatches[realIdxF])
               continue;
 
-            const cv::Mat &dF = F.mDescriptors.row(realIdxF);
+            const uint8_t *dF = F.mDescriptors.At(realIdxF);
 
             const int dist = DescriptorDistance(dKF, dF);
 
@@ -291,7 +293,7 @@ int ORBmatcher::SearchByBoW(KeyFrame *pKF, Frame &F,
             if (vpMapPointMatches[realIdxF])
               continue;
 
-            const cv::Mat &dF = F.mDescriptors.row(realIdxF);
+            const uint8_t *dF = F.mDescriptors.At(realIdxF);
 
             const int dist = DescriptorDistance(dKF, dF);
 
@@ -424,6 +426,9 @@ int ORBmatcher::SearchByProjection(KeyFrame *pKF, Sophus::Sim3f &Scw,
 
   int nmatches = 0;
 
+  // Candidates of the current point, reused across points
+  vector<size_t> vIndices;
+
   // For each Candidate MapPoint Project and Match
   for (int iMP = 0, iendMP = vpPoints.size(); iMP < iendMP; iMP++) {
     MapPoint *pMP = vpPoints[iMP];
@@ -469,14 +474,13 @@ int ORBmatcher::SearchByProjection(KeyFrame *pKF, Sophus::Sim3f &Scw,
     // Search in a radius
     const float radius = th * pKF->mvScaleFactors[nPredictedLevel];
 
-    const vector<size_t> vIndices =
-        pKF->GetFeaturesInArea(uv(0), uv(1), radius);
+    pKF->GetFeaturesInArea(vIndices, uv(0), uv(1), radius);
 
     if (vIndices.empty())
       continue;
 
     // Match to the most similar keypoint in the radius
-    const cv::Mat dMP = pMP->GetDescriptor();
+    const DescriptorBlock dMP = pMP->GetDescriptor();
 
     int bestDist = 256;
     int bestIdx = -1;
@@ -492,9 +496,9 @@ int ORBmatcher::SearchByProjection(KeyFrame *pKF, Sophus::Sim3f &Scw,
       if (kpLevel < nPredictedLevel - 1 || kpLevel > nPredictedLevel)
         continue;
 
-      const cv::Mat &dKF = pKF->mDescriptors.row(idx);
+      const uint8_t *dKF = pKF->mDescriptors.At(idx);
 
-      const int dist = DescriptorDistance(dMP, dKF);
+      const int dist = DescriptorDistance(dMP.data(), dKF);
 
       if (dist < bestDist) {
         bestDist = dist;
@@ -533,6 +537,9 @@ int ORBmatcher::SearchByProjection(KeyFrame *pKF, Sophus::Sim3<float> &Scw,
 
   int nmatches = 0;
 
+  // Candidates of the current point, reused across points
+  vector<size_t> vIndices;
+
   // For each Candidate MapPoint Project and Match
   for (int iMP = 0, iendMP = vpPoints.size(); iMP < iendMP; iMP++) {
     MapPoint *pMP = vpPoints[iMP];
@@ -584,13 +591,13 @@ int ORBmatcher::SearchByProjection(KeyFrame *pKF, Sophus::Sim3<float> &Scw,
     // Search in a radius
     const float radius = th * pKF->mvScaleFactors[nPredictedLevel];
 
-    const vector<size_t> vIndices = pKF->GetFeaturesInArea(u, v, radius);
+    pKF->GetFeaturesInArea(vIndices, u, v, radius);
 
     if (vIndices.empty())
       continue;
 
     // Match to the most similar keypoint in the radius
-    const cv::Mat dMP = pMP->GetDescriptor();
+    const DescriptorBlock dMP = pMP->GetDescriptor();
 
     int bestDist = 256;
     int bestIdx = -1;
@@ -606,9 +613,9 @@ int ORBmatcher::SearchByProjection(KeyFrame *pKF, Sophus::Sim3<float> &Scw,
       if (kpLevel < nPredictedLevel - 1 || kpLevel > nPredictedLevel)
         continue;
 
-      const cv::Mat &dKF = pKF->mDescriptors.row(idx);
+      const uint8_t *dKF = pKF->mDescriptors.At(idx);
 
-      const int dist = DescriptorDistance(dMP, dKF);
+      const int dist = DescriptorDistance(dMP.data(), dKF);
 
       if (dist < bestDist) {
         bestDist = dist;
@@ -641,19 +648,21 @@ int ORBmatcher::SearchForInitialization(Frame &F1, Frame &F2,
   vector<int> vMatchedDistance(F2.mvKeysUn.size(), INT_MAX);
   vector<int> vnMatches21(F2.mvKeysUn.size(), -1);
 
+  vector<size_t> vIndices2;
+
   for (size_t i1 = 0, iend1 = F1.mvKeysUn.size(); i1 < iend1; i1++) {
     cv::KeyPoint kp1 = F1.mvKeysUn[i1];
     int level1 = kp1.octave;
     if (level1 > 0)
       continue;
 
-    vector<size_t> vIndices2 = F2.GetFeaturesInArea(
-        vbPrevMatched[i1].x, vbPrevMatched[i1].y, windowSize, level1, level1);
+    F2.GetFeaturesInArea(vIndices2, vbPrevMatched[i1].x, vbPrevMatched[i1].y,
+                         windowSize, level1, level1);
 
     if (vIndices2.empty())
       continue;
 
-    cv::Mat d1 = F1.mDescriptors.row(i1);
+    const uint8_t *d1 = F1.mDescriptors.At(i1);
 
     int bestDist = INT_MAX;
     int bestDist2 = INT_MAX;
@@ -663,7 +672,7 @@ int ORBmatcher::SearchForInitialization(Frame &F1, Frame &F2,
          vit != vIndices2.end(); vit++) {
       size_t i2 = *vit;
 
-      cv::Mat d2 = F2.mDescriptors.row(i2);
+      const uint8_t *d2 = F2.mDescriptors.At(i2);
 
       int dist = DescriptorDistance(d1, d2);
 
@@ -737,12 +746,12 @@ int ORBmatcher::SearchByBoW(KeyFrame *pKF1, KeyFrame *pKF2,
   const vector<cv::KeyPoint> &vKeysUn1 = pKF1->mvKeysUn;
   const DBoW2::FeatureVector &vFeatVec1 = pKF1->mFeatVec;
   const vector<MapPoint *> vpMapPoints1 = pKF1->GetMapPointMatches();
-  const cv::Mat &Descriptors1 = pKF1->mDescriptors;
+  const DescriptorBlock &Descriptors1 = pKF1->mDescriptors;
 
   const vector<cv::KeyPoint> &vKeysUn2 = pKF2->mvKeysUn;
   const DBoW2::FeatureVector &vFeatVec2 = pKF2->mFeatVec;
   const vector<MapPoint *> vpMapPoints2 = pKF2->GetMapPointMatches();
-  const cv::Mat &Descriptors2 = pKF2->mDescriptors;
+  const DescriptorBlock &Descriptors2 = pKF2->mDescriptors;
 
   vpMatches12 =
       vector<MapPoint *>(vpMapPoints1.size(), static_cast<MapPoint *>(NULL));
@@ -775,7 +784,7 @@ int ORBmatcher::SearchByBoW(KeyFrame *pKF1, KeyFrame *pKF2,
         if (pMP1->isBad())
           continue;
 
-        const cv::Mat &d1 = Descriptors1.row(idx1);
+        const uint8_t *d1 = Descriptors1.At(idx1);
 
         int bestDist1 = 256;
         int bestIdx2 = -1;
@@ -796,7 +805,7 @@ int ORBmatcher::SearchByBoW(KeyFrame *pKF1, KeyFrame *pKF2,
           if (pMP2->isBad())
             continue;
 
-          const cv::Mat &d2 = Descriptors2.row(idx2);
+          const uint8_t *d2 = Descriptors2.At(idx2);
 
           int dist = DescriptorDistance(d1, d2);
 
@@ -942,7 +951,7 @@ int ORBmatcher::SearchForTriangulation(
         const bool bRight1 =
             (pKF1->NLeft == -1 || idx1 < pKF1->NLeft) ? false : true;
 
-        const cv::Mat &d1 = pKF1->mDescriptors.row(idx1);
+        const uint8_t *d1 = pKF1->mDescriptors.At(idx1);
 
         int bestDist = TH_LOW;
         int bestIdx2 = -1;
@@ -962,7 +971,7 @@ int ORBmatcher::SearchForTriangulation(
             if (!bStereo2)
               continue;
 
-          const cv::Mat &d2 = pKF2->mDescriptors.row(idx2);
+          const uint8_t *d2 = pKF2->mDescriptors.At(idx2);
 
           const int dist = DescriptorDistance(d1, d2);
 
@@ -1087,8 +1096,10 @@ int ORBmatcher::SearchForTriangulation(
   return nmatches;
 }
 
-int ORBmatcher::Fuse(KeyFrame *pKF, const vector<MapPoint *> &vpMapPoints,
-                     const float th, const bool bRight) {
+void ORBmatcher::SearchForFuse(KeyFrame *pKF,
+                               const vector<MapPoint *> &vpMapPoints,
+                               vector<FuseMatch> &vMatches, const float th,
+                               const bool bRight) {
   GeometricCamera *pCamera;
   Sophus::SE3f Tcw;
   Eigen::Vector3f Ow;
@@ -1109,10 +1120,13 @@ int ORBmatcher::Fuse(KeyFrame *pKF, const vector<MapPoint *> &vpMapPoints,
   const float &cy = pKF->cy;
   const float &bf = pKF->mbf;
 
-  int nFused = 0;
+  vMatches.clear();
 
   const int nMPs = vpMapPoints.size();
 
+  // Candidates of the current point, reused across points
+  vector<size_t> vIndices;
+
   // For debbuging
   int count_notMP = 0, count_bad = 0, count_isinKF = 0, count_negdepth = 0,
       count_notinim = 0, count_dist = 0, count_normal = 0, count_notidx = 0,
@@ -1178,8 +1192,7 @@ int ORBmatcher::Fuse(KeyFrame *pKF, const vector<MapPoint *> &vpMapPoints,
     // Search in a radius
     const float radius = th * pKF->mvScaleFactors[nPredictedLevel];
 
-    const vector<size_t> vIndices =
-        pKF->GetFeaturesInArea(uv(0), uv(1), radius, bRight);
+    pKF->GetFeaturesInArea(vIndices, uv(0), uv(1), radius, bRight);
 
     if (vIndices.empty()) {
       count_notidx++;
@@ -1188,7 +1201,7 @@ int ORBmatcher::Fuse(KeyFrame *pKF, const vector<MapPoint *> &vpMapPoints,
 
     // Match to the most similar keypoint in the radius
 
-    const cv::Mat dMP = pMP->GetDescriptor();
+    const DescriptorBlock dMP = pMP->GetDescriptor();
 
     int bestDist = 256;
     int bestIdx = -1;
@@ -1231,9 +1244,9 @@ int ORBmatcher::Fuse(KeyFrame *pKF, const vector<MapPoint *> &vpMapPoints,
       if (bRight)
         idx += pKF->NLeft;
 
-      const cv::Mat &dKF = pKF->mDescriptors.row(idx);
+      const uint8_t *dKF = pKF->mDescriptors.At(idx);
 
-      const int dist = DescriptorDistance(dMP, dKF);
+      const int dist = DescriptorDistance(dMP.data(), dKF);
 
       if (dist < bestDist) {
         bestDist = dist;
@@ -1241,28 +1254,61 @@ int ORBmatcher::Fuse(KeyFrame *pKF, const vector<MapPoint *> &vpMapPoints,
       }
     }
 
-    // If there is already a MapPoint replace otherwise add new measurement
     if (bestDist <= TH_LOW) {
-      MapPoint *pMPinKF = pKF->GetMapPoint(bestIdx);
-      if (pMPinKF) {
-        if (!pMPinKF->isBad()) {
-          if (pMPinKF->Observations() > pMP->Observations())
-            pMP->Replace(pMPinKF);
-          else
-            pMPinKF->Replace(pMP);
-        }
-      } else {
-        pMP->AddObservation(pKF, bestIdx);
-        pKF->AddMapPoint(pMP, bestIdx);
-      }
-      nFused++;
+      FuseMatch match;
+      match.nPoint = i;
+      match.nIdx = bestIdx;
+      vMatches.push_back(match);
     } else
       count_thcheck++;
   }
+}
+
+int ORBmatcher::ApplyFuse(KeyFrame *pKF, const vector<MapPoint *> &vpMapPoints,
+                          const vector<FuseMatch> &vMatches,
+                          vector<MapPoint *> *pvpTouched) {
+  int nFused = 0;
+
+  for (const FuseMatch &match : vMatches) {
+    MapPoint *pMP = vpMapPoints[match.nPoint];
+
+    // An earlier fusion may have replaced the point or added it to pKF
+    if (pMP->isBad() || pMP->IsInKeyFrame(pKF))
+      continue;
+
+    // If there is already a MapPoint replace otherwise add new measurement
+    MapPoint *pMPinKF = pKF->GetMapPoint(match.nIdx);
+    MapPoint *pMPTouched = NULL;
+    if (pMPinKF) {
+      if (!pMPinKF->isBad()) {
+        if (pMPinKF->Observations() > pMP->Observations()) {
+          pMP->Replace(pMPinKF);
+          pMPTouched = pMPinKF;
+        } else {
+          pMPinKF->Replace(pMP);
+          pMPTouched = pMP;
+        }
+      }
+    } else {
+      pMP->AddObservation(pKF, match.nIdx);
+      pKF->AddMapPoint(pMP, match.nIdx);
+      pMPTouched = pMP;
+    }
+    if (pvpTouched && pMPTouched)
+      pvpTouched->push_back(pMPTouched);
+    nFused++;
+  }
 
   return nFused;
 }
 
+int ORBmatcher::Fuse(KeyFrame *pKF, const vector<MapPoint *> &vpMapPoints,
+                     const float th, const bool bRight) {
+  vector<FuseMatch> vMatches;
+  SearchForFuse(pKF, vpMapPoints, vMatches, th, bRight);
+  return ApplyFuse(pKF, vpMapPoints, vMatches);
+}
+
 int ORBmatcher::Fuse(KeyFrame *pKF, Sophus::Sim3f &Scw,
                      const vector<MapPoint *> &vpPoints, float th,
                      vector<MapPoint *> &vpReplacePoint) {
@@ -1284,6 +1330,9 @@ int ORBmatcher::Fuse(KeyFrame *pKF, Sophus::Sim3f &Scw,
 
   const int nPoints = vpPoints.size();
 
+  // Candidates of the current point, reused across points
+  vector<size_t> vIndices;
+
   // For each candidate MapPoint project and match
   for (int iMP = 0; iMP < nPoints; iMP++) {
     MapPoint *pMP = vpPoints[iMP];
@@ -1330,15 +1379,14 @@ int ORBmatcher::Fuse(KeyFrame *pKF, Sophus::Sim3f &Scw,
     // Search in a radius
     const float radius = th * pKF->mvScaleFactors[nPredictedLevel];
 
-    const vector<size_t> vIndices =
-        pKF->GetFeaturesInArea(uv(0), uv(1), radius);
+    pKF->GetFeaturesInArea(vIndices, uv(0), uv(1), radius);
 
     if (vIndices.empty())
       continue;
 
     // Match to the most similar keypoint in the radius
 
-    const cv::Mat dMP = pMP->GetDescriptor();
+    const DescriptorBlock dMP = pMP->GetDescriptor();
 
     int bestDist = INT_MAX;
     int bestIdx = -1;
@@ -1350,9 +1398,9 @@ int ORBmatcher::Fuse(KeyFrame *pKF, Sophus::Sim3f &Scw,
       if (kpLevel < nPredictedLevel - 1 || kpLevel > nPredictedLevel)
         continue;
 
-      const cv::Mat &dKF = pKF->mDescriptors.row(idx);
+      const uint8_t *dKF = pKF->mDescriptors.At(idx);
 
-      int dist = DescriptorDistance(dMP, dKF);
+      int dist = DescriptorDistance(dMP.data(), dKF);
 
       if (dist < bestDist) {
         bestDist = dist;
@@ -1414,6 +1462,9 @@ int ORBmatcher::SearchBySim3(KeyFrame *pKF1, KeyFrame *pKF2,
   vector<int> vnMatch1(N1, -1);
   vector<int> vnMatch2(N2, -1);
 
+  // Candidates of the current point, reused across points
+  vector<size_t> vIndices;
+
   // Transform from KF1 to KF2 and search
   for (int i1 = 0; i1 < N1; i1++) {
     MapPoint *pMP = vpMapPoints1[i1];
@@ -1457,13 +1508,13 @@ int ORBmatcher::SearchBySim3(KeyFrame *pKF1, KeyFrame *pKF2,
     // Search in a radius
     const float radius = th * pKF2->mvScaleFactors[nPredictedLevel];
 
-    const vector<size_t> vIndices = pKF2->GetFeaturesInArea(u, v, radius);
+    pKF2->GetFeaturesInArea(vIndices, u, v, radius);
 
     if (vIndices.empty())
       continue;
 
     // Match to the most similar keypoint in the radius
-    const cv::Mat dMP = pMP->GetDescriptor();
+    const DescriptorBlock dMP = pMP->GetDescriptor();
 
     int bestDist = INT_MAX;
     int bestIdx = -1;
@@ -1477,9 +1528,9 @@ int ORBmatcher::SearchBySim3(KeyFrame *pKF1, KeyFrame *pKF2,
       if (kp.octave < nPredictedLevel - 1 || kp.octave > nPredictedLevel)
         continue;
 
-      const cv::Mat &dKF = pKF2->mDescriptors.row(idx);
+      const uint8_t *dKF = pKF2->mDescriptors.At(idx);
 
-      const int dist = DescriptorDistance(dMP, dKF);
+      const int dist = DescriptorDistance(dMP.data(), dKF);
 
       if (dist < bestDist) {
         bestDist = dist;
@@ -1535,13 +1586,13 @@ int ORBmatcher::SearchBySim3(KeyFrame *pKF1, KeyFrame *pKF2,
     // Search in a radius of 2.5*sigma(ScaleLevel)
     const float radius = th * pKF1->mvScaleFactors[nPredictedLevel];
 
-    const vector<size_t> vIndices = pKF1->GetFeaturesInArea(u, v, radius);
+    pKF1->GetFeaturesInArea(vIndices, u, v, radius);
 
     if (vIndices.empty())
       continue;
 
     // Match to the most similar keypoint in the radius
-    const cv::Mat dMP = pMP->GetDescriptor();
+    const DescriptorBlock dMP = pMP->GetDescriptor();
 
     int bestDist = INT_MAX;
     int bestIdx = -1;
@@ -1555,9 +1606,9 @@ int ORBmatcher::SearchBySim3(KeyFrame *pKF1, KeyFrame *pKF2,
       if (kp.octave < nPredictedLevel - 1 || kp.octave > nPredictedLevel)
         continue;
 
-      const cv::Mat &dKF = pKF1->mDescriptors.row(idx);
+      const uint8_t *dKF = pKF1->mDescriptors.At(idx);
 
-      const int dist = DescriptorDistance(dMP, dKF);
+      const int dist = DescriptorDistance(dMP.data(), dKF);
 
       if (dist < bestDist) {
         bestDist = dist;
@@ -1607,6 +1658,9 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame,
   const bool bForward = tlc(2) > CurrentFrame.mb && !bMono;
   const bool bBackward = -tlc(2) > CurrentFrame.mb && !bMono;
 
+  // Candidates of the current point, reused across points
+  vector<size_t> vIndices2;
+
   for (int i = 0; i < LastFrame.N; i++) {
     MapPoint *pMP = LastFrame.mvpMapPoints[i];
     if (pMP) {
@@ -1637,22 +1691,20 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame,
         // Search in a window. Size depends on scale
         float radius = th * CurrentFrame.mvScaleFactors[nLastOctave];
 
-        vector<size_t> vIndices2;
-
         if (bForward)
-          vIndices2 =
-              CurrentFrame.GetFeaturesInArea(uv(0), uv(1), radius, nLastOctave);
+          CurrentFrame.GetFeaturesInArea(vIndices2, uv(0), uv(1), radius,
+                                         nLastOctave);
         else if (bBackward)
-          vIndices2 = CurrentFrame.GetFeaturesInArea(uv(0), uv(1), radius, 0,
-                                                     nLastOctave);
+          CurrentFrame.GetFeaturesInArea(vIndices2, uv(0), uv(1), radius, 0,
+                                         nLastOctave);
         else
-          vIndices2 = CurrentFrame.GetFeaturesInArea(
-              uv(0), uv(1), radius, nLastOctave - 1, nLastOctave + 1);
+          CurrentFrame.GetFeaturesInArea(vIndices2, uv(0), uv(1), radius,
+                                         nLastOctave - 1, nLastOctave + 1);
 
         if (vIndices2.empty())
           continue;
 
-        const cv::Mat dMP = pMP->GetDescriptor();
+        const DescriptorBlock dMP = pMP->GetDescriptor();
 
         int bestDist = 256;
         int bestIdx2 = -1;
@@ -1673,9 +1725,9 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame,
               continue;
           }
 
-          const cv::Mat &d = CurrentFrame.mDescriptors.row(i2);
+          const uint8_t *d = CurrentFrame.mDescriptors.At(i2);
 
-          const int dist = DescriptorDistance(dMP, d);
+          const int dist = DescriptorDistance(dMP.data(), d);
 
           if (dist < bestDist) {
             bestDist = dist;
@@ -1721,19 +1773,18 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame,
           // Search in a window. Size depends on scale
           float radius = th * CurrentFrame.mvScaleFactors[nLastOctave];
 
-          vector<size_t> vIndices2;
-
           if (bForward)
-            vIndices2 = CurrentFrame.GetFeaturesInArea(uv(0), uv(1), radius,
-                                                       nLastOctave, -1, true);
+            CurrentFrame.GetFeaturesInArea(vIndices2, uv(0), uv(1), radius,
+                                           nLastOctave, -1, true);
           else if (bBackward)
-            vIndices2 = CurrentFrame.GetFeaturesInArea(uv(0), uv(1), radius, 0,
-                                                       nLastOctave, true);
+            CurrentFrame.GetFeaturesInArea(vIndices2, uv(0), uv(1), radius, 0,
+                                           nLastOctave, true);
           else
-            vIndices2 = CurrentFrame.GetFeaturesInArea(
-                uv(0), uv(1), radius, nLastOctave - 1, nLastOctave + 1, true);
+            CurrentFrame.GetFeaturesInArea(vIndices2, uv(0), uv(1), radius,
+                                           nLastOctave - 1, nLastOctave + 1,
+                                           true);
 
-          const cv::Mat dMP = pMP->GetDescriptor();
+          const DescriptorBlock dMP = pMP->GetDescriptor();
 
           int bestDist = 256;
           int bestIdx2 = -1;
@@ -1747,10 +1798,10 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame,
                       ->Observations() > 0)
                 continue;
 
-            const cv::Mat &d =
-                CurrentFrame.mDescriptors.row(i2 + CurrentFrame.Nleft);
+            const uint8_t *d =
+                CurrentFrame.mDescriptors.At(i2 + CurrentFrame.Nleft);
 
-            const int dist = DescriptorDistance(dMP, d);
+            const int dist = DescriptorDistance(dMP.data(), d);
 
             if (dist < bestDist) {
               bestDist = dist;
@@ -1823,6 +1874,9 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, KeyFrame *pKF,
 
   const vector<MapPoint *> vpMPs = pKF->GetMapPointMatches();
 
+  // Candidates of the current point, reused across points
+  vector<size_t> vIndices2;
+
   for (size_t i = 0, iend = vpMPs.size(); i < iend; i++) {
     MapPoint *pMP = vpMPs[i];
 
@@ -1855,13 +1909,14 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, KeyFrame *pKF,
         // Search in a window
         const float radius = th * CurrentFrame.mvScaleFactors[nPredictedLevel];
 
-        const vector<size_t> vIndices2 = CurrentFrame.GetFeaturesInArea(
-            uv(0), uv(1), radius, nPredictedLevel - 1, nPredictedLevel + 1);
+        CurrentFrame.GetFeaturesInArea(vIndices2, uv(0), uv(1), radius,
+                                       nPredictedLevel - 1,
+                                       nPredictedLevel + 1);
 
         if (vIndices2.empty())
           continue;
 
-        const cv::Mat dMP = pMP->GetDescriptor();
+        const DescriptorBlock dMP = pMP->GetDescriptor();
 
         int bestDist = 256;
         int bestIdx2 = -1;
@@ -1872,9 +1927,9 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, KeyFrame *pKF,
           if (CurrentFrame.mvpMapPoints[i2])
             continue;
 
-          const cv::Mat &d = CurrentFrame.mDescriptors.row(i2);
+          const uint8_t *d = CurrentFrame.mDescriptors.At(i2);
 
-          const int dist = DescriptorDistance(dMP, d);
+          const int dist = DescriptorDistance(dMP.data(), d);
 
           if (dist < bestDist) {
             bestDist = dist;
@@ -1956,22 +2011,15 @@ void ORBmatcher::ComputeThreeMaxima(vector<int> *histo, const int L, int &ind1,
   }
 }
 
-// Bit set count operation from
-// http://graphics.stanford.edu/~seander/bithacks.html#CountBitsSetParallel
-int ORBmatcher::DescriptorDistance(const cv::Mat &a, const cv::Mat &b) {
-  const int *pa = a.ptr<int32_t>();
-  const int *pb = b.ptr<int32_t>();
-
-  int dist = 0;
-
-  for (int i = 0; i < 8; i++, pa++, pb++) {
-    unsigned int v = *pa ^ *pb;
-    v = v - ((v >> 1) & 0x55555555);
-    v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
-    dist += (((v + (v >> 4)) & 0xF0F0F0F) * 0x1010101) >> 24;
-  }
-
-  return dist;
+void ORBmatcher::DescriptorDistances(const uint8_t *a,
+                                     const DescriptorBlock &B,
+                                     const vector<size_t> &vIndices,
+                                     vector<int> &vDistances) {
+  vDistances.resize(vIndices.size());
+  if (vIndices.empty())
+    return;
+  Hamming::Distances(a, B.data(), Hamming::DESCRIPTOR_BYTES, vIndices.data(),
+                     vIndices.size(), vDistances.data());
 }
 
 } // namespace ORB_SLAM3
@@ -0,0 +1,138 @@
+/**
+ * This file is part of ORB-SLAM3
+ *
+ * Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez
+ * Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+ * Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós,
+ * University of Zaragoza.
+ *
+ * ORB-SLAM3 is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ORB-SLAM3. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "FeatureGrid.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+namespace ORB_SLAM3 {
+
+FeatureGrid::FeatureGrid()
+    : mnCols(0), mnRows(0), mfMinX(0), mfMinY(0), mfCellWidthInv(0),
+      mfCellHeightInv(0) {}
+
+void FeatureGrid::Build(const vector<cv::KeyPoint> &vKeys, const float minX,
+                        const float minY, const float cellWidthInv,
+                        const float cellHeightInv, const int nCols,
+                        const int nRows) {
+  mnCols = nCols;
+  mnRows = nRows;
+  mfMinX = minX;
+  mfMinY = minY;
+  mfCellWidthInv = cellWidthInv;
+  mfCellHeightInv = cellHeightInv;
+
+  const int nCells = nCols * nRows;
+  const size_t N = vKeys.size();
+
+  // Cell of each keypoint (-1 if outside the grid), and cell histogram
+  vector<int> vCellOf(N);
+  mvCellStart.assign(nCells + 1, 0);
+  for (size_t i = 0; i < N; i++) {
+    const cv::KeyPoint &kp = vKeys[i];
+    const int posX = round((kp.pt.x - minX) * cellWidthInv);
+    const int posY = round((kp.pt.y - minY) * cellHeightInv);
+
+    // Keypoint's coordinates are undistorted, which could cause to go out of
+    // the image
+    if (posX < 0 || posX >= nCols || posY < 0 || posY >= nRows) {
+      vCellOf[i] = -1;
+      continue;
+    }
+
+    vCellOf[i] = posX * nRows + posY;
+    mvCellStart[vCellOf[i] + 1]++;
+  }
+
+  for (int c = 0; c < nCells; c++)
+    mvCellStart[c + 1] += mvCellStart[c];
+
+  // Counting sort, stable so each cell keeps increasing keypoint indices
+  const size_t nAssigned = mvCellStart[nCells];
+  mvIndex.resize(nAssigned);
+  mvX.resize(nAssigned);
+  mvY.resize(nAssigned);
+  mvOctave.resize(nAssigned);
+
+  vector<uint32_t> vNext(mvCellStart.begin(), mvCellStart.end() - 1);
+  for (size_t i = 0; i < N; i++) {
+    if (vCellOf[i] < 0)
+      continue;
+    const uint32_t k = vNext[vCellOf[i]]++;
+    mvIndex[k] = i;
+    mvX[k] = vKeys[i].pt.x;
+    mvY[k] = vKeys[i].pt.y;
+    mvOctave[k] = vKeys[i].octave;
+  }
+}
+
+void FeatureGrid::GetFeaturesInArea(const float &x, const float &y,
+                                    const float &r, const int minLevel,
+                                    const int maxLevel,
+                                    vector<size_t> &vIndices) const {
+  if (mvCellStart.empty())
+    return;
+
+  const int nMinCellX =
+      max(0, (int)floor((x - mfMinX - r) * mfCellWidthInv));
+  if (nMinCellX >= mnCols)
+    return;
+
+  const int nMaxCellX =
+      min(mnCols - 1, (int)ceil((x - mfMinX + r) * mfCellWidthInv));
+  if (nMaxCellX < 0)
+    return;
+
+  const int nMinCellY =
+      max(0, (int)floor((y - mfMinY - r) * mfCellHeightInv));
+  if (nMinCellY >= mnRows)
+    return;
+
+  const int nMaxCellY =
+      min(mnRows - 1, (int)ceil((y - mfMinY + r) * mfCellHeightInv));
+  if (nMaxCellY < 0)
+    return;
+
+  // Octaves are never negative, so an unchecked lower bound is a no-op
+  const bool bCheckLevels = (minLevel > 0) || (maxLevel >= 0);
+  const int minOctave = bCheckLevels ? minLevel : INT_MIN;
+  const int maxOctave = (bCheckLevels && maxLevel >= 0) ? maxLevel : INT_MAX;
+
+  const float *pX = mvX.data();
+  const float *pY = mvY.data();
+  const int8_t *pOctave = mvOctave.data();
+
+  // The cells of one grid column are contiguous
+  for (int ix = nMinCellX; ix <= nMaxCellX; ix++) {
+    const size_t kend = CellEnd(ix, nMaxCellY);
+    for (size_t k = CellBegin(ix, nMinCellY); k < kend; k++) {
+      const int octave = pOctave[k];
+      const bool bInside = fabs(pX[k] - x) < r && fabs(pY[k] - y) < r &&
+                           octave >= minOctave && octave <= maxOctave;
+      if (bInside)
+        vIndices.push_back(mvIndex[k]);
+    }
+  }
+}
+
+} // namespace ORB_SLAM3
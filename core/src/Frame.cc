@@ -21,7 +21,14 @@
 
 #include "Frame.h"
 
-#include <thread>
+#include <climits>
+#include <future>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
 #include "CameraModels/GeometricCamera.h"
 #include "Converter.h"
@@ -30,6 +37,7 @@
 #include "MapPoint.h"
 #include "ORB/extractor.h"
 #include "ORB/matcher.h"
+#include "ThreadPool.h"
 
 #include "CameraModels/KannalaBrandt8.h"
 #include "CameraModels/Pinhole.h"
@@ -92,15 +100,8 @@ Frame::Frame(const Frame &frame)
       mvRightToLeftMatch(frame.mvRightToLeftMatch),
       mvStereo3Dpoints(frame.mvStereo3Dpoints), mTlr(frame.mTlr),
       mRlr(frame.mRlr), mtlr(frame.mtlr), mTrl(frame.mTrl), mTcw(frame.mTcw),
-      mbHasPose(false), mbHasVelocity(false) {
-  for (int i = 0; i < FRAME_GRID_COLS; i++)
-    for (int j = 0; j < FRAME_GRID_ROWS; j++) {
-      mGrid[i][j] = frame.mGrid[i][j];
-      if (frame.Nleft > 0) {
-        mGridRight[i][j] = frame.mGridRight[i][j];
-      }
-    }
-
+      mGrid(frame.mGrid), mGridRight(frame.mGridRight), mbHasPose(false),
+      mbHasVelocity(false) {
   if (frame.mbHasPose)
     SetPose(frame.GetPose());
 
@@ -148,10 +149,7 @@ Frame::Frame(const cv::Mat &imLeft, const cv::Mat &imRight,
   chrono::steady_clock::time_point time_StartExtORB =
       chrono::steady_clock::now();
 #endif
-  thread threadLeft(&Frame::ExtractORB, this, 0, imLeft, 0, 0);
-  thread threadRight(&Frame::ExtractORB, this, 1, imRight, 0, 0);
-  threadLeft.join();
-  threadRight.join();
+  ExtractORBStereo(imLeft, imRight, 0, 0, 0, 0);
 #ifdef REGISTER_TIMES
   chrono::steady_clock::time_point time_EndExtORB = chrono::steady_clock::now();
 
@@ -430,43 +428,44 @@ Frame::Frame(const cv::Mat &imGray, const double &timeStamp,
 }
 
 void Frame::AssignFeaturesToGrid() {
-  // Fill matrix with points
-  const int nCells = FRAME_GRID_COLS * FRAME_GRID_ROWS;
-
-  int nReserve = 0.5f * N / (nCells);
-
-  for (unsigned int i = 0; i < FRAME_GRID_COLS; i++)
-    for (unsigned int j = 0; j < FRAME_GRID_ROWS; j++) {
-      mGrid[i][j].reserve(nReserve);
-      if (Nleft != -1) {
-        mGridRight[i][j].reserve(nReserve);
-      }
-    }
-
-  for (int i = 0; i < N; i++) {
-    const cv::KeyPoint &kp = (Nleft == -1) ? mvKeysUn[i]
-                             : (i < Nleft) ? mvKeys[i]
-                                           : mvKeysRight[i - Nleft];
-
-    int nGridPosX, nGridPosY;
-    if (PosInGrid(kp, nGridPosX, nGridPosY)) {
-      if (Nleft == -1 || i < Nleft)
-        mGrid[nGridPosX][nGridPosY].push_back(i);
-      else
-        mGridRight[nGridPosX][nGridPosY].push_back(i - Nleft);
-    }
-  }
+  // Right keypoints are indexed from 0 in their own grid
+  mGrid.Build((Nleft == -1) ? mvKeysUn : mvKeys, mnMinX, mnMinY,
+              mfGridElementWidthInv, mfGridElementHeightInv, FRAME_GRID_COLS,
+              FRAME_GRID_ROWS);
+  if (Nleft != -1)
+    mGridRight.Build(mvKeysRight, mnMinX, mnMinY, mfGridElementWidthInv,
+                     mfGridElementHeightInv, FRAME_GRID_COLS, FRAME_GRID_ROWS);
 }
 
 void Frame::ExtractORB(int flag, const cv::Mat &im, const int x0,
                        const int x1) {
   vector<int> vLapping = {x0, x1};
-  if (flag == 0)
+  cv::Mat descriptors;
+  if (flag == 0) {
     monoLeft =
-        (*mpORBextractorLeft)(im, cv::Mat(), mvKeys, mDescriptors, vLapping);
-  else
+        (*mpORBextractorLeft)(im, cv::Mat(), mvKeys, descriptors, vLapping);
+    mDescriptors = descriptors;
+  } else {
     monoRight = (*mpORBextractorRight)(im, cv::Mat(), mvKeysRight,
-                                       mDescriptorsRight, vLapping);
+                                       descriptors, vLapping);
+    mDescriptorsRight = descriptors;
+  }
+}
+
+void Frame::ExtractORBStereo(const cv::Mat &imLeft, const cv::Mat &imRight,
+                             const int x0Left, const int x1Left,
+                             const int x0Right, const int x1Right) {
+  ThreadPool *pPool = mpORBextractorRight->GetThreadPool();
+  if (!pPool) {
+    ExtractORB(0, imLeft, x0Left, x1Left);
+    ExtractORB(1, imRight, x0Right, x1Right);
+    return;
+  }
+
+  future<void> right = pPool->Submit(
+      [&] { ExtractORB(1, imRight, x0Right, x1Right); });
+  ExtractORB(0, imLeft, x0Left, x1Left);
+  right.get();
 }
 
 bool Frame::isSet() const { return mbIsSet; }
@@ -540,6 +539,13 @@ Eigen::Vector3f Frame::GetRelativePoseTlr_translation() {
   return mTlr.translation();
 }
 
+void Frame::SetRelativePoseTlr(const Sophus::SE3f &Tlr) {
+  mTlr = Tlr;
+  mTrl = mTlr.inverse();
+  mRlr = mTlr.rotationMatrix();
+  mtlr = mTlr.translation();
+}
+
 bool Frame::isInFrustum(MapPoint *pMP, float viewingCosLimit) {
   if (Nleft == -1) {
     pMP->mbTrackInView = false;
@@ -686,66 +692,19 @@ vector<size_t> Frame::GetFeaturesInArea(const float &x, const float &y,
   vector<size_t> vIndices;
   vIndices.reserve(N);
 
-  float factorX = r;
-  float factorY = r;
-
-  const int nMinCellX =
-      max(0, (int)floor((x - mnMinX - factorX) * mfGridElementWidthInv));
-  if (nMinCellX >= FRAME_GRID_COLS) {
-    return vIndices;
-  }
-
-  const int nMaxCellX =
-      min((int)FRAME_GRID_COLS - 1,
-          (int)ceil((x - mnMinX + factorX) * mfGridElementWidthInv));
-  if (nMaxCellX < 0) {
-    return vIndices;
-  }
-
-  const int nMinCellY =
-      max(0, (int)floor((y - mnMinY - factorY) * mfGridElementHeightInv));
-  if (nMinCellY >= FRAME_GRID_ROWS) {
-    return vIndices;
-  }
+  GetFeaturesInArea(vIndices, x, y, r, minLevel, maxLevel, bRight);
 
-  const int nMaxCellY =
-      min((int)FRAME_GRID_ROWS - 1,
-          (int)ceil((y - mnMinY + factorY) * mfGridElementHeightInv));
-  if (nMaxCellY < 0) {
-    return vIndices;
-  }
-
-  const bool bCheckLevels = (minLevel > 0) || (maxLevel >= 0);
-
-  for (int ix = nMinCellX; ix <= nMaxCellX; ix++) {
-    for (int iy = nMinCellY; iy <= nMaxCellY; iy++) {
-      const vector<size_t> vCell =
-          (!bRight) ? mGrid[ix][iy] : mGridRight[ix][iy];
-      if (vCell.empty())
-        continue;
-
-      for (size_t j = 0, jend = vCell.size(); j < jend; j++) {
-        const cv::KeyPoint &kpUn = (Nleft == -1) ? mvKeysUn[vCell[j]]
-                                   : (!bRight)   ? mvKeys[vCell[j]]
-                                                 : mvKeysRight[vCell[j]];
-        if (bCheckLevels) {
-          if (kpUn.octave < minLevel)
-            continue;
-          if (maxLevel >= 0)
-            if (kpUn.octave > maxLevel)
-              continue;
-        }
+  return vIndices;
+}
 
-        const float distx = kpUn.pt.x - x;
-        const float disty = kpUn.pt.y - y;
+void Frame::GetFeaturesInArea(vector<size_t> &vIndices, const float &x,
+                              const float &y, const float &r,
+                              const int minLevel, const int maxLevel,
+                              const bool bRight) const {
+  vIndices.clear();
 
-        if (fabs(distx) < factorX && fabs(disty) < factorY)
-          vIndices.push_back(vCell[j]);
-      }
-    }
-  }
-
-  return vIndices;
+  const FeatureGrid &grid = (!bRight) ? mGrid : mGridRight;
+  grid.GetFeaturesInArea(x, y, r, minLevel, maxLevel, vIndices);
 }
 
 bool Frame::PosInGrid(const cv::KeyPoint &kp, int &posX, int &posY) {
@@ -828,6 +787,82 @@ void Frame::ComputeImageBounds(const cv::Mat &imLeft) {
   }
 }
 
+namespace {
+
+// Half size of the stereo correlation patch and of the sliding window search
+const int STEREO_PATCH_W = 5;
+const int STEREO_SEARCH_L = 5;
+
+// Sum of absolute differences between the (2W+1)x(2W+1) patch of the left
+// image centered at pL and the patches of the right image centered at pR + inc
+// for inc in [-L, L], written to dist[L + inc]. Patch rows are read 16 bytes
+// at a time, so 5 bytes past the right edge of each patch must be readable,
+// which the border of the pyramid levels guarantees.
+void SlidingWindowSAD(const uchar *pL, const size_t stepL, const uchar *pR,
+                      const size_t stepR, int *dist) {
+  const int w = STEREO_PATCH_W;
+  const int L = STEREO_SEARCH_L;
+  const int nInc = 2 * L + 1;
+
+#if defined(__SSE2__)
+  const __m128i mask =
+      _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 0, 0, 0, 0);
+  __m128i acc[nInc];
+  for (int k = 0; k < nInc; k++)
+    acc[k] = _mm_setzero_si128();
+
+  for (int r = -w; r <= w; r++) {
+    const uchar *rowL = pL + r * (ptrdiff_t)stepL - w;
+    const uchar *rowR = pR + r * (ptrdiff_t)stepR - w - L;
+    const __m128i l = _mm_and_si128(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(rowL)), mask);
+    for (int k = 0; k < nInc; k++) {
+      const __m128i rr = _mm_and_si128(
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(rowR + k)), mask);
+      acc[k] = _mm_add_epi64(acc[k], _mm_sad_epu8(l, rr));
+    }
+  }
+
+  for (int k = 0; k < nInc; k++)
+    dist[k] = _mm_cvtsi128_si32(acc[k]) +
+              _mm_cvtsi128_si32(_mm_unpackhi_epi64(acc[k], acc[k]));
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  static const uint8_t maskBytes[16] = {255, 255, 255, 255, 255, 255,
+                                        255, 255, 255, 255, 255, 0,
+                                        0,   0,   0,   0};
+  const uint8x16_t mask = vld1q_u8(maskBytes);
+  uint16x8_t acc[nInc];
+  for (int k = 0; k < nInc; k++)
+    acc[k] = vdupq_n_u16(0);
+
+  for (int r = -w; r <= w; r++) {
+    const uchar *rowL = pL + r * (ptrdiff_t)stepL - w;
+    const uchar *rowR = pR + r * (ptrdiff_t)stepR - w - L;
+    const uint8x16_t l = vandq_u8(vld1q_u8(rowL), mask);
+    for (int k = 0; k < nInc; k++) {
+      const uint8x16_t rr = vandq_u8(vld1q_u8(rowR + k), mask);
+      acc[k] = vpadalq_u8(acc[k], vabdq_u8(l, rr));
+    }
+  }
+
+  for (int k = 0; k < nInc; k++)
+    dist[k] = vaddvq_u16(acc[k]);
+#else
+  for (int k = 0; k < nInc; k++) {
+    int sad = 0;
+    for (int r = -w; r <= w; r++) {
+      const uchar *rowL = pL + r * (ptrdiff_t)stepL;
+      const uchar *rowR = pR + r * (ptrdiff_t)stepR + k - L;
+      for (int c = -w; c <= w; c++)
+        sad += abs((int)rowL[c] - (int)rowR[c]);
+    }
+    dist[k] = sad;
+  }
+#endif
+}
+
+} // namespace
+
 void Frame::ComputeStereoMatches() {
   mvuRight = vector<float>(N, -1.0f);
   mvDepth = vector<float>(N, -1.0f);
@@ -836,23 +871,34 @@ void Frame::ComputeStereoMatches() {
 
   const int nRows = mpORBextractorLeft->mvImagePyramid[0].rows;
 
-  // Assign keypoints to row table
-  vector<vector<size_t>> vRowIndices(nRows, vector<size_t>());
-
-  for (int i = 0; i < nRows; i++)
-    vRowIndices[i].reserve(200);
-
+  // Assign keypoints to row table. The table is stored as one flat array of
+  // right keypoint indices plus the offset of every row (CSR layout), so
+  // building it costs two allocations instead of one vector per row.
   const int Nr = mvKeysRight.size();
 
+  vector<int> vRowStart(nRows + 1, 0);
+  vector<int> vRowMin(Nr), vRowMax(Nr);
+
   for (int iR = 0; iR < Nr; iR++) {
     const cv::KeyPoint &kp = mvKeysRight[iR];
     const float &kpY = kp.pt.y;
     const float r = 2.0f * mvScaleFactors[mvKeysRight[iR].octave];
-    const int maxr = ceil(kpY + r);
-    const int minr = floor(kpY - r);
+    vRowMin[iR] = max((int)floor(kpY - r), 0);
+    vRowMax[iR] = min((int)ceil(kpY + r), nRows - 1);
 
-    for (int yi = minr; yi <= maxr; yi++)
-      vRowIndices[yi].push_back(iR);
+    for (int yi = vRowMin[iR]; yi <= vRowMax[iR]; yi++)
+      vRowStart[yi + 1]++;
+  }
+
+  for (int yi = 0; yi < nRows; yi++)
+    vRowStart[yi + 1] += vRowStart[yi];
+
+  vector<int> vRowIndices(vRowStart[nRows]);
+  {
+    vector<int> vRowFill(vRowStart.begin(), vRowStart.end() - 1);
+    for (int iR = 0; iR < Nr; iR++)
+      for (int yi = vRowMin[iR]; yi <= vRowMax[iR]; yi++)
+        vRowIndices[vRowFill[yi]++] = iR;
   }
 
   // Set limits for search
@@ -860,35 +906,39 @@ void Frame::ComputeStereoMatches() {
   const float minD = 0;
   const float maxD = mbf / minZ;
 
-  // For each left keypoint search a match in the right image
-  vector<pair<int, int>> vDistIdx;
-  vDistIdx.reserve(N);
+  // SAD of the accepted matches, -1 for the rest
+  vector<int> vSadDist(N, -1);
 
-  for (int iL = 0; iL < N; iL++) {
+  // For each left keypoint search a match in the right image. Keypoints are
+  // independent and only write their own entries, so chunks of them run on
+  // the extractors' thread pool.
+  auto matchKeyPoint = [&](const int iL) {
     const cv::KeyPoint &kpL = mvKeys[iL];
     const int &levelL = kpL.octave;
     const float &vL = kpL.pt.y;
     const float &uL = kpL.pt.x;
 
-    const vector<size_t> &vCandidates = vRowIndices[vL];
+    const int row = vL;
+    const int *pCandidates = vRowIndices.data() + vRowStart[row];
+    const int nCandidates = vRowStart[row + 1] - vRowStart[row];
 
-    if (vCandidates.empty())
-      continue;
+    if (nCandidates == 0)
+      return;
 
     const float minU = uL - maxD;
     const float maxU = uL - minD;
 
     if (maxU < 0)
-      continue;
+      return;
 
     int bestDist = ORBmatcher::TH_HIGH;
     size_t bestIdxR = 0;
 
-    const cv::Mat &dL = mDescriptors.row(iL);
+    const uint8_t *dL = mDescriptors.At(iL);
 
     // Compare descriptor to right keypoints
-    for (size_t iC = 0; iC < vCandidates.size(); iC++) {
-      const size_t iR = vCandidates[iC];
+    for (int iC = 0; iC < nCandidates; iC++) {
+      const size_t iR = pCandidates[iC];
       const cv::KeyPoint &kpR = mvKeysRight[iR];
 
       if (kpR.octave < levelL - 1 || kpR.octave > levelL + 1)
@@ -897,7 +947,7 @@ void Frame::ComputeStereoMatches() {
       const float &uR = kpR.pt.x;
 
       if (uR >= minU && uR <= maxU) {
-        const cv::Mat &dR = mDescriptorsRight.row(iR);
+        const uint8_t *dR = mDescriptorsRight.At(iR);
         const int dist = ORBmatcher::DescriptorDistance(dL, dR);
 
         if (dist < bestDist) {
@@ -917,40 +967,32 @@ void Frame::ComputeStereoMatches() {
       const float scaleduR0 = round(uR0 * scaleFactor);
 
       // sliding window search
-      const int w = 5;
-      cv::Mat IL = mpORBextractorLeft->mvImagePyramid[kpL.octave]
-                       .rowRange(scaledvL - w, scaledvL + w + 1)
-                       .colRange(scaleduL - w, scaleduL + w + 1);
-
-      int bestDist = INT_MAX;
-      int bestincR = 0;
-      const int L = 5;
-      vector<float> vDists;
-      vDists.resize(2 * L + 1);
+      const int w = STEREO_PATCH_W;
+      const int L = STEREO_SEARCH_L;
+      const cv::Mat &imL = mpORBextractorLeft->mvImagePyramid[kpL.octave];
+      const cv::Mat &imR = mpORBextractorRight->mvImagePyramid[kpL.octave];
 
       const float iniu = scaleduR0 + L - w;
       const float endu = scaleduR0 + L + w + 1;
-      if (iniu < 0 ||
-          endu >= mpORBextractorRight->mvImagePyramid[kpL.octave].cols)
-        continue;
+      if (iniu < 0 || endu >= imR.cols)
+        return;
 
-      for (int incR = -L; incR <= +L; incR++) {
-        cv::Mat IR =
-            mpORBextractorRight->mvImagePyramid[kpL.octave]
-                .rowRange(scaledvL - w, scaledvL + w + 1)
-                .colRange(scaleduR0 + incR - w, scaleduR0 + incR + w + 1);
+      int vDists[2 * STEREO_SEARCH_L + 1];
+      SlidingWindowSAD(imL.ptr<uchar>((int)scaledvL) + (int)scaleduL, imL.step,
+                       imR.ptr<uchar>((int)scaledvL) + (int)scaleduR0,
+                       imR.step, vDists);
 
-        float dist = cv::norm(IL, IR, cv::NORM_L1);
-        if (dist < bestDist) {
-          bestDist = dist;
+      int bestDist = INT_MAX;
+      int bestincR = 0;
+      for (int incR = -L; incR <= +L; incR++) {
+        if (vDists[L + incR] < bestDist) {
+          bestDist = vDists[L + incR];
           bestincR = incR;
         }
-
-        vDists[L + incR] = dist;
       }
 
       if (bestincR == -L || bestincR == L)
-        continue;
+        return;
 
       // Sub-pixel match (Parabola fitting)
       const float dist1 = vDists[L + bestincR - 1];
@@ -961,7 +1003,7 @@ void Frame::ComputeStereoMatches() {
           (dist1 - dist3) / (2.0f * (dist1 + dist3 - 2.0f * dist2));
 
       if (deltaR < -1 || deltaR > 1)
-        continue;
+        return;
 
       // Re-scaled coordinate
       float bestuR = mvScaleFactors[kpL.octave] *
@@ -976,11 +1018,36 @@ void Frame::ComputeStereoMatches() {
         }
         mvDepth[iL] = mbf / disparity;
         mvuRight[iL] = bestuR;
-        vDistIdx.push_back(pair<int, int>(bestDist, iL));
+        vSadDist[iL] = bestDist;
       }
     }
+  };
+
+  const int chunkSize = 64;
+  const int nChunks = (N + chunkSize - 1) / chunkSize;
+  auto matchChunk = [&](const int chunk) {
+    const int end = min(N, (chunk + 1) * chunkSize);
+    for (int iL = chunk * chunkSize; iL < end; iL++)
+      matchKeyPoint(iL);
+  };
+
+  ThreadPool *pPool = mpORBextractorLeft->GetThreadPool();
+  if (pPool) {
+    pPool->ParallelFor(0, nChunks, matchChunk);
+  } else {
+    for (int chunk = 0; chunk < nChunks; chunk++)
+      matchChunk(chunk);
   }
 
+  vector<pair<int, int>> vDistIdx;
+  vDistIdx.reserve(N);
+  for (int iL = 0; iL < N; iL++)
+    if (vSadDist[iL] >= 0)
+      vDistIdx.push_back(pair<int, int>(vSadDist[iL], iL));
+
+  if (vDistIdx.empty())
+    return;
+
   sort(vDistIdx.begin(), vDistIdx.end());
   const float median = vDistIdx[vDistIdx.size() / 2].first;
   const float thDist = 1.5f * 1.4f * median;
@@ -1075,15 +1142,11 @@ Frame::Frame(const cv::Mat &imLeft, const cv::Mat &imRight,
   chrono::steady_clock::time_point time_StartExtORB =
       chrono::steady_clock::now();
 #endif
-  thread threadLeft(&Frame::ExtractORB, this, 0, imLeft,
-                    static_cast<KannalaBrandt8 *>(mpCamera)->mvLappingArea[0],
-                    static_cast<KannalaBrandt8 *>(mpCamera)->mvLappingArea[1]);
-  thread threadRight(
-      &Frame::ExtractORB, this, 1, imRight,
-      static_cast<KannalaBrandt8 *>(mpCamera2)->mvLappingArea[0],
-      static_cast<KannalaBrandt8 *>(mpCamera2)->mvLappingArea[1]);
-  threadLeft.join();
-  threadRight.join();
+  ExtractORBStereo(imLeft, imRight,
+                   static_cast<KannalaBrandt8 *>(mpCamera)->mvLappingArea[0],
+                   static_cast<KannalaBrandt8 *>(mpCamera)->mvLappingArea[1],
+                   static_cast<KannalaBrandt8 *>(mpCamera2)->mvLappingArea[0],
+                   static_cast<KannalaBrandt8 *>(mpCamera2)->mvLappingArea[1]);
 #ifdef REGISTER_TIMES
   chrono::steady_clock::time_point time_EndExtORB = chrono::steady_clock::now();
 
@@ -1122,10 +1185,7 @@ Frame::Frame(const cv::Mat &imLeft, const cv::Mat &imRight,
   mb = mbf / fx;
 
   // Sophus/Eigen
-  mTlr = Tlr;
-  mTrl = mTlr.inverse();
-  mRlr = mTlr.rotationMatrix();
-  mtlr = mTlr.translation();
+  SetRelativePoseTlr(Tlr);
 
 #ifdef REGISTER_TIMES
   chrono::steady_clock::time_point time_StartStereoMatches =
@@ -1142,7 +1202,9 @@ Frame::Frame(const cv::Mat &imLeft, const cv::Mat &imRight,
 #endif
 
   // Put all descriptors in the same matrix
-  cv::vconcat(mDescriptors, mDescriptorsRight, mDescriptors);
+  cv::Mat descriptors;
+  cv::vconcat(mDescriptors.mat(), mDescriptorsRight.mat(), descriptors);
+  mDescriptors = descriptors;
 
   mvpMapPoints = vector<MapPoint *>(N, static_cast<MapPoint *>(nullptr));
   mvbOutlier = vector<bool>(N, false);
@@ -1160,9 +1222,8 @@ void Frame::ComputeStereoFishEyeMatches() {
   vector<cv::KeyPoint> stereoRight(mvKeysRight.begin() + monoRight,
                                    mvKeysRight.end());
 
-  cv::Mat stereoDescLeft = mDescriptors.rowRange(monoLeft, mDescriptors.rows);
-  cv::Mat stereoDescRight =
-      mDescriptorsRight.rowRange(monoRight, mDescriptorsRight.rows);
+  cv::Mat stereoDescLeft = mDescriptors.rowRange(monoLeft, Nleft);
+  cv::Mat stereoDescRight = mDescriptorsRight.rowRange(monoRight, Nright);
 
   mvLeftToRightMatch = vector<int>(Nleft, -1);
   mvRightToLeftMatch = vector<int>(Nright, -1);
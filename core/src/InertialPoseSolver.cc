@@ -0,0 +1,231 @@
+/**
+ * This file is part of ORB-SLAM3
+ *
+ * Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez
+ * Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+ * Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós,
+ * University of Zaragoza.
+ *
+ * ORB-SLAM3 is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ORB-SLAM3. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "InertialPoseSolver.h"
+
+#include <Eigen/Dense>
+#include <g2o/core/robust_kernel.h>
+
+namespace ORB_SLAM3 {
+
+InertialPoseSolver::InertialPoseSolver() : mnDim(0), mbWorkspaceBound(false) {}
+
+InertialPoseSolver::~InertialPoseSolver() {
+  for (EdgeMonoOnlyPose *e : mvpEdgesMono)
+    delete e;
+  for (EdgeStereoOnlyPose *e : mvpEdgesStereo)
+    delete e;
+  for (EdgeInertial *e : mvpEdgesInertial)
+    delete e;
+  for (EdgeGyroRW *e : mvpEdgesGyroRW)
+    delete e;
+  for (EdgeAccRW *e : mvpEdgesAccRW)
+    delete e;
+  for (EdgePriorPoseImu *e : mvpEdgesPrior)
+    delete e;
+
+  for (State &s : mvStates) {
+    delete s.VP;
+    delete s.VV;
+    delete s.VG;
+    delete s.VA;
+  }
+}
+
+void InertialPoseSolver::AddState(VertexPose *VP, VertexVelocity *VV,
+                                  VertexGyroBias *VG, VertexAccBias *VA,
+                                  const bool bFixed) {
+  State s;
+  s.VP = VP;
+  s.VV = VV;
+  s.VG = VG;
+  s.VA = VA;
+  s.nOffset = bFixed ? -1 : mnDim;
+  if (!bFixed)
+    mnDim += 15;
+  mvStates.push_back(s);
+
+  VP->setFixed(bFixed);
+  VV->setFixed(bFixed);
+  VG->setFixed(bFixed);
+  VA->setFixed(bFixed);
+}
+
+void InertialPoseSolver::AddEdge(EdgeMonoOnlyPose *e) {
+  mvpEdgesMono.push_back(e);
+}
+
+void InertialPoseSolver::AddEdge(EdgeStereoOnlyPose *e) {
+  mvpEdgesStereo.push_back(e);
+}
+
+void InertialPoseSolver::AddEdge(EdgeInertial *e) {
+  mvpEdgesInertial.push_back(e);
+}
+
+void InertialPoseSolver::AddEdge(EdgeGyroRW *e) { mvpEdgesGyroRW.push_back(e); }
+
+void InertialPoseSolver::AddEdge(EdgeAccRW *e) { mvpEdgesAccRW.push_back(e); }
+
+void InertialPoseSolver::AddEdge(EdgePriorPoseImu *e) {
+  mvpEdgesPrior.push_back(e);
+}
+
+size_t InertialPoseSolver::NumEdges() const {
+  return mvpEdgesMono.size() + mvpEdgesStereo.size() +
+         mvpEdgesInertial.size() + mvpEdgesGyroRW.size() +
+         mvpEdgesAccRW.size() + mvpEdgesPrior.size();
+}
+
+int InertialPoseSolver::Offset(const g2o::HyperGraph::Vertex *pV) const {
+  for (const State &s : mvStates) {
+    if (s.nOffset < 0)
+      continue;
+    if (pV == s.VP)
+      return s.nOffset;
+    if (pV == s.VV)
+      return s.nOffset + 6;
+    if (pV == s.VG)
+      return s.nOffset + 9;
+    if (pV == s.VA)
+      return s.nOffset + 12;
+  }
+  return -1;
+}
+
+template <class Edge, class Jacobian>
+void InertialPoseSolver::Accumulate(Edge *e, const Jacobian &J, MatrixH &H,
+                                    VectorB &b) const {
+  // Huber kernels scale the information by their first derivative
+  typename Edge::InformationType Omega = e->information();
+  if (e->robustKernel()) {
+    g2o::Vector3 rho;
+    e->robustKernel()->robustify(e->chi2(), rho);
+    Omega *= rho[1];
+  }
+
+  const Eigen::Matrix<double, Jacobian::ColsAtCompileTime,
+                      Jacobian::RowsAtCompileTime>
+      JtW = J.transpose() * Omega;
+
+  int c1 = 0;
+  for (size_t k1 = 0; k1 < e->vertices().size(); k1++) {
+    const g2o::OptimizableGraph::Vertex *pV1 =
+        static_cast<const g2o::OptimizableGraph::Vertex *>(e->vertex(k1));
+    const int d1 = pV1->dimension();
+    const int o1 = Offset(pV1);
+    if (o1 >= 0) {
+      b.segment(o1, d1).noalias() -= JtW.middleRows(c1, d1) * e->error();
+
+      int c2 = 0;
+      for (size_t k2 = 0; k2 < e->vertices().size(); k2++) {
+        const g2o::OptimizableGraph::Vertex *pV2 =
+            static_cast<const g2o::OptimizableGraph::Vertex *>(e->vertex(k2));
+        const int d2 = pV2->dimension();
+        const int o2 = Offset(pV2);
+        if (o2 >= 0)
+          H.block(o1, o2, d1, d2).noalias() +=
+              JtW.middleRows(c1, d1) * J.middleCols(c2, d2);
+        c2 += d2;
+      }
+    }
+    c1 += d1;
+  }
+}
+
+template <class Edge>
+void InertialPoseSolver::Accumulate(const vector<Edge *> &vpEdges, MatrixH &H,
+                                    VectorB &b) const {
+  for (Edge *e : vpEdges) {
+    if (e->level() != 0)
+      continue;
+    e->computeError();
+    Accumulate(e, e->GetJacobian(), H, b);
+  }
+}
+
+template <class Edge>
+void InertialPoseSolver::SizeWorkspace(const vector<Edge *> &vpEdges) {
+  for (Edge *e : vpEdges)
+    mJacobianWorkspace.updateSize(e);
+}
+
+template <class Edge>
+void InertialPoseSolver::BindWorkspace(const vector<Edge *> &vpEdges) {
+  // The edges declare linearizeOplus(), which hides this overload
+  for (Edge *e : vpEdges)
+    static_cast<g2o::OptimizableGraph::Edge *>(e)->linearizeOplus(
+        mJacobianWorkspace);
+}
+
+void InertialPoseSolver::Optimize(const int nIterations) {
+  if (mnDim == 0)
+    return;
+
+  if (!mbWorkspaceBound) {
+    SizeWorkspace(mvpEdgesMono);
+    SizeWorkspace(mvpEdgesStereo);
+    SizeWorkspace(mvpEdgesInertial);
+    SizeWorkspace(mvpEdgesGyroRW);
+    SizeWorkspace(mvpEdgesAccRW);
+    SizeWorkspace(mvpEdgesPrior);
+    mJacobianWorkspace.allocate();
+
+    BindWorkspace(mvpEdgesMono);
+    BindWorkspace(mvpEdgesStereo);
+    BindWorkspace(mvpEdgesInertial);
+    BindWorkspace(mvpEdgesGyroRW);
+    BindWorkspace(mvpEdgesAccRW);
+    BindWorkspace(mvpEdgesPrior);
+    mbWorkspaceBound = true;
+  }
+
+  MatrixH H(mnDim, mnDim);
+  VectorB b(mnDim);
+
+  for (int it = 0; it < nIterations; it++) {
+    H.setZero();
+    b.setZero();
+
+    Accumulate(mvpEdgesMono, H, b);
+    Accumulate(mvpEdgesStereo, H, b);
+    Accumulate(mvpEdgesInertial, H, b);
+    Accumulate(mvpEdgesGyroRW, H, b);
+    Accumulate(mvpEdgesAccRW, H, b);
+    Accumulate(mvpEdgesPrior, H, b);
+
+    const Eigen::LDLT<MatrixH> ldlt(H);
+    if (ldlt.info() != Eigen::Success || !ldlt.isPositive())
+      break;
+    const VectorB dx = ldlt.solve(b);
+
+    for (State &s : mvStates) {
+      if (s.nOffset < 0)
+        continue;
+      s.VP->oplus(dx.data() + s.nOffset);
+      s.VV->oplus(dx.data() + s.nOffset + 6);
+      s.VG->oplus(dx.data() + s.nOffset + 9);
+      s.VA->oplus(dx.data() + s.nOffset + 12);
+    }
+  }
+}
+
+} // namespace ORB_SLAM3
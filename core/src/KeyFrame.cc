@@ -36,15 +36,13 @@ KeyFrame::KeyFrame()
       mnGridRows(FRAME_GRID_ROWS), mfGridElementWidthInv(0),
       mfGridElementHeightInv(0), mnTrackReferenceForFrame(0),
       mnFuseTargetForKF(0), mnBALocalForKF(0), mnBAFixedForKF(0),
-      mnBALocalForMerge(0), mnLoopQuery(0), mnLoopWords(0), mnRelocQuery(0),
-      mnRelocWords(0), mnMergeQuery(0), mnMergeWords(0), mnBAGlobalForKF(0),
-      fx(0), fy(0), cx(0), cy(0), invfx(0), invfy(0),
-      mnPlaceRecognitionQuery(0), mnPlaceRecognitionWords(0),
-      mPlaceRecognitionScore(0), mbf(0), mb(0), mThDepth(0), N(0), mvKeys(),
+      mnBALocalForMerge(0), mnBAGlobalForKF(0), fx(0), fy(0), cx(0), cy(0),
+      invfx(0), invfy(0), mbf(0), mb(0), mThDepth(0), N(0), mvKeys(),
       mvKeysUn(), mvuRight(), mvDepth(), mnScaleLevels(0), mfScaleFactor(0),
       mfLogScaleFactor(0), mvScaleFactors(0), mvLevelSigma2(0),
       mvInvLevelSigma2(0), mnMinX(0), mnMinY(0), mnMaxX(0), mnMaxY(0),
-      mPrevKF(NULL), mNextKF(NULL), mbFirstConnection(true), mpParent(NULL),
+      mPrevKF(NULL), mNextKF(NULL), mnMapPointsVersion(0),
+      mbFirstConnection(true), mpParent(NULL),
       mbNotErase(false), mbToBeErased(false), mbBad(false), mHalfBaseline(0),
       mbCurrentPlaceRecognition(false), mnMergeCorrectedForKF(0), NLeft(0),
       NRight(0), mnNumberOfOpt(0), mbHasVelocity(false) {}
@@ -56,13 +54,10 @@ KeyFrame::KeyFrame(Frame &F, Map *pMap, KeyFrameDatabase *pKFDB)
       mfGridElementWidthInv(F.mfGridElementWidthInv),
       mfGridElementHeightInv(F.mfGridElementHeightInv),
       mnTrackReferenceForFrame(0), mnFuseTargetForKF(0), mnBALocalForKF(0),
-      mnBAFixedForKF(0), mnBALocalForMerge(0), mnLoopQuery(0), mnLoopWords(0),
-      mnRelocQuery(0), mnRelocWords(0), mnBAGlobalForKF(0),
-      mnPlaceRecognitionQuery(0), mnPlaceRecognitionWords(0),
-      mPlaceRecognitionScore(0), fx(F.fx), fy(F.fy), cx(F.cx), cy(F.cy),
-      invfx(F.invfx), invfy(F.invfy), mbf(F.mbf), mb(F.mb),
-      mThDepth(F.mThDepth), N(F.N), mvKeys(F.mvKeys), mvKeysUn(F.mvKeysUn),
-      mvuRight(F.mvuRight), mvDepth(F.mvDepth),
+      mnBAFixedForKF(0), mnBALocalForMerge(0), mnBAGlobalForKF(0), fx(F.fx),
+      fy(F.fy), cx(F.cx), cy(F.cy), invfx(F.invfx), invfy(F.invfy),
+      mbf(F.mbf), mb(F.mb), mThDepth(F.mThDepth), N(F.N), mvKeys(F.mvKeys),
+      mvKeysUn(F.mvKeysUn), mvuRight(F.mvuRight), mvDepth(F.mvDepth),
       mDescriptors(F.mDescriptors.clone()), mBowVec(F.mBowVec),
       mFeatVec(F.mFeatVec), mnScaleLevels(F.mnScaleLevels),
       mfScaleFactor(F.mfScaleFactor), mfLogScaleFactor(F.mfLogScaleFactor),
@@ -70,7 +65,8 @@ KeyFrame::KeyFrame(Frame &F, Map *pMap, KeyFrameDatabase *pKFDB)
       mvInvLevelSigma2(F.mvInvLevelSigma2), mnMinX(F.mnMinX), mnMinY(F.mnMinY),
       mnMaxX(F.mnMaxX), mnMaxY(F.mnMaxY), mK_(F.mK_), mPrevKF(NULL),
       mNextKF(NULL), mpImuPreintegrated(F.mpImuPreintegrated),
-      mImuCalib(F.mImuCalib), mvpMapPoints(F.mvpMapPoints), mpKeyFrameDB(pKFDB),
+      mImuCalib(F.mImuCalib), mvpMapPoints(F.mvpMapPoints),
+      mnMapPointsVersion(0), mpKeyFrameDB(pKFDB),
       mpORBvocabulary(F.mpORBvocabulary), mbFirstConnection(true),
       mpParent(NULL), mDistCoef(F.mDistCoef), mbNotErase(false),
       mnDataset(F.mnDataset), mbToBeErased(false), mbBad(false),
@@ -90,9 +86,12 @@ KeyFrame::KeyFrame(Frame &F, Map *pMap, KeyFrameDatabase *pKFDB)
     if (F.Nleft != -1)
       mGridRight[i].resize(mnGridRows);
     for (int j = 0; j < mnGridRows; j++) {
-      mGrid[i][j] = F.mGrid[i][j];
+      for (size_t k = F.mGrid.CellBegin(i, j); k < F.mGrid.CellEnd(i, j); k++)
+        mGrid[i][j].push_back(F.mGrid.Index(k));
       if (F.Nleft != -1) {
-        mGridRight[i][j] = F.mGridRight[i][j];
+        for (size_t k = F.mGridRight.CellBegin(i, j);
+             k < F.mGridRight.CellEnd(i, j); k++)
+          mGridRight[i][j].push_back(F.mGridRight.Index(k));
       }
     }
   }
@@ -293,24 +292,30 @@ int KeyFrame::GetNumberMPs() {
 void KeyFrame::AddMapPoint(MapPoint *pMP, const size_t &idx) {
   unique_lock<mutex> lock(mMutexFeatures);
   mvpMapPoints[idx] = pMP;
+  mnMapPointsVersion++;
 }
 
 void KeyFrame::EraseMapPointMatch(const int &idx) {
   unique_lock<mutex> lock(mMutexFeatures);
   mvpMapPoints[idx] = static_cast<MapPoint *>(NULL);
+  mnMapPointsVersion++;
 }
 
 void KeyFrame::EraseMapPointMatch(MapPoint *pMP) {
   tuple<size_t, size_t> indexes = pMP->GetIndexInKeyFrame(this);
   size_t leftIndex = get<0>(indexes), rightIndex = get<1>(indexes);
+  unique_lock<mutex> lock(mMutexFeatures);
   if (leftIndex != -1)
     mvpMapPoints[leftIndex] = static_cast<MapPoint *>(NULL);
   if (rightIndex != -1)
     mvpMapPoints[rightIndex] = static_cast<MapPoint *>(NULL);
+  mnMapPointsVersion++;
 }
 
 void KeyFrame::ReplaceMapPointMatch(const int &idx, MapPoint *pMP) {
+  unique_lock<mutex> lock(mMutexFeatures);
   mvpMapPoints[idx] = pMP;
+  mnMapPointsVersion++;
 }
 
 set<MapPoint *> KeyFrame::GetMapPoints() {
@@ -352,6 +357,11 @@ vector<MapPoint *> KeyFrame::GetMapPointMatches() {
   return mvpMapPoints;
 }
 
+unsigned long KeyFrame::GetMapPointsVersion() {
+  unique_lock<mutex> lock(mMutexFeatures);
+  return mnMapPointsVersion;
+}
+
 MapPoint *KeyFrame::GetMapPoint(const size_t &idx) {
   unique_lock<mutex> lock(mMutexFeatures);
   return mvpMapPoints[idx];
@@ -655,39 +665,51 @@ vector<size_t> KeyFrame::GetFeaturesInArea(const float &x, const float &y,
   vector<size_t> vIndices;
   vIndices.reserve(N);
 
+  GetFeaturesInArea(vIndices, x, y, r, bRight);
+
+  return vIndices;
+}
+
+void KeyFrame::GetFeaturesInArea(vector<size_t> &vIndices, const float &x,
+                                 const float &y, const float &r,
+                                 const bool bRight) const {
+  vIndices.clear();
+
   float factorX = r;
   float factorY = r;
 
   const int nMinCellX =
       max(0, (int)floor((x - mnMinX - factorX) * mfGridElementWidthInv));
   if (nMinCellX >= mnGridCols)
-    return vIndices;
+    return;
 
   const int nMaxCellX =
       min((int)mnGridCols - 1,
           (int)ceil((x - mnMinX + factorX) * mfGridElementWidthInv));
   if (nMaxCellX < 0)
-    return vIndices;
+    return;
 
   const int nMinCellY =
       max(0, (int)floor((y - mnMinY - factorY) * mfGridElementHeightInv));
   if (nMinCellY >= mnGridRows)
-    return vIndices;
+    return;
 
   const int nMaxCellY =
       min((int)mnGridRows - 1,
           (int)ceil((y - mnMinY + factorY) * mfGridElementHeightInv));
   if (nMaxCellY < 0)
-    return vIndices;
+    return;
+
+  const vector<cv::KeyPoint> &vKeys = (NLeft == -1) ? mvKeysUn
+                                      : (!bRight)   ? mvKeys
+                                                    : mvKeysRight;
 
   for (int ix = nMinCellX; ix <= nMaxCellX; ix++) {
     for (int iy = nMinCellY; iy <= nMaxCellY; iy++) {
-      const vector<size_t> vCell =
+      const vector<size_t> &vCell =
           (!bRight) ? mGrid[ix][iy] : mGridRight[ix][iy];
       for (size_t j = 0, jend = vCell.size(); j < jend; j++) {
-        const cv::KeyPoint &kpUn = (NLeft == -1) ? mvKeysUn[vCell[j]]
-                                   : (!bRight)   ? mvKeys[vCell[j]]
-                                                 : mvKeysRight[vCell[j]];
+        const cv::KeyPoint &kpUn = vKeys[vCell[j]];
         const float distx = kpUn.pt.x - x;
         const float disty = kpUn.pt.y - y;
 
@@ -696,8 +718,6 @@ vector<size_t> KeyFrame::GetFeaturesInArea(const float &x, const float &y,
       }
     }
   }
-
-  return vIndices;
 }
 
 bool KeyFrame::IsInImage(const float &x, const float &y) const {
@@ -875,6 +895,7 @@ void KeyFrame::PostLoad(map<long unsigned int, KeyFrame *> &mpKFid,
   // Each MapPoint sight from this KeyFrame
   mvpMapPoints.clear();
   mvpMapPoints.resize(N);
+  mnMapPointsVersion++;
   for (int i = 0; i < N; ++i) {
     if (mvBackupMapPointsId[i] != -1)
       mvpMapPoints[i] = mpMPid[mvBackupMapPointsId[i]];
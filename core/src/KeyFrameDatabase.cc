@@ -24,561 +24,416 @@
 #include "KeyFrame.h"
 #include <DBoW2/BowVector.h>
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include <mutex>
+#include <shared_mutex>
 
 using namespace std;
 
 namespace ORB_SLAM3 {
 
+void KeyFrameDatabase::QueryContext::Reset(size_t n) {
+  // Entries of previous queries are invalidated by the query number, so only
+  // new keyframe ids need initialising
+  mnQuery++;
+  if (vnQuery.size() < n) {
+    vnQuery.resize(n, 0);
+    vnGroup.resize(n);
+    vnWords.resize(n);
+    vL1.resize(n);
+    vScore.resize(n);
+  }
+}
+
+void KeyFrameDatabase::QueryContext::Touch(size_t id, int group) {
+  vnQuery[id] = mnQuery;
+  vnGroup[id] = group;
+  vnWords[id] = 0;
+  vL1[id] = 0.0;
+  vScore[id] = 0.f;
+}
+
+int KeyFrameDatabase::QueryContext::MaxWords(
+    const vector<KeyFrame *> &vpKFs) const {
+  int maxWords = 0;
+  for (size_t i = 0; i < vpKFs.size(); i++)
+    maxWords = max(maxWords, vnWords[vpKFs[i]->mnId]);
+  return maxWords;
+}
+
+int KeyFrameDatabase::QueryContext::Words(const KeyFrame *pKF,
+                                          int group) const {
+  if (!Touched(pKF->mnId) || vnGroup[pKF->mnId] != group)
+    return 0;
+  return vnWords[pKF->mnId];
+}
+
+float KeyFrameDatabase::QueryContext::Similarity(const KeyFrame *pKF) const {
+  return Touched(pKF->mnId) ? vScore[pKF->mnId] : 0.f;
+}
+
 KeyFrameDatabase::KeyFrameDatabase(const ORBVocabulary &voc) : mpVoc(&voc) {
+  mbL1Score = voc.getScoringType() == DBoW2::L1_NORM;
   mvInvertedFile.resize(voc.size());
 }
 
 void KeyFrameDatabase::add(KeyFrame *pKF) {
-  unique_lock<mutex> lock(mMutex);
+  unique_lock<shared_mutex> lock(mMutex);
+
+  const size_t id = pKF->mnId;
+  if (id >= mvpKeyFrames.size())
+    mvpKeyFrames.resize(id + 1, static_cast<KeyFrame *>(NULL));
 
   for (DBoW2::BowVector::const_iterator vit = pKF->mBowVec.begin(),
                                         vend = pKF->mBowVec.end();
-       vit != vend; vit++)
-    mvInvertedFile[vit->first].push_back(pKF);
+       vit != vend; vit++) {
+    PostingList &postings = mvInvertedFile[vit->first];
+    // Tombstones of this same keyframe would come back to life
+    if (postings.nErased)
+      Compact(postings);
+    postings.vnIds.push_back(id);
+    postings.vWeights.push_back(vit->second);
+  }
+
+  mvpKeyFrames[id] = pKF;
 }
 
 void KeyFrameDatabase::erase(KeyFrame *pKF) {
-  unique_lock<mutex> lock(mMutex);
+  unique_lock<shared_mutex> lock(mMutex);
+
+  const size_t id = pKF->mnId;
+  if (id >= mvpKeyFrames.size() || mvpKeyFrames[id] != pKF)
+    return;
 
-  // Erase elements in the Inverse File for the entry
+  // Leave a tombstone in the lists of its words, compacting those that are
+  // half dead
+  mvpKeyFrames[id] = NULL;
   for (DBoW2::BowVector::const_iterator vit = pKF->mBowVec.begin(),
                                         vend = pKF->mBowVec.end();
        vit != vend; vit++) {
-    // List of keyframes that share the word
-    list<KeyFrame *> &lKFs = mvInvertedFile[vit->first];
-
-    for (list<KeyFrame *>::iterator lit = lKFs.begin(), lend = lKFs.end();
-         lit != lend; lit++) {
-      if (pKF == *lit) {
-        lKFs.erase(lit);
-        break;
-      }
-    }
+    PostingList &postings = mvInvertedFile[vit->first];
+    if (++postings.nErased * 2 >= postings.vnIds.size())
+      Compact(postings);
   }
 }
 
 void KeyFrameDatabase::clear() {
   mvInvertedFile.clear();
   mvInvertedFile.resize(mpVoc->size());
+  mvpKeyFrames.clear();
 }
 
 void KeyFrameDatabase::clearMap(Map *pMap) {
-  unique_lock<mutex> lock(mMutex);
+  unique_lock<shared_mutex> lock(mMutex);
 
-  // Erase elements in the Inverse File for the entry
-  for (vector<list<KeyFrame *>>::iterator vit = mvInvertedFile.begin(),
-                                          vend = mvInvertedFile.end();
-       vit != vend; vit++) {
-    // List of keyframes that share the word
-    list<KeyFrame *> &lKFs = *vit;
-
-    for (list<KeyFrame *>::iterator lit = lKFs.begin(), lend = lKFs.end();
-         lit != lend;) {
-      KeyFrame *pKFi = *lit;
-      if (pMap == pKFi->GetMap()) {
-        lit = lKFs.erase(lit);
-        // Dont delete the KF because the class Map clean all the KF when it is
-        // destroyed
-      } else {
-        ++lit;
-      }
-    }
+  // Dont delete the KF because the class Map clean all the KF when it is
+  // destroyed
+  for (size_t id = 0; id < mvpKeyFrames.size(); id++) {
+    if (mvpKeyFrames[id] && mvpKeyFrames[id]->GetMap() == pMap)
+      mvpKeyFrames[id] = NULL;
   }
-}
 
-vector<KeyFrame *> KeyFrameDatabase::DetectLoopCandidates(KeyFrame *pKF,
-                                                          float minScore) {
-  set<KeyFrame *> spConnectedKeyFrames = pKF->GetConnectedKeyFrames();
-  list<KeyFrame *> lKFsSharingWords;
+  for (size_t i = 0; i < mvInvertedFile.size(); i++) {
+    if (!mvInvertedFile[i].vnIds.empty())
+      Compact(mvInvertedFile[i]);
+  }
+}
 
-  // Search all keyframes that share a word with current keyframes
-  // Discard keyframes connected to the query keyframe
-  {
-    unique_lock<mutex> lock(mMutex);
-
-    for (DBoW2::BowVector::const_iterator vit = pKF->mBowVec.begin(),
-                                          vend = pKF->mBowVec.end();
-         vit != vend; vit++) {
-      list<KeyFrame *> &lKFs = mvInvertedFile[vit->first];
-
-      for (list<KeyFrame *>::iterator lit = lKFs.begin(), lend = lKFs.end();
-           lit != lend; lit++) {
-        KeyFrame *pKFi = *lit;
-        if (pKFi->GetMap() ==
-            pKF->GetMap()) // For consider a loop candidate it a candidate it
-                           // must be in the same map
-        {
-          if (pKFi->mnLoopQuery != pKF->mnId) {
-            pKFi->mnLoopWords = 0;
-            if (!spConnectedKeyFrames.count(pKFi)) {
-              pKFi->mnLoopQuery = pKF->mnId;
-              lKFsSharingWords.push_back(pKFi);
-            }
-          }
-          pKFi->mnLoopWords++;
-        }
-      }
-    }
+void KeyFrameDatabase::Compact(PostingList &postings) {
+  size_t n = 0;
+  for (size_t i = 0; i < postings.vnIds.size(); i++) {
+    if (!mvpKeyFrames[postings.vnIds[i]])
+      continue;
+    postings.vnIds[n] = postings.vnIds[i];
+    postings.vWeights[n] = postings.vWeights[i];
+    n++;
   }
+  postings.vnIds.resize(n);
+  postings.vWeights.resize(n);
+  postings.nErased = 0;
+}
 
-  if (lKFsSharingWords.empty())
-    return vector<KeyFrame *>();
+template <class Classify>
+void KeyFrameDatabase::CollectSharingWords(
+    const DBoW2::BowVector &bow, QueryContext &context,
+    vector<KeyFrame *> *vpKFsSharingWords, Classify classify) {
+  // Query words come in increasing order, so the L1 terms of every keyframe
+  // are summed in the same order as DBoW2 does
+  for (DBoW2::BowVector::const_iterator vit = bow.begin(), vend = bow.end();
+       vit != vend; vit++) {
+    const PostingList &postings = mvInvertedFile[vit->first];
+    const double vi = vit->second;
+
+    for (size_t i = 0; i < postings.vnIds.size(); i++) {
+      const uint32_t id = postings.vnIds[i];
+      KeyFrame *pKFi = mvpKeyFrames[id];
+      if (!pKFi)
+        continue;
 
-  list<pair<float, KeyFrame *>> lScoreAndMatch;
+      if (!context.Touched(id)) {
+        const int group = classify(pKFi);
+        context.Touch(id, group);
+        if (group >= 0)
+          vpKFsSharingWords[group].push_back(pKFi);
+      }
+      if (context.vnGroup[id] < 0)
+        continue;
+      context.vnWords[id]++;
 
-  // Only compare against those keyframes that share enough words
-  int maxCommonWords = 0;
-  for (list<KeyFrame *>::iterator lit = lKFsSharingWords.begin(),
-                                  lend = lKFsSharingWords.end();
-       lit != lend; lit++) {
-    if ((*lit)->mnLoopWords > maxCommonWords)
-      maxCommonWords = (*lit)->mnLoopWords;
+      if (mbL1Score) {
+        const double wi = postings.vWeights[i];
+        context.vL1[id] += fabs(vi - wi) - fabs(vi) - fabs(wi);
+      }
+    }
   }
+}
 
-  int minCommonWords = maxCommonWords * 0.8f;
+float KeyFrameDatabase::Score(const DBoW2::BowVector &bow,
+                              const QueryContext &context,
+                              KeyFrame *pKF) const {
+  if (mbL1Score)
+    return -context.vL1[pKF->mnId] / 2.0;
+  return mpVoc->score(bow, pKF->mBowVec);
+}
 
-  int nscores = 0;
+void KeyFrameDatabase::AccumulateCovisibilityScores(
+    const DBoW2::BowVector &bow, QueryContext &context,
+    const vector<KeyFrame *> &vpKFsSharingWords, int group, int minCommonWords,
+    float minScore, int minNeighWords,
+    vector<pair<float, KeyFrame *>> &vAccScoreAndMatch) {
+  vector<pair<float, KeyFrame *>> vScoreAndMatch;
 
   // Compute similarity score. Retain the matches whose score is higher than
   // minScore
-  for (list<KeyFrame *>::iterator lit = lKFsSharingWords.begin(),
-                                  lend = lKFsSharingWords.end();
-       lit != lend; lit++) {
-    KeyFrame *pKFi = *lit;
-
-    if (pKFi->mnLoopWords > minCommonWords) {
-      nscores++;
-
-      float si = mpVoc->score(pKF->mBowVec, pKFi->mBowVec);
+  for (size_t i = 0; i < vpKFsSharingWords.size(); i++) {
+    KeyFrame *pKFi = vpKFsSharingWords[i];
+    if (context.Words(pKFi, group) <= minCommonWords)
+      continue;
 
-      pKFi->mLoopScore = si;
-      if (si >= minScore)
-        lScoreAndMatch.push_back(make_pair(si, pKFi));
-    }
+    const float si = Score(bow, context, pKFi);
+    context.vScore[pKFi->mnId] = si;
+    if (si >= minScore)
+      vScoreAndMatch.push_back(make_pair(si, pKFi));
   }
 
-  if (lScoreAndMatch.empty())
-    return vector<KeyFrame *>();
-
-  list<pair<float, KeyFrame *>> lAccScoreAndMatch;
-  float bestAccScore = minScore;
-
   // Lets now accumulate score by covisibility
-  for (list<pair<float, KeyFrame *>>::iterator it = lScoreAndMatch.begin(),
-                                               itend = lScoreAndMatch.end();
-       it != itend; it++) {
-    KeyFrame *pKFi = it->second;
+  vAccScoreAndMatch.reserve(vScoreAndMatch.size());
+  for (size_t i = 0; i < vScoreAndMatch.size(); i++) {
+    KeyFrame *pKFi = vScoreAndMatch[i].second;
     vector<KeyFrame *> vpNeighs = pKFi->GetBestCovisibilityKeyFrames(10);
 
-    float bestScore = it->first;
-    float accScore = it->first;
+    float bestScore = vScoreAndMatch[i].first;
+    float accScore = bestScore;
     KeyFrame *pBestKF = pKFi;
-    for (vector<KeyFrame *>::iterator vit = vpNeighs.begin(),
-                                      vend = vpNeighs.end();
-         vit != vend; vit++) {
-      KeyFrame *pKF2 = *vit;
-      if (pKF2->mnLoopQuery == pKF->mnId &&
-          pKF2->mnLoopWords > minCommonWords) {
-        accScore += pKF2->mLoopScore;
-        if (pKF2->mLoopScore > bestScore) {
-          pBestKF = pKF2;
-          bestScore = pKF2->mLoopScore;
-        }
-      }
-    }
-
-    lAccScoreAndMatch.push_back(make_pair(accScore, pBestKF));
-    if (accScore > bestAccScore)
-      bestAccScore = accScore;
-  }
-
-  // Return all those keyframes with a score higher than 0.75*bestScore
-  float minScoreToRetain = 0.75f * bestAccScore;
+    for (size_t j = 0; j < vpNeighs.size(); j++) {
+      KeyFrame *pKF2 = vpNeighs[j];
+      if (context.Words(pKF2, group) <= minNeighWords)
+        continue;
 
-  set<KeyFrame *> spAlreadyAddedKF;
-  vector<KeyFrame *> vpLoopCandidates;
-  vpLoopCandidates.reserve(lAccScoreAndMatch.size());
-
-  for (list<pair<float, KeyFrame *>>::iterator it = lAccScoreAndMatch.begin(),
-                                               itend = lAccScoreAndMatch.end();
-       it != itend; it++) {
-    if (it->first > minScoreToRetain) {
-      KeyFrame *pKFi = it->second;
-      if (!spAlreadyAddedKF.count(pKFi)) {
-        vpLoopCandidates.push_back(pKFi);
-        spAlreadyAddedKF.insert(pKFi);
+      const float s2 = context.Similarity(pKF2);
+      accScore += s2;
+      if (s2 > bestScore) {
+        pBestKF = pKF2;
+        bestScore = s2;
       }
     }
-  }
 
-  return vpLoopCandidates;
+    vAccScoreAndMatch.push_back(make_pair(accScore, pBestKF));
+  }
 }
 
-void KeyFrameDatabase::DetectCandidates(KeyFrame *pKF, float minScore,
-                                        vector<KeyFrame *> &vpLoopCand,
-                                        vector<KeyFrame *> &vpMergeCand) {
+vector<KeyFrame *>
+KeyFrameDatabase::DetectLoopCandidates(KeyFrame *pKF, float minScore,
+                                       QueryContext *pContext) {
   set<KeyFrame *> spConnectedKeyFrames = pKF->GetConnectedKeyFrames();
-  list<KeyFrame *> lKFsSharingWordsLoop, lKFsSharingWordsMerge;
+  Map *pMap = pKF->GetMap();
+  vector<KeyFrame *> vpKFsSharingWords;
+  QueryContext localContext;
+  QueryContext &context = pContext ? *pContext : localContext;
 
   // Search all keyframes that share a word with current keyframes
   // Discard keyframes connected to the query keyframe
   {
-    unique_lock<mutex> lock(mMutex);
-
-    for (DBoW2::BowVector::const_iterator vit = pKF->mBowVec.begin(),
-                                          vend = pKF->mBowVec.end();
-         vit != vend; vit++) {
-      list<KeyFrame *> &lKFs = mvInvertedFile[vit->first];
-
-      for (list<KeyFrame *>::iterator lit = lKFs.begin(), lend = lKFs.end();
-           lit != lend; lit++) {
-        KeyFrame *pKFi = *lit;
-        if (pKFi->GetMap() ==
-            pKF->GetMap()) // For consider a loop candidate it a candidate it
-                           // must be in the same map
-        {
-          if (pKFi->mnLoopQuery != pKF->mnId) {
-            pKFi->mnLoopWords = 0;
-            if (!spConnectedKeyFrames.count(pKFi)) {
-              pKFi->mnLoopQuery = pKF->mnId;
-              lKFsSharingWordsLoop.push_back(pKFi);
-            }
-          }
-          pKFi->mnLoopWords++;
-        } else if (!pKFi->GetMap()->IsBad()) {
-          if (pKFi->mnMergeQuery != pKF->mnId) {
-            pKFi->mnMergeWords = 0;
-            if (!spConnectedKeyFrames.count(pKFi)) {
-              pKFi->mnMergeQuery = pKF->mnId;
-              lKFsSharingWordsMerge.push_back(pKFi);
-            }
-          }
-          pKFi->mnMergeWords++;
-        }
-      }
-    }
+    shared_lock<shared_mutex> lock(mMutex);
+
+    context.Reset(mvpKeyFrames.size());
+    CollectSharingWords(pKF->mBowVec, context, &vpKFsSharingWords,
+                        [&](KeyFrame *pKFi) {
+                          // For consider a loop candidate it must be in the
+                          // same map
+                          if (pKFi->GetMap() != pMap ||
+                              spConnectedKeyFrames.count(pKFi))
+                            return -1;
+                          return 0;
+                        });
   }
 
-  if (lKFsSharingWordsLoop.empty() && lKFsSharingWordsMerge.empty())
-    return;
-
-  if (!lKFsSharingWordsLoop.empty()) {
-    list<pair<float, KeyFrame *>> lScoreAndMatch;
+  if (vpKFsSharingWords.empty())
+    return vector<KeyFrame *>();
 
-    // Only compare against those keyframes that share enough words
-    int maxCommonWords = 0;
-    for (list<KeyFrame *>::iterator lit = lKFsSharingWordsLoop.begin(),
-                                    lend = lKFsSharingWordsLoop.end();
-         lit != lend; lit++) {
-      if ((*lit)->mnLoopWords > maxCommonWords)
-        maxCommonWords = (*lit)->mnLoopWords;
-    }
+  // Only compare against those keyframes that share enough words
+  int minCommonWords = context.MaxWords(vpKFsSharingWords) * 0.8f;
 
-    int minCommonWords = maxCommonWords * 0.8f;
+  vector<pair<float, KeyFrame *>> vAccScoreAndMatch;
+  AccumulateCovisibilityScores(pKF->mBowVec, context, vpKFsSharingWords, 0,
+                               minCommonWords, minScore, minCommonWords,
+                               vAccScoreAndMatch);
 
-    int nscores = 0;
+  if (vAccScoreAndMatch.empty())
+    return vector<KeyFrame *>();
 
-    // Compute similarity score. Retain the matches whose score is higher than
-    // minScore
-    for (list<KeyFrame *>::iterator lit = lKFsSharingWordsLoop.begin(),
-                                    lend = lKFsSharingWordsLoop.end();
-         lit != lend; lit++) {
-      KeyFrame *pKFi = *lit;
+  float bestAccScore = minScore;
+  for (size_t i = 0; i < vAccScoreAndMatch.size(); i++)
+    bestAccScore = max(bestAccScore, vAccScoreAndMatch[i].first);
 
-      if (pKFi->mnLoopWords > minCommonWords) {
-        nscores++;
+  // Return all those keyframes with a score higher than 0.75*bestScore
+  float minScoreToRetain = 0.75f * bestAccScore;
 
-        float si = mpVoc->score(pKF->mBowVec, pKFi->mBowVec);
+  set<KeyFrame *> spAlreadyAddedKF;
+  vector<KeyFrame *> vpLoopCandidates;
+  vpLoopCandidates.reserve(vAccScoreAndMatch.size());
 
-        pKFi->mLoopScore = si;
-        if (si >= minScore)
-          lScoreAndMatch.push_back(make_pair(si, pKFi));
-      }
+  for (size_t i = 0; i < vAccScoreAndMatch.size(); i++) {
+    if (vAccScoreAndMatch[i].first > minScoreToRetain) {
+      KeyFrame *pKFi = vAccScoreAndMatch[i].second;
+      if (spAlreadyAddedKF.insert(pKFi).second)
+        vpLoopCandidates.push_back(pKFi);
     }
+  }
 
-    if (!lScoreAndMatch.empty()) {
-      list<pair<float, KeyFrame *>> lAccScoreAndMatch;
-      float bestAccScore = minScore;
-
-      // Lets now accumulate score by covisibility
-      for (list<pair<float, KeyFrame *>>::iterator it = lScoreAndMatch.begin(),
-                                                   itend = lScoreAndMatch.end();
-           it != itend; it++) {
-        KeyFrame *pKFi = it->second;
-        vector<KeyFrame *> vpNeighs = pKFi->GetBestCovisibilityKeyFrames(10);
-
-        float bestScore = it->first;
-        float accScore = it->first;
-        KeyFrame *pBestKF = pKFi;
-        for (vector<KeyFrame *>::iterator vit = vpNeighs.begin(),
-                                          vend = vpNeighs.end();
-             vit != vend; vit++) {
-          KeyFrame *pKF2 = *vit;
-          if (pKF2->mnLoopQuery == pKF->mnId &&
-              pKF2->mnLoopWords > minCommonWords) {
-            accScore += pKF2->mLoopScore;
-            if (pKF2->mLoopScore > bestScore) {
-              pBestKF = pKF2;
-              bestScore = pKF2->mLoopScore;
-            }
-          }
-        }
+  return vpLoopCandidates;
+}
 
-        lAccScoreAndMatch.push_back(make_pair(accScore, pBestKF));
-        if (accScore > bestAccScore)
-          bestAccScore = accScore;
-      }
+void KeyFrameDatabase::DetectCandidates(KeyFrame *pKF, float minScore,
+                                        vector<KeyFrame *> &vpLoopCand,
+                                        vector<KeyFrame *> &vpMergeCand,
+                                        QueryContext *pContext) {
+  set<KeyFrame *> spConnectedKeyFrames = pKF->GetConnectedKeyFrames();
+  Map *pMap = pKF->GetMap();
+  // Loop candidates (group 0) come from the current map and merge candidates
+  // (group 1) from the rest, both selected the same way
+  vector<KeyFrame *> vpKFsSharingWords[2];
+  vector<KeyFrame *> *vpvpCand[2] = {&vpLoopCand, &vpMergeCand};
+  QueryContext localContext;
+  QueryContext &context = pContext ? *pContext : localContext;
 
-      // Return all those keyframes with a score higher than 0.75*bestScore
-      float minScoreToRetain = 0.75f * bestAccScore;
-
-      set<KeyFrame *> spAlreadyAddedKF;
-      vpLoopCand.reserve(lAccScoreAndMatch.size());
-
-      for (list<pair<float, KeyFrame *>>::iterator
-               it = lAccScoreAndMatch.begin(),
-               itend = lAccScoreAndMatch.end();
-           it != itend; it++) {
-        if (it->first > minScoreToRetain) {
-          KeyFrame *pKFi = it->second;
-          if (!spAlreadyAddedKF.count(pKFi)) {
-            vpLoopCand.push_back(pKFi);
-            spAlreadyAddedKF.insert(pKFi);
-          }
-        }
-      }
-    }
+  // Search all keyframes that share a word with current keyframes
+  // Discard keyframes connected to the query keyframe
+  {
+    shared_lock<shared_mutex> lock(mMutex);
+
+    context.Reset(mvpKeyFrames.size());
+    CollectSharingWords(pKF->mBowVec, context, vpKFsSharingWords,
+                        [&](KeyFrame *pKFi) {
+                          if (spConnectedKeyFrames.count(pKFi))
+                            return -1;
+                          Map *pMapi = pKFi->GetMap();
+                          if (pMapi == pMap)
+                            return 0;
+                          if (!pMapi->IsBad())
+                            return 1;
+                          return -1;
+                        });
   }
 
-  if (!lKFsSharingWordsMerge.empty()) {
-    list<pair<float, KeyFrame *>> lScoreAndMatch;
+  for (int group = 0; group < 2; group++) {
+    if (vpKFsSharingWords[group].empty())
+      continue;
 
     // Only compare against those keyframes that share enough words
-    int maxCommonWords = 0;
-    for (list<KeyFrame *>::iterator lit = lKFsSharingWordsMerge.begin(),
-                                    lend = lKFsSharingWordsMerge.end();
-         lit != lend; lit++) {
-      if ((*lit)->mnMergeWords > maxCommonWords)
-        maxCommonWords = (*lit)->mnMergeWords;
-    }
+    int minCommonWords = context.MaxWords(vpKFsSharingWords[group]) * 0.8f;
 
-    int minCommonWords = maxCommonWords * 0.8f;
+    vector<pair<float, KeyFrame *>> vAccScoreAndMatch;
+    AccumulateCovisibilityScores(pKF->mBowVec, context,
+                                 vpKFsSharingWords[group], group,
+                                 minCommonWords, minScore, minCommonWords,
+                                 vAccScoreAndMatch);
 
-    int nscores = 0;
+    if (vAccScoreAndMatch.empty())
+      continue;
 
-    // Compute similarity score. Retain the matches whose score is higher than
-    // minScore
-    for (list<KeyFrame *>::iterator lit = lKFsSharingWordsMerge.begin(),
-                                    lend = lKFsSharingWordsMerge.end();
-         lit != lend; lit++) {
-      KeyFrame *pKFi = *lit;
+    float bestAccScore = minScore;
+    for (size_t i = 0; i < vAccScoreAndMatch.size(); i++)
+      bestAccScore = max(bestAccScore, vAccScoreAndMatch[i].first);
 
-      if (pKFi->mnMergeWords > minCommonWords) {
-        nscores++;
+    // Return all those keyframes with a score higher than 0.75*bestScore
+    float minScoreToRetain = 0.75f * bestAccScore;
 
-        float si = mpVoc->score(pKF->mBowVec, pKFi->mBowVec);
+    set<KeyFrame *> spAlreadyAddedKF;
+    vector<KeyFrame *> &vpCand = *vpvpCand[group];
+    vpCand.reserve(vAccScoreAndMatch.size());
 
-        pKFi->mMergeScore = si;
-        if (si >= minScore)
-          lScoreAndMatch.push_back(make_pair(si, pKFi));
+    for (size_t i = 0; i < vAccScoreAndMatch.size(); i++) {
+      if (vAccScoreAndMatch[i].first > minScoreToRetain) {
+        KeyFrame *pKFi = vAccScoreAndMatch[i].second;
+        if (spAlreadyAddedKF.insert(pKFi).second)
+          vpCand.push_back(pKFi);
       }
     }
-
-    if (!lScoreAndMatch.empty()) {
-      list<pair<float, KeyFrame *>> lAccScoreAndMatch;
-      float bestAccScore = minScore;
-
-      // Lets now accumulate score by covisibility
-      for (list<pair<float, KeyFrame *>>::iterator it = lScoreAndMatch.begin(),
-                                                   itend = lScoreAndMatch.end();
-           it != itend; it++) {
-        KeyFrame *pKFi = it->second;
-        vector<KeyFrame *> vpNeighs = pKFi->GetBestCovisibilityKeyFrames(10);
-
-        float bestScore = it->first;
-        float accScore = it->first;
-        KeyFrame *pBestKF = pKFi;
-        for (vector<KeyFrame *>::iterator vit = vpNeighs.begin(),
-                                          vend = vpNeighs.end();
-             vit != vend; vit++) {
-          KeyFrame *pKF2 = *vit;
-          if (pKF2->mnMergeQuery == pKF->mnId &&
-              pKF2->mnMergeWords > minCommonWords) {
-            accScore += pKF2->mMergeScore;
-            if (pKF2->mMergeScore > bestScore) {
-              pBestKF = pKF2;
-              bestScore = pKF2->mMergeScore;
-            }
-          }
-        }
-
-        lAccScoreAndMatch.push_back(make_pair(accScore, pBestKF));
-        if (accScore > bestAccScore)
-          bestAccScore = accScore;
-      }
-
-      // Return all those keyframes with a score higher than 0.75*bestScore
-      float minScoreToRetain = 0.75f * bestAccScore;
-
-      set<KeyFrame *> spAlreadyAddedKF;
-      vpMergeCand.reserve(lAccScoreAndMatch.size());
-
-      for (list<pair<float, KeyFrame *>>::iterator
-               it = lAccScoreAndMatch.begin(),
-               itend = lAccScoreAndMatch.end();
-           it != itend; it++) {
-        if (it->first > minScoreToRetain) {
-          KeyFrame *pKFi = it->second;
-          if (!spAlreadyAddedKF.count(pKFi)) {
-            vpMergeCand.push_back(pKFi);
-            spAlreadyAddedKF.insert(pKFi);
-          }
-        }
-      }
-    }
-  }
-
-  for (DBoW2::BowVector::const_iterator vit = pKF->mBowVec.begin(),
-                                        vend = pKF->mBowVec.end();
-       vit != vend; vit++) {
-    list<KeyFrame *> &lKFs = mvInvertedFile[vit->first];
-
-    for (list<KeyFrame *>::iterator lit = lKFs.begin(), lend = lKFs.end();
-         lit != lend; lit++) {
-      KeyFrame *pKFi = *lit;
-      pKFi->mnLoopQuery = -1;
-      pKFi->mnMergeQuery = -1;
-    }
   }
 }
 
 void KeyFrameDatabase::DetectBestCandidates(KeyFrame *pKF,
                                             vector<KeyFrame *> &vpLoopCand,
                                             vector<KeyFrame *> &vpMergeCand,
-                                            int nMinWords) {
-  list<KeyFrame *> lKFsSharingWords;
+                                            int nMinWords,
+                                            QueryContext *pContext) {
+  vector<KeyFrame *> vpKFsSharingWords;
   set<KeyFrame *> spConnectedKF;
+  QueryContext localContext;
+  QueryContext &context = pContext ? *pContext : localContext;
 
   // Search all keyframes that share a word with current frame
   {
-    unique_lock<mutex> lock(mMutex);
+    shared_lock<shared_mutex> lock(mMutex);
 
     spConnectedKF = pKF->GetConnectedKeyFrames();
 
-    for (DBoW2::BowVector::const_iterator vit = pKF->mBowVec.begin(),
-                                          vend = pKF->mBowVec.end();
-         vit != vend; vit++) {
-      list<KeyFrame *> &lKFs = mvInvertedFile[vit->first];
-
-      for (list<KeyFrame *>::iterator lit = lKFs.begin(), lend = lKFs.end();
-           lit != lend; lit++) {
-        KeyFrame *pKFi = *lit;
-        if (spConnectedKF.find(pKFi) != spConnectedKF.end()) {
-          continue;
-        }
-        if (pKFi->mnPlaceRecognitionQuery != pKF->mnId) {
-          pKFi->mnPlaceRecognitionWords = 0;
-          pKFi->mnPlaceRecognitionQuery = pKF->mnId;
-          lKFsSharingWords.push_back(pKFi);
-        }
-        pKFi->mnPlaceRecognitionWords++;
-      }
-    }
+    context.Reset(mvpKeyFrames.size());
+    CollectSharingWords(
+        pKF->mBowVec, context, &vpKFsSharingWords,
+        [&](KeyFrame *pKFi) { return spConnectedKF.count(pKFi) ? -1 : 0; });
   }
-  if (lKFsSharingWords.empty())
+  if (vpKFsSharingWords.empty())
     return;
 
   // Only compare against those keyframes that share enough words
-  int maxCommonWords = 0;
-  for (list<KeyFrame *>::iterator lit = lKFsSharingWords.begin(),
-                                  lend = lKFsSharingWords.end();
-       lit != lend; lit++) {
-    if ((*lit)->mnPlaceRecognitionWords > maxCommonWords)
-      maxCommonWords = (*lit)->mnPlaceRecognitionWords;
-  }
-
-  int minCommonWords = maxCommonWords * 0.8f;
+  int minCommonWords = context.MaxWords(vpKFsSharingWords) * 0.8f;
 
   if (minCommonWords < nMinWords) {
     minCommonWords = nMinWords;
   }
 
-  list<pair<float, KeyFrame *>> lScoreAndMatch;
-
-  int nscores = 0;
+  vector<pair<float, KeyFrame *>> vAccScoreAndMatch;
+  AccumulateCovisibilityScores(pKF->mBowVec, context, vpKFsSharingWords, 0,
+                               minCommonWords, -numeric_limits<float>::max(),
+                               0, vAccScoreAndMatch);
 
-  // Compute similarity score.
-  for (list<KeyFrame *>::iterator lit = lKFsSharingWords.begin(),
-                                  lend = lKFsSharingWords.end();
-       lit != lend; lit++) {
-    KeyFrame *pKFi = *lit;
-
-    if (pKFi->mnPlaceRecognitionWords > minCommonWords) {
-      nscores++;
-      float si = mpVoc->score(pKF->mBowVec, pKFi->mBowVec);
-      pKFi->mPlaceRecognitionScore = si;
-      lScoreAndMatch.push_back(make_pair(si, pKFi));
-    }
-  }
-
-  if (lScoreAndMatch.empty())
+  if (vAccScoreAndMatch.empty())
     return;
 
-  list<pair<float, KeyFrame *>> lAccScoreAndMatch;
   float bestAccScore = 0;
-
-  // Lets now accumulate score by covisibility
-  for (list<pair<float, KeyFrame *>>::iterator it = lScoreAndMatch.begin(),
-                                               itend = lScoreAndMatch.end();
-       it != itend; it++) {
-    KeyFrame *pKFi = it->second;
-    vector<KeyFrame *> vpNeighs = pKFi->GetBestCovisibilityKeyFrames(10);
-
-    float bestScore = it->first;
-    float accScore = bestScore;
-    KeyFrame *pBestKF = pKFi;
-    for (vector<KeyFrame *>::iterator vit = vpNeighs.begin(),
-                                      vend = vpNeighs.end();
-         vit != vend; vit++) {
-      KeyFrame *pKF2 = *vit;
-      if (pKF2->mnPlaceRecognitionQuery != pKF->mnId)
-        continue;
-
-      accScore += pKF2->mPlaceRecognitionScore;
-      if (pKF2->mPlaceRecognitionScore > bestScore) {
-        pBestKF = pKF2;
-        bestScore = pKF2->mPlaceRecognitionScore;
-      }
-    }
-    lAccScoreAndMatch.push_back(make_pair(accScore, pBestKF));
-    if (accScore > bestAccScore)
-      bestAccScore = accScore;
-  }
+  for (size_t i = 0; i < vAccScoreAndMatch.size(); i++)
+    bestAccScore = max(bestAccScore, vAccScoreAndMatch[i].first);
 
   // Return all those keyframes with a score higher than 0.75*bestScore
   float minScoreToRetain = 0.75f * bestAccScore;
+  Map *pMap = pKF->GetMap();
   set<KeyFrame *> spAlreadyAddedKF;
-  vpLoopCand.reserve(lAccScoreAndMatch.size());
-  vpMergeCand.reserve(lAccScoreAndMatch.size());
-  for (list<pair<float, KeyFrame *>>::iterator it = lAccScoreAndMatch.begin(),
-                                               itend = lAccScoreAndMatch.end();
-       it != itend; it++) {
-    const float &si = it->first;
+  vpLoopCand.reserve(vAccScoreAndMatch.size());
+  vpMergeCand.reserve(vAccScoreAndMatch.size());
+  for (size_t i = 0; i < vAccScoreAndMatch.size(); i++) {
+    const float &si = vAccScoreAndMatch[i].first;
     if (si > minScoreToRetain) {
-      KeyFrame *pKFi = it->second;
-      if (!spAlreadyAddedKF.count(pKFi)) {
-        if (pKF->GetMap() == pKFi->GetMap()) {
+      KeyFrame *pKFi = vAccScoreAndMatch[i].second;
+      if (spAlreadyAddedKF.insert(pKFi).second) {
+        if (pMap == pKFi->GetMap()) {
           vpLoopCand.push_back(pKFi);
         } else {
           vpMergeCand.push_back(pKFi);
         }
-        spAlreadyAddedKF.insert(pKFi);
       }
     }
   }
@@ -592,241 +447,110 @@ bool compFirst(const pair<float, KeyFrame *> &a,
 void KeyFrameDatabase::DetectNBestCandidates(KeyFrame *pKF,
                                              vector<KeyFrame *> &vpLoopCand,
                                              vector<KeyFrame *> &vpMergeCand,
-                                             int nNumCandidates) {
-  list<KeyFrame *> lKFsSharingWords;
+                                             int nNumCandidates,
+                                             QueryContext *pContext) {
+  vector<KeyFrame *> vpKFsSharingWords;
   set<KeyFrame *> spConnectedKF;
+  QueryContext localContext;
+  QueryContext &context = pContext ? *pContext : localContext;
 
   // Search all keyframes that share a word with current frame
   {
-    unique_lock<mutex> lock(mMutex);
+    shared_lock<shared_mutex> lock(mMutex);
 
     spConnectedKF = pKF->GetConnectedKeyFrames();
 
-    for (DBoW2::BowVector::const_iterator vit = pKF->mBowVec.begin(),
-                                          vend = pKF->mBowVec.end();
-         vit != vend; vit++) {
-      list<KeyFrame *> &lKFs = mvInvertedFile[vit->first];
-
-      for (list<KeyFrame *>::iterator lit = lKFs.begin(), lend = lKFs.end();
-           lit != lend; lit++) {
-        KeyFrame *pKFi = *lit;
-
-        if (pKFi->mnPlaceRecognitionQuery != pKF->mnId) {
-          pKFi->mnPlaceRecognitionWords = 0;
-          if (!spConnectedKF.count(pKFi)) {
-
-            pKFi->mnPlaceRecognitionQuery = pKF->mnId;
-            lKFsSharingWords.push_back(pKFi);
-          }
-        }
-        pKFi->mnPlaceRecognitionWords++;
-      }
-    }
+    context.Reset(mvpKeyFrames.size());
+    CollectSharingWords(
+        pKF->mBowVec, context, &vpKFsSharingWords,
+        [&](KeyFrame *pKFi) { return spConnectedKF.count(pKFi) ? -1 : 0; });
   }
-  if (lKFsSharingWords.empty())
+  if (vpKFsSharingWords.empty())
     return;
 
   // Only compare against those keyframes that share enough words
-  int maxCommonWords = 0;
-  for (list<KeyFrame *>::iterator lit = lKFsSharingWords.begin(),
-                                  lend = lKFsSharingWords.end();
-       lit != lend; lit++) {
-    if ((*lit)->mnPlaceRecognitionWords > maxCommonWords)
-      maxCommonWords = (*lit)->mnPlaceRecognitionWords;
-  }
-
-  int minCommonWords = maxCommonWords * 0.8f;
-
-  list<pair<float, KeyFrame *>> lScoreAndMatch;
+  int minCommonWords = context.MaxWords(vpKFsSharingWords) * 0.8f;
 
-  int nscores = 0;
+  vector<pair<float, KeyFrame *>> vAccScoreAndMatch;
+  AccumulateCovisibilityScores(pKF->mBowVec, context, vpKFsSharingWords, 0,
+                               minCommonWords, -numeric_limits<float>::max(),
+                               0, vAccScoreAndMatch);
 
-  // Compute similarity score.
-  for (list<KeyFrame *>::iterator lit = lKFsSharingWords.begin(),
-                                  lend = lKFsSharingWords.end();
-       lit != lend; lit++) {
-    KeyFrame *pKFi = *lit;
-
-    if (pKFi->mnPlaceRecognitionWords > minCommonWords) {
-      nscores++;
-      float si = mpVoc->score(pKF->mBowVec, pKFi->mBowVec);
-      pKFi->mPlaceRecognitionScore = si;
-      lScoreAndMatch.push_back(make_pair(si, pKFi));
-    }
-  }
-
-  if (lScoreAndMatch.empty())
+  if (vAccScoreAndMatch.empty())
     return;
 
-  list<pair<float, KeyFrame *>> lAccScoreAndMatch;
-  float bestAccScore = 0;
-
-  // Lets now accumulate score by covisibility
-  for (list<pair<float, KeyFrame *>>::iterator it = lScoreAndMatch.begin(),
-                                               itend = lScoreAndMatch.end();
-       it != itend; it++) {
-    KeyFrame *pKFi = it->second;
-    vector<KeyFrame *> vpNeighs = pKFi->GetBestCovisibilityKeyFrames(10);
-
-    float bestScore = it->first;
-    float accScore = bestScore;
-    KeyFrame *pBestKF = pKFi;
-    for (vector<KeyFrame *>::iterator vit = vpNeighs.begin(),
-                                      vend = vpNeighs.end();
-         vit != vend; vit++) {
-      KeyFrame *pKF2 = *vit;
-      if (pKF2->mnPlaceRecognitionQuery != pKF->mnId)
-        continue;
-
-      accScore += pKF2->mPlaceRecognitionScore;
-      if (pKF2->mPlaceRecognitionScore > bestScore) {
-        pBestKF = pKF2;
-        bestScore = pKF2->mPlaceRecognitionScore;
-      }
-    }
-    lAccScoreAndMatch.push_back(make_pair(accScore, pBestKF));
-    if (accScore > bestAccScore)
-      bestAccScore = accScore;
-  }
-
-  lAccScoreAndMatch.sort(compFirst);
+  stable_sort(vAccScoreAndMatch.begin(), vAccScoreAndMatch.end(), compFirst);
 
+  Map *pMap = pKF->GetMap();
   vpLoopCand.reserve(nNumCandidates);
   vpMergeCand.reserve(nNumCandidates);
   set<KeyFrame *> spAlreadyAddedKF;
-  int i = 0;
-  list<pair<float, KeyFrame *>>::iterator it = lAccScoreAndMatch.begin();
-  while (i < lAccScoreAndMatch.size() &&
-         (vpLoopCand.size() < nNumCandidates ||
-          vpMergeCand.size() < nNumCandidates)) {
-    KeyFrame *pKFi = it->second;
+  for (size_t i = 0; i < vAccScoreAndMatch.size() &&
+                     (vpLoopCand.size() < nNumCandidates ||
+                      vpMergeCand.size() < nNumCandidates);
+       i++) {
+    KeyFrame *pKFi = vAccScoreAndMatch[i].second;
     if (pKFi->isBad())
       continue;
 
-    if (!spAlreadyAddedKF.count(pKFi)) {
-      if (pKF->GetMap() == pKFi->GetMap() &&
-          vpLoopCand.size() < nNumCandidates) {
+    if (spAlreadyAddedKF.insert(pKFi).second) {
+      Map *pMapi = pKFi->GetMap();
+      if (pMap == pMapi && vpLoopCand.size() < nNumCandidates) {
         vpLoopCand.push_back(pKFi);
-      } else if (pKF->GetMap() != pKFi->GetMap() &&
-                 vpMergeCand.size() < nNumCandidates &&
-                 !pKFi->GetMap()->IsBad()) {
+      } else if (pMap != pMapi && vpMergeCand.size() < nNumCandidates &&
+                 !pMapi->IsBad()) {
         vpMergeCand.push_back(pKFi);
       }
-      spAlreadyAddedKF.insert(pKFi);
     }
-    i++;
-    it++;
   }
 }
 
-vector<KeyFrame *> KeyFrameDatabase::DetectRelocalizationCandidates(Frame *F,
-                                                                    Map *pMap) {
-  list<KeyFrame *> lKFsSharingWords;
+vector<KeyFrame *>
+KeyFrameDatabase::DetectRelocalizationCandidates(Frame *F, Map *pMap,
+                                                 QueryContext *pContext) {
+  vector<KeyFrame *> vpKFsSharingWords;
+  QueryContext localContext;
+  QueryContext &context = pContext ? *pContext : localContext;
 
   // Search all keyframes that share a word with current frame
   {
-    unique_lock<mutex> lock(mMutex);
-
-    for (DBoW2::BowVector::const_iterator vit = F->mBowVec.begin(),
-                                          vend = F->mBowVec.end();
-         vit != vend; vit++) {
-      list<KeyFrame *> &lKFs = mvInvertedFile[vit->first];
-
-      for (list<KeyFrame *>::iterator lit = lKFs.begin(), lend = lKFs.end();
-           lit != lend; lit++) {
-        KeyFrame *pKFi = *lit;
-        if (pKFi->mnRelocQuery != F->mnId) {
-          pKFi->mnRelocWords = 0;
-          pKFi->mnRelocQuery = F->mnId;
-          lKFsSharingWords.push_back(pKFi);
-        }
-        pKFi->mnRelocWords++;
-      }
-    }
+    shared_lock<shared_mutex> lock(mMutex);
+
+    context.Reset(mvpKeyFrames.size());
+    CollectSharingWords(F->mBowVec, context, &vpKFsSharingWords,
+                        [](KeyFrame *) { return 0; });
   }
-  if (lKFsSharingWords.empty())
+  if (vpKFsSharingWords.empty())
     return vector<KeyFrame *>();
 
   // Only compare against those keyframes that share enough words
-  int maxCommonWords = 0;
-  for (list<KeyFrame *>::iterator lit = lKFsSharingWords.begin(),
-                                  lend = lKFsSharingWords.end();
-       lit != lend; lit++) {
-    if ((*lit)->mnRelocWords > maxCommonWords)
-      maxCommonWords = (*lit)->mnRelocWords;
-  }
-
-  int minCommonWords = maxCommonWords * 0.8f;
+  int minCommonWords = context.MaxWords(vpKFsSharingWords) * 0.8f;
 
-  list<pair<float, KeyFrame *>> lScoreAndMatch;
+  vector<pair<float, KeyFrame *>> vAccScoreAndMatch;
+  AccumulateCovisibilityScores(F->mBowVec, context, vpKFsSharingWords, 0,
+                               minCommonWords, -numeric_limits<float>::max(),
+                               0, vAccScoreAndMatch);
 
-  int nscores = 0;
-
-  // Compute similarity score.
-  for (list<KeyFrame *>::iterator lit = lKFsSharingWords.begin(),
-                                  lend = lKFsSharingWords.end();
-       lit != lend; lit++) {
-    KeyFrame *pKFi = *lit;
-
-    if (pKFi->mnRelocWords > minCommonWords) {
-      nscores++;
-      float si = mpVoc->score(F->mBowVec, pKFi->mBowVec);
-      pKFi->mRelocScore = si;
-      lScoreAndMatch.push_back(make_pair(si, pKFi));
-    }
-  }
-
-  if (lScoreAndMatch.empty())
+  if (vAccScoreAndMatch.empty())
     return vector<KeyFrame *>();
 
-  list<pair<float, KeyFrame *>> lAccScoreAndMatch;
   float bestAccScore = 0;
-
-  // Lets now accumulate score by covisibility
-  for (list<pair<float, KeyFrame *>>::iterator it = lScoreAndMatch.begin(),
-                                               itend = lScoreAndMatch.end();
-       it != itend; it++) {
-    KeyFrame *pKFi = it->second;
-    vector<KeyFrame *> vpNeighs = pKFi->GetBestCovisibilityKeyFrames(10);
-
-    float bestScore = it->first;
-    float accScore = bestScore;
-    KeyFrame *pBestKF = pKFi;
-    for (vector<KeyFrame *>::iterator vit = vpNeighs.begin(),
-                                      vend = vpNeighs.end();
-         vit != vend; vit++) {
-      KeyFrame *pKF2 = *vit;
-      if (pKF2->mnRelocQuery != F->mnId)
-        continue;
-
-      accScore += pKF2->mRelocScore;
-      if (pKF2->mRelocScore > bestScore) {
-        pBestKF = pKF2;
-        bestScore = pKF2->mRelocScore;
-      }
-    }
-    lAccScoreAndMatch.push_back(make_pair(accScore, pBestKF));
-    if (accScore > bestAccScore)
-      bestAccScore = accScore;
-  }
+  for (size_t i = 0; i < vAccScoreAndMatch.size(); i++)
+    bestAccScore = max(bestAccScore, vAccScoreAndMatch[i].first);
 
   // Return all those keyframes with a score higher than 0.75*bestScore
   float minScoreToRetain = 0.75f * bestAccScore;
   set<KeyFrame *> spAlreadyAddedKF;
   vector<KeyFrame *> vpRelocCandidates;
-  vpRelocCandidates.reserve(lAccScoreAndMatch.size());
-  for (list<pair<float, KeyFrame *>>::iterator it = lAccScoreAndMatch.begin(),
-                                               itend = lAccScoreAndMatch.end();
-       it != itend; it++) {
-    const float &si = it->first;
+  vpRelocCandidates.reserve(vAccScoreAndMatch.size());
+  for (size_t i = 0; i < vAccScoreAndMatch.size(); i++) {
+    const float &si = vAccScoreAndMatch[i].first;
     if (si > minScoreToRetain) {
-      KeyFrame *pKFi = it->second;
+      KeyFrame *pKFi = vAccScoreAndMatch[i].second;
       if (pKFi->GetMap() != pMap)
         continue;
-      if (!spAlreadyAddedKF.count(pKFi)) {
+      if (spAlreadyAddedKF.insert(pKFi).second)
         vpRelocCandidates.push_back(pKFi);
-        spAlreadyAddedKF.insert(pKFi);
-      }
     }
   }
 
@@ -838,8 +562,10 @@ void KeyFrameDatabase::SetORBVocabulary(ORBVocabulary *pORBVoc) {
   ptr = (ORBVocabulary **)(&mpVoc);
   *ptr = pORBVoc;
 
+  mbL1Score = mpVoc->getScoringType() == DBoW2::L1_NORM;
   mvInvertedFile.clear();
   mvInvertedFile.resize(mpVoc->size());
+  mvpKeyFrames.clear();
 }
 
 } // namespace ORB_SLAM3
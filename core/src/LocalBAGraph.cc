@@ -0,0 +1,282 @@
+/**
+ * This file is part of ORB-SLAM3
+ *
+ * Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez
+ * Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+ * Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós,
+ * University of Zaragoza.
+ *
+ * ORB-SLAM3 is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ORB-SLAM3. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "LocalBAGraph.h"
+
+#include "KeyFrame.h"
+#include "Map.h"
+#include "MapPoint.h"
+#include "OptimizableTypes.h"
+#include "ParallelBlockSolver.h"
+
+#include <g2o/core/robust_kernel_impl.h>
+#include <g2o/solvers/eigen/linear_solver_eigen.h>
+
+namespace ORB_SLAM3 {
+
+// Vertex ids: keyframes and points interleaved, so ids stay valid as the map
+// grows
+static int KeyFrameId(const KeyFrame *pKF) { return 2 * pKF->mnId; }
+static int MapPointId(const MapPoint *pMP) { return 2 * pMP->mnId + 1; }
+
+LocalBAGraph::LocalBAGraph(ThreadPool *pThreadPool)
+    : mpMap(NULL), mnMapId(0), mnStamp(0) {
+  auto linearSolver = std::make_unique<
+      g2o::LinearSolverEigen<g2o::BlockSolver_6_3::PoseMatrixType>>();
+  auto solver_ptr = std::make_unique<ParallelBlockSolver_6_3>(
+      std::move(linearSolver), pThreadPool);
+  mpAlgorithm = new g2o::OptimizationAlgorithmLevenberg(std::move(solver_ptr));
+
+  mOptimizer.setAlgorithm(mpAlgorithm);
+  mOptimizer.setVerbose(false);
+}
+
+void LocalBAGraph::Clear() {
+  mOptimizer.clear();
+  mKeyFrames.clear();
+  mMapPoints.clear();
+  mvObservations.clear();
+  mpMap = NULL;
+  mnMapId = 0;
+}
+
+g2o::VertexSE3Expmap *LocalBAGraph::GetVertex(KeyFrame *pKF) const {
+  auto it = mKeyFrames.find(pKF);
+  return it == mKeyFrames.end() ? NULL : it->second.pVertex;
+}
+
+g2o::VertexPointXYZ *LocalBAGraph::GetVertex(MapPoint *pMP) const {
+  auto it = mMapPoints.find(pMP);
+  return it == mMapPoints.end() ? NULL : it->second.pVertex;
+}
+
+g2o::VertexSE3Expmap *LocalBAGraph::AddKeyFrame(KeyFrame *pKF,
+                                                const bool bFixed) {
+  KeyFrameEntry &entry = mKeyFrames[pKF];
+  if (!entry.pVertex) {
+    entry.pVertex = new g2o::VertexSE3Expmap();
+    entry.pVertex->setId(KeyFrameId(pKF));
+    mOptimizer.addVertex(entry.pVertex);
+  }
+  entry.nStamp = mnStamp;
+
+  Sophus::SE3<float> Tcw = pKF->GetPose();
+  entry.pVertex->setEstimate(g2o::SE3Quat(Tcw.unit_quaternion().cast<double>(),
+                                          Tcw.translation().cast<double>()));
+  entry.pVertex->setFixed(bFixed);
+  return entry.pVertex;
+}
+
+bool LocalBAGraph::AreEdgesValid(const PointEntry &entry) const {
+  for (const Observation &obs : entry.vObservations) {
+    if (obs.pKF->isBad() || obs.pKF->GetMap() != mpMap)
+      return false;
+    auto it = mKeyFrames.find(obs.pKF);
+    if (it == mKeyFrames.end() || it->second.nStamp != mnStamp)
+      return false;
+  }
+  return true;
+}
+
+void LocalBAGraph::BuildEdges(MapPoint *pMP, PointEntry &entry) {
+  for (const Observation &obs : entry.vObservations)
+    mOptimizer.removeEdge(obs.pEdge);
+  entry.vObservations.clear();
+
+  // Version first: a change made while reading is caught on the next update
+  entry.nVersion = pMP->GetObservationsVersion();
+  const map<KeyFrame *, tuple<int, int>> observations = pMP->GetObservations();
+
+  const float thHuberMono = sqrt(5.991);
+  const float thHuberStereo = sqrt(7.815);
+
+  for (map<KeyFrame *, tuple<int, int>>::const_iterator
+           mit = observations.begin(),
+           mend = observations.end();
+       mit != mend; mit++) {
+    KeyFrame *pKFi = mit->first;
+    if (pKFi->isBad() || pKFi->GetMap() != mpMap)
+      continue;
+
+    // Observations made after the window was collected wait for the next one
+    auto kit = mKeyFrames.find(pKFi);
+    if (kit == mKeyFrames.end() || kit->second.nStamp != mnStamp)
+      continue;
+    g2o::VertexSE3Expmap *vSE3 = kit->second.pVertex;
+
+    const int leftIndex = get<0>(mit->second);
+
+    // Monocular observation
+    if (leftIndex != -1 && pKFi->mvuRight[leftIndex] < 0) {
+      const cv::KeyPoint &kpUn = pKFi->mvKeysUn[leftIndex];
+      Eigen::Matrix<double, 2, 1> obs;
+      obs << kpUn.pt.x, kpUn.pt.y;
+
+      ORB_SLAM3::EdgeSE3ProjectXYZ *e = new ORB_SLAM3::EdgeSE3ProjectXYZ();
+
+      e->setVertex(0, entry.pVertex);
+      e->setVertex(1, vSE3);
+      e->setMeasurement(obs);
+      const float &invSigma2 = pKFi->mvInvLevelSigma2[kpUn.octave];
+      e->setInformation(Eigen::Matrix2d::Identity() * invSigma2);
+
+      g2o::RobustKernelHuber *rk = new g2o::RobustKernelHuber;
+      e->setRobustKernel(rk);
+      rk->setDelta(thHuberMono);
+
+      e->pCamera = pKFi->mpCamera;
+
+      mOptimizer.addEdge(e);
+      entry.vObservations.push_back({e, pKFi, pMP, MONO});
+    } else if (leftIndex != -1) // Stereo observation
+    {
+      const cv::KeyPoint &kpUn = pKFi->mvKeysUn[leftIndex];
+      Eigen::Matrix<double, 3, 1> obs;
+      const float kp_ur = pKFi->mvuRight[leftIndex];
+      obs << kpUn.pt.x, kpUn.pt.y, kp_ur;
+
+      g2o::EdgeStereoSE3ProjectXYZ *e = new g2o::EdgeStereoSE3ProjectXYZ();
+
+      e->setVertex(0, entry.pVertex);
+      e->setVertex(1, vSE3);
+      e->setMeasurement(obs);
+      const float &invSigma2 = pKFi->mvInvLevelSigma2[kpUn.octave];
+      e->setInformation(Eigen::Matrix3d::Identity() * invSigma2);
+
+      g2o::RobustKernelHuber *rk = new g2o::RobustKernelHuber;
+      e->setRobustKernel(rk);
+      rk->setDelta(thHuberStereo);
+
+      e->fx = pKFi->fx;
+      e->fy = pKFi->fy;
+      e->cx = pKFi->cx;
+      e->cy = pKFi->cy;
+      e->bf = pKFi->mbf;
+
+      mOptimizer.addEdge(e);
+      entry.vObservations.push_back({e, pKFi, pMP, STEREO});
+    }
+
+    if (pKFi->mpCamera2) {
+      int rightIndex = get<1>(mit->second);
+
+      if (rightIndex != -1) {
+        rightIndex -= pKFi->NLeft;
+
+        Eigen::Matrix<double, 2, 1> obs;
+        const cv::KeyPoint &kp = pKFi->mvKeysRight[rightIndex];
+        obs << kp.pt.x, kp.pt.y;
+
+        ORB_SLAM3::EdgeSE3ProjectXYZToBody *e =
+            new ORB_SLAM3::EdgeSE3ProjectXYZToBody();
+
+        e->setVertex(0, entry.pVertex);
+        e->setVertex(1, vSE3);
+        e->setMeasurement(obs);
+        const float &invSigma2 = pKFi->mvInvLevelSigma2[kp.octave];
+        e->setInformation(Eigen::Matrix2d::Identity() * invSigma2);
+
+        g2o::RobustKernelHuber *rk = new g2o::RobustKernelHuber;
+        e->setRobustKernel(rk);
+        rk->setDelta(thHuberMono);
+
+        Sophus::SE3f Trl = pKFi->GetRelativePoseTrl();
+        e->mTrl = g2o::SE3Quat(Trl.unit_quaternion().cast<double>(),
+                               Trl.translation().cast<double>());
+
+        e->pCamera = pKFi->mpCamera2;
+
+        mOptimizer.addEdge(e);
+        entry.vObservations.push_back({e, pKFi, pMP, BODY});
+      }
+    }
+  }
+}
+
+int LocalBAGraph::Update(Map *pMap, const list<KeyFrame *> &lLocalKeyFrames,
+                         const list<KeyFrame *> &lFixedKeyFrames,
+                         const list<MapPoint *> &lLocalMapPoints) {
+  // Nothing carries over to another map
+  if (pMap != mpMap || pMap->GetId() != mnMapId) {
+    Clear();
+    mpMap = pMap;
+    mnMapId = pMap->GetId();
+  }
+  mnStamp++;
+
+  // Keyframe vertices, created or moved to the current poses
+  for (KeyFrame *pKFi : lLocalKeyFrames)
+    AddKeyFrame(pKFi, pKFi->mnId == pMap->GetInitKFid());
+  for (KeyFrame *pKFi : lFixedKeyFrames)
+    AddKeyFrame(pKFi, true);
+
+  // Point vertices, and edges of new points and of those whose observations
+  // changed or reach keyframes out of the window
+  for (MapPoint *pMP : lLocalMapPoints) {
+    auto it = mMapPoints.find(pMP);
+    const bool bNew = it == mMapPoints.end();
+    if (bNew) {
+      g2o::VertexPointXYZ *vPoint = new g2o::VertexPointXYZ();
+      vPoint->setId(MapPointId(pMP));
+      vPoint->setMarginalized(true);
+      mOptimizer.addVertex(vPoint);
+      it = mMapPoints.emplace(pMP, PointEntry()).first;
+      it->second.pVertex = vPoint;
+    }
+
+    PointEntry &entry = it->second;
+    entry.nStamp = mnStamp;
+    entry.pVertex->setEstimate(pMP->GetWorldPos().cast<double>());
+
+    if (bNew || entry.nVersion != pMP->GetObservationsVersion() ||
+        !AreEdgesValid(entry))
+      BuildEdges(pMP, entry);
+  }
+
+  // Points that left the window, with their edges
+  for (auto it = mMapPoints.begin(); it != mMapPoints.end();) {
+    if (it->second.nStamp != mnStamp) {
+      mOptimizer.removeVertex(it->second.pVertex);
+      it = mMapPoints.erase(it);
+    } else
+      it++;
+  }
+
+  // Keyframes that left the window. No edge of a local point reaches them.
+  for (auto it = mKeyFrames.begin(); it != mKeyFrames.end();) {
+    if (it->second.nStamp != mnStamp) {
+      mOptimizer.removeVertex(it->second.pVertex);
+      it = mKeyFrames.erase(it);
+    } else
+      it++;
+  }
+
+  mvObservations.clear();
+  for (MapPoint *pMP : lLocalMapPoints) {
+    const PointEntry &entry = mMapPoints[pMP];
+    mvObservations.insert(mvObservations.end(), entry.vObservations.begin(),
+                          entry.vObservations.end());
+  }
+
+  return mvObservations.size();
+}
+
+} // namespace ORB_SLAM3
@@ -0,0 +1,182 @@
+/**
+ * This file is part of ORB-SLAM3
+ *
+ * Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez
+ * Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+ * Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós,
+ * University of Zaragoza.
+ *
+ * ORB-SLAM3 is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ORB-SLAM3. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "LocalMapCache.h"
+
+#include "KeyFrame.h"
+#include "MapPoint.h"
+
+#include <algorithm>
+
+namespace ORB_SLAM3 {
+
+void LocalMapCache::Clear() {
+  mvVoters.clear();
+  mvpVoterKFs.clear();
+  mvnVotes.clear();
+  mvpVoted.clear();
+  mvKFPoints.clear();
+  mvpKFPoints.clear();
+}
+
+void LocalMapCache::AddVotes(KeyFrame *const *vpKFs, const size_t n,
+                             const int nVotes) {
+  if (nVotes == 0)
+    return;
+
+  for (size_t i = 0; i < n; i++) {
+    KeyFrame *pKF = vpKFs[i];
+    if (pKF->mnId >= mvnVotes.size())
+      mvnVotes.resize(pKF->mnId + 1, 0);
+
+    int &votes = mvnVotes[pKF->mnId];
+    if (votes == 0)
+      mvpVoted.push_back(pKF);
+    votes += nVotes;
+  }
+}
+
+void LocalMapCache::UpdateVotes(const vector<MapPoint *> &vpMapPoints) {
+  mvpSortedPoints.clear();
+  for (MapPoint *pMP : vpMapPoints)
+    if (pMP)
+      mvpSortedPoints.push_back(pMP);
+  sort(mvpSortedPoints.begin(), mvpSortedPoints.end());
+
+  // Merge the sorted points with the sorted voters of the previous call
+  mvNewVoters.clear();
+  mvpNewVoterKFs.clear();
+
+  const size_t nPoints = mvpSortedPoints.size();
+  const size_t nVoters = mvVoters.size();
+  size_t i = 0, j = 0;
+  while (i < nPoints || j < nVoters) {
+    MapPoint *pMP = (i < nPoints) ? mvpSortedPoints[i] : NULL;
+
+    if (!pMP || (j < nVoters && mvVoters[j].pMP < pMP)) {
+      // The point does not vote anymore
+      const Voter &old = mvVoters[j++];
+      AddVotes(mvpVoterKFs.data() + old.begin, old.end - old.begin,
+               -old.nTimes);
+      continue;
+    }
+
+    Voter voter;
+    voter.pMP = pMP;
+    voter.nTimes = 0;
+    while (i < nPoints && mvpSortedPoints[i] == pMP) {
+      voter.nTimes++;
+      i++;
+    }
+    voter.begin = mvpNewVoterKFs.size();
+
+    if (j < nVoters && mvVoters[j].pMP == pMP) {
+      const Voter &old = mvVoters[j++];
+      if (pMP->GetObservationsVersion() == old.nVersion) {
+        // Same observations, only the number of votes may change
+        mvpNewVoterKFs.insert(mvpNewVoterKFs.end(),
+                              mvpVoterKFs.begin() + old.begin,
+                              mvpVoterKFs.begin() + old.end);
+        voter.nVersion = old.nVersion;
+        voter.end = mvpNewVoterKFs.size();
+        AddVotes(mvpNewVoterKFs.data() + voter.begin, voter.end - voter.begin,
+                 voter.nTimes - old.nTimes);
+        mvNewVoters.push_back(voter);
+        continue;
+      }
+
+      AddVotes(mvpVoterKFs.data() + old.begin, old.end - old.begin,
+               -old.nTimes);
+    }
+
+    voter.nVersion = pMP->GetObservingKeyFrames(mvpNewVoterKFs);
+    voter.end = mvpNewVoterKFs.size();
+    AddVotes(mvpNewVoterKFs.data() + voter.begin, voter.end - voter.begin,
+             voter.nTimes);
+    mvNewVoters.push_back(voter);
+  }
+
+  mvVoters.swap(mvNewVoters);
+  mvpVoterKFs.swap(mvpNewVoterKFs);
+
+  // Keyframes are listed once per time their votes rose from zero
+  sort(mvpVoted.begin(), mvpVoted.end());
+  mvpVoted.erase(unique(mvpVoted.begin(), mvpVoted.end()), mvpVoted.end());
+  mvpVoted.erase(remove_if(mvpVoted.begin(), mvpVoted.end(),
+                           [this](KeyFrame *pKF) {
+                             return mvnVotes[pKF->mnId] == 0;
+                           }),
+                 mvpVoted.end());
+}
+
+int LocalMapCache::GetVotes(KeyFrame *pKF) const {
+  return (pKF->mnId < mvnVotes.size()) ? mvnVotes[pKF->mnId] : 0;
+}
+
+void LocalMapCache::CollectMapPoints(const vector<KeyFrame *> &vpKeyFrames,
+                                     const unsigned long nFrameId,
+                                     vector<MapPoint *> &vpMapPoints) {
+  vpMapPoints.clear();
+  mvNewKFPoints.clear();
+  mvpNewKFPoints.clear();
+
+  for (vector<KeyFrame *>::const_reverse_iterator itKF = vpKeyFrames.rbegin(),
+                                                  itEndKF = vpKeyFrames.rend();
+       itKF != itEndKF; ++itKF) {
+    KeyFramePoints entry;
+    entry.pKF = *itKF;
+    // Read before the matches, so a concurrent change is seen next time
+    entry.nVersion = entry.pKF->GetMapPointsVersion();
+    entry.begin = mvpNewKFPoints.size();
+
+    vector<KeyFramePoints>::const_iterator cached =
+        lower_bound(mvKFPoints.begin(), mvKFPoints.end(), entry);
+    if (cached != mvKFPoints.end() && cached->pKF == entry.pKF &&
+        cached->nVersion == entry.nVersion) {
+      mvpNewKFPoints.insert(mvpNewKFPoints.end(),
+                            mvpKFPoints.begin() + cached->begin,
+                            mvpKFPoints.begin() + cached->end);
+    } else {
+      const vector<MapPoint *> vpMPs = entry.pKF->GetMapPointMatches();
+      for (MapPoint *pMP : vpMPs)
+        if (pMP)
+          mvpNewKFPoints.push_back(pMP);
+    }
+    entry.end = mvpNewKFPoints.size();
+    mvNewKFPoints.push_back(entry);
+
+    for (size_t i = entry.begin; i < entry.end; i++) {
+      MapPoint *pMP = mvpNewKFPoints[i];
+      if (pMP->mnTrackReferenceForFrame == nFrameId)
+        continue;
+      if (!pMP->isBad()) {
+        vpMapPoints.push_back(pMP);
+        pMP->mnTrackReferenceForFrame = nFrameId;
+      }
+    }
+  }
+
+  sort(mvNewKFPoints.begin(), mvNewKFPoints.end());
+  mvKFPoints.swap(mvNewKFPoints);
+  mvpKFPoints.swap(mvpNewKFPoints);
+}
+
+} // namespace ORB_SLAM3
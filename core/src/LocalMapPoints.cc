@@ -0,0 +1,171 @@
+/**
+ * This file is part of ORB-SLAM3
+ *
+ * Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez
+ * Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+ * Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós,
+ * University of Zaragoza.
+ *
+ * ORB-SLAM3 is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ORB-SLAM3. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "LocalMapPoints.h"
+
+#include "CameraModels/GeometricCamera.h"
+#include "Frame.h"
+#include "MapPoint.h"
+
+#include <cmath>
+
+using namespace std;
+
+namespace ORB_SLAM3 {
+
+namespace {
+
+// Camera coordinates (in U, V, Z), distance and viewing angle checks, with the
+// same operations in the same order as Frame::isInFrustum but no branches.
+// Arrays are function arguments so that __restrict lets the loop vectorize
+// without runtime alias checks.
+void TransformAndCheck(
+    const size_t n, const float *__restrict X, const float *__restrict Y,
+    const float *__restrict Z, const float *__restrict Nx,
+    const float *__restrict Ny, const float *__restrict Nz,
+    const float *__restrict minD, const float *__restrict maxD,
+    const Eigen::Matrix3f &Rcw, const Eigen::Vector3f &tcw,
+    const Eigen::Vector3f &Ow, const float viewingCosLimit,
+    float *__restrict U, float *__restrict V, float *__restrict Zc,
+    float *__restrict depth, float *__restrict dist,
+    float *__restrict viewCos, uint8_t *__restrict visible) {
+  const float r00 = Rcw(0, 0), r01 = Rcw(0, 1), r02 = Rcw(0, 2);
+  const float r10 = Rcw(1, 0), r11 = Rcw(1, 1), r12 = Rcw(1, 2);
+  const float r20 = Rcw(2, 0), r21 = Rcw(2, 1), r22 = Rcw(2, 2);
+  const float t0 = tcw(0), t1 = tcw(1), t2 = tcw(2);
+  const float o0 = Ow(0), o1 = Ow(1), o2 = Ow(2);
+
+  for (size_t i = 0; i < n; i++) {
+    const float xc = r00 * X[i] + r01 * Y[i] + r02 * Z[i] + t0;
+    const float yc = r10 * X[i] + r11 * Y[i] + r12 * Z[i] + t1;
+    const float zc = r20 * X[i] + r21 * Y[i] + r22 * Z[i] + t2;
+    depth[i] = sqrtf(xc * xc + yc * yc + zc * zc);
+
+    const float px = X[i] - o0, py = Y[i] - o1, pz = Z[i] - o2;
+    const float d = sqrtf(px * px + py * py + pz * pz);
+    const float c = (px * Nx[i] + py * Ny[i] + pz * Nz[i]) / d;
+
+    U[i] = xc;
+    V[i] = yc;
+    Zc[i] = zc;
+    dist[i] = d;
+    viewCos[i] = c;
+    visible[i] = (d >= 0.8f * minD[i]) & (d <= 1.2f * maxD[i]) &
+                 (c >= viewingCosLimit);
+  }
+}
+
+} // namespace
+
+void LocalMapPoints::Build(const vector<MapPoint *> &vpMapPoints) {
+  const size_t n = vpMapPoints.size();
+  mvX.resize(n);
+  mvY.resize(n);
+  mvZ.resize(n);
+  mvNx.resize(n);
+  mvNy.resize(n);
+  mvNz.resize(n);
+  mvMinDistance.resize(n);
+  mvMaxDistance.resize(n);
+
+  Eigen::Vector3f P, Pn;
+  for (size_t i = 0; i < n; i++) {
+    vpMapPoints[i]->GetViewingGeometry(P, Pn, mvMinDistance[i],
+                                       mvMaxDistance[i]);
+    mvX[i] = P(0);
+    mvY[i] = P(1);
+    mvZ[i] = P(2);
+    mvNx[i] = Pn(0);
+    mvNy[i] = Pn(1);
+    mvNz[i] = Pn(2);
+  }
+}
+
+void LocalMapPoints::Project(const Eigen::Matrix3f &Rcw,
+                             const Eigen::Vector3f &tcw,
+                             const Eigen::Vector3f &Ow,
+                             GeometricCamera *pCamera, const float minX,
+                             const float maxX, const float minY,
+                             const float maxY, const float viewingCosLimit,
+                             View &view) const {
+  const size_t n = size();
+  view.vU.resize(n);
+  view.vV.resize(n);
+  view.vZ.resize(n);
+  view.vDepth.resize(n);
+  view.vDist.resize(n);
+  view.vViewCos.resize(n);
+  view.vbInImage.resize(n);
+  view.vbVisible.resize(n);
+
+  TransformAndCheck(n, mvX.data(), mvY.data(), mvZ.data(), mvNx.data(),
+                    mvNy.data(), mvNz.data(), mvMinDistance.data(),
+                    mvMaxDistance.data(), Rcw, tcw, Ow, viewingCosLimit,
+                    view.vU.data(), view.vV.data(), view.vZ.data(),
+                    view.vDepth.data(), view.vDist.data(),
+                    view.vViewCos.data(), view.vbVisible.data());
+
+  float *U = view.vU.data();
+  float *V = view.vV.data();
+  const float *Zc = view.vZ.data();
+  uint8_t *inImage = view.vbInImage.data();
+  uint8_t *visible = view.vbVisible.data();
+
+  // Projection, in place over the camera coordinates
+  if (pCamera->GetType() == GeometricCamera::CAM_PINHOLE) {
+    const float fx = pCamera->getParameter(0), fy = pCamera->getParameter(1);
+    const float cx = pCamera->getParameter(2), cy = pCamera->getParameter(3);
+    for (size_t i = 0; i < n; i++) {
+      U[i] = fx * U[i] / Zc[i] + cx;
+      V[i] = fy * V[i] / Zc[i] + cy;
+    }
+  } else {
+    for (size_t i = 0; i < n; i++) {
+      if (Zc[i] < 0.0f)
+        continue;
+      const Eigen::Vector2f uv =
+          pCamera->project(Eigen::Vector3f(U[i], V[i], Zc[i]));
+      U[i] = uv(0);
+      V[i] = uv(1);
+    }
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    inImage[i] = (Zc[i] >= 0.0f) & (U[i] >= minX) & (U[i] <= maxX) &
+                 (V[i] >= minY) & (V[i] <= maxY);
+    visible[i] &= inImage[i];
+  }
+}
+
+int LocalMapPoints::PredictScale(const size_t i, const float dist,
+                                 const Frame &F) const {
+  const float ratio = mvMaxDistance[i] / dist;
+
+  int nScale = ceil(log(ratio) / F.mfLogScaleFactor);
+  if (nScale < 0)
+    nScale = 0;
+  else if (nScale >= F.mnScaleLevels)
+    nScale = F.mnScaleLevels - 1;
+
+  return nScale;
+}
+
+} // namespace ORB_SLAM3
@@ -32,21 +32,27 @@ using namespace std;
 
 #include <chrono>
 #include <mutex>
+#include <thread>
 
 namespace ORB_SLAM3 {
 
 LocalMapping::LocalMapping(System *pSys, Atlas *pAtlas, const float bMonocular,
-                           bool bInertial, const string &_strSeqName)
-    : mpSystem(pSys), mbMonocular(bMonocular), mbInertial(bInertial),
+                           bool bInertial, const string &_strSeqName,
+                           const int nThreads)
+    : mpSystem(pSys), mpThreadPool(new ThreadPool(nThreads)),
+      mpLocalBAGraph(new LocalBAGraph(mpThreadPool)),
+      mbMonocular(bMonocular), mbInertial(bInertial),
       mbResetRequested(false), mbResetRequestedActiveMap(false),
       mbFinishRequested(false), mbFinished(true), mpAtlas(pAtlas),
-      bInitializing(false), mbAbortBA(false), mbStopped(false),
-      mbStopRequested(false), mbNotStop(false), mbAcceptKeyFrames(true),
-      mIdxInit(0), mScale(1.0), mInitSect(0), mbNotBA1(true), mbNotBA2(true),
-      mIdxIteration(0), infoInertial(Eigen::MatrixXd::Zero(9, 9)) {
+      mNewKeyFrames(16), bInitializing(false), mbAbortBA(false),
+      mbStopped(false), mbStopRequested(false), mbNotStop(false),
+      mbAcceptKeyFrames(true), mIdxInit(0), mScale(1.0), mInitSect(0),
+      mbNotBA1(true), mbNotBA2(true), mIdxIteration(0),
+      infoInertial(Eigen::MatrixXd::Zero(9, 9)) {
   mnMatchesInliers = 0;
 
   mbBadImu = false;
+  mbWakeUp = false;
 
   mTinit = 0.f;
 
@@ -59,6 +65,11 @@ LocalMapping::LocalMapping(System *pSys, Atlas *pAtlas, const float bMonocular,
 #endif
 }
 
+LocalMapping::~LocalMapping() {
+  delete mpLocalBAGraph;
+  delete mpThreadPool;
+}
+
 void LocalMapping::SetLoopCloser(LoopClosing *pLoopCloser) {
   mpLoopCloser = pLoopCloser;
 }
@@ -166,12 +177,14 @@ void LocalMapping::Run() {
             Optimizer::LocalInertialBA(
                 mpCurrentKeyFrame, &mbAbortBA, mpCurrentKeyFrame->GetMap(),
                 num_FixedKF_BA, num_OptKF_BA, num_MPs_BA, num_edges_BA, bLarge,
-                !mpCurrentKeyFrame->GetMap()->GetIniertialBA2());
+                !mpCurrentKeyFrame->GetMap()->GetIniertialBA2(),
+                mpThreadPool);
             b_doneLBA = true;
           } else {
             Optimizer::LocalBundleAdjustment(
                 mpCurrentKeyFrame, &mbAbortBA, mpCurrentKeyFrame->GetMap(),
-                num_FixedKF_BA, num_OptKF_BA, num_MPs_BA, num_edges_BA);
+                num_FixedKF_BA, num_OptKF_BA, num_MPs_BA, num_edges_BA,
+                mpLocalBAGraph);
             b_doneLBA = true;
           }
         }
@@ -283,7 +296,7 @@ void LocalMapping::Run() {
     } else if (Stop() && !mbBadImu) {
       // Safe area to stop
       while (isStopped() && !CheckFinish()) {
-        usleep(3000);
+        WaitForWakeUp();
       }
       if (CheckFinish())
         break;
@@ -297,29 +310,49 @@ void LocalMapping::Run() {
     if (CheckFinish())
       break;
 
-    usleep(3000);
+    // Sleep until a keyframe or a request arrives. A stop requested while
+    // keyframes were being processed is honoured without waiting. With a bad
+    // IMU neither is served, so sleep until the reset Tracking will request.
+    bool bStopPending;
+    {
+      unique_lock<mutex> lock(mMutexStop);
+      bStopPending = mbStopRequested && !mbNotStop;
+    }
+    if (!((CheckNewKeyFrames() || bStopPending) && !mbBadImu))
+      WaitForWakeUp();
   }
 
   SetFinish();
 }
 
 void LocalMapping::InsertKeyFrame(KeyFrame *pKF) {
-  unique_lock<mutex> lock(mMutexNewKFs);
-  mlNewKeyFrames.push_back(pKF);
+  // Tracking::NeedNewKeyFrame asks for no keyframe while the queue is full,
+  // so this only waits for the one or two keyframes of a map initialization
+  while (!mNewKeyFrames.TryPush(pKF)) {
+    WakeUp();
+    this_thread::yield();
+  }
   mbAbortBA = true;
+  WakeUp();
+}
+
+void LocalMapping::WakeUp() {
+  unique_lock<mutex> lock(mMutexWakeUp);
+  mbWakeUp = true;
+  mcvWakeUp.notify_one();
 }
 
-bool LocalMapping::CheckNewKeyFrames() {
-  unique_lock<mutex> lock(mMutexNewKFs);
-  return (!mlNewKeyFrames.empty());
+void LocalMapping::WaitForWakeUp() {
+  unique_lock<mutex> lock(mMutexWakeUp);
+  mcvWakeUp.wait(lock, [this] { return mbWakeUp; });
+  mbWakeUp = false;
 }
 
+bool LocalMapping::CheckNewKeyFrames() { return !mNewKeyFrames.Empty(); }
+
 void LocalMapping::ProcessNewKeyFrame() {
-  {
-    unique_lock<mutex> lock(mMutexNewKFs);
-    mpCurrentKeyFrame = mlNewKeyFrames.front();
-    mlNewKeyFrames.pop_front();
-  }
+  if (!mNewKeyFrames.TryPop(mpCurrentKeyFrame))
+    return;
 
   // Compute Bags of Words structures
   mpCurrentKeyFrame->ComputeBoW();
@@ -413,8 +446,81 @@ void LocalMapping::CreateNewMapPoints() {
     }
   }
 
+  // Same for every neighbour
+  const bool bCoarse = mbInertial &&
+                       mpTracker->mState == Tracking::RECENTLY_LOST &&
+                       mpCurrentKeyFrame->GetMap()->GetIniertialBA2();
+
+  const int nNeighs = vpNeighKFs.size();
+  if (mpThreadPool->Size() == 0) {
+    // Search matches with epipolar restriction and triangulate
+    vector<NewMapPoint> vNewMapPoints;
+    for (int i = 0; i < nNeighs; i++) {
+      if (i > 0 && CheckNewKeyFrames())
+        return;
+
+      vNewMapPoints.clear();
+      TriangulateWithNeighbor(vpNeighKFs[i], bCoarse, vNewMapPoints);
+      AddNewMapPoints(vpNeighKFs[i], vNewMapPoints);
+    }
+    return;
+  }
+
+  // Same with one task per neighbour. The tasks only read the keyframes, so
+  // the search with neighbour i does not skip the features of the current
+  // keyframe that get a point from an earlier neighbour. The search matches
+  // every feature on its own (see TriangulateWithNeighbor), so dropping
+  // those features from the candidates of neighbour i gives exactly the
+  // points of the serial loop above.
+  vector<vector<NewMapPoint>> vvNewMapPoints(nNeighs);
+  vector<char> vbAborted(nNeighs, false);
+  mpThreadPool->ParallelFor(0, nNeighs, [&](int i) {
+    if (i > 0 && CheckNewKeyFrames()) {
+      vbAborted[i] = true;
+      return;
+    }
+    TriangulateWithNeighbor(vpNeighKFs[i], bCoarse, vvNewMapPoints[i]);
+  });
+
+  for (int i = 0; i < nNeighs; i++) {
+    if (vbAborted[i])
+      return;
+    AddNewMapPoints(vpNeighKFs[i], vvNewMapPoints[i]);
+  }
+}
+
+void LocalMapping::AddNewMapPoints(KeyFrame *pKF2,
+                                   const vector<NewMapPoint> &vNewMapPoints) {
+  for (const NewMapPoint &nmp : vNewMapPoints) {
+    // Triangulated with an earlier neighbour after this search ran
+    if (mpCurrentKeyFrame->GetMapPoint(nmp.idx1))
+      continue;
+
+    MapPoint *pMP =
+        new MapPoint(nmp.x3D, mpCurrentKeyFrame, mpAtlas->GetCurrentMap());
+
+    pMP->AddObservation(mpCurrentKeyFrame, nmp.idx1);
+    pMP->AddObservation(pKF2, nmp.idx2);
+
+    mpCurrentKeyFrame->AddMapPoint(pMP, nmp.idx1);
+    pKF2->AddMapPoint(pMP, nmp.idx2);
+
+    pMP->ComputeDistinctiveDescriptors();
+
+    pMP->UpdateNormalAndDepth();
+
+    mpAtlas->AddMapPoint(pMP);
+    mlpRecentAddedMapPoints.push_back(pMP);
+  }
+}
+
+void LocalMapping::TriangulateWithNeighbor(
+    KeyFrame *pKF2, const bool bCoarse, vector<NewMapPoint> &vNewMapPoints) {
   float th = 0.6f;
 
+  // Without the orientation check, and as a feature of pKF2 can be matched
+  // to several ones of the current keyframe, the match of a feature does not
+  // depend on the others. CreateNewMapPoints relies on it.
   ORBmatcher matcher(th, false);
 
   Sophus::SE3<float> sophTcw1 = mpCurrentKeyFrame->GetPose();
@@ -432,285 +538,248 @@ void LocalMapping::CreateNewMapPoints() {
   const float &invfy1 = mpCurrentKeyFrame->invfy;
 
   const float ratioFactor = 1.5f * mpCurrentKeyFrame->mfScaleFactor;
-  int countStereo = 0;
-  int countStereoGoodProj = 0;
-  int countStereoAttempt = 0;
-  int totalStereoPts = 0;
-  // Search matches with epipolar restriction and triangulate
-  for (size_t i = 0; i < vpNeighKFs.size(); i++) {
-    if (i > 0 && CheckNewKeyFrames())
-      return;
-
-    KeyFrame *pKF2 = vpNeighKFs[i];
 
-    GeometricCamera *pCamera1 = mpCurrentKeyFrame->mpCamera,
-                    *pCamera2 = pKF2->mpCamera;
+  GeometricCamera *pCamera1 = mpCurrentKeyFrame->mpCamera,
+                  *pCamera2 = pKF2->mpCamera;
 
-    // Check first that baseline is not too short
-    Eigen::Vector3f Ow2 = pKF2->GetCameraCenter();
-    Eigen::Vector3f vBaseline = Ow2 - Ow1;
-    const float baseline = vBaseline.norm();
+  // Check first that baseline is not too short
+  Eigen::Vector3f Ow2 = pKF2->GetCameraCenter();
+  Eigen::Vector3f vBaseline = Ow2 - Ow1;
+  const float baseline = vBaseline.norm();
 
-    if (!mbMonocular) {
-      if (baseline < pKF2->mb)
-        continue;
-    } else {
-      const float medianDepthKF2 = pKF2->ComputeSceneMedianDepth(2);
-      const float ratioBaselineDepth = baseline / medianDepthKF2;
+  if (!mbMonocular) {
+    if (baseline < pKF2->mb)
+      return;
+  } else {
+    const float medianDepthKF2 = pKF2->ComputeSceneMedianDepth(2);
+    const float ratioBaselineDepth = baseline / medianDepthKF2;
 
-      if (ratioBaselineDepth < 0.01)
-        continue;
-    }
+    if (ratioBaselineDepth < 0.01)
+      return;
+  }
 
-    // Search matches that fullfil epipolar constraint
-    vector<pair<size_t, size_t>> vMatchedIndices;
-    bool bCoarse = mbInertial && mpTracker->mState == Tracking::RECENTLY_LOST &&
-                   mpCurrentKeyFrame->GetMap()->GetIniertialBA2();
-
-    matcher.SearchForTriangulation(mpCurrentKeyFrame, pKF2, vMatchedIndices,
-                                   false, bCoarse);
-
-    Sophus::SE3<float> sophTcw2 = pKF2->GetPose();
-    Eigen::Matrix<float, 3, 4> eigTcw2 = sophTcw2.matrix3x4();
-    Eigen::Matrix<float, 3, 3> Rcw2 = eigTcw2.block<3, 3>(0, 0);
-    Eigen::Matrix<float, 3, 3> Rwc2 = Rcw2.transpose();
-    Eigen::Vector3f tcw2 = sophTcw2.translation();
-
-    const float &fx2 = pKF2->fx;
-    const float &fy2 = pKF2->fy;
-    const float &cx2 = pKF2->cx;
-    const float &cy2 = pKF2->cy;
-    const float &invfx2 = pKF2->invfx;
-    const float &invfy2 = pKF2->invfy;
-
-    // Triangulate each match
-    const int nmatches = vMatchedIndices.size();
-    for (int ikp = 0; ikp < nmatches; ikp++) {
-      const int &idx1 = vMatchedIndices[ikp].first;
-      const int &idx2 = vMatchedIndices[ikp].second;
-
-      const cv::KeyPoint &kp1 =
-          (mpCurrentKeyFrame->NLeft == -1) ? mpCurrentKeyFrame->mvKeysUn[idx1]
-          : (idx1 < mpCurrentKeyFrame->NLeft)
-              ? mpCurrentKeyFrame->mvKeys[idx1]
-              : mpCurrentKeyFrame->mvKeysRight[idx1 - mpCurrentKeyFrame->NLeft];
-      const float kp1_ur = mpCurrentKeyFrame->mvuRight[idx1];
-      bool bStereo1 = (!mpCurrentKeyFrame->mpCamera2 && kp1_ur >= 0);
-      const bool bRight1 =
-          (mpCurrentKeyFrame->NLeft == -1 || idx1 < mpCurrentKeyFrame->NLeft)
-              ? false
-              : true;
-
-      const cv::KeyPoint &kp2 = (pKF2->NLeft == -1) ? pKF2->mvKeysUn[idx2]
-                                : (idx2 < pKF2->NLeft)
-                                    ? pKF2->mvKeys[idx2]
-                                    : pKF2->mvKeysRight[idx2 - pKF2->NLeft];
-
-      const float kp2_ur = pKF2->mvuRight[idx2];
-      bool bStereo2 = (!pKF2->mpCamera2 && kp2_ur >= 0);
-      const bool bRight2 =
-          (pKF2->NLeft == -1 || idx2 < pKF2->NLeft) ? false : true;
-
-      if (mpCurrentKeyFrame->mpCamera2 && pKF2->mpCamera2) {
-        if (bRight1 && bRight2) {
-          sophTcw1 = mpCurrentKeyFrame->GetRightPose();
-          Ow1 = mpCurrentKeyFrame->GetRightCameraCenter();
-
-          sophTcw2 = pKF2->GetRightPose();
-          Ow2 = pKF2->GetRightCameraCenter();
-
-          pCamera1 = mpCurrentKeyFrame->mpCamera2;
-          pCamera2 = pKF2->mpCamera2;
-        } else if (bRight1 && !bRight2) {
-          sophTcw1 = mpCurrentKeyFrame->GetRightPose();
-          Ow1 = mpCurrentKeyFrame->GetRightCameraCenter();
-
-          sophTcw2 = pKF2->GetPose();
-          Ow2 = pKF2->GetCameraCenter();
-
-          pCamera1 = mpCurrentKeyFrame->mpCamera2;
-          pCamera2 = pKF2->mpCamera;
-        } else if (!bRight1 && bRight2) {
-          sophTcw1 = mpCurrentKeyFrame->GetPose();
-          Ow1 = mpCurrentKeyFrame->GetCameraCenter();
-
-          sophTcw2 = pKF2->GetRightPose();
-          Ow2 = pKF2->GetRightCameraCenter();
-
-          pCamera1 = mpCurrentKeyFrame->mpCamera;
-          pCamera2 = pKF2->mpCamera2;
-        } else {
-          sophTcw1 = mpCurrentKeyFrame->GetPose();
-          Ow1 = mpCurrentKeyFrame->GetCameraCenter();
+  // Search matches that fullfil epipolar constraint
+  vector<pair<size_t, size_t>> vMatchedIndices;
+
+  matcher.SearchForTriangulation(mpCurrentKeyFrame, pKF2, vMatchedIndices,
+                                 false, bCoarse);
+
+  Sophus::SE3<float> sophTcw2 = pKF2->GetPose();
+  Eigen::Matrix<float, 3, 4> eigTcw2 = sophTcw2.matrix3x4();
+  Eigen::Matrix<float, 3, 3> Rcw2 = eigTcw2.block<3, 3>(0, 0);
+  Eigen::Matrix<float, 3, 3> Rwc2 = Rcw2.transpose();
+  Eigen::Vector3f tcw2 = sophTcw2.translation();
+
+  const float &fx2 = pKF2->fx;
+  const float &fy2 = pKF2->fy;
+  const float &cx2 = pKF2->cx;
+  const float &cy2 = pKF2->cy;
+  const float &invfx2 = pKF2->invfx;
+  const float &invfy2 = pKF2->invfy;
+
+  // Triangulate each match
+  const int nmatches = vMatchedIndices.size();
+  for (int ikp = 0; ikp < nmatches; ikp++) {
+    const int &idx1 = vMatchedIndices[ikp].first;
+    const int &idx2 = vMatchedIndices[ikp].second;
+
+    const cv::KeyPoint &kp1 =
+        (mpCurrentKeyFrame->NLeft == -1) ? mpCurrentKeyFrame->mvKeysUn[idx1]
+        : (idx1 < mpCurrentKeyFrame->NLeft)
+            ? mpCurrentKeyFrame->mvKeys[idx1]
+            : mpCurrentKeyFrame->mvKeysRight[idx1 - mpCurrentKeyFrame->NLeft];
+    const float kp1_ur = mpCurrentKeyFrame->mvuRight[idx1];
+    bool bStereo1 = (!mpCurrentKeyFrame->mpCamera2 && kp1_ur >= 0);
+    const bool bRight1 =
+        (mpCurrentKeyFrame->NLeft == -1 || idx1 < mpCurrentKeyFrame->NLeft)
+            ? false
+            : true;
+
+    const cv::KeyPoint &kp2 = (pKF2->NLeft == -1) ? pKF2->mvKeysUn[idx2]
+                              : (idx2 < pKF2->NLeft)
+                                  ? pKF2->mvKeys[idx2]
+                                  : pKF2->mvKeysRight[idx2 - pKF2->NLeft];
+
+    const float kp2_ur = pKF2->mvuRight[idx2];
+    bool bStereo2 = (!pKF2->mpCamera2 && kp2_ur >= 0);
+    const bool bRight2 =
+        (pKF2->NLeft == -1 || idx2 < pKF2->NLeft) ? false : true;
+
+    if (mpCurrentKeyFrame->mpCamera2 && pKF2->mpCamera2) {
+      if (bRight1 && bRight2) {
+        sophTcw1 = mpCurrentKeyFrame->GetRightPose();
+        Ow1 = mpCurrentKeyFrame->GetRightCameraCenter();
+
+        sophTcw2 = pKF2->GetRightPose();
+        Ow2 = pKF2->GetRightCameraCenter();
+
+        pCamera1 = mpCurrentKeyFrame->mpCamera2;
+        pCamera2 = pKF2->mpCamera2;
+      } else if (bRight1 && !bRight2) {
+        sophTcw1 = mpCurrentKeyFrame->GetRightPose();
+        Ow1 = mpCurrentKeyFrame->GetRightCameraCenter();
+
+        sophTcw2 = pKF2->GetPose();
+        Ow2 = pKF2->GetCameraCenter();
+
+        pCamera1 = mpCurrentKeyFrame->mpCamera2;
+        pCamera2 = pKF2->mpCamera;
+      } else if (!bRight1 && bRight2) {
+        sophTcw1 = mpCurrentKeyFrame->GetPose();
+        Ow1 = mpCurrentKeyFrame->GetCameraCenter();
+
+        sophTcw2 = pKF2->GetRightPose();
+        Ow2 = pKF2->GetRightCameraCenter();
+
+        pCamera1 = mpCurrentKeyFrame->mpCamera;
+        pCamera2 = pKF2->mpCamera2;
+      } else {
+        sophTcw1 = mpCurrentKeyFrame->GetPose();
+        Ow1 = mpCurrentKeyFrame->GetCameraCenter();
 
-          sophTcw2 = pKF2->GetPose();
-          Ow2 = pKF2->GetCameraCenter();
+        sophTcw2 = pKF2->GetPose();
+        Ow2 = pKF2->GetCameraCenter();
 
-          pCamera1 = mpCurrentKeyFrame->mpCamera;
-          pCamera2 = pKF2->mpCamera;
-        }
-        eigTcw1 = sophTcw1.matrix3x4();
-        Rcw1 = eigTcw1.block<3, 3>(0, 0);
-        Rwc1 = Rcw1.transpose();
-        tcw1 = sophTcw1.translation();
-
-        eigTcw2 = sophTcw2.matrix3x4();
-        Rcw2 = eigTcw2.block<3, 3>(0, 0);
-        Rwc2 = Rcw2.transpose();
-        tcw2 = sophTcw2.translation();
+        pCamera1 = mpCurrentKeyFrame->mpCamera;
+        pCamera2 = pKF2->mpCamera;
       }
+      eigTcw1 = sophTcw1.matrix3x4();
+      Rcw1 = eigTcw1.block<3, 3>(0, 0);
+      Rwc1 = Rcw1.transpose();
+      tcw1 = sophTcw1.translation();
+
+      eigTcw2 = sophTcw2.matrix3x4();
+      Rcw2 = eigTcw2.block<3, 3>(0, 0);
+      Rwc2 = Rcw2.transpose();
+      tcw2 = sophTcw2.translation();
+    }
 
-      // Check parallax between rays
-      Eigen::Vector3f xn1 = pCamera1->unprojectEig(kp1.pt);
-      Eigen::Vector3f xn2 = pCamera2->unprojectEig(kp2.pt);
-
-      Eigen::Vector3f ray1 = Rwc1 * xn1;
-      Eigen::Vector3f ray2 = Rwc2 * xn2;
-      const float cosParallaxRays =
-          ray1.dot(ray2) / (ray1.norm() * ray2.norm());
-
-      float cosParallaxStereo = cosParallaxRays + 1;
-      float cosParallaxStereo1 = cosParallaxStereo;
-      float cosParallaxStereo2 = cosParallaxStereo;
-
-      if (bStereo1)
-        cosParallaxStereo1 = cos(2 * atan2(mpCurrentKeyFrame->mb / 2,
-                                           mpCurrentKeyFrame->mvDepth[idx1]));
-      else if (bStereo2)
-        cosParallaxStereo2 = cos(2 * atan2(pKF2->mb / 2, pKF2->mvDepth[idx2]));
+    // Check parallax between rays
+    Eigen::Vector3f xn1 = pCamera1->unprojectEig(kp1.pt);
+    Eigen::Vector3f xn2 = pCamera2->unprojectEig(kp2.pt);
 
-      if (bStereo1 || bStereo2)
-        totalStereoPts++;
+    Eigen::Vector3f ray1 = Rwc1 * xn1;
+    Eigen::Vector3f ray2 = Rwc2 * xn2;
+    const float cosParallaxRays = ray1.dot(ray2) / (ray1.norm() * ray2.norm());
 
-      cosParallaxStereo = min(cosParallaxStereo1, cosParallaxStereo2);
+    float cosParallaxStereo = cosParallaxRays + 1;
+    float cosParallaxStereo1 = cosParallaxStereo;
+    float cosParallaxStereo2 = cosParallaxStereo;
 
-      Eigen::Vector3f x3D;
+    if (bStereo1)
+      cosParallaxStereo1 = cos(2 * atan2(mpCurrentKeyFrame->mb / 2,
+                                         mpCurrentKeyFrame->mvDepth[idx1]));
+    else if (bStereo2)
+      cosParallaxStereo2 = cos(2 * atan2(pKF2->mb / 2, pKF2->mvDepth[idx2]));
 
-      bool goodProj = false;
-      bool bPointStereo = false;
-      if (cosParallaxRays < cosParallaxStereo && cosParallaxRays > 0 &&
-          (bStereo1 || bStereo2 || (cosParallaxRays < 0.9996 && mbInertial) ||
-           (cosParallaxRays < 0.9998 && !mbInertial))) {
-        goodProj = GeometricTools::Triangulate(xn1, xn2, eigTcw1, eigTcw2, x3D);
-        if (!goodProj)
-          continue;
-      } else if (bStereo1 && cosParallaxStereo1 < cosParallaxStereo2) {
-        countStereoAttempt++;
-        bPointStereo = true;
-        goodProj = mpCurrentKeyFrame->UnprojectStereo(idx1, x3D);
-      } else if (bStereo2 && cosParallaxStereo2 < cosParallaxStereo1) {
-        countStereoAttempt++;
-        bPointStereo = true;
-        goodProj = pKF2->UnprojectStereo(idx2, x3D);
-      } else {
-        continue; // No stereo and very low parallax
-      }
+    cosParallaxStereo = min(cosParallaxStereo1, cosParallaxStereo2);
 
-      if (goodProj && bPointStereo)
-        countStereoGoodProj++;
+    Eigen::Vector3f x3D;
 
+    bool goodProj = false;
+    if (cosParallaxRays < cosParallaxStereo && cosParallaxRays > 0 &&
+        (bStereo1 || bStereo2 || (cosParallaxRays < 0.9996 && mbInertial) ||
+         (cosParallaxRays < 0.9998 && !mbInertial))) {
+      goodProj = GeometricTools::Triangulate(xn1, xn2, eigTcw1, eigTcw2, x3D);
       if (!goodProj)
         continue;
+    } else if (bStereo1 && cosParallaxStereo1 < cosParallaxStereo2) {
+      goodProj = mpCurrentKeyFrame->UnprojectStereo(idx1, x3D);
+    } else if (bStereo2 && cosParallaxStereo2 < cosParallaxStereo1) {
+      goodProj = pKF2->UnprojectStereo(idx2, x3D);
+    } else {
+      continue; // No stereo and very low parallax
+    }
 
-      // Check triangulation in front of cameras
-      float z1 = Rcw1.row(2).dot(x3D) + tcw1(2);
-      if (z1 <= 0)
-        continue;
-
-      float z2 = Rcw2.row(2).dot(x3D) + tcw2(2);
-      if (z2 <= 0)
-        continue;
-
-      // Check reprojection error in first keyframe
-      const float &sigmaSquare1 = mpCurrentKeyFrame->mvLevelSigma2[kp1.octave];
-      const float x1 = Rcw1.row(0).dot(x3D) + tcw1(0);
-      const float y1 = Rcw1.row(1).dot(x3D) + tcw1(1);
-      const float invz1 = 1.0 / z1;
-
-      if (!bStereo1) {
-        cv::Point2f uv1 = pCamera1->project(cv::Point3f(x1, y1, z1));
-        float errX1 = uv1.x - kp1.pt.x;
-        float errY1 = uv1.y - kp1.pt.y;
-
-        if ((errX1 * errX1 + errY1 * errY1) > 5.991 * sigmaSquare1)
-          continue;
+    if (!goodProj)
+      continue;
 
-      } else {
-        float u1 = fx1 * x1 * invz1 + cx1;
-        float u1_r = u1 - mpCurrentKeyFrame->mbf * invz1;
-        float v1 = fy1 * y1 * invz1 + cy1;
-        float errX1 = u1 - kp1.pt.x;
-        float errY1 = v1 - kp1.pt.y;
-        float errX1_r = u1_r - kp1_ur;
-        if ((errX1 * errX1 + errY1 * errY1 + errX1_r * errX1_r) >
-            7.8 * sigmaSquare1)
-          continue;
-      }
+    // Check triangulation in front of cameras
+    float z1 = Rcw1.row(2).dot(x3D) + tcw1(2);
+    if (z1 <= 0)
+      continue;
 
-      // Check reprojection error in second keyframe
-      const float sigmaSquare2 = pKF2->mvLevelSigma2[kp2.octave];
-      const float x2 = Rcw2.row(0).dot(x3D) + tcw2(0);
-      const float y2 = Rcw2.row(1).dot(x3D) + tcw2(1);
-      const float invz2 = 1.0 / z2;
-      if (!bStereo2) {
-        cv::Point2f uv2 = pCamera2->project(cv::Point3f(x2, y2, z2));
-        float errX2 = uv2.x - kp2.pt.x;
-        float errY2 = uv2.y - kp2.pt.y;
-        if ((errX2 * errX2 + errY2 * errY2) > 5.991 * sigmaSquare2)
-          continue;
-      } else {
-        float u2 = fx2 * x2 * invz2 + cx2;
-        float u2_r = u2 - mpCurrentKeyFrame->mbf * invz2;
-        float v2 = fy2 * y2 * invz2 + cy2;
-        float errX2 = u2 - kp2.pt.x;
-        float errY2 = v2 - kp2.pt.y;
-        float errX2_r = u2_r - kp2_ur;
-        if ((errX2 * errX2 + errY2 * errY2 + errX2_r * errX2_r) >
-            7.8 * sigmaSquare2)
-          continue;
-      }
+    float z2 = Rcw2.row(2).dot(x3D) + tcw2(2);
+    if (z2 <= 0)
+      continue;
 
-      // Check scale consistency
-      Eigen::Vector3f normal1 = x3D - Ow1;
-      float dist1 = normal1.norm();
+    // Check reprojection error in first keyframe
+    const float &sigmaSquare1 = mpCurrentKeyFrame->mvLevelSigma2[kp1.octave];
+    const float x1 = Rcw1.row(0).dot(x3D) + tcw1(0);
+    const float y1 = Rcw1.row(1).dot(x3D) + tcw1(1);
+    const float invz1 = 1.0 / z1;
 
-      Eigen::Vector3f normal2 = x3D - Ow2;
-      float dist2 = normal2.norm();
+    if (!bStereo1) {
+      cv::Point2f uv1 = pCamera1->project(cv::Point3f(x1, y1, z1));
+      float errX1 = uv1.x - kp1.pt.x;
+      float errY1 = uv1.y - kp1.pt.y;
 
-      if (dist1 == 0 || dist2 == 0)
+      if ((errX1 * errX1 + errY1 * errY1) > 5.991 * sigmaSquare1)
         continue;
 
-      if (mbFarPoints &&
-          (dist1 >= mThFarPoints || dist2 >= mThFarPoints)) // MODIFICATION
+    } else {
+      float u1 = fx1 * x1 * invz1 + cx1;
+      float u1_r = u1 - mpCurrentKeyFrame->mbf * invz1;
+      float v1 = fy1 * y1 * invz1 + cy1;
+      float errX1 = u1 - kp1.pt.x;
+      float errY1 = v1 - kp1.pt.y;
+      float errX1_r = u1_r - kp1_ur;
+      if ((errX1 * errX1 + errY1 * errY1 + errX1_r * errX1_r) >
+          7.8 * sigmaSquare1)
         continue;
+    }
 
-      const float ratioDist = dist2 / dist1;
-      const float ratioOctave = mpCurrentKeyFrame->mvScaleFactors[kp1.octave] /
-                                pKF2->mvScaleFactors[kp2.octave];
-
-      if (ratioDist * ratioFactor < ratioOctave ||
-          ratioDist > ratioOctave * ratioFactor)
+    // Check reprojection error in second keyframe
+    const float sigmaSquare2 = pKF2->mvLevelSigma2[kp2.octave];
+    const float x2 = Rcw2.row(0).dot(x3D) + tcw2(0);
+    const float y2 = Rcw2.row(1).dot(x3D) + tcw2(1);
+    const float invz2 = 1.0 / z2;
+    if (!bStereo2) {
+      cv::Point2f uv2 = pCamera2->project(cv::Point3f(x2, y2, z2));
+      float errX2 = uv2.x - kp2.pt.x;
+      float errY2 = uv2.y - kp2.pt.y;
+      if ((errX2 * errX2 + errY2 * errY2) > 5.991 * sigmaSquare2)
         continue;
+    } else {
+      float u2 = fx2 * x2 * invz2 + cx2;
+      float u2_r = u2 - mpCurrentKeyFrame->mbf * invz2;
+      float v2 = fy2 * y2 * invz2 + cy2;
+      float errX2 = u2 - kp2.pt.x;
+      float errY2 = v2 - kp2.pt.y;
+      float errX2_r = u2_r - kp2_ur;
+      if ((errX2 * errX2 + errY2 * errY2 + errX2_r * errX2_r) >
+          7.8 * sigmaSquare2)
+        continue;
+    }
 
-      // Triangulation is succesfull
-      MapPoint *pMP =
-          new MapPoint(x3D, mpCurrentKeyFrame, mpAtlas->GetCurrentMap());
-      if (bPointStereo)
-        countStereo++;
+    // Check scale consistency
+    Eigen::Vector3f normal1 = x3D - Ow1;
+    float dist1 = normal1.norm();
 
-      pMP->AddObservation(mpCurrentKeyFrame, idx1);
-      pMP->AddObservation(pKF2, idx2);
+    Eigen::Vector3f normal2 = x3D - Ow2;
+    float dist2 = normal2.norm();
 
-      mpCurrentKeyFrame->AddMapPoint(pMP, idx1);
-      pKF2->AddMapPoint(pMP, idx2);
+    if (dist1 == 0 || dist2 == 0)
+      continue;
 
-      pMP->ComputeDistinctiveDescriptors();
+    if (mbFarPoints &&
+        (dist1 >= mThFarPoints || dist2 >= mThFarPoints)) // MODIFICATION
+      continue;
 
-      pMP->UpdateNormalAndDepth();
+    const float ratioDist = dist2 / dist1;
+    const float ratioOctave = mpCurrentKeyFrame->mvScaleFactors[kp1.octave] /
+                              pKF2->mvScaleFactors[kp2.octave];
 
-      mpAtlas->AddMapPoint(pMP);
-      mlpRecentAddedMapPoints.push_back(pMP);
-    }
+    if (ratioDist * ratioFactor < ratioOctave ||
+        ratioDist > ratioOctave * ratioFactor)
+      continue;
+
+    // Triangulation is succesfull
+    NewMapPoint nmp;
+    nmp.x3D = x3D;
+    nmp.idx1 = idx1;
+    nmp.idx2 = idx2;
+    vNewMapPoints.push_back(nmp);
   }
 }
 
@@ -766,19 +835,30 @@ void LocalMapping::SearchInNeighbors() {
     }
   }
 
-  // Search matches by projection from current KF in target KFs
+  // Search matches by projection from current KF in target KFs. The searches
+  // (left and right camera of every target) run concurrently and do not
+  // change the map. The fusions are applied afterwards in target order, so
+  // the result does not depend on the scheduling.
   ORBmatcher matcher;
   vector<MapPoint *> vpMapPointMatches =
       mpCurrentKeyFrame->GetMapPointMatches();
-  for (vector<KeyFrame *>::iterator vit = vpTargetKFs.begin(),
-                                    vend = vpTargetKFs.end();
-       vit != vend; vit++) {
-    KeyFrame *pKFi = *vit;
+  const int nTargets = vpTargetKFs.size();
+  vector<vector<ORBmatcher::FuseMatch>> vvMatches(2 * nTargets);
+  mpThreadPool->ParallelFor(0, 2 * nTargets, [&](int i) {
+    KeyFrame *pKFi = vpTargetKFs[i / 2];
+    const bool bRight = i % 2;
+    if (bRight && pKFi->NLeft == -1)
+      return;
+    ORBmatcher matcherTask;
+    matcherTask.SearchForFuse(pKFi, vpMapPointMatches, vvMatches[i], 3.0,
+                              bRight);
+  });
 
-    matcher.Fuse(pKFi, vpMapPointMatches);
-    if (pKFi->NLeft != -1)
-      matcher.Fuse(pKFi, vpMapPointMatches, true);
-  }
+  // Points whose observations changed, the only ones to update at the end
+  vector<MapPoint *> vpTouched;
+  for (int i = 0; i < 2 * nTargets; i++)
+    matcher.ApplyFuse(vpTargetKFs[i / 2], vpMapPointMatches, vvMatches[i],
+                      &vpTouched);
 
   if (mbAbortBA)
     return;
@@ -807,19 +887,25 @@ void LocalMapping::SearchInNeighbors() {
     }
   }
 
-  matcher.Fuse(mpCurrentKeyFrame, vpFuseCandidates);
-  if (mpCurrentKeyFrame->NLeft != -1)
-    matcher.Fuse(mpCurrentKeyFrame, vpFuseCandidates, true);
+  const int nCameras = (mpCurrentKeyFrame->NLeft != -1) ? 2 : 1;
+  vector<vector<ORBmatcher::FuseMatch>> vvCurrentMatches(nCameras);
+  mpThreadPool->ParallelFor(0, nCameras, [&](int i) {
+    ORBmatcher matcherTask;
+    matcherTask.SearchForFuse(mpCurrentKeyFrame, vpFuseCandidates,
+                              vvCurrentMatches[i], 3.0, i == 1);
+  });
+  for (int i = 0; i < nCameras; i++)
+    matcher.ApplyFuse(mpCurrentKeyFrame, vpFuseCandidates, vvCurrentMatches[i],
+                      &vpTouched);
 
   // Update points
-  vpMapPointMatches = mpCurrentKeyFrame->GetMapPointMatches();
-  for (size_t i = 0, iend = vpMapPointMatches.size(); i < iend; i++) {
-    MapPoint *pMP = vpMapPointMatches[i];
-    if (pMP) {
-      if (!pMP->isBad()) {
-        pMP->ComputeDistinctiveDescriptors();
-        pMP->UpdateNormalAndDepth();
-      }
+  sort(vpTouched.begin(), vpTouched.end());
+  vpTouched.erase(unique(vpTouched.begin(), vpTouched.end()), vpTouched.end());
+  for (size_t i = 0, iend = vpTouched.size(); i < iend; i++) {
+    MapPoint *pMP = vpTouched[i];
+    if (!pMP->isBad()) {
+      pMP->ComputeDistinctiveDescriptors();
+      pMP->UpdateNormalAndDepth();
     }
   }
 
@@ -830,14 +916,15 @@ void LocalMapping::SearchInNeighbors() {
 void LocalMapping::RequestStop() {
   unique_lock<mutex> lock(mMutexStop);
   mbStopRequested = true;
-  unique_lock<mutex> lock2(mMutexNewKFs);
   mbAbortBA = true;
+  WakeUp();
 }
 
 bool LocalMapping::Stop() {
   unique_lock<mutex> lock(mMutexStop);
   if (mbStopRequested && !mbNotStop) {
     mbStopped = true;
+    mcvStop.notify_all();
     cerr << "Local Mapping STOP" << endl;
     return true;
   }
@@ -850,6 +937,11 @@ bool LocalMapping::isStopped() {
   return mbStopped;
 }
 
+void LocalMapping::WaitUntilStopped() {
+  unique_lock<mutex> lock(mMutexStop);
+  mcvStop.wait(lock, [this] { return mbStopped; });
+}
+
 bool LocalMapping::stopRequested() {
   unique_lock<mutex> lock(mMutexStop);
   return mbStopRequested;
@@ -862,11 +954,10 @@ void LocalMapping::Release() {
     return;
   mbStopped = false;
   mbStopRequested = false;
-  for (list<KeyFrame *>::iterator lit = mlNewKeyFrames.begin(),
-                                  lend = mlNewKeyFrames.end();
-       lit != lend; lit++)
-    delete *lit;
-  mlNewKeyFrames.clear();
+  KeyFrame *pKF;
+  while (mNewKeyFrames.TryPop(pKF))
+    delete pKF;
+  WakeUp();
 
   cerr << "Local Mapping RELEASE" << endl;
 }
@@ -888,6 +979,8 @@ bool LocalMapping::SetNotStop(bool flag) {
     return false;
 
   mbNotStop = flag;
+  if (!flag)
+    WakeUp();
 
   return true;
 }
@@ -1046,15 +1139,12 @@ void LocalMapping::RequestReset() {
     cerr << "LM: Map reset recieved" << endl;
     mbResetRequested = true;
   }
+  WakeUp();
   cerr << "LM: Map reset, waiting..." << endl;
 
-  while (1) {
-    {
-      unique_lock<mutex> lock2(mMutexReset);
-      if (!mbResetRequested)
-        break;
-    }
-    usleep(3000);
+  {
+    unique_lock<mutex> lock2(mMutexReset);
+    mcvReset.wait(lock2, [this] { return !mbResetRequested; });
   }
   cerr << "LM: Map reset, Done!!!" << endl;
 }
@@ -1066,15 +1156,12 @@ void LocalMapping::RequestResetActiveMap(Map *pMap) {
     mbResetRequestedActiveMap = true;
     mpMapToReset = pMap;
   }
+  WakeUp();
   cerr << "LM: Active map reset, waiting..." << endl;
 
-  while (1) {
-    {
-      unique_lock<mutex> lock2(mMutexReset);
-      if (!mbResetRequestedActiveMap)
-        break;
-    }
-    usleep(3000);
+  {
+    unique_lock<mutex> lock2(mMutexReset);
+    mcvReset.wait(lock2, [this] { return !mbResetRequestedActiveMap; });
   }
   cerr << "LM: Active map reset, Done!!!" << endl;
 }
@@ -1087,8 +1174,9 @@ void LocalMapping::ResetIfRequested() {
       executed_reset = true;
 
       cerr << "LM: Reseting Atlas in Local Mapping..." << endl;
-      mlNewKeyFrames.clear();
+      mNewKeyFrames.Clear();
       mlpRecentAddedMapPoints.clear();
+      mpLocalBAGraph->Clear();
       mbResetRequested = false;
       mbResetRequestedActiveMap = false;
 
@@ -1106,8 +1194,9 @@ void LocalMapping::ResetIfRequested() {
     if (mbResetRequestedActiveMap) {
       executed_reset = true;
       cerr << "LM: Reseting current map in Local Mapping..." << endl;
-      mlNewKeyFrames.clear();
+      mNewKeyFrames.Clear();
       mlpRecentAddedMapPoints.clear();
+      mpLocalBAGraph->Clear();
 
       // Inertial parameters
       mTinit = 0.f;
@@ -1119,6 +1208,9 @@ void LocalMapping::ResetIfRequested() {
       mbResetRequestedActiveMap = false;
       cerr << "LM: End reseting Local Mapping..." << endl;
     }
+
+    if (executed_reset)
+      mcvReset.notify_all();
   }
   if (executed_reset)
     cerr << "LM: Reset free the mutex" << endl;
@@ -1127,6 +1219,7 @@ void LocalMapping::ResetIfRequested() {
 void LocalMapping::RequestFinish() {
   unique_lock<mutex> lock(mMutexFinish);
   mbFinishRequested = true;
+  WakeUp();
 }
 
 bool LocalMapping::CheckFinish() {
@@ -1139,6 +1232,7 @@ void LocalMapping::SetFinish() {
   mbFinished = true;
   unique_lock<mutex> lock2(mMutexStop);
   mbStopped = true;
+  mcvStop.notify_all();
 }
 
 bool LocalMapping::isFinished() {
@@ -1381,13 +1475,11 @@ void LocalMapping::InitializeIMU(float priorG, float priorA, bool bFIBA) {
   mnKFs = vpKF.size();
   mIdxInit++;
 
-  for (list<KeyFrame *>::iterator lit = mlNewKeyFrames.begin(),
-                                  lend = mlNewKeyFrames.end();
-       lit != lend; lit++) {
-    (*lit)->SetBadFlag();
-    delete *lit;
+  KeyFrame *pKFi;
+  while (mNewKeyFrames.TryPop(pKFi)) {
+    pKFi->SetBadFlag();
+    delete pKFi;
   }
-  mlNewKeyFrames.clear();
 
   mpTracker->mState = Tracking::OK;
   bInitializing = false;
@@ -1449,13 +1541,11 @@ void LocalMapping::ScaleRefinement() {
   }
   chrono::steady_clock::time_point t3 = chrono::steady_clock::now();
 
-  for (list<KeyFrame *>::iterator lit = mlNewKeyFrames.begin(),
-                                  lend = mlNewKeyFrames.end();
-       lit != lend; lit++) {
-    (*lit)->SetBadFlag();
-    delete *lit;
+  KeyFrame *pKFi;
+  while (mNewKeyFrames.TryPop(pKFi)) {
+    pKFi->SetBadFlag();
+    delete pKFi;
   }
-  mlNewKeyFrames.clear();
 
   double t_inertial_only =
       chrono::duration_cast<chrono::duration<double>>(t1 - t0).count();
@@ -37,14 +37,15 @@ LoopClosing::LoopClosing(Atlas *pAtlas, KeyFrameDatabase *pDB,
                          const bool bActiveLC)
     : mbResetRequested(false), mbResetActiveMapRequested(false),
       mbFinishRequested(false), mbFinished(true), mpAtlas(pAtlas),
-      mpKeyFrameDB(pDB), mpORBVocabulary(pVoc), mpMatchedKF(NULL),
-      mLastLoopKFid(0), mbRunningGBA(false), mbFinishedGBA(true),
-      mbStopGBA(false), mpThreadGBA(NULL), mbFixScale(bFixScale),
-      mnFullBAIdx(0), mnLoopNumCoincidences(0), mnMergeNumCoincidences(0),
-      mbLoopDetected(false), mbMergeDetected(false), mnLoopNumNotFound(0),
-      mnMergeNumNotFound(0), mbActiveLC(bActiveLC) {
+      mpKeyFrameDB(pDB), mpORBVocabulary(pVoc), mLoopKeyFrameQueue(256),
+      mpMatchedKF(NULL), mLastLoopKFid(0), mbRunningGBA(false),
+      mbFinishedGBA(true), mbStopGBA(false), mpThreadGBA(NULL),
+      mbFixScale(bFixScale), mnFullBAIdx(0), mnLoopNumCoincidences(0),
+      mnMergeNumCoincidences(0), mbLoopDetected(false), mbMergeDetected(false),
+      mnLoopNumNotFound(0), mnMergeNumNotFound(0), mbActiveLC(bActiveLC) {
   mnCovisibilityConsistencyTh = 3;
   mpLastCurrentKF = static_cast<KeyFrame *>(NULL);
+  mbWakeUp = false;
 
 #ifdef REGISTER_TIMES
 
@@ -299,21 +300,47 @@ void LoopClosing::Run() {
       break;
     }
 
-    usleep(5000);
+    // Sleep until a keyframe or a request arrives
+    if (!CheckNewKeyFrames())
+      WaitForWakeUp();
   }
 
   SetFinish();
 }
 
 void LoopClosing::InsertKeyFrame(KeyFrame *pKF) {
-  unique_lock<mutex> lock(mMutexLoopQueue);
-  if (pKF->mnId != 0)
-    mlpLoopKeyFrameQueue.push_back(pKF);
+  // With place recognition deactivated nothing would ever take them out
+  if (pKF->mnId == 0 || !mbActiveLC)
+    return;
+
+  // Never make Local Mapping wait for place recognition: when the ring is
+  // full the keyframe goes to the overflow list, and so do the following ones
+  // until it is drained, to keep them in order
+  {
+    unique_lock<mutex> lock(mMutexLoopOverflow);
+    if (!mlpLoopKeyFrameOverflow.empty() || !mLoopKeyFrameQueue.TryPush(pKF))
+      mlpLoopKeyFrameOverflow.push_back(pKF);
+  }
+  WakeUp();
+}
+
+void LoopClosing::WakeUp() {
+  unique_lock<mutex> lock(mMutexWakeUp);
+  mbWakeUp = true;
+  mcvWakeUp.notify_one();
+}
+
+void LoopClosing::WaitForWakeUp() {
+  unique_lock<mutex> lock(mMutexWakeUp);
+  mcvWakeUp.wait(lock, [this] { return mbWakeUp; });
+  mbWakeUp = false;
 }
 
 bool LoopClosing::CheckNewKeyFrames() {
-  unique_lock<mutex> lock(mMutexLoopQueue);
-  return (!mlpLoopKeyFrameQueue.empty());
+  if (!mlpLoopKeyFrameBacklog.empty() || !mLoopKeyFrameQueue.Empty())
+    return true;
+  unique_lock<mutex> lock(mMutexLoopOverflow);
+  return !mlpLoopKeyFrameOverflow.empty();
 }
 
 bool LoopClosing::NewDetectCommonRegions() {
@@ -323,9 +350,17 @@ bool LoopClosing::NewDetectCommonRegions() {
     return false;
 
   {
-    unique_lock<mutex> lock(mMutexLoopQueue);
-    mpCurrentKF = mlpLoopKeyFrameQueue.front();
-    mlpLoopKeyFrameQueue.pop_front();
+    if (!mlpLoopKeyFrameBacklog.empty()) {
+      mpCurrentKF = mlpLoopKeyFrameBacklog.front();
+      mlpLoopKeyFrameBacklog.pop_front();
+    } else if (!mLoopKeyFrameQueue.TryPop(mpCurrentKF)) {
+      // Overflowed keyframes are newer than any left in the ring
+      unique_lock<mutex> lock(mMutexLoopOverflow);
+      if (mlpLoopKeyFrameOverflow.empty())
+        return false;
+      mpCurrentKF = mlpLoopKeyFrameOverflow.front();
+      mlpLoopKeyFrameOverflow.pop_front();
+    }
     // Avoid that a keyframe can be erased while it is being process by this
     // thread
     mpCurrentKF->SetNotErase();
@@ -484,7 +519,8 @@ bool LoopClosing::NewDetectCommonRegions() {
         chrono::steady_clock::now();
 #endif
     mpKeyFrameDB->DetectNBestCandidates(mpCurrentKF, vpLoopBowCand,
-                                        vpMergeBowCand, 3);
+                                        vpMergeBowCand, 3,
+                                        &mPlaceRecognitionQuery);
 #ifdef REGISTER_TIMES
     chrono::steady_clock::time_point time_EndQuery =
         chrono::steady_clock::now();
@@ -992,7 +1028,6 @@ void LoopClosing::CorrectLoop() {
   // Send a stop signal to Local Mapping
   // Avoid new keyframes are inserted while correcting the loop
   mpLocalMapper->RequestStop();
-  mpLocalMapper->EmptyQueue(); // Proccess keyframes in the queue
 
   // If a Global Bundle Adjustment is running, abort it
   if (isRunningGBA()) {
@@ -1010,9 +1045,9 @@ void LoopClosing::CorrectLoop() {
   }
 
   // Wait until Local Mapping has effectively stopped
-  while (!mpLocalMapper->isStopped()) {
-    usleep(1000);
-  }
+  mpLocalMapper->WaitUntilStopped();
+  // Proccess keyframes in the queue. Only now, the queue has a single consumer
+  mpLocalMapper->EmptyQueue();
 
   // Ensure current keyframe is updated
   // cerr << "Start updating connections" << endl;
@@ -1289,9 +1324,7 @@ void LoopClosing::MergeLocal() {
   // Verbose::VERBOSITY_DEBUG); cerr << "Request Stop Local Mapping" << endl;
   mpLocalMapper->RequestStop();
   // Wait until Local Mapping has effectively stopped
-  while (!mpLocalMapper->isStopped()) {
-    usleep(1000);
-  }
+  mpLocalMapper->WaitUntilStopped();
   // cerr << "Local Map stopped" << endl;
 
   mpLocalMapper->EmptyQueue();
@@ -1751,9 +1784,7 @@ void LoopClosing::MergeLocal() {
 
     mpLocalMapper->RequestStop();
     // Wait until Local Mapping has effectively stopped
-    while (!mpLocalMapper->isStopped()) {
-      usleep(1000);
-    }
+    mpLocalMapper->WaitUntilStopped();
 
     // Optimize graph (and update the loop position for each element form the
     // begining to the end)
@@ -1866,9 +1897,7 @@ void LoopClosing::MergeLocal2() {
   // cerr << "Request Stop Local Mapping" << endl;
   mpLocalMapper->RequestStop();
   // Wait until Local Mapping has effectively stopped
-  while (!mpLocalMapper->isStopped()) {
-    usleep(1000);
-  }
+  mpLocalMapper->WaitUntilStopped();
   // cerr << "Local Map stopped" << endl;
 
   Map *pCurrentMap = mpCurrentKF->GetMap();
@@ -2244,15 +2273,10 @@ void LoopClosing::RequestReset() {
     unique_lock<mutex> lock(mMutexReset);
     mbResetRequested = true;
   }
+  WakeUp();
 
-  while (1) {
-    {
-      unique_lock<mutex> lock2(mMutexReset);
-      if (!mbResetRequested)
-        break;
-    }
-    usleep(5000);
-  }
+  unique_lock<mutex> lock2(mMutexReset);
+  mcvReset.wait(lock2, [this] { return !mbResetRequested; });
 }
 
 void LoopClosing::RequestResetActiveMap(Map *pMap) {
@@ -2261,32 +2285,44 @@ void LoopClosing::RequestResetActiveMap(Map *pMap) {
     mbResetActiveMapRequested = true;
     mpMapToReset = pMap;
   }
+  WakeUp();
 
-  while (1) {
-    {
-      unique_lock<mutex> lock2(mMutexReset);
-      if (!mbResetActiveMapRequested)
-        break;
-    }
-    usleep(3000);
-  }
+  unique_lock<mutex> lock2(mMutexReset);
+  mcvReset.wait(lock2, [this] { return !mbResetActiveMapRequested; });
 }
 
 void LoopClosing::ResetIfRequested() {
   unique_lock<mutex> lock(mMutexReset);
   if (mbResetRequested) {
     cerr << "Loop closer reset requested..." << endl;
-    mlpLoopKeyFrameQueue.clear();
+    mLoopKeyFrameQueue.Clear();
+    mlpLoopKeyFrameBacklog.clear();
+    {
+      unique_lock<mutex> lock2(mMutexLoopOverflow);
+      mlpLoopKeyFrameOverflow.clear();
+    }
     mLastLoopKFid = 0; // TODO old variable, it is not use in the new algorithm
     mbResetRequested = false;
     mbResetActiveMapRequested = false;
+    mcvReset.notify_all();
   } else if (mbResetActiveMapRequested) {
 
-    for (list<KeyFrame *>::const_iterator it = mlpLoopKeyFrameQueue.begin();
-         it != mlpLoopKeyFrameQueue.end();) {
+    // The ring can only be popped, so the keyframes of other maps are kept
+    // in the backlog
+    KeyFrame *pKFi;
+    while (mLoopKeyFrameQueue.TryPop(pKFi))
+      mlpLoopKeyFrameBacklog.push_back(pKFi);
+    {
+      unique_lock<mutex> lock2(mMutexLoopOverflow);
+      mlpLoopKeyFrameBacklog.splice(mlpLoopKeyFrameBacklog.end(),
+                                    mlpLoopKeyFrameOverflow);
+    }
+
+    for (list<KeyFrame *>::const_iterator it = mlpLoopKeyFrameBacklog.begin();
+         it != mlpLoopKeyFrameBacklog.end();) {
       KeyFrame *pKFi = *it;
       if (pKFi->GetMap() == mpMapToReset) {
-        it = mlpLoopKeyFrameQueue.erase(it);
+        it = mlpLoopKeyFrameBacklog.erase(it);
       } else
         ++it;
     }
@@ -2294,6 +2330,7 @@ void LoopClosing::ResetIfRequested() {
     mLastLoopKFid = mpAtlas->GetLastInitKFid(); // TODO old variable, it is not
                                                 // use in the new algorithm
     mbResetActiveMapRequested = false;
+    mcvReset.notify_all();
   }
 }
 
@@ -2353,11 +2390,8 @@ void LoopClosing::RunGlobalBundleAdjustment(Map *pActiveMap,
       Verbose::Log("Updating map ...", Verbose::VERBOSITY_NORMAL);
 
       mpLocalMapper->RequestStop();
-      // Wait until Local Mapping has effectively stopped
-
-      while (!mpLocalMapper->isStopped() && !mpLocalMapper->isFinished()) {
-        usleep(1000);
-      }
+      // Wait until Local Mapping has effectively stopped (or finished)
+      mpLocalMapper->WaitUntilStopped();
 
       // Get Map Mutex
       unique_lock<mutex> lock(pActiveMap->mMutexMapUpdate);
@@ -2555,6 +2589,7 @@ void LoopClosing::RequestFinish() {
   unique_lock<mutex> lock(mMutexFinish);
   // cerr << "LC: Finish requested" << endl;
   mbFinishRequested = true;
+  WakeUp();
 }
 
 bool LoopClosing::CheckFinish() {
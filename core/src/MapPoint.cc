@@ -35,8 +35,8 @@ MapPoint::MapPoint()
     : mnFirstKFid(0), mnFirstFrame(0), nObs(0), mnTrackReferenceForFrame(0),
       mnLastFrameSeen(0), mnBALocalForKF(0), mnFuseCandidateForKF(0),
       mnLoopPointForKF(0), mnCorrectedByKF(0), mnCorrectedReference(0),
-      mnBAGlobalForKF(0), mnVisible(1), mnFound(1), mbBad(false),
-      mpReplaced(static_cast<MapPoint *>(NULL)) {
+      mnBAGlobalForKF(0), mnObservationsVersion(0), mnVisible(1), mnFound(1),
+      mbBad(false), mpReplaced(static_cast<MapPoint *>(NULL)) {
   mpReplaced = static_cast<MapPoint *>(NULL);
 }
 
@@ -44,8 +44,8 @@ MapPoint::MapPoint(const Eigen::Vector3f &Pos, KeyFrame *pRefKF, Map *pMap)
     : mnFirstKFid(pRefKF->mnId), mnFirstFrame(pRefKF->mnFrameId), nObs(0),
       mnTrackReferenceForFrame(0), mnLastFrameSeen(0), mnBALocalForKF(0),
       mnFuseCandidateForKF(0), mnLoopPointForKF(0), mnCorrectedByKF(0),
-      mnCorrectedReference(0), mnBAGlobalForKF(0), mpRefKF(pRefKF),
-      mnVisible(1), mnFound(1), mbBad(false),
+      mnCorrectedReference(0), mnBAGlobalForKF(0), mnObservationsVersion(0),
+      mpRefKF(pRefKF), mnVisible(1), mnFound(1), mbBad(false),
       mpReplaced(static_cast<MapPoint *>(NULL)), mfMinDistance(0),
       mfMaxDistance(0), mpMap(pMap), mnOriginMapId(pMap->GetId()) {
   SetWorldPos(Pos);
@@ -66,8 +66,8 @@ MapPoint::MapPoint(const double invDepth, cv::Point2f uv_init, KeyFrame *pRefKF,
     : mnFirstKFid(pRefKF->mnId), mnFirstFrame(pRefKF->mnFrameId), nObs(0),
       mnTrackReferenceForFrame(0), mnLastFrameSeen(0), mnBALocalForKF(0),
       mnFuseCandidateForKF(0), mnLoopPointForKF(0), mnCorrectedByKF(0),
-      mnCorrectedReference(0), mnBAGlobalForKF(0), mpRefKF(pRefKF),
-      mnVisible(1), mnFound(1), mbBad(false),
+      mnCorrectedReference(0), mnBAGlobalForKF(0), mnObservationsVersion(0),
+      mpRefKF(pRefKF), mnVisible(1), mnFound(1), mbBad(false),
       mpReplaced(static_cast<MapPoint *>(NULL)), mfMinDistance(0),
       mfMaxDistance(0), mpMap(pMap), mnOriginMapId(pMap->GetId()) {
   mInvDepth = invDepth;
@@ -89,7 +89,7 @@ MapPoint::MapPoint(const Eigen::Vector3f &Pos, Map *pMap, Frame *pFrame,
     : mnFirstKFid(-1), mnFirstFrame(pFrame->mnId), nObs(0),
       mnTrackReferenceForFrame(0), mnLastFrameSeen(0), mnBALocalForKF(0),
       mnFuseCandidateForKF(0), mnLoopPointForKF(0), mnCorrectedByKF(0),
-      mnCorrectedReference(0), mnBAGlobalForKF(0),
+      mnCorrectedReference(0), mnBAGlobalForKF(0), mnObservationsVersion(0),
       mpRefKF(static_cast<KeyFrame *>(NULL)), mnVisible(1), mnFound(1),
       mbBad(false), mpReplaced(NULL), mpMap(pMap),
       mnOriginMapId(pMap->GetId()) {
@@ -119,7 +119,7 @@ MapPoint::MapPoint(const Eigen::Vector3f &Pos, Map *pMap, Frame *pFrame,
   mfMaxDistance = dist * levelScaleFactor;
   mfMinDistance = mfMaxDistance / pFrame->mvScaleFactors[nLevels - 1];
 
-  pFrame->mDescriptors.row(idxF).copyTo(mDescriptor);
+  mDescriptor = pFrame->mDescriptors.row(idxF).clone();
 
   // MapPoints can be created from Tracking and Local Mapping. This mutex avoid
   // conflicts with id.
@@ -165,6 +165,7 @@ void MapPoint::AddObservation(KeyFrame *pKF, int idx) {
   }
 
   mObservations[pKF] = indexes;
+  mnObservationsVersion++;
 
   if (!pKF->mpCamera2 && pKF->mvuRight[idx] >= 0)
     nObs += 2;
@@ -191,6 +192,7 @@ void MapPoint::EraseObservation(KeyFrame *pKF) {
       }
 
       mObservations.erase(pKF);
+      mnObservationsVersion++;
 
       if (mpRefKF == pKF)
         mpRefKF = mObservations.begin()->first;
@@ -210,6 +212,21 @@ map<KeyFrame *, tuple<int, int>> MapPoint::GetObservations() {
   return mObservations;
 }
 
+unsigned long MapPoint::GetObservingKeyFrames(vector<KeyFrame *> &vpKFs) {
+  unique_lock<mutex> lock(mMutexFeatures);
+  for (map<KeyFrame *, tuple<int, int>>::const_iterator
+           mit = mObservations.begin(),
+           mend = mObservations.end();
+       mit != mend; mit++)
+    vpKFs.push_back(mit->first);
+  return mnObservationsVersion;
+}
+
+unsigned long MapPoint::GetObservationsVersion() {
+  unique_lock<mutex> lock(mMutexFeatures);
+  return mnObservationsVersion;
+}
+
 int MapPoint::Observations() {
   unique_lock<mutex> lock(mMutexFeatures);
   return nObs;
@@ -223,6 +240,7 @@ void MapPoint::SetBadFlag() {
     mbBad = true;
     obs = mObservations;
     mObservations.clear();
+    mnObservationsVersion++;
   }
   for (map<KeyFrame *, tuple<int, int>>::iterator mit = obs.begin(),
                                                   mend = obs.end();
@@ -257,6 +275,7 @@ void MapPoint::Replace(MapPoint *pMP) {
     unique_lock<mutex> lock2(mMutexPos);
     obs = mObservations;
     mObservations.clear();
+    mnObservationsVersion++;
     mbBad = true;
     nvisible = mnVisible;
     nfound = mnFound;
@@ -322,7 +341,7 @@ float MapPoint::GetFoundRatio() {
 
 void MapPoint::ComputeDistinctiveDescriptors() {
   // Retrieve all observed descriptors
-  vector<cv::Mat> vDescriptors;
+  vector<DescriptorObservation> vObs;
 
   map<KeyFrame *, tuple<int, int>> observations;
 
@@ -336,7 +355,7 @@ void MapPoint::ComputeDistinctiveDescriptors() {
   if (observations.empty())
     return;
 
-  vDescriptors.reserve(observations.size());
+  vObs.reserve(2 * observations.size());
 
   for (map<KeyFrame *, tuple<int, int>>::iterator mit = observations.begin(),
                                                   mend = observations.end();
@@ -348,38 +367,82 @@ void MapPoint::ComputeDistinctiveDescriptors() {
       int leftIndex = get<0>(indexes), rightIndex = get<1>(indexes);
 
       if (leftIndex != -1) {
-        vDescriptors.push_back(pKF->mDescriptors.row(leftIndex));
+        DescriptorObservation obs = {pKF, leftIndex};
+        vObs.push_back(obs);
       }
       if (rightIndex != -1) {
-        vDescriptors.push_back(pKF->mDescriptors.row(rightIndex));
+        DescriptorObservation obs = {pKF, rightIndex};
+        vObs.push_back(obs);
       }
     }
   }
 
-  if (vDescriptors.empty())
+  if (vObs.empty())
     return;
 
-  // Compute distances between them
-  const size_t N = vDescriptors.size();
+  // Bound the work for heavily observed points: keep the descriptors of the
+  // most recent keyframes, in observation order
+  if (vObs.size() > MAX_DESCRIPTOR_OBSERVATIONS) {
+    vector<size_t> vOrder(vObs.size());
+    for (size_t i = 0; i < vOrder.size(); i++)
+      vOrder[i] = i;
+    stable_sort(vOrder.begin(), vOrder.end(), [&](size_t a, size_t b) {
+      return vObs[a].pKF->mnId > vObs[b].pKF->mnId;
+    });
+    vOrder.resize(MAX_DESCRIPTOR_OBSERVATIONS);
+    sort(vOrder.begin(), vOrder.end());
+
+    vector<DescriptorObservation> vKept(vOrder.size());
+    for (size_t i = 0; i < vOrder.size(); i++)
+      vKept[i] = vObs[vOrder[i]];
+    vObs.swap(vKept);
+  }
 
-  float Distances[N][N];
+  unique_lock<mutex> lock(mMutexDescriptor);
+
+  // Position of every observation in the previous call, -1 if it is new. Both
+  // lists are sorted by keyframe and index, so a single merge pass finds them.
+  const size_t N = vObs.size();
+  const size_t NPrev = mvDescriptorObservations.size();
+  vector<int> vPrev(N, -1);
+  less<KeyFrame *> lessKF;
+  for (size_t i = 0, j = 0; i < N && j < NPrev;) {
+    const DescriptorObservation &a = vObs[i];
+    const DescriptorObservation &b = mvDescriptorObservations[j];
+    if (a.pKF == b.pKF && a.idx == b.idx)
+      vPrev[i++] = j++;
+    else if (lessKF(a.pKF, b.pKF) || (a.pKF == b.pKF && a.idx < b.idx))
+      i++;
+    else
+      j++;
+  }
+
+  // Compute distances between them, only for pairs not seen before
+  vector<uint16_t> vDistances(N * N);
   for (size_t i = 0; i < N; i++) {
-    Distances[i][i] = 0;
+    vDistances[i * N + i] = 0;
+    const uint8_t *di = vObs[i].pKF->mDescriptors.At(vObs[i].idx);
     for (size_t j = i + 1; j < N; j++) {
-      int distij =
-          ORBmatcher::DescriptorDistance(vDescriptors[i], vDescriptors[j]);
-      Distances[i][j] = distij;
-      Distances[j][i] = distij;
+      int distij;
+      if (vPrev[i] >= 0 && vPrev[j] >= 0)
+        distij = mvDescriptorDistances[vPrev[i] * NPrev + vPrev[j]];
+      else
+        distij = ORBmatcher::DescriptorDistance(
+            di, vObs[j].pKF->mDescriptors.At(vObs[j].idx));
+      vDistances[i * N + j] = distij;
+      vDistances[j * N + i] = distij;
     }
   }
 
   // Take the descriptor with least median distance to the rest
   int BestMedian = INT_MAX;
   int BestIdx = 0;
+  vector<uint16_t> vDists(N);
   for (size_t i = 0; i < N; i++) {
-    vector<int> vDists(Distances[i], Distances[i] + N);
-    sort(vDists.begin(), vDists.end());
-    int median = vDists[0.5 * (N - 1)];
+    vDists.assign(vDistances.begin() + i * N, vDistances.begin() + (i + 1) * N);
+    const size_t m = 0.5 * (N - 1);
+    nth_element(vDists.begin(), vDists.begin() + m, vDists.end());
+    int median = vDists[m];
 
     if (median < BestMedian) {
       BestMedian = median;
@@ -387,15 +450,20 @@ void MapPoint::ComputeDistinctiveDescriptors() {
     }
   }
 
+  mvDescriptorObservations.swap(vObs);
+  mvDescriptorDistances.swap(vDistances);
+
+  const DescriptorObservation &best = mvDescriptorObservations[BestIdx];
   {
-    unique_lock<mutex> lock(mMutexFeatures);
-    mDescriptor = vDescriptors[BestIdx].clone();
+    unique_lock<mutex> lock2(mMutexFeatures);
+    mDescriptor = best.pKF->mDescriptors.row(best.idx).clone();
   }
 }
 
-cv::Mat MapPoint::GetDescriptor() {
+DescriptorBlock MapPoint::GetDescriptor() {
   unique_lock<mutex> lock(mMutexFeatures);
-  return mDescriptor.clone();
+  // The descriptor is replaced, never modified in place, so sharing it is safe
+  return mDescriptor;
 }
 
 tuple<int, int> MapPoint::GetIndexInKeyFrame(KeyFrame *pKF) {
@@ -494,6 +562,16 @@ float MapPoint::GetMaxDistanceInvariance() {
   return 1.2f * mfMaxDistance;
 }
 
+void MapPoint::GetViewingGeometry(Eigen::Vector3f &pos,
+                                  Eigen::Vector3f &normal, float &minDistance,
+                                  float &maxDistance) {
+  unique_lock<mutex> lock(mMutexPos);
+  pos = mWorldPos;
+  normal = mNormalVector;
+  minDistance = mfMinDistance;
+  maxDistance = mfMaxDistance;
+}
+
 int MapPoint::PredictScale(const float &currentDist, KeyFrame *pKF) {
   float ratio;
   {
@@ -592,6 +670,7 @@ void MapPoint::PostLoad(map<long unsigned int, KeyFrame *> &mpKFid,
   }
 
   mObservations.clear();
+  mnObservationsVersion++;
 
   for (map<long unsigned int, int>::const_iterator
            it = mBackupObservationsId1.begin(),
@@ -35,7 +35,11 @@ using namespace std;
 #include <mutex>
 
 #include "Debug.h"
+#include "InertialPoseSolver.h"
+#include "LocalBAGraph.h"
 #include "OptimizableTypes.h"
+#include "ParallelBlockSolver.h"
+#include "PoseSolver.h"
 
 namespace ORB_SLAM3 {
 bool sortByVal(const pair<MapPoint *, int> &a, const pair<MapPoint *, int> &b) {
@@ -765,184 +769,51 @@ void Optimizer::FullInertialBA(Map *pMap, int its, const bool bFixLocal,
 }
 
 int Optimizer::PoseOptimization(Frame *pFrame) {
-  g2o::SparseOptimizer optimizer;
-  auto linearSolver = std::make_unique<
-      g2o::LinearSolverDense<g2o::BlockSolver_6_3::PoseMatrixType>>();
-  auto solver_ptr =
-      std::make_unique<g2o::BlockSolver_6_3>(std::move(linearSolver));
-  auto solver = new g2o::OptimizationAlgorithmLevenberg(std::move(solver_ptr));
-  optimizer.setAlgorithm(solver);
+  const float deltaMono = sqrt(5.991);
+  const float deltaStereo = sqrt(7.815);
 
-  int nInitialCorrespondences = 0;
+  PoseSolver solver(pFrame, deltaMono, deltaStereo);
 
-  // Set Frame vertex
-  g2o::VertexSE3Expmap *vSE3 = new g2o::VertexSE3Expmap();
-  Sophus::SE3<float> Tcw = pFrame->GetPose();
-  vSE3->setEstimate(g2o::SE3Quat(Tcw.unit_quaternion().cast<double>(),
-                                 Tcw.translation().cast<double>()));
-  vSE3->setId(0);
-  vSE3->setFixed(false);
-  optimizer.addVertex(vSE3);
+  int nInitialCorrespondences = 0;
 
-  // Set MapPoint vertices
   const int N = pFrame->N;
 
-  vector<ORB_SLAM3::EdgeSE3ProjectXYZOnlyPose *> vpEdgesMono;
-  vector<ORB_SLAM3::EdgeSE3ProjectXYZOnlyPoseToBody *> vpEdgesMono_FHR;
-  vector<size_t> vnIndexEdgeMono, vnIndexEdgeRight;
-  vpEdgesMono.reserve(N);
-  vpEdgesMono_FHR.reserve(N);
-  vnIndexEdgeMono.reserve(N);
-  vnIndexEdgeRight.reserve(N);
-
-  vector<g2o::EdgeStereoSE3ProjectXYZOnlyPose *> vpEdgesStereo;
-  vector<size_t> vnIndexEdgeStereo;
-  vpEdgesStereo.reserve(N);
-  vnIndexEdgeStereo.reserve(N);
-
-  const float deltaMono = sqrt(5.991);
-  const float deltaStereo = sqrt(7.815);
-
   {
     unique_lock<mutex> lock(MapPoint::mGlobalMutex);
 
     for (int i = 0; i < N; i++) {
       MapPoint *pMP = pFrame->mvpMapPoints[i];
       if (pMP) {
+        const Eigen::Vector3d Xw = pMP->GetWorldPos().cast<double>();
+
         // Conventional SLAM
         if (!pFrame->mpCamera2) {
-          // Monocular observation
-          if (pFrame->mvuRight[i] < 0) {
-            nInitialCorrespondences++;
-            pFrame->mvbOutlier[i] = false;
-
-            Eigen::Matrix<double, 2, 1> obs;
-            const cv::KeyPoint &kpUn = pFrame->mvKeysUn[i];
-            obs << kpUn.pt.x, kpUn.pt.y;
-
-            ORB_SLAM3::EdgeSE3ProjectXYZOnlyPose *e =
-                new ORB_SLAM3::EdgeSE3ProjectXYZOnlyPose();
-
-            e->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex *>(
-                                optimizer.vertex(0)));
-            e->setMeasurement(obs);
-            const float invSigma2 = pFrame->mvInvLevelSigma2[kpUn.octave];
-            e->setInformation(Eigen::Matrix2d::Identity() * invSigma2);
-
-            g2o::RobustKernelHuber *rk = new g2o::RobustKernelHuber;
-            e->setRobustKernel(rk);
-            rk->setDelta(deltaMono);
-
-            e->pCamera = pFrame->mpCamera;
-            e->Xw = pMP->GetWorldPos().cast<double>();
-
-            optimizer.addEdge(e);
-
-            vpEdgesMono.push_back(e);
-            vnIndexEdgeMono.push_back(i);
-          } else // Stereo observation
-          {
-            nInitialCorrespondences++;
-            pFrame->mvbOutlier[i] = false;
-
-            Eigen::Matrix<double, 3, 1> obs;
-            const cv::KeyPoint &kpUn = pFrame->mvKeysUn[i];
-            const float &kp_ur = pFrame->mvuRight[i];
-            obs << kpUn.pt.x, kpUn.pt.y, kp_ur;
-
-            g2o::EdgeStereoSE3ProjectXYZOnlyPose *e =
-                new g2o::EdgeStereoSE3ProjectXYZOnlyPose();
-
-            e->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex *>(
-                                optimizer.vertex(0)));
-            e->setMeasurement(obs);
-            const float invSigma2 = pFrame->mvInvLevelSigma2[kpUn.octave];
-            Eigen::Matrix3d Info = Eigen::Matrix3d::Identity() * invSigma2;
-            e->setInformation(Info);
-
-            g2o::RobustKernelHuber *rk = new g2o::RobustKernelHuber;
-            e->setRobustKernel(rk);
-            rk->setDelta(deltaStereo);
-
-            e->fx = pFrame->fx;
-            e->fy = pFrame->fy;
-            e->cx = pFrame->cx;
-            e->cy = pFrame->cy;
-            e->bf = pFrame->mbf;
-            e->Xw = pMP->GetWorldPos().cast<double>();
+          nInitialCorrespondences++;
+          pFrame->mvbOutlier[i] = false;
 
-            optimizer.addEdge(e);
+          const cv::KeyPoint &kpUn = pFrame->mvKeysUn[i];
+          const float invSigma2 = pFrame->mvInvLevelSigma2[kpUn.octave];
 
-            vpEdgesStereo.push_back(e);
-            vnIndexEdgeStereo.push_back(i);
-          }
+          // Monocular observation
+          if (pFrame->mvuRight[i] < 0)
+            solver.AddMono(Xw, kpUn.pt.x, kpUn.pt.y, invSigma2, i);
+          else // Stereo observation
+            solver.AddStereo(Xw, kpUn.pt.x, kpUn.pt.y, pFrame->mvuRight[i],
+                             invSigma2, i);
         }
         // SLAM with respect a rigid body
         else {
           nInitialCorrespondences++;
-
-          cv::KeyPoint kpUn;
+          pFrame->mvbOutlier[i] = false;
 
           if (i < pFrame->Nleft) { // Left camera observation
-            kpUn = pFrame->mvKeys[i];
-
-            pFrame->mvbOutlier[i] = false;
-
-            Eigen::Matrix<double, 2, 1> obs;
-            obs << kpUn.pt.x, kpUn.pt.y;
-
-            ORB_SLAM3::EdgeSE3ProjectXYZOnlyPose *e =
-                new ORB_SLAM3::EdgeSE3ProjectXYZOnlyPose();
-
-            e->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex *>(
-                                optimizer.vertex(0)));
-            e->setMeasurement(obs);
-            const float invSigma2 = pFrame->mvInvLevelSigma2[kpUn.octave];
-            e->setInformation(Eigen::Matrix2d::Identity() * invSigma2);
-
-            g2o::RobustKernelHuber *rk = new g2o::RobustKernelHuber;
-            e->setRobustKernel(rk);
-            rk->setDelta(deltaMono);
-
-            e->pCamera = pFrame->mpCamera;
-            e->Xw = pMP->GetWorldPos().cast<double>();
-
-            optimizer.addEdge(e);
-
-            vpEdgesMono.push_back(e);
-            vnIndexEdgeMono.push_back(i);
+            const cv::KeyPoint &kp = pFrame->mvKeys[i];
+            solver.AddMono(Xw, kp.pt.x, kp.pt.y,
+                           pFrame->mvInvLevelSigma2[kp.octave], i);
           } else {
-            kpUn = pFrame->mvKeysRight[i - pFrame->Nleft];
-
-            Eigen::Matrix<double, 2, 1> obs;
-            obs << kpUn.pt.x, kpUn.pt.y;
-
-            pFrame->mvbOutlier[i] = false;
-
-            ORB_SLAM3::EdgeSE3ProjectXYZOnlyPoseToBody *e =
-                new ORB_SLAM3::EdgeSE3ProjectXYZOnlyPoseToBody();
-
-            e->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex *>(
-                                optimizer.vertex(0)));
-            e->setMeasurement(obs);
-            const float invSigma2 = pFrame->mvInvLevelSigma2[kpUn.octave];
-            e->setInformation(Eigen::Matrix2d::Identity() * invSigma2);
-
-            g2o::RobustKernelHuber *rk = new g2o::RobustKernelHuber;
-            e->setRobustKernel(rk);
-            rk->setDelta(deltaMono);
-
-            e->pCamera = pFrame->mpCamera2;
-            e->Xw = pMP->GetWorldPos().cast<double>();
-
-            e->mTrl = g2o::SE3Quat(
-                pFrame->GetRelativePoseTrl().unit_quaternion().cast<double>(),
-                pFrame->GetRelativePoseTrl().translation().cast<double>());
-
-            optimizer.addEdge(e);
-
-            vpEdgesMono_FHR.push_back(e);
-            vnIndexEdgeRight.push_back(i);
+            const cv::KeyPoint &kp = pFrame->mvKeysRight[i - pFrame->Nleft];
+            solver.AddRight(Xw, kp.pt.x, kp.pt.y,
+                            pFrame->mvInvLevelSigma2[kp.octave], i);
           }
         }
       }
@@ -959,99 +830,26 @@ int Optimizer::PoseOptimization(Frame *pFrame) {
   const float chi2Stereo[4] = {7.815, 7.815, 7.815, 7.815};
   const int its[4] = {10, 10, 10, 10};
 
+  const Sophus::SE3d Tcw = pFrame->GetPose().cast<double>();
+  Sophus::SE3d Tcw_opt = Tcw;
+
   int nBad = 0;
   for (size_t it = 0; it < 4; it++) {
-    Tcw = pFrame->GetPose();
-    vSE3->setEstimate(g2o::SE3Quat(Tcw.unit_quaternion().cast<double>(),
-                                   Tcw.translation().cast<double>()));
-
-    optimizer.initializeOptimization(0);
-    optimizer.optimize(its[it]);
-
-    nBad = 0;
-    for (size_t i = 0, iend = vpEdgesMono.size(); i < iend; i++) {
-      ORB_SLAM3::EdgeSE3ProjectXYZOnlyPose *e = vpEdgesMono[i];
-
-      const size_t idx = vnIndexEdgeMono[i];
-
-      if (pFrame->mvbOutlier[idx]) {
-        e->computeError();
-      }
-
-      const float chi2 = e->chi2();
-
-      if (chi2 > chi2Mono[it]) {
-        pFrame->mvbOutlier[idx] = true;
-        e->setLevel(1);
-        nBad++;
-      } else {
-        pFrame->mvbOutlier[idx] = false;
-        e->setLevel(0);
-      }
-
-      if (it == 2)
-        e->setRobustKernel(0);
-    }
-
-    for (size_t i = 0, iend = vpEdgesMono_FHR.size(); i < iend; i++) {
-      ORB_SLAM3::EdgeSE3ProjectXYZOnlyPoseToBody *e = vpEdgesMono_FHR[i];
+    Tcw_opt = Tcw;
+    solver.Optimize(Tcw_opt, its[it]);
 
-      const size_t idx = vnIndexEdgeRight[i];
+    nBad = solver.Classify(Tcw_opt, chi2Mono[it], chi2Stereo[it],
+                           pFrame->mvbOutlier);
 
-      if (pFrame->mvbOutlier[idx]) {
-        e->computeError();
-      }
-
-      const float chi2 = e->chi2();
-
-      if (chi2 > chi2Mono[it]) {
-        pFrame->mvbOutlier[idx] = true;
-        e->setLevel(1);
-        nBad++;
-      } else {
-        pFrame->mvbOutlier[idx] = false;
-        e->setLevel(0);
-      }
-
-      if (it == 2)
-        e->setRobustKernel(0);
-    }
-
-    for (size_t i = 0, iend = vpEdgesStereo.size(); i < iend; i++) {
-      g2o::EdgeStereoSE3ProjectXYZOnlyPose *e = vpEdgesStereo[i];
-
-      const size_t idx = vnIndexEdgeStereo[i];
-
-      if (pFrame->mvbOutlier[idx]) {
-        e->computeError();
-      }
-
-      const float chi2 = e->chi2();
-
-      if (chi2 > chi2Stereo[it]) {
-        pFrame->mvbOutlier[idx] = true;
-        e->setLevel(1);
-        nBad++;
-      } else {
-        e->setLevel(0);
-        pFrame->mvbOutlier[idx] = false;
-      }
-
-      if (it == 2)
-        e->setRobustKernel(0);
-    }
+    if (it == 2)
+      solver.SetRobust(false);
 
-    if (optimizer.edges().size() < 10)
+    if (solver.size() < 10)
       break;
   }
 
   // Recover optimized pose and return number of inliers
-  g2o::VertexSE3Expmap *vSE3_recov =
-      static_cast<g2o::VertexSE3Expmap *>(optimizer.vertex(0));
-  g2o::SE3Quat SE3quat_recov = vSE3_recov->estimate();
-  Sophus::SE3<float> pose(SE3quat_recov.rotation().cast<float>(),
-                          SE3quat_recov.translation().cast<float>());
-  pFrame->SetPose(pose);
+  pFrame->SetPose(Tcw_opt.cast<float>());
 
   return nInitialCorrespondences - nBad;
 }
@@ -1059,7 +857,7 @@ int Optimizer::PoseOptimization(Frame *pFrame) {
 void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool *pbStopFlag,
                                       Map *pMap, int &num_fixedKF,
                                       int &num_OptKF, int &num_MPs,
-                                      int &num_edges) {
+                                      int &num_edges, LocalBAGraph *pGraph) {
   // Local KeyFrames: First Breath Search from Current Keyframe
   list<KeyFrame *> lLocalKeyFrames;
 
@@ -1130,286 +928,64 @@ void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool *pbStopFlag,
     return;
   }
 
-  // Setup optimizer
-  g2o::SparseOptimizer optimizer;
-  auto linearSolver = std::make_unique<
-      g2o::LinearSolverEigen<g2o::BlockSolver_6_3::PoseMatrixType>>();
-  auto solver_ptr =
-      std::make_unique<g2o::BlockSolver_6_3>(std::move(linearSolver));
-  auto solver = new g2o::OptimizationAlgorithmLevenberg(std::move(solver_ptr));
-  if (pMap->IsInertial())
-    solver->setUserLambdaInit(100.0);
-
-  optimizer.setAlgorithm(solver);
-  optimizer.setVerbose(false);
-
-  if (pbStopFlag)
-    optimizer.setForceStopFlag(pbStopFlag);
-
-  unsigned long maxKFid = 0;
+  // Without a persistent graph the window is built from scratch
+  unique_ptr<LocalBAGraph> pOwnGraph;
+  if (!pGraph) {
+    pOwnGraph.reset(new LocalBAGraph());
+    pGraph = pOwnGraph.get();
+  }
 
   // DEBUG LBA
   pCurrentMap->msOptKFs.clear();
   pCurrentMap->msFixedKFs.clear();
-
-  // Set Local KeyFrame vertices
-  for (list<KeyFrame *>::iterator lit = lLocalKeyFrames.begin(),
-                                  lend = lLocalKeyFrames.end();
-       lit != lend; lit++) {
-    KeyFrame *pKFi = *lit;
-    g2o::VertexSE3Expmap *vSE3 = new g2o::VertexSE3Expmap();
-    Sophus::SE3<float> Tcw = pKFi->GetPose();
-    vSE3->setEstimate(g2o::SE3Quat(Tcw.unit_quaternion().cast<double>(),
-                                   Tcw.translation().cast<double>()));
-    vSE3->setId(pKFi->mnId);
-    vSE3->setFixed(pKFi->mnId == pMap->GetInitKFid());
-    optimizer.addVertex(vSE3);
-    if (pKFi->mnId > maxKFid)
-      maxKFid = pKFi->mnId;
-    // DEBUG LBA
+  for (KeyFrame *pKFi : lLocalKeyFrames)
     pCurrentMap->msOptKFs.insert(pKFi->mnId);
-  }
-  num_OptKF = lLocalKeyFrames.size();
-
-  // Set Fixed KeyFrame vertices
-  for (list<KeyFrame *>::iterator lit = lFixedCameras.begin(),
-                                  lend = lFixedCameras.end();
-       lit != lend; lit++) {
-    KeyFrame *pKFi = *lit;
-    g2o::VertexSE3Expmap *vSE3 = new g2o::VertexSE3Expmap();
-    Sophus::SE3<float> Tcw = pKFi->GetPose();
-    vSE3->setEstimate(g2o::SE3Quat(Tcw.unit_quaternion().cast<double>(),
-                                   Tcw.translation().cast<double>()));
-    vSE3->setId(pKFi->mnId);
-    vSE3->setFixed(true);
-    optimizer.addVertex(vSE3);
-    if (pKFi->mnId > maxKFid)
-      maxKFid = pKFi->mnId;
-    // DEBUG LBA
+  for (KeyFrame *pKFi : lFixedCameras)
     pCurrentMap->msFixedKFs.insert(pKFi->mnId);
-  }
-
-  // Set MapPoint vertices
-  const int nExpectedSize =
-      (lLocalKeyFrames.size() + lFixedCameras.size()) * lLocalMapPoints.size();
-
-  vector<ORB_SLAM3::EdgeSE3ProjectXYZ *> vpEdgesMono;
-  vpEdgesMono.reserve(nExpectedSize);
-
-  vector<ORB_SLAM3::EdgeSE3ProjectXYZToBody *> vpEdgesBody;
-  vpEdgesBody.reserve(nExpectedSize);
-
-  vector<KeyFrame *> vpEdgeKFMono;
-  vpEdgeKFMono.reserve(nExpectedSize);
-
-  vector<KeyFrame *> vpEdgeKFBody;
-  vpEdgeKFBody.reserve(nExpectedSize);
-
-  vector<MapPoint *> vpMapPointEdgeMono;
-  vpMapPointEdgeMono.reserve(nExpectedSize);
-
-  vector<MapPoint *> vpMapPointEdgeBody;
-  vpMapPointEdgeBody.reserve(nExpectedSize);
-
-  vector<g2o::EdgeStereoSE3ProjectXYZ *> vpEdgesStereo;
-  vpEdgesStereo.reserve(nExpectedSize);
-
-  vector<KeyFrame *> vpEdgeKFStereo;
-  vpEdgeKFStereo.reserve(nExpectedSize);
-
-  vector<MapPoint *> vpMapPointEdgeStereo;
-  vpMapPointEdgeStereo.reserve(nExpectedSize);
-
-  const float thHuberMono = sqrt(5.991);
-  const float thHuberStereo = sqrt(7.815);
-
-  int nPoints = 0;
-
-  int nEdges = 0;
-
-  for (list<MapPoint *>::iterator lit = lLocalMapPoints.begin(),
-                                  lend = lLocalMapPoints.end();
-       lit != lend; lit++) {
-    MapPoint *pMP = *lit;
-    g2o::VertexPointXYZ *vPoint = new g2o::VertexPointXYZ();
-    vPoint->setEstimate(pMP->GetWorldPos().cast<double>());
-    int id = pMP->mnId + maxKFid + 1;
-    vPoint->setId(id);
-    vPoint->setMarginalized(true);
-    optimizer.addVertex(vPoint);
-    nPoints++;
-
-    const map<KeyFrame *, tuple<int, int>> observations =
-        pMP->GetObservations();
-
-    // Set edges
-    for (map<KeyFrame *, tuple<int, int>>::const_iterator
-             mit = observations.begin(),
-             mend = observations.end();
-         mit != mend; mit++) {
-      KeyFrame *pKFi = mit->first;
-
-      if (!pKFi->isBad() && pKFi->GetMap() == pCurrentMap) {
-        const int leftIndex = get<0>(mit->second);
-
-        // Monocular observation
-        if (leftIndex != -1 && pKFi->mvuRight[get<0>(mit->second)] < 0) {
-          const cv::KeyPoint &kpUn = pKFi->mvKeysUn[leftIndex];
-          Eigen::Matrix<double, 2, 1> obs;
-          obs << kpUn.pt.x, kpUn.pt.y;
-
-          ORB_SLAM3::EdgeSE3ProjectXYZ *e = new ORB_SLAM3::EdgeSE3ProjectXYZ();
-
-          e->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex *>(
-                              optimizer.vertex(id)));
-          e->setVertex(1, dynamic_cast<g2o::OptimizableGraph::Vertex *>(
-                              optimizer.vertex(pKFi->mnId)));
-          e->setMeasurement(obs);
-          const float &invSigma2 = pKFi->mvInvLevelSigma2[kpUn.octave];
-          e->setInformation(Eigen::Matrix2d::Identity() * invSigma2);
-
-          g2o::RobustKernelHuber *rk = new g2o::RobustKernelHuber;
-          e->setRobustKernel(rk);
-          rk->setDelta(thHuberMono);
-
-          e->pCamera = pKFi->mpCamera;
-
-          optimizer.addEdge(e);
-          vpEdgesMono.push_back(e);
-          vpEdgeKFMono.push_back(pKFi);
-          vpMapPointEdgeMono.push_back(pMP);
-
-          nEdges++;
-        } else if (leftIndex != -1 && pKFi->mvuRight[get<0>(mit->second)] >=
-                                          0) // Stereo observation
-        {
-          const cv::KeyPoint &kpUn = pKFi->mvKeysUn[leftIndex];
-          Eigen::Matrix<double, 3, 1> obs;
-          const float kp_ur = pKFi->mvuRight[get<0>(mit->second)];
-          obs << kpUn.pt.x, kpUn.pt.y, kp_ur;
-
-          g2o::EdgeStereoSE3ProjectXYZ *e = new g2o::EdgeStereoSE3ProjectXYZ();
-
-          e->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex *>(
-                              optimizer.vertex(id)));
-          e->setVertex(1, dynamic_cast<g2o::OptimizableGraph::Vertex *>(
-                              optimizer.vertex(pKFi->mnId)));
-          e->setMeasurement(obs);
-          const float &invSigma2 = pKFi->mvInvLevelSigma2[kpUn.octave];
-          Eigen::Matrix3d Info = Eigen::Matrix3d::Identity() * invSigma2;
-          e->setInformation(Info);
-
-          g2o::RobustKernelHuber *rk = new g2o::RobustKernelHuber;
-          e->setRobustKernel(rk);
-          rk->setDelta(thHuberStereo);
-
-          e->fx = pKFi->fx;
-          e->fy = pKFi->fy;
-          e->cx = pKFi->cx;
-          e->cy = pKFi->cy;
-          e->bf = pKFi->mbf;
-
-          optimizer.addEdge(e);
-          vpEdgesStereo.push_back(e);
-          vpEdgeKFStereo.push_back(pKFi);
-          vpMapPointEdgeStereo.push_back(pMP);
-
-          nEdges++;
-        }
-
-        if (pKFi->mpCamera2) {
-          int rightIndex = get<1>(mit->second);
-
-          if (rightIndex != -1) {
-            rightIndex -= pKFi->NLeft;
-
-            Eigen::Matrix<double, 2, 1> obs;
-            cv::KeyPoint kp = pKFi->mvKeysRight[rightIndex];
-            obs << kp.pt.x, kp.pt.y;
-
-            ORB_SLAM3::EdgeSE3ProjectXYZToBody *e =
-                new ORB_SLAM3::EdgeSE3ProjectXYZToBody();
-
-            e->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex *>(
-                                optimizer.vertex(id)));
-            e->setVertex(1, dynamic_cast<g2o::OptimizableGraph::Vertex *>(
-                                optimizer.vertex(pKFi->mnId)));
-            e->setMeasurement(obs);
-            const float &invSigma2 = pKFi->mvInvLevelSigma2[kp.octave];
-            e->setInformation(Eigen::Matrix2d::Identity() * invSigma2);
-
-            g2o::RobustKernelHuber *rk = new g2o::RobustKernelHuber;
-            e->setRobustKernel(rk);
-            rk->setDelta(thHuberMono);
-
-            Sophus::SE3f Trl = pKFi->GetRelativePoseTrl();
-            e->mTrl = g2o::SE3Quat(Trl.unit_quaternion().cast<double>(),
-                                   Trl.translation().cast<double>());
-
-            e->pCamera = pKFi->mpCamera2;
+  num_OptKF = lLocalKeyFrames.size();
 
-            optimizer.addEdge(e);
-            vpEdgesBody.push_back(e);
-            vpEdgeKFBody.push_back(pKFi);
-            vpMapPointEdgeBody.push_back(pMP);
-
-            nEdges++;
-          }
-        }
-      }
-    }
-  }
-  num_edges = nEdges;
+  num_edges = pGraph->Update(pCurrentMap, lLocalKeyFrames, lFixedCameras,
+                             lLocalMapPoints);
 
   if (pbStopFlag)
     if (*pbStopFlag)
       return;
 
+  g2o::SparseOptimizer &optimizer = pGraph->GetOptimizer();
+  pGraph->GetAlgorithm()->setUserLambdaInit(pMap->IsInertial() ? 100.0 : 0.0);
+  optimizer.setForceStopFlag(pbStopFlag);
+
   optimizer.initializeOptimization();
   optimizer.optimize(10);
 
+  const vector<LocalBAGraph::Observation> &vObservations =
+      pGraph->GetObservations();
+
   vector<pair<KeyFrame *, MapPoint *>> vToErase;
-  vToErase.reserve(vpEdgesMono.size() + vpEdgesBody.size() +
-                   vpEdgesStereo.size());
+  vToErase.reserve(vObservations.size());
 
   // Check inlier observations
-  for (size_t i = 0, iend = vpEdgesMono.size(); i < iend; i++) {
-    ORB_SLAM3::EdgeSE3ProjectXYZ *e = vpEdgesMono[i];
-    MapPoint *pMP = vpMapPointEdgeMono[i];
-
-    if (pMP->isBad())
+  for (const LocalBAGraph::Observation &obs : vObservations) {
+    if (obs.pMP->isBad())
       continue;
 
-    if (e->chi2() > 5.991 || !e->isDepthPositive()) {
-      KeyFrame *pKFi = vpEdgeKFMono[i];
-      vToErase.push_back(make_pair(pKFi, pMP));
+    bool bOutlier;
+    if (obs.kind == LocalBAGraph::MONO) {
+      ORB_SLAM3::EdgeSE3ProjectXYZ *e =
+          static_cast<ORB_SLAM3::EdgeSE3ProjectXYZ *>(obs.pEdge);
+      bOutlier = e->chi2() > 5.991 || !e->isDepthPositive();
+    } else if (obs.kind == LocalBAGraph::BODY) {
+      ORB_SLAM3::EdgeSE3ProjectXYZToBody *e =
+          static_cast<ORB_SLAM3::EdgeSE3ProjectXYZToBody *>(obs.pEdge);
+      bOutlier = e->chi2() > 5.991 || !e->isDepthPositive();
+    } else {
+      g2o::EdgeStereoSE3ProjectXYZ *e =
+          static_cast<g2o::EdgeStereoSE3ProjectXYZ *>(obs.pEdge);
+      bOutlier = e->chi2() > 7.815 || !e->isDepthPositive();
     }
-  }
-
-  for (size_t i = 0, iend = vpEdgesBody.size(); i < iend; i++) {
-    ORB_SLAM3::EdgeSE3ProjectXYZToBody *e = vpEdgesBody[i];
-    MapPoint *pMP = vpMapPointEdgeBody[i];
-
-    if (pMP->isBad())
-      continue;
 
-    if (e->chi2() > 5.991 || !e->isDepthPositive()) {
-      KeyFrame *pKFi = vpEdgeKFBody[i];
-      vToErase.push_back(make_pair(pKFi, pMP));
-    }
-  }
-
-  for (size_t i = 0, iend = vpEdgesStereo.size(); i < iend; i++) {
-    g2o::EdgeStereoSE3ProjectXYZ *e = vpEdgesStereo[i];
-    MapPoint *pMP = vpMapPointEdgeStereo[i];
-
-    if (pMP->isBad())
-      continue;
-
-    if (e->chi2() > 7.815 || !e->isDepthPositive()) {
-      KeyFrame *pKFi = vpEdgeKFStereo[i];
-      vToErase.push_back(make_pair(pKFi, pMP));
-    }
+    if (bOutlier)
+      vToErase.push_back(make_pair(obs.pKF, obs.pMP));
   }
 
   // Get Map Mutex
@@ -1430,8 +1006,7 @@ void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool *pbStopFlag,
                                   lend = lLocalKeyFrames.end();
        lit != lend; lit++) {
     KeyFrame *pKFi = *lit;
-    g2o::VertexSE3Expmap *vSE3 =
-        static_cast<g2o::VertexSE3Expmap *>(optimizer.vertex(pKFi->mnId));
+    g2o::VertexSE3Expmap *vSE3 = pGraph->GetVertex(pKFi);
     g2o::SE3Quat SE3quat = vSE3->estimate();
     Sophus::SE3f Tiw(SE3quat.rotation().cast<float>(),
                      SE3quat.translation().cast<float>());
@@ -1443,8 +1018,7 @@ void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool *pbStopFlag,
                                   lend = lLocalMapPoints.end();
        lit != lend; lit++) {
     MapPoint *pMP = *lit;
-    g2o::VertexPointXYZ *vPoint = static_cast<g2o::VertexPointXYZ *>(
-        optimizer.vertex(pMP->mnId + maxKFid + 1));
+    g2o::VertexPointXYZ *vPoint = pGraph->GetVertex(pMP);
     pMP->SetWorldPos(vPoint->estimate().cast<float>());
     pMP->UpdateNormalAndDepth();
   }
@@ -2342,7 +1916,8 @@ int Optimizer::OptimizeSim3(KeyFrame *pKF1, KeyFrame *pKF2,
 
 void Optimizer::LocalInertialBA(KeyFrame *pKF, bool *pbStopFlag, Map *pMap,
                                 int &num_fixedKF, int &num_OptKF, int &num_MPs,
-                                int &num_edges, bool bLarge, bool bRecInit) {
+                                int &num_edges, bool bLarge, bool bRecInit,
+                                ThreadPool *pThreadPool) {
   Map *pCurrentMap = pKF->GetMap();
 
   int maxOpt = 10;
@@ -2457,8 +2032,8 @@ void Optimizer::LocalInertialBA(KeyFrame *pKF, bool *pbStopFlag, Map *pMap,
   g2o::SparseOptimizer optimizer;
   auto linearSolver = std::make_unique<
       g2o::LinearSolverEigen<g2o::BlockSolverX::PoseMatrixType>>();
-  auto solver_ptr =
-      std::make_unique<g2o::BlockSolverX>(std::move(linearSolver));
+  auto solver_ptr = std::make_unique<ParallelBlockSolverX>(
+      std::move(linearSolver), pThreadPool);
   auto solver = new g2o::OptimizationAlgorithmLevenberg(std::move(solver_ptr));
   // Use smaller lambda to avoid iterating for finding optimal lambda
   solver->setUserLambdaInit(bLarge ? 1e-2 : 1e0);
@@ -2918,76 +2493,55 @@ Eigen::MatrixXd Optimizer::Marginalize(const Eigen::MatrixXd &H,
   // ba | b  | bc  -->  0   | 0 | 0
   // ca | cb | c        ca* | 0 | c*
 
-  // Size of block before block to marginalize
-  const int a = start;
+  const int n = H.cols();
   // Size of block to marginalize
   const int b = end - start + 1;
-  // Size of block after block to marginalize
-  const int c = H.cols() - (end + 1);
-
-  // Reorder as follows:
-  // a  | ab | ac       a  | ac | ab
-  // ba | b  | bc  -->  ca | c  | cb
-  // ca | cb | c        ba | bc | b
-
-  Eigen::MatrixXd Hn = Eigen::MatrixXd::Zero(H.rows(), H.cols());
-  if (a > 0) {
-    Hn.block(0, 0, a, a) = H.block(0, 0, a, a);
-    Hn.block(0, a + c, a, b) = H.block(0, a, a, b);
-    Hn.block(a + c, 0, b, a) = H.block(a, 0, b, a);
-  }
-  if (a > 0 && c > 0) {
-    Hn.block(0, a, a, c) = H.block(0, a + b, a, c);
-    Hn.block(a, 0, c, a) = H.block(a + b, 0, c, a);
+
+  // The Schur complement only changes the rows and columns of a and c coupled
+  // to b (non zero in ab, ba, cb or bc). In a window of inertial states these
+  // are the states next to the marginalized one, whatever the window size, so
+  // the cost does not grow with it.
+  vector<int> vCoupled;
+  for (int i = 0; i < n; i++) {
+    if (i == start) {
+      i = end;
+      continue;
+    }
+    if (!H.block(i, start, 1, b).isZero(0) ||
+        !H.block(start, i, b, 1).isZero(0))
+      vCoupled.push_back(i);
   }
-  if (c > 0) {
-    Hn.block(a, a, c, c) = H.block(a + b, a + b, c, c);
-    Hn.block(a, a + c, c, b) = H.block(a + b, a, c, b);
-    Hn.block(a + c, a, b, c) = H.block(a, a + b, b, c);
+  const int k = vCoupled.size();
+
+  Eigen::MatrixXd Hkb(k, b), Hbk(b, k);
+  for (int i = 0; i < k; i++) {
+    Hkb.row(i) = H.block(vCoupled[i], start, 1, b);
+    Hbk.col(i) = H.block(start, vCoupled[i], b, 1);
   }
-  Hn.block(a + c, a + c, b, b) = H.block(a, a, b, b);
 
-  // Perform marginalization (Schur complement)
-  Eigen::JacobiSVD<Eigen::MatrixXd> svd(
-      Hn.block(a + c, a + c, b, b), Eigen::ComputeThinU | Eigen::ComputeThinV);
-  Eigen::JacobiSVD<Eigen::MatrixXd>::SingularValuesType singularValues_inv =
-      svd.singularValues();
+  // Hb^-1 * Hbk with the pseudo-inverse of Hb, dropping the eigenvalues below
+  // 1e-6 in magnitude. Hb is symmetric, so this is what its SVD gives, at a
+  // fraction of the cost.
+  Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> eig(
+      H.block(start, start, b, b));
+  Eigen::VectorXd eigenvalues_inv = eig.eigenvalues();
   for (int i = 0; i < b; ++i) {
-    if (singularValues_inv(i) > 1e-6)
-      singularValues_inv(i) = 1.0 / singularValues_inv(i);
+    if (fabs(eigenvalues_inv(i)) > 1e-6)
+      eigenvalues_inv(i) = 1.0 / eigenvalues_inv(i);
     else
-      singularValues_inv(i) = 0;
-  }
-  Eigen::MatrixXd invHb = svd.matrixV() * singularValues_inv.asDiagonal() *
-                          svd.matrixU().transpose();
-  Hn.block(0, 0, a + c, a + c) =
-      Hn.block(0, 0, a + c, a + c) -
-      Hn.block(0, a + c, a + c, b) * invHb * Hn.block(a + c, 0, b, a + c);
-  Hn.block(a + c, a + c, b, b) = Eigen::MatrixXd::Zero(b, b);
-  Hn.block(0, a + c, a + c, b) = Eigen::MatrixXd::Zero(a + c, b);
-  Hn.block(a + c, 0, b, a + c) = Eigen::MatrixXd::Zero(b, a + c);
-
-  // Inverse reorder
-  // a*  | ac* | 0       a*  | 0 | ac*
-  // ca* | c*  | 0  -->  0   | 0 | 0
-  // 0   | 0   | 0       ca* | 0 | c*
-  Eigen::MatrixXd res = Eigen::MatrixXd::Zero(H.rows(), H.cols());
-  if (a > 0) {
-    res.block(0, 0, a, a) = Hn.block(0, 0, a, a);
-    res.block(0, a, a, b) = Hn.block(0, a + c, a, b);
-    res.block(a, 0, b, a) = Hn.block(a + c, 0, b, a);
-  }
-  if (a > 0 && c > 0) {
-    res.block(0, a + b, a, c) = Hn.block(0, a, a, c);
-    res.block(a + b, 0, c, a) = Hn.block(a, 0, c, a);
-  }
-  if (c > 0) {
-    res.block(a + b, a + b, c, c) = Hn.block(a, a, c, c);
-    res.block(a + b, a, c, b) = Hn.block(a, a + c, c, b);
-    res.block(a, a + b, b, c) = Hn.block(a + c, a, b, c);
+      eigenvalues_inv(i) = 0;
   }
-
-  res.block(a, a, b, b) = Hn.block(a + c, a + c, b, b);
+  const Eigen::MatrixXd HbinvHbk =
+      eig.eigenvectors() * (eigenvalues_inv.asDiagonal() *
+                            (eig.eigenvectors().transpose() * Hbk));
+  const Eigen::MatrixXd S = Hkb * HbinvHbk;
+
+  Eigen::MatrixXd res = H;
+  res.middleRows(start, b).setZero();
+  res.middleCols(start, b).setZero();
+  for (int j = 0; j < k; j++)
+    for (int i = 0; i < k; i++)
+      res(vCoupled[i], vCoupled[j]) -= S(i, j);
 
   return res;
 }
@@ -4412,15 +3966,7 @@ void Optimizer::MergeInertialBA(KeyFrame *pCurrKF, KeyFrame *pMergeKF,
 
 int Optimizer::PoseInertialOptimizationLastKeyFrame(Frame *pFrame,
                                                     bool bRecInit) {
-  g2o::SparseOptimizer optimizer;
-  auto linearSolver = std::make_unique<
-      g2o::LinearSolverDense<g2o::BlockSolverX::PoseMatrixType>>();
-  auto solver_ptr =
-      std::make_unique<g2o::BlockSolverX>(std::move(linearSolver));
-  auto solver =
-      new g2o::OptimizationAlgorithmGaussNewton(std::move(solver_ptr));
-  optimizer.setVerbose(false);
-  optimizer.setAlgorithm(solver);
+  InertialPoseSolver solver;
 
   int nInitialMonoCorrespondences = 0;
   int nInitialStereoCorrespondences = 0;
@@ -4428,21 +3974,10 @@ int Optimizer::PoseInertialOptimizationLastKeyFrame(Frame *pFrame,
 
   // Set Frame vertex
   VertexPose *VP = new VertexPose(pFrame);
-  VP->setId(0);
-  VP->setFixed(false);
-  optimizer.addVertex(VP);
   VertexVelocity *VV = new VertexVelocity(pFrame);
-  VV->setId(1);
-  VV->setFixed(false);
-  optimizer.addVertex(VV);
   VertexGyroBias *VG = new VertexGyroBias(pFrame);
-  VG->setId(2);
-  VG->setFixed(false);
-  optimizer.addVertex(VG);
   VertexAccBias *VA = new VertexAccBias(pFrame);
-  VA->setId(3);
-  VA->setFixed(false);
-  optimizer.addVertex(VA);
+  solver.AddState(VP, VV, VG, VA, false);
 
   // Set MapPoint vertices
   const int N = pFrame->N;
@@ -4497,7 +4032,7 @@ int Optimizer::PoseInertialOptimizationLastKeyFrame(Frame *pFrame,
           e->setRobustKernel(rk);
           rk->setDelta(thHuberMono);
 
-          optimizer.addEdge(e);
+          solver.AddEdge(e);
 
           vpEdgesMono.push_back(e);
           vnIndexEdgeMono.push_back(i);
@@ -4527,7 +4062,7 @@ int Optimizer::PoseInertialOptimizationLastKeyFrame(Frame *pFrame,
           e->setRobustKernel(rk);
           rk->setDelta(thHuberStereo);
 
-          optimizer.addEdge(e);
+          solver.AddEdge(e);
 
           vpEdgesStereo.push_back(e);
           vnIndexEdgeStereo.push_back(i);
@@ -4557,7 +4092,7 @@ int Optimizer::PoseInertialOptimizationLastKeyFrame(Frame *pFrame,
           e->setRobustKernel(rk);
           rk->setDelta(thHuberMono);
 
-          optimizer.addEdge(e);
+          solver.AddEdge(e);
 
           vpEdgesMono.push_back(e);
           vnIndexEdgeMono.push_back(i);
@@ -4570,21 +4105,10 @@ int Optimizer::PoseInertialOptimizationLastKeyFrame(Frame *pFrame,
 
   KeyFrame *pKF = pFrame->mpLastKeyFrame;
   VertexPose *VPk = new VertexPose(pKF);
-  VPk->setId(4);
-  VPk->setFixed(true);
-  optimizer.addVertex(VPk);
   VertexVelocity *VVk = new VertexVelocity(pKF);
-  VVk->setId(5);
-  VVk->setFixed(true);
-  optimizer.addVertex(VVk);
   VertexGyroBias *VGk = new VertexGyroBias(pKF);
-  VGk->setId(6);
-  VGk->setFixed(true);
-  optimizer.addVertex(VGk);
   VertexAccBias *VAk = new VertexAccBias(pKF);
-  VAk->setId(7);
-  VAk->setFixed(true);
-  optimizer.addVertex(VAk);
+  solver.AddState(VPk, VVk, VGk, VAk, true);
 
   EdgeInertial *ei = new EdgeInertial(pFrame->mpImuPreintegrated);
 
@@ -4594,7 +4118,7 @@ int Optimizer::PoseInertialOptimizationLastKeyFrame(Frame *pFrame,
   ei->setVertex(3, VAk);
   ei->setVertex(4, VP);
   ei->setVertex(5, VV);
-  optimizer.addEdge(ei);
+  solver.AddEdge(ei);
 
   EdgeGyroRW *egr = new EdgeGyroRW();
   egr->setVertex(0, VGk);
@@ -4602,7 +4126,7 @@ int Optimizer::PoseInertialOptimizationLastKeyFrame(Frame *pFrame,
   Eigen::Matrix3d InfoG =
       pFrame->mpImuPreintegrated->C.block<3, 3>(9, 9).cast<double>().inverse();
   egr->setInformation(InfoG);
-  optimizer.addEdge(egr);
+  solver.AddEdge(egr);
 
   EdgeAccRW *ear = new EdgeAccRW();
   ear->setVertex(0, VAk);
@@ -4611,7 +4135,7 @@ int Optimizer::PoseInertialOptimizationLastKeyFrame(Frame *pFrame,
                               .cast<double>()
                               .inverse();
   ear->setInformation(InfoA);
-  optimizer.addEdge(ear);
+  solver.AddEdge(ear);
 
   // We perform 4 optimizations, after each optimization we classify observation
   // as inlier/outlier At the next optimization, outliers are not included, but
@@ -4628,8 +4152,7 @@ int Optimizer::PoseInertialOptimizationLastKeyFrame(Frame *pFrame,
   int nInliersStereo = 0;
   int nInliers = 0;
   for (size_t it = 0; it < 4; it++) {
-    optimizer.initializeOptimization(0);
-    optimizer.optimize(its[it]);
+    solver.Optimize(its[it]);
 
     nBad = 0;
     nBadMono = 0;
@@ -4696,7 +4219,7 @@ int Optimizer::PoseInertialOptimizationLastKeyFrame(Frame *pFrame,
     nInliers = nInliersMono + nInliersStereo;
     nBad = nBadMono + nBadStereo;
 
-    if (optimizer.edges().size() < 10) {
+    if (solver.NumEdges() < 10) {
       break;
     }
   }
@@ -4778,15 +4301,7 @@ int Optimizer::PoseInertialOptimizationLastKeyFrame(Frame *pFrame,
 }
 
 int Optimizer::PoseInertialOptimizationLastFrame(Frame *pFrame, bool bRecInit) {
-  g2o::SparseOptimizer optimizer;
-  auto linearSolver = std::make_unique<
-      g2o::LinearSolverDense<g2o::BlockSolverX::PoseMatrixType>>();
-  auto solver_ptr =
-      std::make_unique<g2o::BlockSolverX>(std::move(linearSolver));
-  auto solver =
-      new g2o::OptimizationAlgorithmGaussNewton(std::move(solver_ptr));
-  optimizer.setAlgorithm(solver);
-  optimizer.setVerbose(false);
+  InertialPoseSolver solver;
 
   int nInitialMonoCorrespondences = 0;
   int nInitialStereoCorrespondences = 0;
@@ -4794,21 +4309,10 @@ int Optimizer::PoseInertialOptimizationLastFrame(Frame *pFrame, bool bRecInit) {
 
   // Set Current Frame vertex
   VertexPose *VP = new VertexPose(pFrame);
-  VP->setId(0);
-  VP->setFixed(false);
-  optimizer.addVertex(VP);
   VertexVelocity *VV = new VertexVelocity(pFrame);
-  VV->setId(1);
-  VV->setFixed(false);
-  optimizer.addVertex(VV);
   VertexGyroBias *VG = new VertexGyroBias(pFrame);
-  VG->setId(2);
-  VG->setFixed(false);
-  optimizer.addVertex(VG);
   VertexAccBias *VA = new VertexAccBias(pFrame);
-  VA->setId(3);
-  VA->setFixed(false);
-  optimizer.addVertex(VA);
+  solver.AddState(VP, VV, VG, VA, false);
 
   // Set MapPoint vertices
   const int N = pFrame->N;
@@ -4862,7 +4366,7 @@ int Optimizer::PoseInertialOptimizationLastFrame(Frame *pFrame, bool bRecInit) {
           e->setRobustKernel(rk);
           rk->setDelta(thHuberMono);
 
-          optimizer.addEdge(e);
+          solver.AddEdge(e);
 
           vpEdgesMono.push_back(e);
           vnIndexEdgeMono.push_back(i);
@@ -4892,7 +4396,7 @@ int Optimizer::PoseInertialOptimizationLastFrame(Frame *pFrame, bool bRecInit) {
           e->setRobustKernel(rk);
           rk->setDelta(thHuberStereo);
 
-          optimizer.addEdge(e);
+          solver.AddEdge(e);
 
           vpEdgesStereo.push_back(e);
           vnIndexEdgeStereo.push_back(i);
@@ -4922,7 +4426,7 @@ int Optimizer::PoseInertialOptimizationLastFrame(Frame *pFrame, bool bRecInit) {
           e->setRobustKernel(rk);
           rk->setDelta(thHuberMono);
 
-          optimizer.addEdge(e);
+          solver.AddEdge(e);
 
           vpEdgesMono.push_back(e);
           vnIndexEdgeMono.push_back(i);
@@ -4938,21 +4442,10 @@ int Optimizer::PoseInertialOptimizationLastFrame(Frame *pFrame, bool bRecInit) {
   Frame *pFp = pFrame->mpPrevFrame;
 
   VertexPose *VPk = new VertexPose(pFp);
-  VPk->setId(4);
-  VPk->setFixed(false);
-  optimizer.addVertex(VPk);
   VertexVelocity *VVk = new VertexVelocity(pFp);
-  VVk->setId(5);
-  VVk->setFixed(false);
-  optimizer.addVertex(VVk);
   VertexGyroBias *VGk = new VertexGyroBias(pFp);
-  VGk->setId(6);
-  VGk->setFixed(false);
-  optimizer.addVertex(VGk);
   VertexAccBias *VAk = new VertexAccBias(pFp);
-  VAk->setId(7);
-  VAk->setFixed(false);
-  optimizer.addVertex(VAk);
+  solver.AddState(VPk, VVk, VGk, VAk, false);
 
   EdgeInertial *ei = new EdgeInertial(pFrame->mpImuPreintegratedFrame);
 
@@ -4962,7 +4455,7 @@ int Optimizer::PoseInertialOptimizationLastFrame(Frame *pFrame, bool bRecInit) {
   ei->setVertex(3, VAk);
   ei->setVertex(4, VP);
   ei->setVertex(5, VV);
-  optimizer.addEdge(ei);
+  solver.AddEdge(ei);
 
   EdgeGyroRW *egr = new EdgeGyroRW();
   egr->setVertex(0, VGk);
@@ -4970,7 +4463,7 @@ int Optimizer::PoseInertialOptimizationLastFrame(Frame *pFrame, bool bRecInit) {
   Eigen::Matrix3d InfoG =
       pFrame->mpImuPreintegrated->C.block<3, 3>(9, 9).cast<double>().inverse();
   egr->setInformation(InfoG);
-  optimizer.addEdge(egr);
+  solver.AddEdge(egr);
 
   EdgeAccRW *ear = new EdgeAccRW();
   ear->setVertex(0, VAk);
@@ -4979,7 +4472,7 @@ int Optimizer::PoseInertialOptimizationLastFrame(Frame *pFrame, bool bRecInit) {
                               .cast<double>()
                               .inverse();
   ear->setInformation(InfoA);
-  optimizer.addEdge(ear);
+  solver.AddEdge(ear);
 
   if (!pFp->mpcpi)
     Verbose::Log("pFp->mpcpi does not exist!!!\nPrevious Frame " +
@@ -4995,7 +4488,7 @@ int Optimizer::PoseInertialOptimizationLastFrame(Frame *pFrame, bool bRecInit) {
   g2o::RobustKernelHuber *rkp = new g2o::RobustKernelHuber;
   ep->setRobustKernel(rkp);
   rkp->setDelta(5);
-  optimizer.addEdge(ep);
+  solver.AddEdge(ep);
 
   // We perform 4 optimizations, after each optimization we classify observation
   // as inlier/outlier At the next optimization, outliers are not included, but
@@ -5011,8 +4504,7 @@ int Optimizer::PoseInertialOptimizationLastFrame(Frame *pFrame, bool bRecInit) {
   int nInliersStereo = 0;
   int nInliers = 0;
   for (size_t it = 0; it < 4; it++) {
-    optimizer.initializeOptimization(0);
-    optimizer.optimize(its[it]);
+    solver.Optimize(its[it]);
 
     nBad = 0;
     nBadMono = 0;
@@ -5077,7 +4569,7 @@ int Optimizer::PoseInertialOptimizationLastFrame(Frame *pFrame, bool bRecInit) {
     nInliers = nInliersMono + nInliersStereo;
     nBad = nBadMono + nBadStereo;
 
-    if (optimizer.edges().size() < 10) {
+    if (solver.NumEdges() < 10) {
       break;
     }
   }
@@ -0,0 +1,285 @@
+/**
+ * This file is part of ORB-SLAM3
+ *
+ * Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez
+ * Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+ * Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós,
+ * University of Zaragoza.
+ *
+ * ORB-SLAM3 is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ORB-SLAM3. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "PoseSolver.h"
+
+#include <cmath>
+#include <limits>
+
+#include <Eigen/Dense>
+
+#include "CameraModels/GeometricCamera.h"
+#include "Frame.h"
+
+namespace ORB_SLAM3 {
+
+typedef Eigen::Matrix<double, 6, 6> Matrix6d;
+typedef Eigen::Matrix<double, 6, 1> Vector6d;
+
+void PoseSolver::Observations::Add(const Eigen::Vector3d &Xw, const double u,
+                                   const double v, const double ur,
+                                   const double invSigma2, const int nIndex) {
+  vX.push_back(Xw[0]);
+  vY.push_back(Xw[1]);
+  vZ.push_back(Xw[2]);
+  vU.push_back(u);
+  vV.push_back(v);
+  vUr.push_back(ur);
+  vInvSigma2.push_back(invSigma2);
+  vbInlier.push_back(1);
+  vnIndex.push_back(nIndex);
+}
+
+PoseSolver::PoseSolver(Frame *pFrame, const double deltaMono,
+                       const double deltaStereo)
+    : mfx(pFrame->fx), mfy(pFrame->fy), mcx(pFrame->cx), mcy(pFrame->cy),
+      mbf(pFrame->mbf), mDeltaMono(deltaMono), mDeltaStereo(deltaStereo),
+      mbRobust(true) {
+  mpCameras[0] = pFrame->mpCamera;
+  mpCameras[1] = pFrame->mpCamera2;
+  for (int c = 0; c < 2; c++) {
+    mbPinhole[c] = mpCameras[c] &&
+                   mpCameras[c]->GetType() == GeometricCamera::CAM_PINHOLE;
+    for (int k = 0; k < 4; k++)
+      mK[c][k] = mbPinhole[c] ? mpCameras[c]->getParameter(k) : 0.0;
+  }
+  if (mpCameras[1])
+    mTrl = pFrame->GetRelativePoseTrl().cast<double>();
+
+  for (int kind = MONO; kind <= RIGHT; kind++) {
+    Observations &obs = mObs[kind];
+    obs.vX.reserve(pFrame->N);
+    obs.vY.reserve(pFrame->N);
+    obs.vZ.reserve(pFrame->N);
+    obs.vU.reserve(pFrame->N);
+    obs.vV.reserve(pFrame->N);
+    obs.vUr.reserve(pFrame->N);
+    obs.vInvSigma2.reserve(pFrame->N);
+    obs.vbInlier.reserve(pFrame->N);
+    obs.vnIndex.reserve(pFrame->N);
+  }
+}
+
+void PoseSolver::AddMono(const Eigen::Vector3d &Xw, const double u,
+                         const double v, const double invSigma2,
+                         const int nIndex) {
+  mObs[MONO].Add(Xw, u, v, 0.0, invSigma2, nIndex);
+}
+
+void PoseSolver::AddStereo(const Eigen::Vector3d &Xw, const double u,
+                           const double v, const double ur,
+                           const double invSigma2, const int nIndex) {
+  mObs[STEREO].Add(Xw, u, v, ur, invSigma2, nIndex);
+}
+
+void PoseSolver::AddRight(const Eigen::Vector3d &Xw, const double u,
+                          const double v, const double invSigma2,
+                          const int nIndex) {
+  mObs[RIGHT].Add(Xw, u, v, 0.0, invSigma2, nIndex);
+}
+
+size_t PoseSolver::size() const {
+  return mObs[MONO].size() + mObs[STEREO].size() + mObs[RIGHT].size();
+}
+
+void PoseSolver::Residual(const int kind, const size_t i,
+                          const Eigen::Matrix3d &Rcw,
+                          const Eigen::Vector3d &tcw, Eigen::Vector3d &e,
+                          Eigen::Matrix<double, 3, 6> *J) const {
+  const Observations &obs = mObs[kind];
+  const Eigen::Vector3d Xc =
+      Rcw * Eigen::Vector3d(obs.vX[i], obs.vY[i], obs.vZ[i]) + tcw;
+
+  // Derivative of the prediction with respect to Xc
+  Eigen::Matrix3d M;
+
+  if (kind == STEREO) {
+    const double invz = 1.0 / Xc[2];
+    const double u = mfx * Xc[0] * invz + mcx;
+    const double v = mfy * Xc[1] * invz + mcy;
+    e << obs.vU[i] - u, obs.vV[i] - v, obs.vUr[i] - (u - mbf * invz);
+    if (!J)
+      return;
+
+    const double invz2 = invz * invz;
+    M << mfx * invz, 0.0, -mfx * Xc[0] * invz2, //
+        0.0, mfy * invz, -mfy * Xc[1] * invz2,  //
+        mfx * invz, 0.0, -mfx * Xc[0] * invz2 + mbf * invz2;
+  } else {
+    const int c = (kind == RIGHT) ? 1 : 0;
+    const Eigen::Vector3d Xp = (kind == RIGHT) ? mTrl * Xc : Xc;
+
+    Eigen::Matrix<double, 2, 3> Jproj;
+    if (mbPinhole[c]) {
+      const double invz = 1.0 / Xp[2];
+      e << obs.vU[i] - (mK[c][0] * Xp[0] * invz + mK[c][2]),
+          obs.vV[i] - (mK[c][1] * Xp[1] * invz + mK[c][3]), 0.0;
+      if (!J)
+        return;
+
+      const double invz2 = invz * invz;
+      Jproj << mK[c][0] * invz, 0.0, -mK[c][0] * Xp[0] * invz2, //
+          0.0, mK[c][1] * invz, -mK[c][1] * Xp[1] * invz2;
+    } else {
+      const Eigen::Vector2d uv = mpCameras[c]->project(Xp);
+      e << obs.vU[i] - uv[0], obs.vV[i] - uv[1], 0.0;
+      if (!J)
+        return;
+
+      Jproj = mpCameras[c]->projectJac(Xp);
+    }
+
+    M.topRows<2>() = Jproj;
+    if (kind == RIGHT)
+      M.topRows<2>() *= mTrl.rotationMatrix();
+    M.row(2).setZero();
+  }
+
+  // e = obs - proj(exp(dx) Xc), dXc/d(omega, upsilon) = [-[Xc]x | I]
+  J->leftCols<3>() = M * Sophus::SO3d::hat(Xc);
+  J->rightCols<3>() = -M;
+}
+
+double PoseSolver::Evaluate(const Sophus::SE3d &Tcw, Matrix6d *H,
+                            Vector6d *b) const {
+  const Eigen::Matrix3d Rcw = Tcw.rotationMatrix();
+  const Eigen::Vector3d tcw = Tcw.translation();
+
+  if (H) {
+    H->setZero();
+    b->setZero();
+  }
+
+  double chi2 = 0.0;
+  Eigen::Vector3d e;
+  Eigen::Matrix<double, 3, 6> J;
+  for (int kind = MONO; kind <= RIGHT; kind++) {
+    const Observations &obs = mObs[kind];
+    const double delta = (kind == STEREO) ? mDeltaStereo : mDeltaMono;
+    for (size_t i = 0, iend = obs.size(); i < iend; i++) {
+      if (!obs.vbInlier[i])
+        continue;
+
+      Residual(kind, i, Rcw, tcw, e, H ? &J : NULL);
+      const double e2 = e.squaredNorm() * obs.vInvSigma2[i];
+
+      // Huber kernel, the information is scaled by its first derivative
+      double w = obs.vInvSigma2[i];
+      if (mbRobust && e2 > delta * delta) {
+        const double sqrte2 = sqrt(e2);
+        chi2 += 2.0 * delta * sqrte2 - delta * delta;
+        w *= delta / sqrte2;
+      } else {
+        chi2 += e2;
+      }
+
+      if (H) {
+        H->noalias() += w * J.transpose() * J;
+        b->noalias() -= w * J.transpose() * e;
+      }
+    }
+  }
+
+  return chi2;
+}
+
+void PoseSolver::Optimize(Sophus::SE3d &Tcw, const int nIterations) const {
+  bool bInliers = false;
+  for (int kind = MONO; kind <= RIGHT && !bInliers; kind++)
+    for (size_t i = 0; i < mObs[kind].size() && !bInliers; i++)
+      bInliers = mObs[kind].vbInlier[i];
+  if (!bInliers)
+    return;
+
+  Matrix6d H;
+  Vector6d b;
+  double lambda = 0.0;
+  double ni = 2.0;
+
+  for (int it = 0; it < nIterations; it++) {
+    double currentChi = Evaluate(Tcw, &H, &b);
+    if (it == 0)
+      lambda = 1e-5 * H.diagonal().cwiseAbs().maxCoeff();
+
+    // Damped steps until one decreases the cost, as g2o's Levenberg does
+    double rho = 0.0;
+    int q = 0;
+    do {
+      const Eigen::LDLT<Matrix6d> ldlt(H + lambda * Matrix6d::Identity());
+      const bool bOk = ldlt.info() == Eigen::Success && ldlt.isPositive();
+      const Vector6d dx = ldlt.solve(b);
+
+      // dx is rotation first, Sophus tangents are translation first
+      Vector6d xi;
+      xi << dx.tail<3>(), dx.head<3>();
+      const Sophus::SE3d Tnew = Sophus::SE3d::exp(xi) * Tcw;
+      const double tempChi =
+          bOk ? Evaluate(Tnew, NULL, NULL) : numeric_limits<double>::max();
+
+      rho = currentChi - tempChi;
+      rho /= bOk ? dx.dot(lambda * dx + b) + 1e-3 : 1.0;
+      if (rho > 0 && std::isfinite(tempChi) && bOk) {
+        const double alpha = min(1.0 - pow(2.0 * rho - 1.0, 3), 2.0 / 3.0);
+        lambda *= max(1.0 / 3.0, alpha);
+        ni = 2.0;
+        currentChi = tempChi;
+        Tcw = Tnew;
+      } else {
+        lambda *= ni;
+        ni *= 2.0;
+        if (!std::isfinite(lambda))
+          break;
+      }
+      q++;
+    } while (rho < 0 && q < 10);
+
+    if (q == 10 || rho == 0 || !std::isfinite(lambda))
+      break;
+  }
+}
+
+int PoseSolver::Classify(const Sophus::SE3d &Tcw, const double chi2Mono,
+                         const double chi2Stereo, vector<bool> &vbOutlier) {
+  const Eigen::Matrix3d Rcw = Tcw.rotationMatrix();
+  const Eigen::Vector3d tcw = Tcw.translation();
+
+  int nBad = 0;
+  Eigen::Vector3d e;
+  for (int kind = MONO; kind <= RIGHT; kind++) {
+    Observations &obs = mObs[kind];
+    // Compared in single precision, as the g2o chi2 used to be
+    const float th = (kind == STEREO) ? chi2Stereo : chi2Mono;
+    for (size_t i = 0, iend = obs.size(); i < iend; i++) {
+      Residual(kind, i, Rcw, tcw, e, NULL);
+      const float chi2 = e.squaredNorm() * obs.vInvSigma2[i];
+
+      const bool bOutlier = chi2 > th;
+      obs.vbInlier[i] = !bOutlier;
+      vbOutlier[obs.vnIndex[i]] = bOutlier;
+      if (bOutlier)
+        nBad++;
+    }
+  }
+
+  return nBad;
+}
+
+} // namespace ORB_SLAM3
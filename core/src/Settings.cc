@@ -473,6 +473,20 @@ void Settings::readORB(cv::FileStorage &fSettings) {
   nLevels_ = readParameter<int>(fSettings, "ORBextractor.nLevels", found);
   initThFAST_ = readParameter<int>(fSettings, "ORBextractor.iniThFAST", found);
   minThFAST_ = readParameter<int>(fSettings, "ORBextractor.minThFAST", found);
+
+  // Worker threads shared by the extractors, 0 extracts on the calling thread
+  extractorThreads_ =
+      readParameter<int>(fSettings, "ORBextractor.nThreads", found, false);
+  if (!found)
+    extractorThreads_ = 0;
+
+  // CPUs the extractor workers are pinned to, e.g. [2, 3, 4, 5]
+  cv::FileNode node = fSettings["ORBextractor.cpuAffinity"];
+  if (node.isSeq())
+    node >> vExtractorAffinity_;
+  else if (!node.empty())
+    cerr << "ORBextractor.cpuAffinity must be a list of CPU ids, ignoring..."
+         << endl;
 }
 
 void Settings::readViewer(cv::FileStorage &fSettings) {
@@ -512,6 +526,19 @@ void Settings::readOtherParameters(cv::FileStorage &fSettings) {
 
   thFarPoints_ =
       readParameter<float>(fSettings, "System.thFarPoints", found, false);
+
+  // Time allowed to a relocalization attempt in ms, 0 for no limit
+  relocTimeBudget_ =
+      readParameter<float>(fSettings, "System.relocTimeBudget", found, false);
+  if (!found)
+    relocTimeBudget_ = 0;
+
+  // Worker threads of Local Mapping (triangulation, fusion and local BA
+  // linearization), 0 runs all the work on its own thread
+  mappingThreads_ =
+      readParameter<int>(fSettings, "LocalMapping.nThreads", found, false);
+  if (!found)
+    mappingThreads_ = 0;
 }
 
 void Settings::precomputeRectificationMaps() {
@@ -674,6 +701,13 @@ ostream &operator<<(ostream &output, const Settings &settings) {
   output << "\t-ORB number of scales: " << settings.nLevels_ << endl;
   output << "\t-Initial FAST threshold: " << settings.initThFAST_ << endl;
   output << "\t-Min FAST threshold: " << settings.minThFAST_ << endl;
+  output << "\t-ORB extractor threads: " << settings.extractorThreads_ << endl;
+  if (!settings.vExtractorAffinity_.empty()) {
+    output << "\t-ORB extractor CPUs:";
+    for (int cpu : settings.vExtractorAffinity_)
+      output << " " << cpu;
+    output << endl;
+  }
 
   return output;
 }
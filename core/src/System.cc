@@ -187,11 +187,19 @@ System::System(const string &strVocFile, const string &strSettingsFile,
                            sensor_type, settings_, strSequence);
 
   // Initialize the Local Mapping thread and launch
+  int nMappingThreads = 0;
+  if (settings_)
+    nMappingThreads = settings_->mappingThreads();
+  else {
+    node = fsSettings["LocalMapping.nThreads"];
+    if (!node.empty() && node.isInt())
+      nMappingThreads = static_cast<int>(node);
+  }
   mpLocalMapper = new LocalMapping(
       this, mpAtlas, sensor_type == MONOCULAR || sensor_type == IMU_MONOCULAR,
       sensor_type == IMU_MONOCULAR || sensor_type == IMU_STEREO ||
           sensor_type == IMU_RGB_D,
-      strSequence);
+      strSequence, nMappingThreads);
   mptLocalMapping = new thread(&ORB_SLAM3::LocalMapping::Run, mpLocalMapper);
   mpLocalMapper->mInitFr = initFr;
   if (settings_)
@@ -275,9 +283,7 @@ Sophus::SE3f System::TrackStereo(const cv::Mat &imLeft, const cv::Mat &imRight,
       mpLocalMapper->RequestStop();
 
       // Wait until Local Mapping has effectively stopped
-      while (!mpLocalMapper->isStopped()) {
-        usleep(1000);
-      }
+      mpLocalMapper->WaitUntilStopped();
 
       mpTracker->InformOnlyTracking(true);
       mbActivateLocalizationMode = false;
@@ -348,9 +354,7 @@ Sophus::SE3f System::TrackRGBD(const cv::Mat &im, const cv::Mat &depthmap,
       mpLocalMapper->RequestStop();
 
       // Wait until Local Mapping has effectively stopped
-      while (!mpLocalMapper->isStopped()) {
-        usleep(1000);
-      }
+      mpLocalMapper->WaitUntilStopped();
 
       mpTracker->InformOnlyTracking(true);
       mbActivateLocalizationMode = false;
@@ -421,9 +425,7 @@ Sophus::SE3f System::TrackMonocular(const cv::Mat &im, const double &timestamp,
       mpLocalMapper->RequestStop();
 
       // Wait until Local Mapping has effectively stopped
-      while (!mpLocalMapper->isStopped()) {
-        usleep(1000);
-      }
+      mpLocalMapper->WaitUntilStopped();
 
       mpTracker->InformOnlyTracking(true);
       mbActivateLocalizationMode = false;
@@ -504,6 +506,14 @@ void System::Shutdown() {
 
   mpLocalMapper->RequestFinish();
   mpLoopCloser->RequestFinish();
+
+  Verbose::Log("Keyframe queues: mapping max depth " +
+                   to_string(mpLocalMapper->MaxKeyframesInQueue()) +
+                   ", loop closing max depth " +
+                   to_string(mpLoopCloser->MaxKeyframesInQueue()) +
+                   ", overflowed " +
+                   to_string(mpLoopCloser->OverflowedKeyframes()),
+               Verbose::VERBOSITY_NORMAL);
   /*if(mpViewer)
   {
       mpViewer->RequestFinish();
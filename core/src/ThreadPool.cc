@@ -0,0 +1,171 @@
+/**
+ * This file is part of ORB-SLAM3
+ *
+ * Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez
+ * Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+ * Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós,
+ * University of Zaragoza.
+ *
+ * ORB-SLAM3 is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ORB-SLAM3. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <memory>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace ORB_SLAM3 {
+
+ThreadPool::ThreadPool(const int nThreads, const vector<int> &vCpus)
+    : mbStop(false) {
+  for (int i = 0; i < nThreads; i++) {
+    mvWorkers.emplace_back(&ThreadPool::Run, this);
+
+    if (!vCpus.empty()) {
+      const int cpu = vCpus[i % vCpus.size()];
+      if (!PinWorker(i, cpu))
+        cerr << "ThreadPool: could not pin worker " << i << " to CPU " << cpu
+             << endl;
+    }
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    unique_lock<mutex> lock(mMutexJobs);
+    mbStop = true;
+  }
+  mcvJobs.notify_all();
+  for (thread &t : mvWorkers)
+    t.join();
+}
+
+bool ThreadPool::PinWorker(const int i, const int cpu) {
+#ifdef __linux__
+  if (cpu < 0 || cpu >= CPU_SETSIZE)
+    return false;
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return pthread_setaffinity_np(mvWorkers[i].native_handle(), sizeof(set),
+                                &set) == 0;
+#else
+  return false;
+#endif
+}
+
+void ThreadPool::Run() {
+  while (true) {
+    function<void()> job;
+    {
+      unique_lock<mutex> lock(mMutexJobs);
+      mcvJobs.wait(lock, [this] { return mbStop || !mqJobs.empty(); });
+      if (mqJobs.empty())
+        return;
+      job = std::move(mqJobs.front());
+      mqJobs.pop_front();
+    }
+    job();
+  }
+}
+
+future<void> ThreadPool::Submit(function<void()> job) {
+  auto task = make_shared<packaged_task<void()>>(std::move(job));
+  future<void> result = task->get_future();
+
+  if (mvWorkers.empty()) {
+    (*task)();
+    return result;
+  }
+
+  {
+    unique_lock<mutex> lock(mMutexJobs);
+    mqJobs.emplace_back([task] { (*task)(); });
+  }
+  mcvJobs.notify_one();
+  return result;
+}
+
+namespace {
+
+// Shared by the caller and the helpers of one ParallelFor. Helpers may start
+// after the loop is over, so it is reference counted and they only touch the
+// loop body after claiming a valid item.
+struct ParallelForState {
+  atomic<int> next;
+  int end;
+  int nPending;
+  mutex mMutex;
+  condition_variable mcvDone;
+};
+
+void ParallelForWork(ParallelForState &state, const function<void(int)> &f) {
+  int nDone = 0;
+  for (int i = state.next++; i < state.end; i = state.next++) {
+    f(i);
+    nDone++;
+  }
+
+  if (nDone > 0) {
+    unique_lock<mutex> lock(state.mMutex);
+    state.nPending -= nDone;
+    if (state.nPending == 0)
+      state.mcvDone.notify_all();
+  }
+}
+
+} // namespace
+
+void ThreadPool::ParallelFor(const int begin, const int end,
+                             const function<void(int)> &f) {
+  const int n = end - begin;
+  if (n <= 0)
+    return;
+
+  if (mvWorkers.empty() || n == 1) {
+    for (int i = begin; i < end; i++)
+      f(i);
+    return;
+  }
+
+  auto state = make_shared<ParallelForState>();
+  state->next = begin;
+  state->end = end;
+  state->nPending = n;
+
+  const int nHelpers = min(Size(), n - 1);
+  {
+    unique_lock<mutex> lock(mMutexJobs);
+    for (int i = 0; i < nHelpers; i++)
+      mqJobs.emplace_back([state, &f] { ParallelForWork(*state, f); });
+  }
+  if (nHelpers == 1)
+    mcvJobs.notify_one();
+  else
+    mcvJobs.notify_all();
+
+  ParallelForWork(*state, f);
+
+  unique_lock<mutex> lock(state->mMutex);
+  state->mcvDone.wait(lock, [&state] { return state->nPending == 0; });
+}
+
+} // namespace ORB_SLAM3
@@ -38,6 +38,7 @@
 
 #include <iostream>
 
+#include <atomic>
 #include <chrono>
 #include <mutex>
 
@@ -52,11 +53,12 @@ Tracking::Tracking(System *pSys, ORBVocabulary *pVoc, FrameDrawer *pFrameDrawer,
                    const string &_nameSeq)
     : mState(NO_IMAGES_YET), sensor_type(sensor_type), mTrackedFr(0),
       mbStep(false), mbOnlyTracking(false), mbMapUpdated(false), mbVO(false),
-      mpORBVocabulary(pVoc), mpKeyFrameDB(pKFDB), mbReadyToInitialize(false),
-      mpSystem(pSys), mpViewer(NULL), bStepByStep(false),
-      mpFrameDrawer(pFrameDrawer), mpMapDrawer(pMapDrawer), mpAtlas(pAtlas),
-      mnLastRelocFrameId(0), time_recently_lost(5.0), mnInitialFrameId(0),
-      mbCreatedMap(false), mnFirstFrameId(0), mpCamera2(nullptr),
+      mpExtractorPool(nullptr), mpORBVocabulary(pVoc), mpKeyFrameDB(pKFDB),
+      mbReadyToInitialize(false), mpLocalMapCacheMap(NULL), mpSystem(pSys),
+      mpViewer(NULL), bStepByStep(false), mpFrameDrawer(pFrameDrawer),
+      mpMapDrawer(pMapDrawer), mpAtlas(pAtlas), mnLastRelocFrameId(0),
+      time_recently_lost(5.0), mnInitialFrameId(0), mbCreatedMap(false),
+      mnFirstFrameId(0), mpCamera2(nullptr),
       mpLastKeyFrame(static_cast<KeyFrame *>(NULL)) {
   // Load camera parameters from settings file
   if (settings) {
@@ -88,6 +90,12 @@ Tracking::Tracking(System *pSys, ORBVocabulary *pVoc, FrameDrawer *pFrameDrawer,
     if (!b_parse_cam || !b_parse_orb || !b_parse_imu) {
       throw std::runtime_error("Error parsing config file, format not correct");
     }
+
+    // Optional, relocalization runs until done if missing
+    mRelocTimeBudget = 0;
+    cv::FileNode node = fSettings["System.relocTimeBudget"];
+    if (!node.empty() && (node.isReal() || node.isInt()))
+      mRelocTimeBudget = node.real();
   }
 
   initID = 0;
@@ -512,6 +520,7 @@ void Tracking::PrintTimeStats() {
 
 Tracking::~Tracking() {
   // f_track_stats.close();
+  delete mpExtractorPool;
 }
 
 void Tracking::newParameterLoader(Settings *settings) {
@@ -568,6 +577,7 @@ void Tracking::newParameterLoader(Settings *settings) {
   mMinFrames = 0;
   mMaxFrames = settings->fps();
   mbRGB = settings->rgb();
+  mRelocTimeBudget = settings->relocTimeBudget();
 
   // ORB parameters
   int nFeatures = settings->nFeatures();
@@ -575,17 +585,30 @@ void Tracking::newParameterLoader(Settings *settings) {
   int fIniThFAST = settings->initThFAST();
   int fMinThFAST = settings->minThFAST();
   float fScaleFactor = settings->scaleFactor();
+  int nExtractorThreads = settings->extractorThreads();
+
+  // Stereo needs at least one worker to extract both images at once
+  if ((sensor_type & SensorType::CAMERA_MASK) == SensorType::STEREO)
+    nExtractorThreads = max(nExtractorThreads, 1);
+
+  mpExtractorPool =
+      new ThreadPool(nExtractorThreads, settings->extractorAffinity());
 
   mpORBextractorLeft = new ORBextractor(nFeatures, fScaleFactor, nLevels,
                                         fIniThFAST, fMinThFAST);
+  mpORBextractorLeft->SetThreadPool(mpExtractorPool);
 
-  if ((sensor_type & SensorType::CAMERA_MASK) == SensorType::STEREO)
+  if ((sensor_type & SensorType::CAMERA_MASK) == SensorType::STEREO) {
     mpORBextractorRight = new ORBextractor(nFeatures, fScaleFactor, nLevels,
                                            fIniThFAST, fMinThFAST);
+    mpORBextractorRight->SetThreadPool(mpExtractorPool);
+  }
 
-  if ((sensor_type & SensorType::CAMERA_MASK) == SensorType::MONOCULAR)
+  if ((sensor_type & SensorType::CAMERA_MASK) == SensorType::MONOCULAR) {
     mpIniORBextractor = new ORBextractor(5 * nFeatures, fScaleFactor, nLevels,
                                          fIniThFAST, fMinThFAST);
+    mpIniORBextractor->SetThreadPool(mpExtractorPool);
+  }
 
   // IMU parameters
   Sophus::SE3f Tbc = settings->Tbc();
@@ -1170,20 +1193,42 @@ bool Tracking::ParseORBParamFile(cv::FileStorage &fSettings) {
     b_miss_params = true;
   }
 
+  // Optional, extract on the tracking thread if missing
+  int nExtractorThreads = 0;
+  node = fSettings["ORBextractor.nThreads"];
+  if (!node.empty() && node.isInt())
+    nExtractorThreads = node.operator int();
+
+  vector<int> vExtractorAffinity;
+  node = fSettings["ORBextractor.cpuAffinity"];
+  if (node.isSeq())
+    node >> vExtractorAffinity;
+
   if (b_miss_params) {
     return false;
   }
 
+  // Stereo needs at least one worker to extract both images at once
+  if ((sensor_type & SensorType::CAMERA_MASK) == SensorType::STEREO)
+    nExtractorThreads = max(nExtractorThreads, 1);
+
+  mpExtractorPool = new ThreadPool(nExtractorThreads, vExtractorAffinity);
+
   mpORBextractorLeft = new ORBextractor(nFeatures, fScaleFactor, nLevels,
                                         fIniThFAST, fMinThFAST);
+  mpORBextractorLeft->SetThreadPool(mpExtractorPool);
 
-  if ((sensor_type & SensorType::CAMERA_MASK) == SensorType::STEREO)
+  if ((sensor_type & SensorType::CAMERA_MASK) == SensorType::STEREO) {
     mpORBextractorRight = new ORBextractor(nFeatures, fScaleFactor, nLevels,
                                            fIniThFAST, fMinThFAST);
+    mpORBextractorRight->SetThreadPool(mpExtractorPool);
+  }
 
-  if ((sensor_type & SensorType::CAMERA_MASK) == SensorType::MONOCULAR)
+  if ((sensor_type & SensorType::CAMERA_MASK) == SensorType::MONOCULAR) {
     mpIniORBextractor = new ORBextractor(5 * nFeatures, fScaleFactor, nLevels,
                                          fIniThFAST, fMinThFAST);
+    mpIniORBextractor->SetThreadPool(mpExtractorPool);
+  }
 
   cerr << endl << "ORB Extractor Parameters: " << endl;
   cerr << "- Number of Features: " << nFeatures << endl;
@@ -1191,6 +1236,7 @@ bool Tracking::ParseORBParamFile(cv::FileStorage &fSettings) {
   cerr << "- Scale Factor: " << fScaleFactor << endl;
   cerr << "- Initial Fast Threshold: " << fIniThFAST << endl;
   cerr << "- Minimum Fast Threshold: " << fMinThFAST << endl;
+  cerr << "- Extractor Threads: " << nExtractorThreads << endl;
 
   return true;
 }
@@ -2812,6 +2858,21 @@ bool Tracking::TrackLocalMap() {
 }
 
 bool Tracking::NeedNewKeyFrame() {
+  // If Local Mapping is freezed by a Loop Closure do not insert keyframes
+  if (mpLocalMapper->isStopped() || mpLocalMapper->stopRequested()) {
+    /*if(sensor_type == SensorType::MONOCULAR)
+    {
+        cerr << "NeedNewKeyFrame: localmap stopped" << endl;
+    }*/
+    return false;
+  }
+
+  // Backpressure: Local Mapping is too far behind to take another keyframe.
+  // Checked first, so neither the periodic keyframes before IMU
+  // initialization can fill the queue.
+  if (mpLocalMapper->KeyframeQueueFull())
+    return false;
+
   if ((sensor_type & SensorType::USE_IMU) &&
       !mpAtlas->GetCurrentMap()->isImuInitialized()) {
     if (sensor_type == SensorType::IMU_MONOCULAR &&
@@ -2828,15 +2889,6 @@ bool Tracking::NeedNewKeyFrame() {
   if (mbOnlyTracking)
     return false;
 
-  // If Local Mapping is freezed by a Loop Closure do not insert keyframes
-  if (mpLocalMapper->isStopped() || mpLocalMapper->stopRequested()) {
-    /*if(sensor_type == SensorType::MONOCULAR)
-    {
-        cerr << "NeedNewKeyFrame: localmap stopped" << endl;
-    }*/
-    return false;
-  }
-
   const int nKFs = mpAtlas->KeyFramesInMap();
 
   // Do not insert keyframes if not enough frames have passed from last
@@ -3114,22 +3166,101 @@ void Tracking::SearchLocalPoints() {
     }
   }
 
-  int nToMatch = 0;
+  // Project points in frame and check its visibility. The geometry of the
+  // whole local map is tested at once, then the tracking data of each point
+  // is filled as Frame::isInFrustum does.
+  const Sophus::SE3f Tcw = mCurrentFrame.GetPose();
+  const Eigen::Matrix3f Rcw = Tcw.rotationMatrix();
+  const Eigen::Vector3f tcw = Tcw.translation();
+  const Eigen::Vector3f Ow = mCurrentFrame.GetOw();
+  const float viewingCosLimit = 0.5;
 
-  // Project points in frame and check its visibility
-  for (vector<MapPoint *>::iterator vit = mvpLocalMapPoints.begin(),
-                                    vend = mvpLocalMapPoints.end();
-       vit != vend; vit++) {
-    MapPoint *pMP = *vit;
+  mLocalMapPoints.Build(mvpLocalMapPoints);
+  mLocalMapPoints.Project(Rcw, tcw, Ow, mCurrentFrame.mpCamera, Frame::mnMinX,
+                          Frame::mnMaxX, Frame::mnMinY, Frame::mnMaxY,
+                          viewingCosLimit, mLocalMapView);
+
+  const bool bStereo = mCurrentFrame.Nleft != -1;
+  if (bStereo) {
+    const Sophus::SE3f Trl = mCurrentFrame.GetRelativePoseTrl();
+    const Eigen::Matrix3f Rrl = Trl.rotationMatrix();
+    const Eigen::Vector3f Or =
+        mCurrentFrame.GetRwc() *
+            mCurrentFrame.GetRelativePoseTlr().translation() +
+        Ow;
+    mLocalMapPoints.Project(Rrl * Rcw, Rrl * tcw + Trl.translation(), Or,
+                            mCurrentFrame.mpCamera2, Frame::mnMinX,
+                            Frame::mnMaxX, Frame::mnMinY, Frame::mnMaxY,
+                            viewingCosLimit, mLocalMapViewR);
+  }
+
+  const LocalMapPoints::View &L = mLocalMapView;
+  const LocalMapPoints::View &R = mLocalMapViewR;
+
+  // Only the visible points are handed to the matcher
+  vector<MapPoint *> vpToMatch;
+  vpToMatch.reserve(mvpLocalMapPoints.size());
+
+  for (size_t i = 0; i < mvpLocalMapPoints.size(); i++) {
+    MapPoint *pMP = mvpLocalMapPoints[i];
 
     if (pMP->mnLastFrameSeen == mCurrentFrame.mnId)
       continue;
     if (pMP->isBad())
       continue;
-    // Project (this fills MapPoint variables for matching)
-    if (mCurrentFrame.isInFrustum(pMP, 0.5)) {
+
+    // Fill MapPoint variables for matching
+    bool bInView;
+    if (!bStereo) {
+      pMP->mbTrackInView = false;
+      pMP->mTrackProjX = -1;
+      pMP->mTrackProjY = -1;
+
+      if (L.vbInImage[i]) {
+        pMP->mTrackProjX = L.vU[i];
+        pMP->mTrackProjY = L.vV[i];
+      }
+
+      if (L.vbVisible[i]) {
+        pMP->mbTrackInView = true;
+        pMP->mTrackProjXR = L.vU[i] - mCurrentFrame.mbf * (1.0f / L.vZ[i]);
+        pMP->mTrackDepth = L.vDepth[i];
+        pMP->mnTrackScaleLevel =
+            mLocalMapPoints.PredictScale(i, L.vDist[i], mCurrentFrame);
+        pMP->mTrackViewCos = L.vViewCos[i];
+      }
+
+      bInView = pMP->mbTrackInView;
+    } else {
+      pMP->mbTrackInView = L.vbVisible[i];
+      pMP->mbTrackInViewR = R.vbVisible[i];
+      pMP->mnTrackScaleLevel = -1;
+      pMP->mnTrackScaleLevelR = -1;
+
+      if (L.vbVisible[i]) {
+        pMP->mTrackProjX = L.vU[i];
+        pMP->mTrackProjY = L.vV[i];
+        pMP->mnTrackScaleLevel =
+            mLocalMapPoints.PredictScale(i, L.vDist[i], mCurrentFrame);
+        pMP->mTrackViewCos = L.vViewCos[i];
+        pMP->mTrackDepth = L.vDepth[i];
+      }
+
+      if (R.vbVisible[i]) {
+        pMP->mTrackProjXR = R.vU[i];
+        pMP->mTrackProjYR = R.vV[i];
+        pMP->mnTrackScaleLevelR =
+            mLocalMapPoints.PredictScale(i, R.vDist[i], mCurrentFrame);
+        pMP->mTrackViewCosR = R.vViewCos[i];
+        pMP->mTrackDepthR = R.vDepth[i];
+      }
+
+      bInView = pMP->mbTrackInView || pMP->mbTrackInViewR;
+    }
+
+    if (bInView) {
       pMP->IncreaseVisible();
-      nToMatch++;
+      vpToMatch.push_back(pMP);
     }
     if (pMP->mbTrackInView) {
       mCurrentFrame.mmProjectPoints[pMP->mnId] =
@@ -3137,7 +3268,7 @@ void Tracking::SearchLocalPoints() {
     }
   }
 
-  if (nToMatch > 0) {
+  if (!vpToMatch.empty()) {
     ORBmatcher matcher(0.8);
     int th = 1;
     if (sensor_type == SensorType::RGB_D ||
@@ -3161,9 +3292,10 @@ void Tracking::SearchLocalPoints() {
         mState == RECENTLY_LOST) // Lost for less than 1 second
       th = 15;                   // 15
 
-    int matches = matcher.SearchByProjection(mCurrentFrame, mvpLocalMapPoints,
-                                             th, mpLocalMapper->mbFarPoints,
-                                             mpLocalMapper->mThFarPoints);
+    int matches =
+        matcher.SearchByProjection(mCurrentFrame, vpToMatch, th,
+                                   mpLocalMapper->mbFarPoints,
+                                   mpLocalMapper->mThFarPoints);
   }
 }
 
@@ -3177,33 +3309,8 @@ void Tracking::UpdateLocalMap() {
 }
 
 void Tracking::UpdateLocalPoints() {
-  mvpLocalMapPoints.clear();
-
-  int count_pts = 0;
-
-  for (vector<KeyFrame *>::const_reverse_iterator
-           itKF = mvpLocalKeyFrames.rbegin(),
-           itEndKF = mvpLocalKeyFrames.rend();
-       itKF != itEndKF; ++itKF) {
-    KeyFrame *pKF = *itKF;
-    const vector<MapPoint *> vpMPs = pKF->GetMapPointMatches();
-
-    for (vector<MapPoint *>::const_iterator itMP = vpMPs.begin(),
-                                            itEndMP = vpMPs.end();
-         itMP != itEndMP; itMP++) {
-
-      MapPoint *pMP = *itMP;
-      if (!pMP)
-        continue;
-      if (pMP->mnTrackReferenceForFrame == mCurrentFrame.mnId)
-        continue;
-      if (!pMP->isBad()) {
-        count_pts++;
-        mvpLocalMapPoints.push_back(pMP);
-        pMP->mnTrackReferenceForFrame = mCurrentFrame.mnId;
-      }
-    }
-  }
+  mLocalMapCache.CollectMapPoints(mvpLocalKeyFrames, mCurrentFrame.mnId,
+                                  mvpLocalMapPoints);
 }
 
 #define SKIP_NULL(ptr)                                                         \
@@ -3213,7 +3320,6 @@ void Tracking::UpdateLocalPoints() {
 void Tracking::UpdateLocalKeyFrames() {
   // Each map point vote for the keyframes in which it has been observed
   Frame *frame = nullptr;
-  map<KeyFrame *, int> key_frame_counter;
   if (!mpAtlas->isImuInitialized() ||
       (mCurrentFrame.mnId < mnLastRelocFrameId + 2))
     frame = &mCurrentFrame;
@@ -3221,27 +3327,33 @@ void Tracking::UpdateLocalKeyFrames() {
     frame = &mLastFrame;
 
   for (auto &map_point : frame->mvpMapPoints) {
-    if (map_point != nullptr && !map_point->isBad()) {
-      const auto observations = map_point->GetObservations();
-      for (const auto ob : observations)
-        key_frame_counter[ob.first]++;
-    } else {
+    if (map_point != nullptr && map_point->isBad())
       map_point = nullptr;
-    }
   }
 
+  // Votes are updated from the points that changed since the last frame
+  Map *current_map = mpAtlas->GetCurrentMap();
+  if (current_map != mpLocalMapCacheMap) {
+    mLocalMapCache.Clear();
+    mpLocalMapCacheMap = current_map;
+  }
+  mLocalMapCache.UpdateVotes(frame->mvpMapPoints);
+  const auto &voted_key_frames = mLocalMapCache.GetVotedKeyFrames();
+
   mvpLocalKeyFrames.clear();
-  mvpLocalKeyFrames.reserve(3 * key_frame_counter.size());
+  mvpLocalKeyFrames.reserve(3 * voted_key_frames.size());
 
   // All keyframes that observe a map point are included in the local map.
   // Also check which keyframe shares most points (best keyframe).
   KeyFrame *best_key_frame = static_cast<KeyFrame *>(nullptr);
-  for (const auto &it : key_frame_counter) {
-    auto &key_frame = *it.first;
-    auto &count = it.second;
-    SKIP_NULL(&key_frame);
-    if (best_key_frame == nullptr || count > key_frame_counter[best_key_frame])
+  int best_count = 0;
+  for (auto key_frame_ptr : voted_key_frames) {
+    auto &key_frame = *key_frame_ptr;
+    const int count = mLocalMapCache.GetVotes(key_frame_ptr);
+    if (best_key_frame == nullptr || count > best_count) {
       best_key_frame = &key_frame;
+      best_count = count;
+    }
     mvpLocalKeyFrames.push_back(&key_frame);
     key_frame.mnTrackReferenceForFrame = mCurrentFrame.mnId;
   }
@@ -3316,8 +3428,8 @@ bool Tracking::Relocalization() {
   // Track Lost: Query KeyFrame Database for keyframe candidates for
   // relocalisation
   vector<KeyFrame *> vpCandidateKFs =
-      mpKeyFrameDB->DetectRelocalizationCandidates(&mCurrentFrame,
-                                                   mpAtlas->GetCurrentMap());
+      mpKeyFrameDB->DetectRelocalizationCandidates(
+          &mCurrentFrame, mpAtlas->GetCurrentMap(), &mRelocQuery);
 
   if (vpCandidateKFs.empty()) {
     Verbose::Log("There are not candidates", Verbose::VERBOSITY_NORMAL);
@@ -3326,143 +3438,137 @@ bool Tracking::Relocalization() {
 
   const int nKFs = vpCandidateKFs.size();
 
-  // We perform first an ORB matching with each candidate
-  // If enough matches are found we setup a PnP solver
-  ORBmatcher matcher(0.75, true);
+  // Candidates are tried at once on the extractor workers, idle while the
+  // tracking thread relocalizes. Each one works on its own copy of the frame
+  // and the first pose supported by enough inliers stops the rest, as does
+  // running out of time budget.
+  const chrono::steady_clock::time_point deadline =
+      chrono::steady_clock::now() +
+      chrono::duration_cast<chrono::steady_clock::duration>(
+          chrono::duration<float, milli>(mRelocTimeBudget));
+  atomic<bool> bMatch(false);
+  const function<bool()> bCancelled = [&]() {
+    return bMatch.load() ||
+           (mRelocTimeBudget > 0 && chrono::steady_clock::now() > deadline);
+  };
+
+  Frame relocFrame;
+  mpExtractorPool->ParallelFor(0, nKFs, [&](int i) {
+    KeyFrame *pKF = vpCandidateKFs[i];
+    if (pKF->isBad() || bCancelled())
+      return;
 
-  vector<MLPnPsolver *> vpMLPnPsolvers;
-  vpMLPnPsolvers.resize(nKFs);
+    Frame frame(mCurrentFrame);
+    if (!RelocalizeWithCandidate(pKF, frame, bCancelled))
+      return;
 
-  vector<vector<MapPoint *>> vvpMapPointMatches;
-  vvpMapPointMatches.resize(nKFs);
+    bool bFirst = false;
+    if (bMatch.compare_exchange_strong(bFirst, true))
+      relocFrame = Frame(frame);
+  });
 
-  vector<bool> vbDiscarded;
-  vbDiscarded.resize(nKFs);
+  if (!bMatch) {
+    return false;
+  } else {
+    mCurrentFrame = Frame(relocFrame);
+    mnLastRelocFrameId = mCurrentFrame.mnId;
+    cerr << "Relocalized!!" << endl;
+    return true;
+  }
+}
 
-  int nCandidates = 0;
+bool Tracking::RelocalizeWithCandidate(KeyFrame *pKF, Frame &frame,
+                                       const function<bool()> &bCancelled) {
+  // We perform first an ORB matching with the candidate
+  // If enough matches are found we setup a PnP solver
+  ORBmatcher matcher(0.75, true);
 
-  for (int i = 0; i < nKFs; i++) {
-    KeyFrame *pKF = vpCandidateKFs[i];
-    if (pKF->isBad())
-      vbDiscarded[i] = true;
-    else {
-      int nmatches =
-          matcher.SearchByBoW(pKF, mCurrentFrame, vvpMapPointMatches[i]);
-      if (nmatches < 15) {
-        vbDiscarded[i] = true;
-        continue;
-      } else {
-        MLPnPsolver *pSolver =
-            new MLPnPsolver(mCurrentFrame, vvpMapPointMatches[i]);
-        pSolver->SetRansacParameters(
-            0.99, 10, 300, 6, 0.5,
-            5.991); // This solver needs at least 6 points
-        vpMLPnPsolvers[i] = pSolver;
-        nCandidates++;
-      }
-    }
-  }
+  vector<MapPoint *> vpMapPointMatches;
+  int nmatches = matcher.SearchByBoW(pKF, frame, vpMapPointMatches);
+  if (nmatches < 15)
+    return false;
+
+  MLPnPsolver solver(frame, vpMapPointMatches);
+  solver.SetRansacParameters(0.99, 10, 300, 6, 0.5,
+                             5.991); // This solver needs at least 6 points
 
-  // Alternatively perform some iterations of P4P RANSAC
+  // Perform some iterations of P4P RANSAC at a time
   // Until we found a camera pose supported by enough inliers
-  bool bMatch = false;
   ORBmatcher matcher2(0.9, true);
+  bool bNoMore = false;
 
-  while (nCandidates > 0 && !bMatch) {
-    for (int i = 0; i < nKFs; i++) {
-      if (vbDiscarded[i])
-        continue;
+  while (!bNoMore && !bCancelled()) {
+    // Perform 5 Ransac Iterations
+    vector<bool> vbInliers;
+    int nInliers;
+    Eigen::Matrix4f eigTcw;
+    bool bTcw = solver.iterate(5, bNoMore, vbInliers, nInliers, eigTcw);
 
-      // Perform 5 Ransac Iterations
-      vector<bool> vbInliers;
-      int nInliers;
-      bool bNoMore;
+    // If a Camera Pose is computed, optimize
+    if (!bTcw)
+      continue;
 
-      MLPnPsolver *pSolver = vpMLPnPsolvers[i];
-      Eigen::Matrix4f eigTcw;
-      bool bTcw = pSolver->iterate(5, bNoMore, vbInliers, nInliers, eigTcw);
+    Sophus::SE3f Tcw(eigTcw);
+    frame.SetPose(Tcw);
 
-      // If Ransac reachs max. iterations discard keyframe
-      if (bNoMore) {
-        vbDiscarded[i] = true;
-        nCandidates--;
-      }
+    set<MapPoint *> sFound;
 
-      // If a Camera Pose is computed, optimize
-      if (bTcw) {
-        Sophus::SE3f Tcw(eigTcw);
-        mCurrentFrame.SetPose(Tcw);
-        // Tcw.copyTo(mCurrentFrame.mTcw);
+    const int np = vbInliers.size();
 
-        set<MapPoint *> sFound;
+    for (int j = 0; j < np; j++) {
+      if (vbInliers[j]) {
+        frame.mvpMapPoints[j] = vpMapPointMatches[j];
+        sFound.insert(vpMapPointMatches[j]);
+      } else
+        frame.mvpMapPoints[j] = NULL;
+    }
 
-        const int np = vbInliers.size();
+    int nGood = Optimizer::PoseOptimization(&frame);
 
-        for (int j = 0; j < np; j++) {
-          if (vbInliers[j]) {
-            mCurrentFrame.mvpMapPoints[j] = vvpMapPointMatches[i][j];
-            sFound.insert(vvpMapPointMatches[i][j]);
-          } else
-            mCurrentFrame.mvpMapPoints[j] = NULL;
-        }
+    if (nGood < 10)
+      continue;
 
-        int nGood = Optimizer::PoseOptimization(&mCurrentFrame);
-
-        if (nGood < 10)
-          continue;
-
-        for (int io = 0; io < mCurrentFrame.N; io++)
-          if (mCurrentFrame.mvbOutlier[io])
-            mCurrentFrame.mvpMapPoints[io] = static_cast<MapPoint *>(NULL);
-
-        // If few inliers, search by projection in a coarse window and optimize
-        // again
-        if (nGood < 50) {
-          int nadditional = matcher2.SearchByProjection(
-              mCurrentFrame, vpCandidateKFs[i], sFound, 10, 100);
-
-          if (nadditional + nGood >= 50) {
-            nGood = Optimizer::PoseOptimization(&mCurrentFrame);
-
-            // If many inliers but still not enough, search by projection again
-            // in a narrower window the camera has been already optimized with
-            // many points
-            if (nGood > 30 && nGood < 50) {
-              sFound.clear();
-              for (int ip = 0; ip < mCurrentFrame.N; ip++)
-                if (mCurrentFrame.mvpMapPoints[ip])
-                  sFound.insert(mCurrentFrame.mvpMapPoints[ip]);
-              nadditional = matcher2.SearchByProjection(
-                  mCurrentFrame, vpCandidateKFs[i], sFound, 3, 64);
-
-              // Final optimization
-              if (nGood + nadditional >= 50) {
-                nGood = Optimizer::PoseOptimization(&mCurrentFrame);
-
-                for (int io = 0; io < mCurrentFrame.N; io++)
-                  if (mCurrentFrame.mvbOutlier[io])
-                    mCurrentFrame.mvpMapPoints[io] = NULL;
-              }
-            }
+    for (int io = 0; io < frame.N; io++)
+      if (frame.mvbOutlier[io])
+        frame.mvpMapPoints[io] = static_cast<MapPoint *>(NULL);
+
+    // If few inliers, search by projection in a coarse window and optimize
+    // again
+    if (nGood < 50) {
+      int nadditional =
+          matcher2.SearchByProjection(frame, pKF, sFound, 10, 100);
+
+      if (nadditional + nGood >= 50) {
+        nGood = Optimizer::PoseOptimization(&frame);
+
+        // If many inliers but still not enough, search by projection again
+        // in a narrower window the camera has been already optimized with
+        // many points
+        if (nGood > 30 && nGood < 50) {
+          sFound.clear();
+          for (int ip = 0; ip < frame.N; ip++)
+            if (frame.mvpMapPoints[ip])
+              sFound.insert(frame.mvpMapPoints[ip]);
+          nadditional = matcher2.SearchByProjection(frame, pKF, sFound, 3, 64);
+
+          // Final optimization
+          if (nGood + nadditional >= 50) {
+            nGood = Optimizer::PoseOptimization(&frame);
+
+            for (int io = 0; io < frame.N; io++)
+              if (frame.mvbOutlier[io])
+                frame.mvpMapPoints[io] = NULL;
           }
         }
-
-        // If the pose is supported by enough inliers stop ransacs and continue
-        if (nGood >= 50) {
-          bMatch = true;
-          break;
-        }
       }
     }
-  }
 
-  if (!bMatch) {
-    return false;
-  } else {
-    mnLastRelocFrameId = mCurrentFrame.mnId;
-    cerr << "Relocalized!!" << endl;
-    return true;
+    // If the pose is supported by enough inliers stop ransacs and continue
+    if (nGood >= 50)
+      return true;
   }
+
+  return false;
 }
 
 void Tracking::Reset(bool bLocMap) {
@@ -3470,8 +3576,7 @@ void Tracking::Reset(bool bLocMap) {
 
   if (mpViewer) {
     mpViewer->RequestStop();
-    while (!mpViewer->isStopped())
-      usleep(3000);
+    mpViewer->WaitUntilStopped();
   }
 
   // Reset Local Mapping
@@ -3493,6 +3598,8 @@ void Tracking::Reset(bool bLocMap) {
 
   // Clear Map (this erase MapPoints and KeyFrames)
   mpAtlas->clearAtlas();
+  mLocalMapCache.Clear();
+  mpLocalMapCacheMap = static_cast<Map *>(NULL);
   mpAtlas->CreateNewMap();
   if (sensor_type & SensorType::USE_IMU)
     mpAtlas->SetInertialSensor();
@@ -3526,8 +3633,7 @@ void Tracking::ResetActiveMap(bool bLocMap) {
   Verbose::Log("Active map Reseting", Verbose::VERBOSITY_NORMAL);
   if (mpViewer) {
     mpViewer->RequestStop();
-    while (!mpViewer->isStopped())
-      usleep(3000);
+    mpViewer->WaitUntilStopped();
   }
 
   Map *pMap = mpAtlas->GetCurrentMap();
@@ -3550,6 +3656,8 @@ void Tracking::ResetActiveMap(bool bLocMap) {
 
   // Clear Map (this erase MapPoints and KeyFrames)
   mpAtlas->clearMap();
+  mLocalMapCache.Clear();
+  mpLocalMapCacheMap = static_cast<Map *>(NULL);
 
   // KeyFrame::nNextId = mpAtlas->GetLastInitKFid();
   // Frame::nNextId = mnLastInitFrameId;
@@ -349,9 +349,8 @@ void Viewer::Run() {
     }
 
     if (Stop()) {
-      while (isStopped()) {
-        usleep(3000);
-      }
+      unique_lock<mutex> lock(mMutexStop);
+      mcvStop.wait(lock, [this] { return !mbStopped; });
     }
 
     if (CheckFinish())
@@ -392,6 +391,11 @@ bool Viewer::isStopped() {
   return mbStopped;
 }
 
+void Viewer::WaitUntilStopped() {
+  unique_lock<mutex> lock(mMutexStop);
+  mcvStop.wait(lock, [this] { return mbStopped; });
+}
+
 bool Viewer::Stop() {
   unique_lock<mutex> lock(mMutexStop);
   unique_lock<mutex> lock2(mMutexFinish);
@@ -401,6 +405,7 @@ bool Viewer::Stop() {
   else if (mbStopRequested) {
     mbStopped = true;
     mbStopRequested = false;
+    mcvStop.notify_all();
     return true;
   }
 
@@ -410,6 +415,7 @@ bool Viewer::Stop() {
 void Viewer::Release() {
   unique_lock<mutex> lock(mMutexStop);
   mbStopped = false;
+  mcvStop.notify_all();
 }
 
 /*void Viewer::SetTrackingPause()
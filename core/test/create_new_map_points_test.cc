@@ -0,0 +1,319 @@
+/**
+ * This file is part of ORB-SLAM3
+ *
+ * Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez
+ * Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+ * Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós,
+ * University of Zaragoza.
+ *
+ * ORB-SLAM3 is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ORB-SLAM3. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// LocalMapping::CreateNewMapPoints with one task per neighbour keyframe
+// against the serial loop it runs without worker threads. A current keyframe
+// and six covisible ones observe a synthetic scene; several neighbours see
+// most points, some features of the current keyframe already have a point
+// and some pairs of its features match the same feature of a neighbour. The
+// points created, their positions and the keyframe slots they fill must be
+// the same for every thread count.
+
+#include "Atlas.h"
+#include "CameraModels/Pinhole.h"
+#include "Frame.h"
+#include "KeyFrame.h"
+#include "LocalMapping.h"
+#include "MapPoint.h"
+
+#include <opencv2/core/core.hpp>
+
+#include <cstdio>
+#include <random>
+
+using namespace std;
+using namespace ORB_SLAM3;
+
+namespace {
+
+const float fx = 450, fy = 450, cx = 320, cy = 240, bf = 45;
+const int WIDTH = 640, HEIGHT = 480;
+const int N_KEYFRAMES = 7; // the current one and its neighbours
+
+struct Scene {
+  vector<Eigen::Vector3f> vXw;
+  vector<cv::Mat> vDescriptors;
+  vector<Sophus::SE3f> vTcw;
+};
+
+Scene MakeScene(const unsigned int seed) {
+  mt19937 rng(seed);
+  uniform_real_distribution<float> uniform(-1.f, 1.f);
+  uniform_int_distribution<int> byte(0, 255);
+
+  Scene s;
+  for (int j = 0; j < 400; j++) {
+    s.vXw.push_back(Eigen::Vector3f(3.f * uniform(rng), 2.f * uniform(rng),
+                                    9.f + 3.f * uniform(rng)));
+    cv::Mat d(1, 32, CV_8U);
+    for (int b = 0; b < 32; b++)
+      d.at<uchar>(b) = (uchar)byte(rng);
+    s.vDescriptors.push_back(d);
+  }
+
+  // Cameras along a line looking at the scene, the current one in the middle
+  for (int k = 0; k < N_KEYFRAMES; k++) {
+    const float offset = k == 0 ? 0.f : (k % 2 ? 1.f : -1.f) * (k + 1) / 2;
+    const Eigen::Vector3f Ow(0.35f * offset, 0.05f * uniform(rng),
+                             0.1f * uniform(rng));
+    const Sophus::SO3f Rwc = Sophus::SO3f::exp(
+        Eigen::Vector3f(0.01f * uniform(rng), 0.03f * uniform(rng), 0.f));
+    s.vTcw.push_back(Sophus::SE3f(Rwc, Ow).inverse());
+  }
+  return s;
+}
+
+// Keyframe k observes the points it sees with a probability of 0.85, with
+// pixel noise and a few flipped descriptor bits. One in three observations is
+// stereo. In the current keyframe (k = 0) one point in fifteen is detected
+// twice, one pixel apart.
+KeyFrame *MakeKeyFrame(const Scene &s, const int k, GeometricCamera *pCamera,
+                       Map *pMap, vector<int> &vPointOfFeature) {
+  mt19937 rng(1000 * k + 7);
+  normal_distribution<float> noise(0.f, 0.3f);
+  bernoulli_distribution seen(0.85);
+  uniform_int_distribution<int> bit(0, 255);
+
+  Frame F;
+  F.mnId = k;
+  F.mTimeStamp = k;
+  F.mpORBvocabulary = NULL;
+  F.mpCamera = pCamera;
+  F.mpCamera2 = NULL;
+  F.Nleft = -1;
+  F.Nright = -1;
+  F.mbf = bf;
+  F.mb = bf / fx;
+  F.mThDepth = 40 * F.mb;
+  F.mK_ << fx, 0.f, cx, 0.f, fy, cy, 0.f, 0.f, 1.f;
+  F.mnDataset = 0;
+
+  F.mnScaleLevels = 8;
+  F.mfScaleFactor = 1.2f;
+  F.mfLogScaleFactor = log(F.mfScaleFactor);
+  F.mvScaleFactors.resize(F.mnScaleLevels);
+  F.mvInvScaleFactors.resize(F.mnScaleLevels);
+  F.mvLevelSigma2.resize(F.mnScaleLevels);
+  F.mvInvLevelSigma2.resize(F.mnScaleLevels);
+  for (int l = 0; l < F.mnScaleLevels; l++) {
+    F.mvScaleFactors[l] = pow(F.mfScaleFactor, l);
+    F.mvInvScaleFactors[l] = 1.f / F.mvScaleFactors[l];
+    F.mvLevelSigma2[l] = F.mvScaleFactors[l] * F.mvScaleFactors[l];
+    F.mvInvLevelSigma2[l] = 1.f / F.mvLevelSigma2[l];
+  }
+
+  vector<cv::Mat> vDescriptors;
+  vPointOfFeature.clear();
+  for (size_t j = 0; j < s.vXw.size(); j++) {
+    const Eigen::Vector3f Xc = s.vTcw[k] * s.vXw[j];
+    const float u = fx * Xc(0) / Xc(2) + cx;
+    const float v = fy * Xc(1) / Xc(2) + cy;
+    if (Xc(2) <= 0 || u < 20 || u > WIDTH - 20 || v < 20 || v > HEIGHT - 20)
+      continue;
+    if (!seen(rng))
+      continue;
+
+    const int nCopies = (k == 0 && j % 15 == 0) ? 2 : 1;
+    for (int c = 0; c < nCopies; c++) {
+      cv::KeyPoint kp;
+      kp.pt = cv::Point2f(u + c + noise(rng), v + noise(rng));
+      kp.octave = 0;
+      kp.angle = 0.f;
+      kp.size = 31.f;
+      kp.response = 1.f;
+      F.mvKeys.push_back(kp);
+
+      const bool bStereo = (j + k + c) % 3 == 0;
+      F.mvuRight.push_back(bStereo ? kp.pt.x - bf / Xc(2) : -1.f);
+      F.mvDepth.push_back(bStereo ? Xc(2) : -1.f);
+
+      cv::Mat d = s.vDescriptors[j].clone();
+      for (int b = 0; b < 3; b++) {
+        const int flip = bit(rng);
+        d.at<uchar>(flip / 8) ^= (uchar)(1 << (flip % 8));
+      }
+      vDescriptors.push_back(d);
+
+      // The same vocabulary node for every observation of a point
+      F.mFeatVec[j % 8].push_back(vPointOfFeature.size());
+      vPointOfFeature.push_back(j);
+    }
+  }
+
+  F.N = F.mvKeys.size();
+  F.mvKeysUn = F.mvKeys;
+  F.mvpMapPoints = vector<MapPoint *>(F.N, static_cast<MapPoint *>(NULL));
+  cv::Mat descriptors;
+  cv::vconcat(vDescriptors, descriptors);
+  F.mDescriptors = descriptors;
+  F.mGrid.Build(F.mvKeysUn, 0.f, 0.f, Frame::mfGridElementWidthInv,
+                Frame::mfGridElementHeightInv, FRAME_GRID_COLS,
+                FRAME_GRID_ROWS);
+  F.SetPose(s.vTcw[k]);
+
+  return new KeyFrame(F, pMap, NULL);
+}
+
+// Gives access to the stage under test
+class LocalMappingProbe : public LocalMapping {
+public:
+  LocalMappingProbe(Atlas *pAtlas, const int nThreads)
+      : LocalMapping(NULL, pAtlas, false, false, string(), nThreads) {
+    mbFarPoints = false;
+    mThFarPoints = 0;
+  }
+
+  list<MapPoint *> CreateNewMapPoints(KeyFrame *pKF) {
+    mpCurrentKeyFrame = pKF;
+    mlpRecentAddedMapPoints.clear();
+    LocalMapping::CreateNewMapPoints();
+    return mlpRecentAddedMapPoints;
+  }
+};
+
+// What CreateNewMapPoints produced, with keyframes and points as indices
+struct Result {
+  // Per new point, (keyframe, feature) of its observations and its position
+  vector<vector<pair<int, int>>> vObservations;
+  vector<Eigen::Vector3f> vXw;
+  // Per keyframe and feature, index of the new point in the slot, -1 for
+  // none and -2 for a point that existed before
+  vector<vector<int>> vSlots;
+  // Features of a neighbour whose slot went to a later point
+  int nOverwritten;
+};
+
+Result Run(const Scene &s, const int nThreads) {
+  GeometricCamera *pCamera = new Pinhole(vector<float>{fx, fy, cx, cy});
+  Atlas *pAtlas = new Atlas(0);
+  Map *pMap = pAtlas->GetCurrentMap();
+
+  vector<KeyFrame *> vpKFs;
+  vector<int> vPointOfFeature;
+  for (int k = 0; k < N_KEYFRAMES; k++)
+    vpKFs.push_back(MakeKeyFrame(s, k, pCamera, pMap, vPointOfFeature));
+
+  // One in ten features of the current keyframe is already tracked
+  KeyFrame *pKF = vpKFs[0];
+  for (int i = 0; i < pKF->N; i += 10) {
+    MapPoint *pMP = new MapPoint(pKF->GetCameraCenter(), pKF, pMap);
+    pMP->AddObservation(pKF, i);
+    pKF->AddMapPoint(pMP, i);
+    pAtlas->AddMapPoint(pMP);
+  }
+
+  for (int k = 1; k < N_KEYFRAMES; k++)
+    pKF->AddConnection(vpKFs[k], 100 - k);
+
+  LocalMappingProbe localMapping(pAtlas, nThreads);
+  const list<MapPoint *> lpNew = localMapping.CreateNewMapPoints(pKF);
+
+  Result result;
+  map<MapPoint *, int> mIndex;
+  for (MapPoint *pMP : lpNew) {
+    mIndex[pMP] = result.vXw.size();
+    result.vXw.push_back(pMP->GetWorldPos());
+
+    vector<pair<int, int>> vObs;
+    for (const auto &obs : pMP->GetObservations()) {
+      const int k = find(vpKFs.begin(), vpKFs.end(), obs.first) - vpKFs.begin();
+      vObs.push_back(make_pair(k, get<0>(obs.second)));
+    }
+    sort(vObs.begin(), vObs.end());
+    result.vObservations.push_back(vObs);
+  }
+
+  result.nOverwritten = 0;
+  result.vSlots.resize(N_KEYFRAMES);
+  for (int k = 0; k < N_KEYFRAMES; k++) {
+    for (int i = 0; i < vpKFs[k]->N; i++) {
+      MapPoint *pMP = vpKFs[k]->GetMapPoint(i);
+      result.vSlots[k].push_back(!pMP ? -1
+                                 : mIndex.count(pMP) ? mIndex[pMP]
+                                                     : -2);
+    }
+  }
+  for (size_t p = 0; p < result.vObservations.size(); p++) {
+    for (const pair<int, int> &obs : result.vObservations[p])
+      if (result.vSlots[obs.first][obs.second] != (int)p)
+        result.nOverwritten++;
+  }
+
+  return result;
+}
+
+int nFailures = 0;
+
+void Check(const bool bOk, const char *what, const int nThreads,
+           const int value) {
+  printf("  %d threads %-12s %d %s\n", nThreads, what, value,
+         bOk ? "ok" : "MISMATCH");
+  if (!bOk)
+    nFailures++;
+}
+
+} // namespace
+
+int main() {
+  Frame::fx = fx;
+  Frame::fy = fy;
+  Frame::cx = cx;
+  Frame::cy = cy;
+  Frame::invfx = 1.f / fx;
+  Frame::invfy = 1.f / fy;
+  Frame::mnMinX = 0.f;
+  Frame::mnMaxX = WIDTH;
+  Frame::mnMinY = 0.f;
+  Frame::mnMaxY = HEIGHT;
+  Frame::mfGridElementWidthInv = FRAME_GRID_COLS / (float)WIDTH;
+  Frame::mfGridElementHeightInv = FRAME_GRID_ROWS / (float)HEIGHT;
+  Frame::mbInitialComputations = false;
+
+  for (unsigned int seed = 1; seed <= 3; seed++) {
+    const Scene s = MakeScene(seed);
+    const Result ref = Run(s, 0);
+    printf("seed %u: %zu points, %d neighbour slots overwritten\n", seed,
+           ref.vXw.size(), ref.nOverwritten);
+    Check(!ref.vXw.empty() && ref.nOverwritten > 0, "scene", 0,
+          (int)ref.vXw.size());
+
+    for (const int nThreads : {1, 2, 4}) {
+      const Result res = Run(s, nThreads);
+      Check(res.vXw.size() == ref.vXw.size(), "points", nThreads,
+            (int)res.vXw.size());
+
+      int nDiff = 0;
+      for (size_t p = 0; p < min(ref.vXw.size(), res.vXw.size()); p++)
+        nDiff += ref.vObservations[p] != res.vObservations[p] ||
+                 ref.vXw[p] != res.vXw[p];
+      Check(nDiff == 0, "observations", nThreads, nDiff);
+
+      nDiff = 0;
+      for (int k = 0; k < N_KEYFRAMES; k++)
+        nDiff += ref.vSlots[k] != res.vSlots[k];
+      Check(nDiff == 0, "slots", nThreads, nDiff);
+    }
+  }
+
+  if (nFailures)
+    printf("%d mismatches\n", nFailures);
+  return nFailures ? 1 : 0;
+}
@@ -0,0 +1,442 @@
+/**
+ * This file is part of ORB-SLAM3
+ *
+ * Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez
+ * Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+ * Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós,
+ * University of Zaragoza.
+ *
+ * ORB-SLAM3 is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ORB-SLAM3. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Parity of InertialPoseSolver with the g2o graph it replaces in
+// Optimizer::PoseInertialOptimizationLastFrame/LastKeyFrame. The same
+// synthetic problem, a previous and a current navigation state linked by
+// preintegrated IMU measurements plus mono and stereo observations (some of
+// them outliers) from the current one, is solved by a SparseOptimizer with
+// BlockSolverX, LinearSolverDense and Gauss-Newton and by InertialPoseSolver,
+// with the optimize and classify schedule of those functions. The estimates,
+// the inlier sets and the Hessian used for the next prior must agree.
+
+#include "CameraModels/Pinhole.h"
+#include "G2oTypes.h"
+#include "ImuTypes.h"
+#include "InertialPoseSolver.h"
+
+#include <g2o/core/block_solver.h>
+#include <g2o/core/optimization_algorithm_gauss_newton.h>
+#include <g2o/core/robust_kernel_impl.h>
+#include <g2o/core/sparse_optimizer.h>
+#include <g2o/solvers/dense/linear_solver_dense.h>
+
+#include <cstdio>
+#include <memory>
+#include <random>
+
+using namespace std;
+using namespace ORB_SLAM3;
+
+namespace {
+
+const double fx = 500, fy = 500, cx = 320, cy = 240, bf = 40;
+
+struct State {
+  Eigen::Matrix3d Rwb;
+  Eigen::Vector3d twb, vwb, bg, ba;
+};
+
+struct Scene {
+  Pinhole *pCamera;
+  IMU::Calib calib;
+  IMU::Preintegrated *pInt;
+  ConstraintPoseImu *pPrior;
+
+  // Initial guesses of the previous and the current state
+  State prev, cur;
+
+  vector<Eigen::Vector3f> vXw;
+  vector<Eigen::Vector3d> vObs; // u, v and, for stereo ones, ur
+  vector<bool> vbStereo;
+};
+
+struct Result {
+  State cur, prev;
+  vector<bool> vbOutlier;
+  Eigen::Matrix<double, 30, 30> H;
+};
+
+Scene MakeScene(const unsigned int seed) {
+  mt19937 rng(seed);
+  normal_distribution<double> noise(0.0, 1.0);
+  uniform_real_distribution<double> uniform(-1.0, 1.0);
+
+  Scene s;
+  s.pCamera = new Pinhole(vector<float>{(float)fx, (float)fy, (float)cx,
+                                        (float)cy});
+  s.calib = IMU::Calib(Sophus::SE3f(), 1e-2, 1e-1, 1e-4, 1e-3);
+
+  // True motion: 0.1 s of constant angular velocity and acceleration
+  State prev;
+  prev.Rwb.setIdentity();
+  prev.twb.setZero();
+  prev.vwb << 1.0, 0.0, 0.2;
+  prev.bg.setZero();
+  prev.ba.setZero();
+
+  s.pInt = new IMU::Preintegrated(IMU::Bias(), s.calib);
+  const Eigen::Vector3f acc(0.5f, 0.2f, IMU::GRAVITY_VALUE + 0.1f);
+  const Eigen::Vector3f gyro(0.3f, -0.2f, 0.1f);
+  for (int i = 0; i < 20; i++)
+    s.pInt->IntegrateNewMeasurement(acc, gyro, 0.005f);
+
+  const Eigen::Vector3d g(0, 0, -IMU::GRAVITY_VALUE);
+  const double t = s.pInt->dT;
+  State cur;
+  cur.Rwb = prev.Rwb * s.pInt->GetDeltaRotation(IMU::Bias()).cast<double>();
+  cur.vwb = prev.vwb + g * t +
+            prev.Rwb * s.pInt->GetDeltaVelocity(IMU::Bias()).cast<double>();
+  cur.twb = prev.twb + prev.vwb * t + 0.5 * g * t * t +
+            prev.Rwb * s.pInt->GetDeltaPosition(IMU::Bias()).cast<double>();
+  cur.bg.setZero();
+  cur.ba.setZero();
+
+  Matrix15d Hprior = Matrix15d::Zero();
+  Hprior.diagonal() << 1e4, 1e4, 1e4, 1e4, 1e4, 1e4, 1e3, 1e3, 1e3, 1e5, 1e5,
+      1e5, 1e4, 1e4, 1e4;
+  s.pPrior = new ConstraintPoseImu(prev.Rwb, prev.twb, prev.vwb, prev.bg,
+                                   prev.ba, Hprior);
+
+  // Points in front of the current camera (the camera is the body), one in
+  // ten observed with a gross error, one in four observed in stereo
+  for (int i = 0; i < 120; i++) {
+    const Eigen::Vector3d Xc(3.0 * uniform(rng), 2.0 * uniform(rng),
+                             4.0 + 4.0 * fabs(uniform(rng)));
+    const Eigen::Vector3d Xw = cur.Rwb * Xc + cur.twb;
+    Eigen::Vector3d obs(fx * Xc(0) / Xc(2) + cx, fy * Xc(1) / Xc(2) + cy, 0);
+    obs(2) = obs(0) - bf / Xc(2);
+    obs += 0.5 * Eigen::Vector3d(noise(rng), noise(rng), noise(rng));
+    if (i % 10 == 0)
+      obs += Eigen::Vector3d(30.0, -20.0, 30.0);
+
+    s.vXw.push_back(Xw.cast<float>());
+    s.vObs.push_back(obs);
+    s.vbStereo.push_back(i % 4 == 0);
+  }
+
+  // Perturbed initial guesses
+  s.prev = prev;
+  s.prev.twb += 0.01 * Eigen::Vector3d(noise(rng), noise(rng), noise(rng));
+  s.cur = cur;
+  s.cur.Rwb = cur.Rwb * ExpSO3(0.02 * noise(rng), 0.02 * noise(rng),
+                               0.02 * noise(rng));
+  s.cur.twb += 0.05 * Eigen::Vector3d(noise(rng), noise(rng), noise(rng));
+  s.cur.vwb += 0.05 * Eigen::Vector3d(noise(rng), noise(rng), noise(rng));
+  return s;
+}
+
+ImuCamPose MakePose(const State &state, GeometricCamera *pCamera) {
+  ImuCamPose pose;
+  pose.its = 0;
+  pose.Rwb = state.Rwb;
+  pose.twb = state.twb;
+  pose.Rcb.assign(1, Eigen::Matrix3d::Identity());
+  pose.Rbc.assign(1, Eigen::Matrix3d::Identity());
+  pose.tcb.assign(1, Eigen::Vector3d::Zero());
+  pose.tbc.assign(1, Eigen::Vector3d::Zero());
+  pose.Rcw.assign(1, state.Rwb.transpose());
+  pose.tcw.assign(1, -state.Rwb.transpose() * state.twb);
+  pose.bf = bf;
+  pose.pCamera.assign(1, pCamera);
+  return pose;
+}
+
+// The graph as the optimizer functions used to build it
+class G2oBackend {
+public:
+  G2oBackend() : mnNextId(0) {
+    auto linearSolver = std::make_unique<
+        g2o::LinearSolverDense<g2o::BlockSolverX::PoseMatrixType>>();
+    auto solver_ptr =
+        std::make_unique<g2o::BlockSolverX>(std::move(linearSolver));
+    mOptimizer.setAlgorithm(
+        new g2o::OptimizationAlgorithmGaussNewton(std::move(solver_ptr)));
+    mOptimizer.setVerbose(false);
+  }
+
+  void AddState(VertexPose *VP, VertexVelocity *VV, VertexGyroBias *VG,
+                VertexAccBias *VA, const bool bFixed) {
+    g2o::OptimizableGraph::Vertex *vpVertices[4] = {VP, VV, VG, VA};
+    for (g2o::OptimizableGraph::Vertex *pV : vpVertices) {
+      pV->setId(mnNextId++);
+      pV->setFixed(bFixed);
+      mOptimizer.addVertex(pV);
+    }
+  }
+
+  template <class Edge> void AddEdge(Edge *e) { mOptimizer.addEdge(e); }
+
+  void Optimize(const int nIterations) {
+    mOptimizer.initializeOptimization(0);
+    mOptimizer.optimize(nIterations);
+  }
+
+private:
+  g2o::SparseOptimizer mOptimizer;
+  int mnNextId;
+};
+
+class SolverBackend {
+public:
+  void AddState(VertexPose *VP, VertexVelocity *VV, VertexGyroBias *VG,
+                VertexAccBias *VA, const bool bFixed) {
+    mSolver.AddState(VP, VV, VG, VA, bFixed);
+  }
+
+  template <class Edge> void AddEdge(Edge *e) { mSolver.AddEdge(e); }
+
+  void Optimize(const int nIterations) { mSolver.Optimize(nIterations); }
+
+private:
+  InertialPoseSolver mSolver;
+};
+
+State GetState(VertexPose *VP, VertexVelocity *VV, VertexGyroBias *VG,
+               VertexAccBias *VA) {
+  State state;
+  state.Rwb = VP->estimate().Rwb;
+  state.twb = VP->estimate().twb;
+  state.vwb = VV->estimate();
+  state.bg = VG->estimate();
+  state.ba = VA->estimate();
+  return state;
+}
+
+// Builds the problem on the backend, runs the schedule of
+// PoseInertialOptimizationLastFrame (bPrevFixed false: previous state free
+// with a prior) or LastKeyFrame (previous state fixed) and reads the result
+// before the backend deletes the graph
+template <class Backend> Result Solve(const Scene &s, const bool bPrevFixed) {
+  Backend backend;
+  Result result;
+
+  VertexPose *VP = new VertexPose();
+  VP->setEstimate(MakePose(s.cur, s.pCamera));
+  VertexVelocity *VV = new VertexVelocity();
+  VV->setEstimate(s.cur.vwb);
+  VertexGyroBias *VG = new VertexGyroBias();
+  VG->setEstimate(s.cur.bg);
+  VertexAccBias *VA = new VertexAccBias();
+  VA->setEstimate(s.cur.ba);
+  backend.AddState(VP, VV, VG, VA, false);
+
+  const float thHuberMono = sqrt(5.991);
+  const float thHuberStereo = sqrt(7.815);
+  const double invSigma2 = 1.0 / (1.2 * 1.2);
+
+  vector<EdgeMonoOnlyPose *> vpEdgesMono;
+  vector<EdgeStereoOnlyPose *> vpEdgesStereo;
+  for (size_t i = 0; i < s.vXw.size(); i++) {
+    if (s.vbStereo[i]) {
+      EdgeStereoOnlyPose *e = new EdgeStereoOnlyPose(s.vXw[i]);
+      e->setVertex(0, VP);
+      e->setMeasurement(s.vObs[i]);
+      e->setInformation(Eigen::Matrix3d::Identity() * invSigma2);
+      g2o::RobustKernelHuber *rk = new g2o::RobustKernelHuber;
+      e->setRobustKernel(rk);
+      rk->setDelta(thHuberStereo);
+      backend.AddEdge(e);
+      vpEdgesStereo.push_back(e);
+    } else {
+      EdgeMonoOnlyPose *e = new EdgeMonoOnlyPose(s.vXw[i], 0);
+      e->setVertex(0, VP);
+      e->setMeasurement(s.vObs[i].head<2>());
+      e->setInformation(Eigen::Matrix2d::Identity() * invSigma2);
+      g2o::RobustKernelHuber *rk = new g2o::RobustKernelHuber;
+      e->setRobustKernel(rk);
+      rk->setDelta(thHuberMono);
+      backend.AddEdge(e);
+      vpEdgesMono.push_back(e);
+    }
+  }
+
+  VertexPose *VPk = new VertexPose();
+  VPk->setEstimate(MakePose(s.prev, s.pCamera));
+  VertexVelocity *VVk = new VertexVelocity();
+  VVk->setEstimate(s.prev.vwb);
+  VertexGyroBias *VGk = new VertexGyroBias();
+  VGk->setEstimate(s.prev.bg);
+  VertexAccBias *VAk = new VertexAccBias();
+  VAk->setEstimate(s.prev.ba);
+  backend.AddState(VPk, VVk, VGk, VAk, bPrevFixed);
+
+  EdgeInertial *ei = new EdgeInertial(s.pInt);
+  ei->setVertex(0, VPk);
+  ei->setVertex(1, VVk);
+  ei->setVertex(2, VGk);
+  ei->setVertex(3, VAk);
+  ei->setVertex(4, VP);
+  ei->setVertex(5, VV);
+  backend.AddEdge(ei);
+
+  EdgeGyroRW *egr = new EdgeGyroRW();
+  egr->setVertex(0, VGk);
+  egr->setVertex(1, VG);
+  egr->setInformation(
+      s.pInt->C.block<3, 3>(9, 9).cast<double>().inverse());
+  backend.AddEdge(egr);
+
+  EdgeAccRW *ear = new EdgeAccRW();
+  ear->setVertex(0, VAk);
+  ear->setVertex(1, VA);
+  ear->setInformation(
+      s.pInt->C.block<3, 3>(12, 12).cast<double>().inverse());
+  backend.AddEdge(ear);
+
+  EdgePriorPoseImu *ep = NULL;
+  if (!bPrevFixed) {
+    ep = new EdgePriorPoseImu(s.pPrior);
+    ep->setVertex(0, VPk);
+    ep->setVertex(1, VVk);
+    ep->setVertex(2, VGk);
+    ep->setVertex(3, VAk);
+    g2o::RobustKernelHuber *rkp = new g2o::RobustKernelHuber;
+    ep->setRobustKernel(rkp);
+    rkp->setDelta(5);
+    backend.AddEdge(ep);
+  }
+
+  const float chi2Mono[4] = {12, 7.5, 5.991, 5.991};
+  const float chi2Stereo[4] = {15.6f, 9.8f, 7.815f, 7.815f};
+  const int its[4] = {10, 10, 10, 10};
+
+  vector<bool> vbOutlier(vpEdgesMono.size() + vpEdgesStereo.size(), false);
+  for (size_t it = 0; it < 4; it++) {
+    backend.Optimize(its[it]);
+
+    for (size_t i = 0; i < vpEdgesMono.size(); i++) {
+      EdgeMonoOnlyPose *e = vpEdgesMono[i];
+      if (vbOutlier[i])
+        e->computeError();
+      vbOutlier[i] = e->chi2() > chi2Mono[it] || !e->isDepthPositive();
+      e->setLevel(vbOutlier[i] ? 1 : 0);
+      if (it == 2)
+        e->setRobustKernel(0);
+    }
+
+    for (size_t i = 0; i < vpEdgesStereo.size(); i++) {
+      EdgeStereoOnlyPose *e = vpEdgesStereo[i];
+      const size_t idx = vpEdgesMono.size() + i;
+      if (vbOutlier[idx])
+        e->computeError();
+      vbOutlier[idx] = e->chi2() > chi2Stereo[it];
+      e->setLevel(vbOutlier[idx] ? 1 : 0);
+      if (it == 2)
+        e->setRobustKernel(0);
+    }
+  }
+
+  result.cur = GetState(VP, VV, VG, VA);
+  result.prev = GetState(VPk, VVk, VGk, VAk);
+  result.vbOutlier = vbOutlier;
+
+  // Hessian recovered as for the next prior, previous state first
+  Eigen::Matrix<double, 30, 30> &H = result.H;
+  H.setZero();
+  H.block<24, 24>(0, 0) += ei->GetHessian();
+
+  Eigen::Matrix<double, 6, 6> Hgr = egr->GetHessian();
+  H.block<3, 3>(9, 9) += Hgr.block<3, 3>(0, 0);
+  H.block<3, 3>(9, 24) += Hgr.block<3, 3>(0, 3);
+  H.block<3, 3>(24, 9) += Hgr.block<3, 3>(3, 0);
+  H.block<3, 3>(24, 24) += Hgr.block<3, 3>(3, 3);
+
+  Eigen::Matrix<double, 6, 6> Har = ear->GetHessian();
+  H.block<3, 3>(12, 12) += Har.block<3, 3>(0, 0);
+  H.block<3, 3>(12, 27) += Har.block<3, 3>(0, 3);
+  H.block<3, 3>(27, 12) += Har.block<3, 3>(3, 0);
+  H.block<3, 3>(27, 27) += Har.block<3, 3>(3, 3);
+
+  if (ep)
+    H.block<15, 15>(0, 0) += ep->GetHessian();
+
+  for (size_t i = 0; i < vpEdgesMono.size(); i++)
+    if (!vbOutlier[i])
+      H.block<6, 6>(15, 15) += vpEdgesMono[i]->GetHessian();
+  for (size_t i = 0; i < vpEdgesStereo.size(); i++)
+    if (!vbOutlier[vpEdgesMono.size() + i])
+      H.block<6, 6>(15, 15) += vpEdgesStereo[i]->GetHessian();
+
+  return result;
+}
+
+int nFailures = 0;
+
+void Check(const bool bOk, const char *what, const char *scenario,
+           const double value) {
+  printf("  %-10s %-9s %.3g %s\n", scenario, what, value,
+         bOk ? "ok" : "MISMATCH");
+  if (!bOk)
+    nFailures++;
+}
+
+void CompareStates(const State &a, const State &b, const char *scenario,
+                   const char *which) {
+  const double tol = 1e-6;
+  char what[32];
+  snprintf(what, sizeof(what), "%s.R", which);
+  const double dR = LogSO3(a.Rwb.transpose() * b.Rwb).norm();
+  Check(dR < tol, what, scenario, dR);
+  snprintf(what, sizeof(what), "%s.t", which);
+  Check((a.twb - b.twb).norm() < tol, what, scenario, (a.twb - b.twb).norm());
+  snprintf(what, sizeof(what), "%s.v", which);
+  Check((a.vwb - b.vwb).norm() < tol, what, scenario, (a.vwb - b.vwb).norm());
+  snprintf(what, sizeof(what), "%s.bg", which);
+  Check((a.bg - b.bg).norm() < tol, what, scenario, (a.bg - b.bg).norm());
+  snprintf(what, sizeof(what), "%s.ba", which);
+  Check((a.ba - b.ba).norm() < tol, what, scenario, (a.ba - b.ba).norm());
+}
+
+} // namespace
+
+int main() {
+  for (unsigned int seed = 1; seed <= 5; seed++) {
+    Scene s = MakeScene(seed);
+    printf("seed %u\n", seed);
+
+    for (const bool bPrevFixed : {false, true}) {
+      const char *scenario = bPrevFixed ? "keyframe" : "frame";
+      const Result ref = Solve<G2oBackend>(s, bPrevFixed);
+      const Result res = Solve<SolverBackend>(s, bPrevFixed);
+
+      CompareStates(ref.cur, res.cur, scenario, "cur");
+      if (!bPrevFixed)
+        CompareStates(ref.prev, res.prev, scenario, "prev");
+
+      int nDiff = 0;
+      for (size_t i = 0; i < ref.vbOutlier.size(); i++)
+        nDiff += ref.vbOutlier[i] != res.vbOutlier[i];
+      Check(nDiff == 0, "outliers", scenario, nDiff);
+
+      const double dH = (ref.H - res.H).norm() / ref.H.norm();
+      Check(dH < 1e-6, "H", scenario, dH);
+    }
+
+    delete s.pPrior;
+    delete s.pInt;
+    delete s.pCamera;
+  }
+
+  if (nFailures)
+    printf("%d mismatches\n", nFailures);
+  return nFailures ? 1 : 0;
+}
@@ -0,0 +1,208 @@
+/**
+ * This file is part of ORB-SLAM3
+ *
+ * Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez
+ * Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+ * Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós,
+ * University of Zaragoza.
+ *
+ * ORB-SLAM3 is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ORB-SLAM3. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Optimizer::Marginalize against the dense implementation it replaced (full
+// reorder and SVD pseudo-inverse, kept below as the reference) on banded
+// windows of 10 to 50 inertial states of 15 parameters. The marginalized
+// block is regular, rank deficient or positive definite with an eigenvalue
+// below the 1e-6 truncation threshold. Results must agree; the timings of
+// both are printed.
+
+#include "Optimizer.h"
+
+#include <Eigen/Dense>
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+using namespace std;
+using namespace ORB_SLAM3;
+
+namespace {
+
+Eigen::MatrixXd ReferenceMarginalize(const Eigen::MatrixXd &H,
+                                     const int &start, const int &end) {
+  // Size of block before block to marginalize
+  const int a = start;
+  // Size of block to marginalize
+  const int b = end - start + 1;
+  // Size of block after block to marginalize
+  const int c = H.cols() - (end + 1);
+
+  // Reorder as follows:
+  // a  | ab | ac       a  | ac | ab
+  // ba | b  | bc  -->  ca | c  | cb
+  // ca | cb | c        ba | bc | b
+
+  Eigen::MatrixXd Hn = Eigen::MatrixXd::Zero(H.rows(), H.cols());
+  if (a > 0) {
+    Hn.block(0, 0, a, a) = H.block(0, 0, a, a);
+    Hn.block(0, a + c, a, b) = H.block(0, a, a, b);
+    Hn.block(a + c, 0, b, a) = H.block(a, 0, b, a);
+  }
+  if (a > 0 && c > 0) {
+    Hn.block(0, a, a, c) = H.block(0, a + b, a, c);
+    Hn.block(a, 0, c, a) = H.block(a + b, 0, c, a);
+  }
+  if (c > 0) {
+    Hn.block(a, a, c, c) = H.block(a + b, a + b, c, c);
+    Hn.block(a, a + c, c, b) = H.block(a + b, a, c, b);
+    Hn.block(a + c, a, b, c) = H.block(a, a + b, b, c);
+  }
+  Hn.block(a + c, a + c, b, b) = H.block(a, a, b, b);
+
+  // Perform marginalization (Schur complement)
+  Eigen::JacobiSVD<Eigen::MatrixXd> svd(
+      Hn.block(a + c, a + c, b, b), Eigen::ComputeThinU | Eigen::ComputeThinV);
+  Eigen::JacobiSVD<Eigen::MatrixXd>::SingularValuesType singularValues_inv =
+      svd.singularValues();
+  for (int i = 0; i < b; ++i) {
+    if (singularValues_inv(i) > 1e-6)
+      singularValues_inv(i) = 1.0 / singularValues_inv(i);
+    else
+      singularValues_inv(i) = 0;
+  }
+  Eigen::MatrixXd invHb = svd.matrixV() * singularValues_inv.asDiagonal() *
+                          svd.matrixU().transpose();
+  Hn.block(0, 0, a + c, a + c) =
+      Hn.block(0, 0, a + c, a + c) -
+      Hn.block(0, a + c, a + c, b) * invHb * Hn.block(a + c, 0, b, a + c);
+  Hn.block(a + c, a + c, b, b) = Eigen::MatrixXd::Zero(b, b);
+  Hn.block(0, a + c, a + c, b) = Eigen::MatrixXd::Zero(a + c, b);
+  Hn.block(a + c, 0, b, a + c) = Eigen::MatrixXd::Zero(b, a + c);
+
+  // Inverse reorder
+  Eigen::MatrixXd res = Eigen::MatrixXd::Zero(H.rows(), H.cols());
+  if (a > 0) {
+    res.block(0, 0, a, a) = Hn.block(0, 0, a, a);
+    res.block(0, a, a, b) = Hn.block(0, a + c, a, b);
+    res.block(a, 0, b, a) = Hn.block(a + c, 0, b, a);
+  }
+  if (a > 0 && c > 0) {
+    res.block(0, a + b, a, c) = Hn.block(0, a, a, c);
+    res.block(a + b, 0, c, a) = Hn.block(a, 0, c, a);
+  }
+  if (c > 0) {
+    res.block(a + b, a + b, c, c) = Hn.block(a, a, c, c);
+    res.block(a + b, a, c, b) = Hn.block(a, a + c, c, b);
+    res.block(a, a + b, b, c) = Hn.block(a + c, a, b, c);
+  }
+
+  res.block(a, a, b, b) = Hn.block(a + c, a + c, b, b);
+
+  return res;
+}
+
+enum Conditioning { REGULAR, RANK_DEFICIENT, ILL_CONDITIONED };
+const char *ConditioningName(const Conditioning c) {
+  return c == REGULAR ? "regular" : c == RANK_DEFICIENT ? "rank-def" : "ill";
+}
+
+const int STATE = 15;
+
+// Chain of N states, consecutive ones linked by a random 30x30 factor, as
+// the inertial edges link consecutive keyframes. The block of state nMarg is
+// then made singular or given an eigenvalue below the threshold.
+Eigen::MatrixXd MakeWindow(const int N, const int nMarg,
+                           const Conditioning conditioning, mt19937 &rng) {
+  normal_distribution<double> noise(0.0, 1.0);
+  const int n = STATE * N;
+  Eigen::MatrixXd H = Eigen::MatrixXd::Zero(n, n);
+  for (int i = 0; i + 1 < N; i++) {
+    Eigen::MatrixXd J(2 * STATE, 2 * STATE);
+    for (int r = 0; r < J.rows(); r++)
+      for (int c = 0; c < J.cols(); c++)
+        J(r, c) = noise(rng);
+    H.block(STATE * i, STATE * i, 2 * STATE, 2 * STATE) += J.transpose() * J;
+  }
+
+  const int m = STATE * nMarg;
+  if (conditioning == RANK_DEFICIENT) {
+    // A parameter no edge constrains
+    H.row(m + 3).setZero();
+    H.col(m + 3).setZero();
+  } else if (conditioning == ILL_CONDITIONED) {
+    // Lower the smallest eigenvalue of the block to 1e-8, keeping H
+    // positive semidefinite
+    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> eig(
+        H.block(m, m, STATE, STATE));
+    const Eigen::VectorXd v = eig.eigenvectors().col(0);
+    const double lambda = eig.eigenvalues()(0);
+    H.block(m, m, STATE, STATE) += (1e-8 - lambda) * v * v.transpose();
+    // Remove the coupling along v, so the whole H stays consistent
+    Eigen::MatrixXd P =
+        Eigen::MatrixXd::Identity(STATE, STATE) - v * v.transpose();
+    if (m > 0)
+      H.block(m - STATE, m, STATE, STATE) *= P;
+    if (m + STATE < n)
+      H.block(m + STATE, m, STATE, STATE) *= P;
+    H.block(m, 0, STATE, n) = H.block(0, m, n, STATE).transpose().eval();
+  }
+  return H;
+}
+
+template <class F> double TimeMs(F f, const int nReps) {
+  const auto t0 = chrono::steady_clock::now();
+  for (int r = 0; r < nReps; r++)
+    f();
+  const auto t1 = chrono::steady_clock::now();
+  return chrono::duration<double, milli>(t1 - t0).count() / nReps;
+}
+
+} // namespace
+
+int main() {
+  mt19937 rng(7);
+  int nFailures = 0;
+
+  printf("%6s %-9s %6s %10s %10s %10s\n", "states", "block", "marg",
+         "rel.diff", "dense ms", "sparse ms");
+  for (const int N : {10, 20, 30, 40, 50}) {
+    for (const Conditioning conditioning :
+         {REGULAR, RANK_DEFICIENT, ILL_CONDITIONED}) {
+      // Oldest state, as in a sliding window, and one in the middle
+      for (const int nMarg : {0, N / 2}) {
+        const Eigen::MatrixXd H = MakeWindow(N, nMarg, conditioning, rng);
+        const int start = STATE * nMarg, end = start + STATE - 1;
+
+        const Eigen::MatrixXd ref = ReferenceMarginalize(H, start, end);
+        const Eigen::MatrixXd res = Optimizer::Marginalize(H, start, end);
+        const double diff = (ref - res).norm() / ref.norm();
+        const bool bOk = diff < 1e-9;
+        if (!bOk)
+          nFailures++;
+
+        const int nReps = N > 30 ? 5 : 20;
+        const double tRef =
+            TimeMs([&] { ReferenceMarginalize(H, start, end); }, nReps);
+        const double tRes =
+            TimeMs([&] { Optimizer::Marginalize(H, start, end); }, nReps);
+
+        printf("%6d %-9s %6d %10.2e %10.3f %10.3f %s\n", N,
+               ConditioningName(conditioning), nMarg, diff, tRef, tRes,
+               bOk ? "" : "MISMATCH");
+      }
+    }
+  }
+
+  return nFailures ? 1 : 0;
+}
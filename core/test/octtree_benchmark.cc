@@ -0,0 +1,398 @@
+/**
+ * This file is part of ORB-SLAM3
+ *
+ * Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez
+ * Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+ * Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós,
+ * University of Zaragoza.
+ *
+ * ORB-SLAM3 is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ORB-SLAM3. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// OctTree::Distribute against the list based DistributeOctTree it replaced
+// (kept below as the reference). FAST corners are detected with low
+// thresholds, cell by cell as in ORBextractor::ComputeKeyPointsOctTree, on
+// textured images at the sizes of a pyramid. Both must select the same
+// keypoints in the same order for a range of feature counts; the timings of
+// both are printed.
+
+#include "ORB/extractor.h"
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/features2d/features2d.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <list>
+#include <vector>
+
+using namespace cv;
+using namespace std;
+using namespace ORB_SLAM3;
+
+namespace {
+
+class ReferenceNode {
+public:
+  ReferenceNode() : bNoMore(false) {}
+
+  void DivideNode(ReferenceNode &n1, ReferenceNode &n2, ReferenceNode &n3,
+                  ReferenceNode &n4);
+
+  vector<cv::KeyPoint> vKeys;
+  cv::Point2i UL, UR, BL, BR;
+  list<ReferenceNode>::iterator lit;
+  bool bNoMore;
+};
+
+void ReferenceNode::DivideNode(ReferenceNode &n1, ReferenceNode &n2,
+                               ReferenceNode &n3, ReferenceNode &n4) {
+  const int halfX = ceil(static_cast<float>(UR.x - UL.x) / 2);
+  const int halfY = ceil(static_cast<float>(BR.y - UL.y) / 2);
+
+  // Define boundaries of childs
+  n1.UL = UL;
+  n1.UR = cv::Point2i(UL.x + halfX, UL.y);
+  n1.BL = cv::Point2i(UL.x, UL.y + halfY);
+  n1.BR = cv::Point2i(UL.x + halfX, UL.y + halfY);
+  n1.vKeys.reserve(vKeys.size());
+
+  n2.UL = n1.UR;
+  n2.UR = UR;
+  n2.BL = n1.BR;
+  n2.BR = cv::Point2i(UR.x, UL.y + halfY);
+  n2.vKeys.reserve(vKeys.size());
+
+  n3.UL = n1.BL;
+  n3.UR = n1.BR;
+  n3.BL = BL;
+  n3.BR = cv::Point2i(n1.BR.x, BL.y);
+  n3.vKeys.reserve(vKeys.size());
+
+  n4.UL = n3.UR;
+  n4.UR = n2.BR;
+  n4.BL = n3.BR;
+  n4.BR = BR;
+  n4.vKeys.reserve(vKeys.size());
+
+  // Associate points to childs
+  for (size_t i = 0; i < vKeys.size(); i++) {
+    const cv::KeyPoint &kp = vKeys[i];
+    if (kp.pt.x < n1.UR.x) {
+      if (kp.pt.y < n1.BR.y)
+        n1.vKeys.push_back(kp);
+      else
+        n3.vKeys.push_back(kp);
+    } else if (kp.pt.y < n1.BR.y)
+      n2.vKeys.push_back(kp);
+    else
+      n4.vKeys.push_back(kp);
+  }
+
+  if (n1.vKeys.size() == 1)
+    n1.bNoMore = true;
+  if (n2.vKeys.size() == 1)
+    n2.bNoMore = true;
+  if (n3.vKeys.size() == 1)
+    n3.bNoMore = true;
+  if (n4.vKeys.size() == 1)
+    n4.bNoMore = true;
+}
+
+bool compareNodes(pair<int, ReferenceNode *> &e1,
+                  pair<int, ReferenceNode *> &e2) {
+  if (e1.first < e2.first) {
+    return true;
+  } else if (e1.first > e2.first) {
+    return false;
+  } else {
+    if (e1.second->UL.x < e2.second->UL.x) {
+      return true;
+    } else {
+      return false;
+    }
+  }
+}
+
+// Pushes the non-empty children of a divided node to the front of lNodes
+void PushChildren(ReferenceNode *children, list<ReferenceNode> &lNodes,
+                  vector<pair<int, ReferenceNode *>> &vSizeAndPointerToNode,
+                  int &nToExpand) {
+  for (int c = 0; c < 4; c++) {
+    ReferenceNode &n = children[c];
+    // Add childs if they contain points
+    if (n.vKeys.size() > 0) {
+      lNodes.push_front(n);
+      if (n.vKeys.size() > 1) {
+        nToExpand++;
+        vSizeAndPointerToNode.push_back(
+            make_pair(n.vKeys.size(), &lNodes.front()));
+        lNodes.front().lit = lNodes.begin();
+      }
+    }
+  }
+}
+
+// ORBextractor::DistributeOctTree before OctTree, with minX = minY = 0
+vector<cv::KeyPoint>
+ReferenceDistribute(const vector<cv::KeyPoint> &vToDistributeKeys,
+                    const int width, const int height, const int N) {
+  // Compute how many initial nodes
+  const int nIni = round(static_cast<float>(width) / height);
+
+  const float hX = static_cast<float>(width) / nIni;
+
+  list<ReferenceNode> lNodes;
+
+  vector<ReferenceNode *> vpIniNodes;
+  vpIniNodes.resize(nIni);
+
+  for (int i = 0; i < nIni; i++) {
+    ReferenceNode ni;
+    ni.UL = cv::Point2i(hX * static_cast<float>(i), 0);
+    ni.UR = cv::Point2i(hX * static_cast<float>(i + 1), 0);
+    ni.BL = cv::Point2i(ni.UL.x, height);
+    ni.BR = cv::Point2i(ni.UR.x, height);
+    ni.vKeys.reserve(vToDistributeKeys.size());
+
+    lNodes.push_back(ni);
+    vpIniNodes[i] = &lNodes.back();
+  }
+
+  // Associate points to childs
+  for (size_t i = 0; i < vToDistributeKeys.size(); i++) {
+    const cv::KeyPoint &kp = vToDistributeKeys[i];
+    vpIniNodes[kp.pt.x / hX]->vKeys.push_back(kp);
+  }
+
+  list<ReferenceNode>::iterator lit = lNodes.begin();
+
+  while (lit != lNodes.end()) {
+    if (lit->vKeys.size() == 1) {
+      lit->bNoMore = true;
+      lit++;
+    } else if (lit->vKeys.empty())
+      lit = lNodes.erase(lit);
+    else
+      lit++;
+  }
+
+  bool bFinish = false;
+
+  vector<pair<int, ReferenceNode *>> vSizeAndPointerToNode;
+  vSizeAndPointerToNode.reserve(lNodes.size() * 4);
+
+  while (!bFinish) {
+    int prevSize = lNodes.size();
+
+    lit = lNodes.begin();
+
+    int nToExpand = 0;
+
+    vSizeAndPointerToNode.clear();
+
+    while (lit != lNodes.end()) {
+      if (lit->bNoMore) {
+        // If node only contains one point do not subdivide and continue
+        lit++;
+        continue;
+      } else {
+        // If more than one point, subdivide
+        ReferenceNode children[4];
+        lit->DivideNode(children[0], children[1], children[2], children[3]);
+        PushChildren(children, lNodes, vSizeAndPointerToNode, nToExpand);
+
+        lit = lNodes.erase(lit);
+        continue;
+      }
+    }
+
+    // Finish if there are more nodes than required features
+    // or all nodes contain just one point
+    if ((int)lNodes.size() >= N || (int)lNodes.size() == prevSize) {
+      bFinish = true;
+    } else if (((int)lNodes.size() + nToExpand * 3) > N) {
+
+      while (!bFinish) {
+
+        prevSize = lNodes.size();
+
+        vector<pair<int, ReferenceNode *>> vPrevSizeAndPointerToNode =
+            vSizeAndPointerToNode;
+        vSizeAndPointerToNode.clear();
+
+        sort(vPrevSizeAndPointerToNode.begin(), vPrevSizeAndPointerToNode.end(),
+             compareNodes);
+        for (int j = vPrevSizeAndPointerToNode.size() - 1; j >= 0; j--) {
+          ReferenceNode children[4];
+          vPrevSizeAndPointerToNode[j].second->DivideNode(
+              children[0], children[1], children[2], children[3]);
+          PushChildren(children, lNodes, vSizeAndPointerToNode, nToExpand);
+
+          lNodes.erase(vPrevSizeAndPointerToNode[j].second->lit);
+
+          if ((int)lNodes.size() >= N)
+            break;
+        }
+
+        if ((int)lNodes.size() >= N || (int)lNodes.size() == prevSize)
+          bFinish = true;
+      }
+    }
+  }
+
+  // Retain the best point in each node
+  vector<cv::KeyPoint> vResultKeys;
+  vResultKeys.reserve(lNodes.size());
+  for (list<ReferenceNode>::iterator lit = lNodes.begin();
+       lit != lNodes.end(); lit++) {
+    vector<cv::KeyPoint> &vNodeKeys = lit->vKeys;
+    cv::KeyPoint *pKP = &vNodeKeys[0];
+    float maxResponse = pKP->response;
+
+    for (size_t k = 1; k < vNodeKeys.size(); k++) {
+      if (vNodeKeys[k].response > maxResponse) {
+        pKP = &vNodeKeys[k];
+        maxResponse = vNodeKeys[k].response;
+      }
+    }
+
+    vResultKeys.push_back(*pKP);
+  }
+
+  return vResultKeys;
+}
+
+const int EDGE_THRESHOLD = 19;
+
+// FAST corners of the 35 pixel cells of the extractor, which overlap by 6
+// pixels so a corner may be detected twice. Coordinates are relative to the
+// border and [0, width) x [0, height) is the area to distribute.
+vector<cv::KeyPoint> DetectCells(const Mat &image, const int threshold,
+                                 int &width, int &height) {
+  const int minBorder = EDGE_THRESHOLD - 3;
+  const int maxBorderX = image.cols - EDGE_THRESHOLD + 3;
+  const int maxBorderY = image.rows - EDGE_THRESHOLD + 3;
+  width = maxBorderX - minBorder;
+  height = maxBorderY - minBorder;
+
+  const int nCols = width / 35, nRows = height / 35;
+  const int wCell = ceil(static_cast<float>(width) / nCols);
+  const int hCell = ceil(static_cast<float>(height) / nRows);
+
+  vector<cv::KeyPoint> vKeys, vKeysCell;
+  for (int i = 0; i < nRows; i++) {
+    const int iniY = minBorder + i * hCell;
+    if (iniY >= maxBorderY - 3)
+      continue;
+    const int maxY = min(iniY + hCell + 6, maxBorderY);
+    for (int j = 0; j < nCols; j++) {
+      const int iniX = minBorder + j * wCell;
+      if (iniX >= maxBorderX - 6)
+        continue;
+      const int maxX = min(iniX + wCell + 6, maxBorderX);
+
+      vKeysCell.clear();
+      FAST(image.rowRange(iniY, maxY).colRange(iniX, maxX), vKeysCell,
+           threshold, true);
+      for (cv::KeyPoint &kp : vKeysCell) {
+        kp.pt.x += j * wCell;
+        kp.pt.y += i * hCell;
+        vKeys.push_back(kp);
+      }
+    }
+  }
+  return vKeys;
+}
+
+// Smoothed noise, whose corners have many equal responses, and raw noise,
+// which gives the most corners
+vector<Mat> MakeImages() {
+  RNG rng(9);
+  Mat noise(480, 640, CV_8U);
+  rng.fill(noise, RNG::UNIFORM, 0, 256);
+  Mat smooth;
+  GaussianBlur(noise, smooth, Size(5, 5), 1.2);
+  return {smooth, noise};
+}
+
+template <class F> double TimeMs(F f, const int nReps) {
+  const auto t0 = chrono::steady_clock::now();
+  for (int r = 0; r < nReps; r++)
+    f();
+  const auto t1 = chrono::steady_clock::now();
+  return chrono::duration<double, milli>(t1 - t0).count() / nReps;
+}
+
+bool SameKeyPoints(const vector<cv::KeyPoint> &v1,
+                   const vector<cv::KeyPoint> &v2) {
+  if (v1.size() != v2.size())
+    return false;
+  for (size_t i = 0; i < v1.size(); i++) {
+    if (v1[i].pt != v2[i].pt || v1[i].response != v2[i].response)
+      return false;
+  }
+  return true;
+}
+
+} // namespace
+
+int main() {
+  const vector<Mat> images = MakeImages();
+  OctTree octTree;
+  int nFailures = 0;
+
+  printf("%5s %9s %3s %6s %5s %6s %10s %10s\n", "image", "size", "th", "keys",
+         "N", "kept", "list ms", "octree ms");
+  for (size_t im = 0; im < images.size(); im++) {
+    // Levels of an 8 level pyramid with scale factor 1.2
+    float scale = 1.f;
+    for (int level = 0; level < 8; level++, scale *= 1.2f) {
+      Mat image;
+      resize(images[im], image,
+             Size(cvRound(images[im].cols / scale),
+                  cvRound(images[im].rows / scale)),
+             0, 0, INTER_LINEAR);
+
+      for (const int threshold : {5, 7}) {
+        int width, height;
+        const vector<cv::KeyPoint> vKeys =
+            DetectCells(image, threshold, width, height);
+
+        for (const int N : {25, 100, 500, 2000}) {
+          const vector<cv::KeyPoint> ref =
+              ReferenceDistribute(vKeys, width, height, N);
+          vector<cv::KeyPoint> res;
+          octTree.Distribute(vKeys, width, height, N, res);
+          const bool bOk = SameKeyPoints(ref, res);
+          if (!bOk)
+            nFailures++;
+
+          const int nReps = 10;
+          const double tRef = TimeMs(
+              [&] { ReferenceDistribute(vKeys, width, height, N); }, nReps);
+          const double tRes = TimeMs(
+              [&] { octTree.Distribute(vKeys, width, height, N, res); },
+              nReps);
+
+          printf("%5zu %4dx%-4d %3d %6zu %5d %6zu %10.3f %10.3f %s\n", im,
+                 image.cols, image.rows, threshold, vKeys.size(), N,
+                 ref.size(), tRef, tRes, bOk ? "" : "MISMATCH");
+        }
+      }
+    }
+  }
+
+  return nFailures ? 1 : 0;
+}
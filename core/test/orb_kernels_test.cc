@@ -0,0 +1,221 @@
+/**
+ * This file is part of ORB-SLAM3
+ *
+ * Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez
+ * Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+ * Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós,
+ * University of Zaragoza.
+ *
+ * ORB-SLAM3 is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ORB-SLAM3. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Orientations and descriptors computed by ORBextractor, with each kernel
+// set this CPU can run, against the scalar code they replaced in the
+// extractor (IC_Angle and computeOrbDescriptor, kept below as the
+// reference). A grid of keypoints on fixed synthetic images, each one at
+// its own orientation and at a sweep of angles, must give bit identical
+// results.
+
+#include "ORB/extractor.h"
+#include "ORB/kernels.h"
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+using namespace cv;
+using namespace std;
+using namespace ORB_SLAM3;
+
+namespace {
+
+const int HALF_PATCH_SIZE = 15;
+// Patch and rotated pattern stay inside the image
+const int BORDER = 20;
+
+float ReferenceAngle(const Mat &image, Point2f pt, const vector<int> &u_max) {
+  int m_01 = 0, m_10 = 0;
+
+  const uchar *center = &image.at<uchar>(cvRound(pt.y), cvRound(pt.x));
+
+  // Treat the center line differently, v=0
+  for (int u = -HALF_PATCH_SIZE; u <= HALF_PATCH_SIZE; ++u)
+    m_10 += u * center[u];
+
+  // Go line by line in the circular patch
+  int step = (int)image.step1();
+  for (int v = 1; v <= HALF_PATCH_SIZE; ++v) {
+    // Proceed over the two lines
+    int v_sum = 0;
+    int d = u_max[v];
+    for (int u = -d; u <= d; ++u) {
+      int val_plus = center[u + v * step], val_minus = center[u - v * step];
+      v_sum += (val_plus - val_minus);
+      m_10 += u * (val_plus + val_minus);
+    }
+    m_01 += v * v_sum;
+  }
+
+  return fastAtan2((float)m_01, (float)m_10);
+}
+
+const float factorPI = (float)(CV_PI / 180.f);
+void ReferenceDescriptor(const KeyPoint &kpt, const Mat &img,
+                         const Point *pattern, uchar *desc) {
+  float angle = (float)kpt.angle * factorPI;
+  float a = (float)cos(angle), b = (float)sin(angle);
+
+  const uchar *center = &img.at<uchar>(cvRound(kpt.pt.y), cvRound(kpt.pt.x));
+  const int step = (int)img.step;
+
+#define GET_VALUE(idx)                                                         \
+  center[cvRound(pattern[idx].x * b + pattern[idx].y * a) * step +             \
+         cvRound(pattern[idx].x * a - pattern[idx].y * b)]
+
+  for (int i = 0; i < 32; ++i, pattern += 16) {
+    int val = 0;
+    for (int j = 0; j < 8; ++j) {
+      const int t0 = GET_VALUE(2 * j);
+      const int t1 = GET_VALUE(2 * j + 1);
+      val |= (t0 < t1) << j;
+    }
+
+    desc[i] = (uchar)val;
+  }
+
+#undef GET_VALUE
+}
+
+// End of row of the circular patch, as computed by ORBextractor
+vector<int> PatchRowEnds() {
+  vector<int> umax(HALF_PATCH_SIZE + 1);
+
+  int v, v0, vmax = cvFloor(HALF_PATCH_SIZE * sqrt(2.f) / 2 + 1);
+  int vmin = cvCeil(HALF_PATCH_SIZE * sqrt(2.f) / 2);
+  const double hp2 = HALF_PATCH_SIZE * HALF_PATCH_SIZE;
+  for (v = 0; v <= vmax; ++v)
+    umax[v] = cvRound(sqrt(hp2 - v * v));
+
+  // Make sure we are symmetric
+  for (v = HALF_PATCH_SIZE, v0 = 0; v >= vmin; --v) {
+    while (umax[v0] == umax[v0 + 1])
+      ++v0;
+    umax[v] = v0;
+    ++v0;
+  }
+  return umax;
+}
+
+// Fixed images: smoothed noise, high contrast shapes on a gradient and raw
+// noise, which has the most ties and near ties between pattern points. They
+// are views into a wider image, so their row step is not their width.
+vector<Mat> MakeImages() {
+  vector<Mat> images;
+  RNG rng(31);
+  const Rect roi(13, 7, 640, 480);
+
+  Mat noise(500, 700, CV_8U);
+  rng.fill(noise, RNG::UNIFORM, 0, 256);
+  Mat smooth;
+  GaussianBlur(noise, smooth, Size(5, 5), 1.5);
+  images.push_back(smooth(roi));
+
+  Mat shapes(500, 700, CV_8U);
+  for (int y = 0; y < shapes.rows; y++)
+    for (int x = 0; x < shapes.cols; x++)
+      shapes.at<uchar>(y, x) = (uchar)((x + 2 * y) * 255 / 1700);
+  for (int i = 0; i < 60; i++) {
+    const Point c(rng.uniform(0, shapes.cols), rng.uniform(0, shapes.rows));
+    const Scalar color(rng.uniform(0, 256));
+    if (i % 2)
+      circle(shapes, c, rng.uniform(5, 40), color, -1);
+    else
+      rectangle(shapes, c, c + Point(rng.uniform(5, 60), rng.uniform(5, 60)),
+                color, -1);
+  }
+  images.push_back(shapes(roi));
+
+  images.push_back(noise(roi));
+  return images;
+}
+
+// Grid of keypoints, at subpixel positions rounded to the same pixel by both
+vector<KeyPoint> MakeKeyPoints(const Mat &image) {
+  vector<KeyPoint> keypoints;
+  for (int y = BORDER; y < image.rows - BORDER; y += 7)
+    for (int x = BORDER; x < image.cols - BORDER; x += 7)
+      keypoints.push_back(KeyPoint(
+          Point2f(x + 0.25f * (y % 3), y - 0.25f * (x % 3)), 31.f));
+  return keypoints;
+}
+
+} // namespace
+
+int main() {
+  const ORBextractor extractor(1000, 1.2f, 8, 20, 7);
+  const vector<Point> &pattern = extractor.GetPattern();
+  const vector<int> umax = PatchRowEnds();
+  const vector<Mat> images = MakeImages();
+
+  int nFailures = 0;
+  for (const char *name : {"scalar", "avx2"}) {
+    if (!ORBKernels::UseKernels(name)) {
+      printf("%s: not supported, skipped\n", name);
+      continue;
+    }
+
+    int nAngles = 0, nAngleFailures = 0;
+    int nDescriptors = 0, nDescriptorFailures = 0;
+    for (const Mat &image : images) {
+      vector<KeyPoint> keypoints = MakeKeyPoints(image);
+
+      extractor.ComputeOrientations(image, keypoints);
+      vector<float> vAngles(keypoints.size());
+      for (size_t i = 0; i < keypoints.size(); i++) {
+        vAngles[i] = ReferenceAngle(image, keypoints[i].pt, umax);
+        nAngles++;
+        if (keypoints[i].angle != vAngles[i])
+          nAngleFailures++;
+      }
+
+      // The keypoint orientations, then a sweep including the multiples of
+      // 90 degrees, where sine and cosine round to exact values
+      for (int k = -1; k < 48; k++) {
+        for (size_t i = 0; i < keypoints.size(); i++)
+          keypoints[i].angle =
+              k < 0 ? vAngles[i] : k * 7.5f + (k % 4 ? 0.3f : 0.f);
+
+        Mat descriptors;
+        extractor.ComputeDescriptors(image, keypoints, descriptors);
+        for (size_t i = 0; i < keypoints.size(); i++) {
+          uchar reference[32];
+          ReferenceDescriptor(keypoints[i], image, &pattern[0], reference);
+          nDescriptors++;
+          if (memcmp(reference, descriptors.ptr((int)i), 32) != 0)
+            nDescriptorFailures++;
+        }
+      }
+    }
+
+    printf("%s (in use: %s): %d of %d angles and %d of %d descriptors "
+           "differ\n",
+           name, ORBKernels::KernelName(), nAngleFailures, nAngles,
+           nDescriptorFailures, nDescriptors);
+    nFailures += nAngleFailures + nDescriptorFailures;
+  }
+
+  return nFailures ? 1 : 0;
+}
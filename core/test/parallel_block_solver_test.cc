@@ -0,0 +1,511 @@
+/**
+ * This file is part of ORB-SLAM3
+ *
+ * Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez
+ * Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+ * Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós,
+ * University of Zaragoza.
+ *
+ * ORB-SLAM3 is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ORB-SLAM3. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Parity of ParallelBlockSolver with the g2o block solver it derives from.
+// The same local BA window, keyframe poses with mono, stereo and right camera
+// (body) observations of marginalized points, and the same local inertial BA
+// window, with velocities, biases and IMU edges as well, are linearized once
+// by the serial g2o::BlockSolver and once by ParallelBlockSolver on pools of
+// several sizes, some vertices being fixed. Hpp, Hpl, Hll, b and the
+// gradients kept in the vertices must agree to rounding, and the parallel
+// systems must be identical for every number of threads.
+
+#include "CameraModels/Pinhole.h"
+#include "G2oTypes.h"
+#include "ImuTypes.h"
+#include "OptimizableTypes.h"
+#include "ParallelBlockSolver.h"
+#include "ThreadPool.h"
+
+#include <g2o/core/block_solver.h>
+#include <g2o/core/optimization_algorithm_levenberg.h>
+#include <g2o/core/robust_kernel_impl.h>
+#include <g2o/core/sparse_optimizer.h>
+#include <g2o/solvers/eigen/linear_solver_eigen.h>
+#include <g2o/types/sba/types_six_dof_expmap.h>
+
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <random>
+
+using namespace std;
+using namespace ORB_SLAM3;
+
+namespace {
+
+const double fx = 450, fy = 450, cx = 320, cy = 240, bf = 45;
+const int N_KEYFRAMES = 8;
+const int N_FIXED = 2; // the oldest keyframes of the window
+const int N_POINTS = 200;
+
+enum Kind { MONO, STEREO, BODY };
+
+struct Observation {
+  int nKF, nPoint;
+  Kind kind;
+  Eigen::Vector3d z; // u, v and, for stereo ones, ur
+  double invSigma2;
+};
+
+struct Scene {
+  Pinhole *pCamera, *pCamera2;
+  Sophus::SE3d Trl;
+  IMU::Calib calib;
+  IMU::Preintegrated *pInt;
+
+  // Perturbed estimates
+  vector<Sophus::SE3d> vTcw;
+  vector<Eigen::Vector3d> vVw, vBg, vBa;
+  vector<Eigen::Vector3d> vXw;
+
+  vector<Observation> vObs;
+};
+
+Scene MakeScene(const unsigned int seed) {
+  mt19937 rng(seed);
+  normal_distribution<double> noise(0.0, 1.0);
+  uniform_real_distribution<double> uniform(-1.0, 1.0);
+
+  Scene s;
+  s.pCamera = new Pinhole(vector<float>{(float)fx, (float)fy, (float)cx,
+                                        (float)cy});
+  s.pCamera2 = new Pinhole(vector<float>{(float)fx, (float)fy, (float)cx,
+                                         (float)cy});
+  s.Trl = Sophus::SE3d(Sophus::SO3d::exp(Eigen::Vector3d(0.01, -0.02, 0.0)),
+                       Eigen::Vector3d(-0.1, 0.0, 0.0));
+
+  s.calib = IMU::Calib(Sophus::SE3f(), 1e-2, 1e-1, 1e-4, 1e-3);
+  s.pInt = new IMU::Preintegrated(IMU::Bias(), s.calib);
+  const Eigen::Vector3f acc(0.5f, 0.2f, IMU::GRAVITY_VALUE + 0.1f);
+  const Eigen::Vector3f gyro(0.03f, -0.02f, 0.01f);
+  for (int i = 0; i < 20; i++)
+    s.pInt->IntegrateNewMeasurement(acc, gyro, 0.005f);
+
+  vector<Sophus::SE3d> vTcwTrue;
+  for (int k = 0; k < N_KEYFRAMES; k++) {
+    const Sophus::SE3d Twc(
+        Sophus::SO3d::exp(Eigen::Vector3d(0.0, 0.02 * k, 0.0)),
+        Eigen::Vector3d(0.15 * k, 0.02 * uniform(rng), 0.0));
+    vTcwTrue.push_back(Twc.inverse());
+
+    Eigen::Matrix<double, 6, 1> xi;
+    for (int d = 0; d < 6; d++)
+      xi(d) = 0.01 * noise(rng);
+    s.vTcw.push_back(Sophus::SE3d::exp(xi) * vTcwTrue.back());
+    s.vVw.push_back(Eigen::Vector3d(1.5, 0.0, 0.0) +
+                    0.05 * Eigen::Vector3d(noise(rng), noise(rng), noise(rng)));
+    s.vBg.push_back(1e-3 * Eigen::Vector3d(noise(rng), noise(rng), noise(rng)));
+    s.vBa.push_back(1e-2 * Eigen::Vector3d(noise(rng), noise(rng), noise(rng)));
+  }
+
+  for (int j = 0; j < N_POINTS; j++) {
+    const Eigen::Vector3d Xw(0.5 + 3.0 * uniform(rng), 2.0 * uniform(rng),
+                             6.0 + 2.0 * uniform(rng));
+    s.vXw.push_back(Xw + 0.02 * Eigen::Vector3d(noise(rng), noise(rng),
+                                                 noise(rng)));
+
+    // Every point seen by four consecutive keyframes, some of them fixed.
+    // One observation in ten is a gross outlier, which puts its Huber kernel
+    // in the linear region.
+    for (int k = j % (N_KEYFRAMES - 3); k < j % (N_KEYFRAMES - 3) + 4; k++) {
+      const Eigen::Vector3d Xc = vTcwTrue[k] * Xw;
+      Observation obs;
+      obs.nKF = k;
+      obs.nPoint = j;
+      obs.kind = (Kind)((j + k) % 3);
+      obs.invSigma2 = 1.0 / pow(1.2, 2 * ((j + k) % 4));
+      if (obs.kind == BODY) {
+        const Eigen::Vector3d Xr = s.Trl * Xc;
+        obs.z << fx * Xr(0) / Xr(2) + cx, fy * Xr(1) / Xr(2) + cy, 0.0;
+      } else {
+        obs.z << fx * Xc(0) / Xc(2) + cx, fy * Xc(1) / Xc(2) + cy, 0.0;
+        if (obs.kind == STEREO)
+          obs.z(2) = obs.z(0) - bf / Xc(2);
+      }
+      obs.z += 0.5 * Eigen::Vector3d(noise(rng), noise(rng), noise(rng));
+      if ((j + 3 * k) % 10 == 0)
+        obs.z += Eigen::Vector3d(20.0, -15.0, 20.0);
+      if (obs.kind != STEREO)
+        obs.z(2) = 0.0;
+      s.vObs.push_back(obs);
+    }
+  }
+  return s;
+}
+
+// Keyframe k as the inertial pose vertex sees it: the body is the left
+// camera and the right camera is the second one of the rig
+ImuCamPose MakePose(const Scene &s, const int k) {
+  const Sophus::SE3d Twb = s.vTcw[k].inverse();
+  const Sophus::SE3d Tcb[2] = {Sophus::SE3d(), s.Trl};
+
+  ImuCamPose pose;
+  pose.its = 0;
+  pose.Rwb = Twb.rotationMatrix();
+  pose.twb = Twb.translation();
+  pose.bf = bf;
+  for (int c = 0; c < 2; c++) {
+    const Sophus::SE3d Tcw = Tcb[c] * s.vTcw[k];
+    pose.Rcb.push_back(Tcb[c].rotationMatrix());
+    pose.tcb.push_back(Tcb[c].translation());
+    pose.Rbc.push_back(Tcb[c].inverse().rotationMatrix());
+    pose.tbc.push_back(Tcb[c].inverse().translation());
+    pose.Rcw.push_back(Tcw.rotationMatrix());
+    pose.tcw.push_back(Tcw.translation());
+  }
+  pose.pCamera.push_back(s.pCamera);
+  pose.pCamera.push_back(s.pCamera2);
+  return pose;
+}
+
+g2o::VertexPointXYZ *AddPoint(g2o::SparseOptimizer &optimizer,
+                              const Eigen::Vector3d &Xw, const int id) {
+  g2o::VertexPointXYZ *vPoint = new g2o::VertexPointXYZ();
+  vPoint->setEstimate(Xw);
+  vPoint->setId(id);
+  vPoint->setMarginalized(true);
+  optimizer.addVertex(vPoint);
+  return vPoint;
+}
+
+template <class Edge>
+void SetWeight(Edge *e, const Observation &obs, const double delta) {
+  e->setInformation(Edge::InformationType::Identity() * obs.invSigma2);
+  g2o::RobustKernelHuber *rk = new g2o::RobustKernelHuber;
+  e->setRobustKernel(rk);
+  rk->setDelta(delta);
+}
+
+// The window as LocalBAGraph builds it
+void BuildLocalBA(g2o::SparseOptimizer &optimizer, const Scene &s) {
+  const float thHuberMono = sqrt(5.991);
+  const float thHuberStereo = sqrt(7.815);
+
+  vector<g2o::VertexSE3Expmap *> vpKFs;
+  for (int k = 0; k < N_KEYFRAMES; k++) {
+    g2o::VertexSE3Expmap *vSE3 = new g2o::VertexSE3Expmap();
+    vSE3->setEstimate(g2o::SE3Quat(s.vTcw[k].unit_quaternion(),
+                                   s.vTcw[k].translation()));
+    vSE3->setId(2 * k);
+    vSE3->setFixed(k < N_FIXED);
+    optimizer.addVertex(vSE3);
+    vpKFs.push_back(vSE3);
+  }
+
+  vector<g2o::VertexPointXYZ *> vpPoints;
+  for (int j = 0; j < N_POINTS; j++)
+    vpPoints.push_back(AddPoint(optimizer, s.vXw[j], 2 * j + 1));
+
+  const g2o::SE3Quat Trl(s.Trl.unit_quaternion(), s.Trl.translation());
+  for (const Observation &obs : s.vObs) {
+    g2o::OptimizableGraph::Edge *pEdge;
+    if (obs.kind == MONO) {
+      EdgeSE3ProjectXYZ *e = new EdgeSE3ProjectXYZ();
+      e->setMeasurement(obs.z.head<2>());
+      SetWeight(e, obs, thHuberMono);
+      e->pCamera = s.pCamera;
+      pEdge = e;
+    } else if (obs.kind == STEREO) {
+      g2o::EdgeStereoSE3ProjectXYZ *e = new g2o::EdgeStereoSE3ProjectXYZ();
+      e->setMeasurement(obs.z);
+      SetWeight(e, obs, thHuberStereo);
+      e->fx = fx;
+      e->fy = fy;
+      e->cx = cx;
+      e->cy = cy;
+      e->bf = bf;
+      pEdge = e;
+    } else {
+      EdgeSE3ProjectXYZToBody *e = new EdgeSE3ProjectXYZToBody();
+      e->setMeasurement(obs.z.head<2>());
+      SetWeight(e, obs, thHuberMono);
+      e->pCamera = s.pCamera2;
+      e->mTrl = Trl;
+      pEdge = e;
+    }
+    pEdge->setVertex(0, vpPoints[obs.nPoint]);
+    pEdge->setVertex(1, vpKFs[obs.nKF]);
+    optimizer.addEdge(pEdge);
+  }
+}
+
+// The window as LocalInertialBA builds it: the oldest keyframes with all
+// their state fixed and the last IMU edge robust and downweighted
+void BuildLocalInertialBA(g2o::SparseOptimizer &optimizer, const Scene &s) {
+  const float thHuberMono = sqrt(5.991);
+  const float thHuberStereo = sqrt(7.815);
+
+  vector<VertexPose *> vpVP;
+  vector<VertexVelocity *> vpVV;
+  vector<VertexGyroBias *> vpVG;
+  vector<VertexAccBias *> vpVA;
+  for (int k = 0; k < N_KEYFRAMES; k++) {
+    const bool bFixed = k < N_FIXED;
+    VertexPose *VP = new VertexPose();
+    VP->setEstimate(MakePose(s, k));
+    VertexVelocity *VV = new VertexVelocity();
+    VV->setEstimate(s.vVw[k]);
+    VertexGyroBias *VG = new VertexGyroBias();
+    VG->setEstimate(s.vBg[k]);
+    VertexAccBias *VA = new VertexAccBias();
+    VA->setEstimate(s.vBa[k]);
+
+    g2o::OptimizableGraph::Vertex *vpVertices[4] = {VP, VV, VG, VA};
+    for (int i = 0; i < 4; i++) {
+      vpVertices[i]->setId(4 * k + i);
+      vpVertices[i]->setFixed(bFixed);
+      optimizer.addVertex(vpVertices[i]);
+    }
+    vpVP.push_back(VP);
+    vpVV.push_back(VV);
+    vpVG.push_back(VG);
+    vpVA.push_back(VA);
+  }
+
+  for (int k = 1; k < N_KEYFRAMES; k++) {
+    EdgeInertial *ei = new EdgeInertial(s.pInt);
+    ei->setVertex(0, vpVP[k - 1]);
+    ei->setVertex(1, vpVV[k - 1]);
+    ei->setVertex(2, vpVG[k - 1]);
+    ei->setVertex(3, vpVA[k - 1]);
+    ei->setVertex(4, vpVP[k]);
+    ei->setVertex(5, vpVV[k]);
+    if (k == N_KEYFRAMES - 1) {
+      g2o::RobustKernelHuber *rki = new g2o::RobustKernelHuber;
+      ei->setRobustKernel(rki);
+      ei->setInformation(ei->information() * 1e-2);
+      rki->setDelta(sqrt(16.92));
+    }
+    optimizer.addEdge(ei);
+
+    EdgeGyroRW *egr = new EdgeGyroRW();
+    egr->setVertex(0, vpVG[k - 1]);
+    egr->setVertex(1, vpVG[k]);
+    egr->setInformation(
+        s.pInt->C.block<3, 3>(9, 9).cast<double>().inverse());
+    optimizer.addEdge(egr);
+
+    EdgeAccRW *ear = new EdgeAccRW();
+    ear->setVertex(0, vpVA[k - 1]);
+    ear->setVertex(1, vpVA[k]);
+    ear->setInformation(
+        s.pInt->C.block<3, 3>(12, 12).cast<double>().inverse());
+    optimizer.addEdge(ear);
+  }
+
+  vector<g2o::VertexPointXYZ *> vpPoints;
+  for (int j = 0; j < N_POINTS; j++)
+    vpPoints.push_back(AddPoint(optimizer, s.vXw[j], 4 * N_KEYFRAMES + j));
+
+  for (const Observation &obs : s.vObs) {
+    g2o::OptimizableGraph::Edge *pEdge;
+    if (obs.kind == STEREO) {
+      EdgeStereo *e = new EdgeStereo(0);
+      e->setMeasurement(obs.z);
+      SetWeight(e, obs, thHuberStereo);
+      pEdge = e;
+    } else {
+      EdgeMono *e = new EdgeMono(obs.kind == BODY ? 1 : 0);
+      e->setMeasurement(obs.z.head<2>());
+      SetWeight(e, obs, thHuberMono);
+      pEdge = e;
+    }
+    pEdge->setVertex(0, vpPoints[obs.nPoint]);
+    pEdge->setVertex(1, vpVP[obs.nKF]);
+    optimizer.addEdge(pEdge);
+  }
+}
+
+// Blocks of a sparse block matrix by (row, column) block index
+typedef map<pair<int, int>, Eigen::MatrixXd> Blocks;
+
+struct System {
+  Blocks Hpp, Hpl, Hll;
+  Eigen::VectorXd b;
+  Eigen::VectorXd bVertices; // gradients of the free vertices, in order
+};
+
+template <class MatrixType>
+Blocks GetBlocks(const g2o::SparseBlockMatrix<MatrixType> &M) {
+  Blocks blocks;
+  for (size_t c = 0; c < M.blockCols().size(); c++)
+    for (const auto &block : M.blockCols()[c])
+      blocks[make_pair(block.first, (int)c)] = *block.second;
+  return blocks;
+}
+
+// Block solver whose system can be read once built
+template <class Solver> class SystemProbe : public Solver {
+public:
+  using Solver::Solver;
+
+  System GetSystem() const {
+    System system;
+    system.Hpp = GetBlocks(*this->_Hpp);
+    system.Hpl = GetBlocks(*this->_Hpl);
+    system.Hll = GetBlocks(*this->_Hll);
+    system.b = Eigen::Map<const Eigen::VectorXd>(
+        this->_b, this->_sizePoses + this->_sizeLandmarks);
+
+    const g2o::SparseOptimizer *optimizer = this->_optimizer;
+    system.bVertices.resize(system.b.size());
+    int r = 0;
+    for (g2o::OptimizableGraph::Vertex *v : optimizer->indexMapping()) {
+      system.bVertices.segment(r, v->dimension()) =
+          Eigen::Map<const Eigen::VectorXd>(v->bData(), v->dimension());
+      r += v->dimension();
+    }
+    return system;
+  }
+};
+
+// Builds the window and linearizes it once, as the first Levenberg iteration
+// does. Args are what the solver takes after the linear solver.
+template <class Solver, class... Args>
+System Linearize(const Scene &s, const bool bInertial, Args... args) {
+  g2o::SparseOptimizer optimizer;
+  auto linearSolver = std::make_unique<
+      g2o::LinearSolverEigen<typename Solver::PoseMatrixType>>();
+  SystemProbe<Solver> *pSolver =
+      new SystemProbe<Solver>(std::move(linearSolver), args...);
+  g2o::OptimizationAlgorithmLevenberg *pAlgorithm =
+      new g2o::OptimizationAlgorithmLevenberg(
+          std::unique_ptr<SystemProbe<Solver>>(pSolver));
+  optimizer.setAlgorithm(pAlgorithm);
+  optimizer.setVerbose(false);
+
+  if (bInertial)
+    BuildLocalInertialBA(optimizer, s);
+  else
+    BuildLocalBA(optimizer, s);
+
+  optimizer.initializeOptimization();
+  pAlgorithm->init();
+  pSolver->buildStructure();
+  optimizer.computeActiveErrors();
+
+  // Stale gradients in the vertices must be overwritten, as g2o does
+  for (g2o::OptimizableGraph::Vertex *v : optimizer.indexMapping())
+    Eigen::Map<Eigen::VectorXd>(v->bData(), v->dimension()).setConstant(1e3);
+
+  pSolver->buildSystem();
+  return pSolver->GetSystem();
+}
+
+// Largest difference between two block sets, relative to the largest entry
+// of the first. Infinite if they do not have the same blocks.
+double Difference(const Blocks &A, const Blocks &B) {
+  if (A.size() != B.size())
+    return INFINITY;
+  double scale = 0.0, diff = 0.0;
+  for (Blocks::const_iterator ait = A.begin(), bit = B.begin(); ait != A.end();
+       ait++, bit++) {
+    if (ait->first != bit->first ||
+        ait->second.rows() != bit->second.rows() ||
+        ait->second.cols() != bit->second.cols())
+      return INFINITY;
+    scale = max(scale, ait->second.cwiseAbs().maxCoeff());
+    diff = max(diff, (ait->second - bit->second).cwiseAbs().maxCoeff());
+  }
+  return scale > 0.0 ? diff / scale : diff;
+}
+
+double Difference(const Eigen::VectorXd &a, const Eigen::VectorXd &b) {
+  if (a.size() != b.size())
+    return INFINITY;
+  const double scale = a.cwiseAbs().maxCoeff();
+  const double diff = (a - b).cwiseAbs().maxCoeff();
+  return scale > 0.0 ? diff / scale : diff;
+}
+
+int nFailures = 0;
+
+void Check(const bool bOk, const char *what, const char *scenario,
+           const int nThreads, const double value) {
+  printf("  %-8s %d threads %-10s %.3g %s\n", scenario, nThreads, what, value,
+         bOk ? "ok" : "MISMATCH");
+  if (!bOk)
+    nFailures++;
+}
+
+// Parallel against serial, to rounding, and against the parallel system of
+// another number of threads, exactly
+void Compare(const System &ref, const System &par, const System *pPar0,
+             const char *scenario, const int nThreads) {
+  const double tol = 1e-12;
+  const double dHpp = Difference(ref.Hpp, par.Hpp);
+  Check(dHpp <= tol, "Hpp", scenario, nThreads, dHpp);
+  const double dHpl = Difference(ref.Hpl, par.Hpl);
+  Check(dHpl <= tol, "Hpl", scenario, nThreads, dHpl);
+  const double dHll = Difference(ref.Hll, par.Hll);
+  Check(dHll <= tol, "Hll", scenario, nThreads, dHll);
+  const double db = Difference(ref.b, par.b);
+  Check(db <= tol, "b", scenario, nThreads, db);
+  const double dbv = Difference(ref.bVertices, par.bVertices);
+  Check(dbv <= tol, "b vertices", scenario, nThreads, dbv);
+
+  if (pPar0) {
+    const double d =
+        max(max(Difference(pPar0->Hpp, par.Hpp),
+                Difference(pPar0->Hpl, par.Hpl)),
+            max(max(Difference(pPar0->Hll, par.Hll),
+                    Difference(pPar0->b, par.b)),
+                Difference(pPar0->bVertices, par.bVertices)));
+    Check(d == 0.0, "repeatable", scenario, nThreads, d);
+  }
+}
+
+template <class SerialSolver, class ParallelSolver>
+void Run(const Scene &s, const bool bInertial, const char *scenario) {
+  const System ref = Linearize<SerialSolver>(s, bInertial);
+  Check(!ref.Hpl.empty() && !ref.Hll.empty(), "schur", scenario, 0, 0.0);
+
+  System par0;
+  for (const int nThreads : {1, 2, 3, 8}) {
+    ThreadPool pool(nThreads);
+    const System par = Linearize<ParallelSolver>(s, bInertial, &pool);
+    Compare(ref, par, nThreads == 1 ? NULL : &par0, scenario, nThreads);
+    if (nThreads == 1)
+      par0 = par;
+  }
+}
+
+} // namespace
+
+int main() {
+  for (unsigned int seed = 1; seed <= 3; seed++) {
+    Scene s = MakeScene(seed);
+    printf("seed %u\n", seed);
+
+    Run<g2o::BlockSolver_6_3, ParallelBlockSolver_6_3>(s, false, "local");
+    Run<g2o::BlockSolverX, ParallelBlockSolverX>(s, true, "inertial");
+
+    delete s.pInt;
+    delete s.pCamera;
+    delete s.pCamera2;
+  }
+
+  if (nFailures)
+    printf("%d mismatches\n", nFailures);
+  return nFailures ? 1 : 0;
+}
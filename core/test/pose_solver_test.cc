@@ -0,0 +1,346 @@
+/**
+ * This file is part of ORB-SLAM3
+ *
+ * Copyright (C) 2017-2021 Carlos Campos, Richard Elvira, Juan J. Gómez
+ * Rodríguez, José M.M. Montiel and Juan D. Tardós, University of Zaragoza.
+ * Copyright (C) 2014-2016 Raúl Mur-Artal, José M.M. Montiel and Juan D. Tardós,
+ * University of Zaragoza.
+ *
+ * ORB-SLAM3 is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * ORB-SLAM3 is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ORB-SLAM3. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Parity of PoseSolver with the g2o graph Optimizer::PoseOptimization used to
+// build: a VertexSE3Expmap solved by Levenberg-Marquardt with BlockSolver_6_3
+// and LinearSolverDense, one Huber weighted EdgeSE3ProjectXYZOnlyPose,
+// EdgeStereoSE3ProjectXYZOnlyPose or EdgeSE3ProjectXYZOnlyPoseToBody per
+// observation. The same synthetic frame, seen by a monocular camera, a
+// rectified stereo pair or a two camera rig and with some observations off
+// by a few or by tens of pixels, goes through the optimize and classify
+// schedule of PoseOptimization on both. The poses and the outlier flags must
+// agree, also for fisheye cameras, projected through project/projectJac.
+
+#include "CameraModels/KannalaBrandt8.h"
+#include "CameraModels/Pinhole.h"
+#include "Frame.h"
+#include "OptimizableTypes.h"
+#include "PoseSolver.h"
+
+#include <g2o/core/block_solver.h>
+#include <g2o/core/optimization_algorithm_levenberg.h>
+#include <g2o/core/robust_kernel_impl.h>
+#include <g2o/core/sparse_optimizer.h>
+#include <g2o/solvers/dense/linear_solver_dense.h>
+#include <g2o/types/sba/types_six_dof_expmap.h>
+
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <random>
+
+using namespace std;
+using namespace ORB_SLAM3;
+
+namespace {
+
+const float fx = 450, fy = 450, cx = 320, cy = 240, bf = 45;
+
+enum Setup { MONOCULAR, STEREO, RIG, FISHEYE_RIG };
+const char *const SETUP_NAMES[] = {"mono", "stereo", "rig", "fisheye"};
+
+struct Observation {
+  PoseSolver::Kind kind;
+  Eigen::Vector3d Xw;
+  Eigen::Vector3d z; // u, v and, for stereo ones, ur
+  double invSigma2;
+};
+
+struct Scene {
+  GeometricCamera *pCamera, *pCamera2;
+  Frame *pFrame;
+  Sophus::SE3f Tcw; // initial guess
+  vector<Observation> vObs;
+};
+
+struct Result {
+  Sophus::SE3d Tcw;
+  vector<bool> vbOutlier;
+  int nBad;
+};
+
+GeometricCamera *MakeCamera(const bool bFisheye) {
+  if (bFisheye)
+    return new KannalaBrandt8(
+        vector<float>{fx, fy, cx, cy, -0.01f, 0.005f, -0.002f, 0.0005f});
+  return new Pinhole(vector<float>{fx, fy, cx, cy});
+}
+
+// Only what PoseSolver takes from the frame is filled
+Scene MakeScene(const Setup setup, const unsigned int seed) {
+  mt19937 rng(seed);
+  normal_distribution<double> noise(0.0, 1.0);
+  uniform_real_distribution<double> uniform(-1.0, 1.0);
+
+  Scene s;
+  const bool bRig = setup == RIG || setup == FISHEYE_RIG;
+  s.pCamera = MakeCamera(setup == FISHEYE_RIG);
+  s.pCamera2 = bRig ? MakeCamera(setup == FISHEYE_RIG) : NULL;
+
+  s.pFrame = new Frame();
+  Frame &F = *s.pFrame;
+  F.mpCamera = s.pCamera;
+  F.mpCamera2 = s.pCamera2;
+  F.mbf = bf;
+  F.mb = bf / fx;
+
+  // Right camera of the rig 10 cm to the right, slightly rotated
+  const Sophus::SE3f Tlr(
+      Sophus::SO3f::exp(Eigen::Vector3f(0.01f, -0.02f, 0.005f)),
+      Eigen::Vector3f(0.1f, 0.f, 0.f));
+  if (bRig)
+    F.SetRelativePoseTlr(Tlr);
+  const Sophus::SE3d Trl = Tlr.inverse().cast<double>();
+
+  const Sophus::SE3d Tcw(
+      Sophus::SO3d::exp(Eigen::Vector3d(0.1, -0.3, 0.05)),
+      Eigen::Vector3d(0.5, -0.2, 1.0));
+
+  const int N = 150;
+  for (int i = 0; i < N; i++) {
+    const Eigen::Vector3d Xc(3.0 * uniform(rng), 2.0 * uniform(rng),
+                             4.0 + 4.0 * fabs(uniform(rng)));
+
+    Observation obs;
+    obs.Xw = Tcw.inverse() * Xc;
+    obs.invSigma2 = 1.0 / pow(1.2, 2 * (i % 4));
+
+    // Stereo one in three, on a rig one in two seen by the right camera
+    if (setup == STEREO && i % 3 == 0) {
+      obs.kind = PoseSolver::STEREO;
+      obs.z << fx * Xc(0) / Xc(2) + cx, fy * Xc(1) / Xc(2) + cy, 0.0;
+      obs.z(2) = obs.z(0) - bf / Xc(2);
+    } else if (bRig && i % 2 == 1) {
+      obs.kind = PoseSolver::RIGHT;
+      obs.z << s.pCamera2->project(Eigen::Vector3d(Trl * Xc)), 0.0;
+    } else {
+      obs.kind = PoseSolver::MONO;
+      obs.z << s.pCamera->project(Xc), 0.0;
+    }
+
+    obs.z += 0.5 * Eigen::Vector3d(noise(rng), noise(rng), noise(rng));
+    // Gross outliers and others close to the threshold, which can change
+    // class from one round to the next
+    if (i % 10 == 0)
+      obs.z += Eigen::Vector3d(30.0, -20.0, 30.0);
+    else if (i % 10 == 5)
+      obs.z += 2.5 * Eigen::Vector3d(1.0, -1.0, 1.0);
+    if (obs.kind != PoseSolver::STEREO)
+      obs.z(2) = 0.0;
+
+    s.vObs.push_back(obs);
+  }
+  F.N = N;
+
+  // Perturbed initial guess, which is single precision in the frame
+  Eigen::Matrix<double, 6, 1> xi;
+  xi << 0.05 * noise(rng), 0.05 * noise(rng), 0.05 * noise(rng),
+      0.02 * noise(rng), 0.02 * noise(rng), 0.02 * noise(rng);
+  s.Tcw = (Sophus::SE3d::exp(xi) * Tcw).cast<float>();
+  return s;
+}
+
+const float deltaMono = sqrt(5.991);
+const float deltaStereo = sqrt(7.815);
+const float chi2Mono[4] = {5.991, 5.991, 5.991, 5.991};
+const float chi2Stereo[4] = {7.815, 7.815, 7.815, 7.815};
+const int its[4] = {10, 10, 10, 10};
+
+// The graph and the schedule of PoseOptimization before PoseSolver
+Result SolveG2o(const Scene &s) {
+  g2o::SparseOptimizer optimizer;
+  auto linearSolver = std::make_unique<
+      g2o::LinearSolverDense<g2o::BlockSolver_6_3::PoseMatrixType>>();
+  auto solver_ptr =
+      std::make_unique<g2o::BlockSolver_6_3>(std::move(linearSolver));
+  optimizer.setAlgorithm(
+      new g2o::OptimizationAlgorithmLevenberg(std::move(solver_ptr)));
+  optimizer.setVerbose(false);
+
+  g2o::VertexSE3Expmap *vSE3 = new g2o::VertexSE3Expmap();
+  vSE3->setId(0);
+  vSE3->setFixed(false);
+  optimizer.addVertex(vSE3);
+
+  const g2o::SE3Quat Trl(
+      s.pFrame->GetRelativePoseTrl().unit_quaternion().cast<double>(),
+      s.pFrame->GetRelativePoseTrl().translation().cast<double>());
+
+  vector<g2o::OptimizableGraph::Edge *> vpEdges;
+  for (const Observation &obs : s.vObs) {
+    g2o::OptimizableGraph::Edge *pEdge;
+    g2o::RobustKernelHuber *rk = new g2o::RobustKernelHuber;
+    if (obs.kind == PoseSolver::STEREO) {
+      g2o::EdgeStereoSE3ProjectXYZOnlyPose *e =
+          new g2o::EdgeStereoSE3ProjectXYZOnlyPose();
+      e->setMeasurement(obs.z);
+      e->setInformation(Eigen::Matrix3d::Identity() * obs.invSigma2);
+      rk->setDelta(deltaStereo);
+      e->fx = Frame::fx;
+      e->fy = Frame::fy;
+      e->cx = Frame::cx;
+      e->cy = Frame::cy;
+      e->bf = s.pFrame->mbf;
+      e->Xw = obs.Xw;
+      pEdge = e;
+    } else if (obs.kind == PoseSolver::RIGHT) {
+      EdgeSE3ProjectXYZOnlyPoseToBody *e =
+          new EdgeSE3ProjectXYZOnlyPoseToBody();
+      e->setMeasurement(obs.z.head<2>());
+      e->setInformation(Eigen::Matrix2d::Identity() * obs.invSigma2);
+      rk->setDelta(deltaMono);
+      e->pCamera = s.pFrame->mpCamera2;
+      e->Xw = obs.Xw;
+      e->mTrl = Trl;
+      pEdge = e;
+    } else {
+      EdgeSE3ProjectXYZOnlyPose *e = new EdgeSE3ProjectXYZOnlyPose();
+      e->setMeasurement(obs.z.head<2>());
+      e->setInformation(Eigen::Matrix2d::Identity() * obs.invSigma2);
+      rk->setDelta(deltaMono);
+      e->pCamera = s.pFrame->mpCamera;
+      e->Xw = obs.Xw;
+      pEdge = e;
+    }
+    pEdge->setVertex(0, vSE3);
+    pEdge->setRobustKernel(rk);
+    optimizer.addEdge(pEdge);
+    vpEdges.push_back(pEdge);
+  }
+
+  Result result;
+  result.vbOutlier.assign(s.vObs.size(), false);
+  for (size_t it = 0; it < 4; it++) {
+    vSE3->setEstimate(g2o::SE3Quat(s.Tcw.unit_quaternion().cast<double>(),
+                                   s.Tcw.translation().cast<double>()));
+
+    optimizer.initializeOptimization(0);
+    optimizer.optimize(its[it]);
+
+    result.nBad = 0;
+    for (size_t i = 0; i < vpEdges.size(); i++) {
+      g2o::OptimizableGraph::Edge *e = vpEdges[i];
+      if (result.vbOutlier[i])
+        e->computeError();
+
+      const float chi2 = e->chi2();
+      const float th = s.vObs[i].kind == PoseSolver::STEREO ? chi2Stereo[it]
+                                                            : chi2Mono[it];
+      result.vbOutlier[i] = chi2 > th;
+      e->setLevel(result.vbOutlier[i] ? 1 : 0);
+      if (result.vbOutlier[i])
+        result.nBad++;
+
+      if (it == 2)
+        e->setRobustKernel(0);
+    }
+
+    if (optimizer.edges().size() < 10)
+      break;
+  }
+
+  const g2o::SE3Quat Tcw = vSE3->estimate();
+  result.Tcw = Sophus::SE3d(Tcw.rotation(), Tcw.translation());
+  return result;
+}
+
+// As PoseOptimization runs it now
+Result SolvePoseSolver(const Scene &s) {
+  PoseSolver solver(s.pFrame, deltaMono, deltaStereo);
+  for (size_t i = 0; i < s.vObs.size(); i++) {
+    const Observation &obs = s.vObs[i];
+    if (obs.kind == PoseSolver::STEREO)
+      solver.AddStereo(obs.Xw, obs.z(0), obs.z(1), obs.z(2), obs.invSigma2, i);
+    else if (obs.kind == PoseSolver::RIGHT)
+      solver.AddRight(obs.Xw, obs.z(0), obs.z(1), obs.invSigma2, i);
+    else
+      solver.AddMono(obs.Xw, obs.z(0), obs.z(1), obs.invSigma2, i);
+  }
+
+  Result result;
+  result.vbOutlier.assign(s.vObs.size(), false);
+  const Sophus::SE3d Tcw = s.Tcw.cast<double>();
+  for (size_t it = 0; it < 4; it++) {
+    result.Tcw = Tcw;
+    solver.Optimize(result.Tcw, its[it]);
+
+    result.nBad = solver.Classify(result.Tcw, chi2Mono[it], chi2Stereo[it],
+                                  result.vbOutlier);
+
+    if (it == 2)
+      solver.SetRobust(false);
+
+    if (solver.size() < 10)
+      break;
+  }
+  return result;
+}
+
+int nFailures = 0;
+
+void Check(const bool bOk, const char *what, const char *scenario,
+           const double value) {
+  printf("  %-8s %-9s %.3g %s\n", scenario, what, value,
+         bOk ? "ok" : "MISMATCH");
+  if (!bOk)
+    nFailures++;
+}
+
+} // namespace
+
+int main() {
+  Frame::fx = fx;
+  Frame::fy = fy;
+  Frame::cx = cx;
+  Frame::cy = cy;
+  Frame::invfx = 1.f / fx;
+  Frame::invfy = 1.f / fy;
+
+  for (unsigned int seed = 1; seed <= 5; seed++) {
+    printf("seed %u\n", seed);
+
+    for (const Setup setup : {MONOCULAR, STEREO, RIG, FISHEYE_RIG}) {
+      const char *scenario = SETUP_NAMES[setup];
+      Scene s = MakeScene(setup, seed);
+      const Result ref = SolveG2o(s);
+      const Result res = SolvePoseSolver(s);
+
+      const double dR = (ref.Tcw.so3().inverse() * res.Tcw.so3()).log().norm();
+      Check(dR < 1e-6, "R", scenario, dR);
+      const double dt = (ref.Tcw.translation() - res.Tcw.translation()).norm();
+      Check(dt < 1e-6, "t", scenario, dt);
+
+      int nDiff = 0;
+      for (size_t i = 0; i < ref.vbOutlier.size(); i++)
+        nDiff += ref.vbOutlier[i] != res.vbOutlier[i];
+      Check(nDiff == 0, "outliers", scenario, nDiff);
+      Check(ref.nBad == res.nBad, "nBad", scenario, res.nBad);
+
+      delete s.pFrame;
+      delete s.pCamera;
+      delete s.pCamera2;
+    }
+  }
+
+  if (nFailures)
+    printf("%d mismatches\n", nFailures);
+  return nFailures ? 1 : 0;
+}